@@ -0,0 +1,424 @@
+//
+//  bench_geohash.cpp
+//
+//  Microbenchmarks of the public functions, run with --benchmark_format=json
+//  or --benchmark_out=<file> for machine readable results.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include "bench_geohash.hpp"
+#include "geohash_batch.hpp"
+#include "geohash_cover.hpp"
+#include "geohash_distance.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// samples
+////////////////////////////////////////////////////////////////////////////////
+
+static std::vector<geolocation> make_samples(distribution d) {
+    std::mt19937_64 rng(uint64_t(d)+1);
+    std::uniform_real_distribution<double> unit(0, 1);
+    std::normal_distribution<double> spread(0, 0.1);
+    static const geolocation cities[]={
+        {31.23, 121.47}, {40.71, -74.01}, {51.51, -0.13}, {35.68, 139.69},
+        {-23.55, -46.63}, {19.08, 72.88}, {-33.87, 151.21}, {55.76, 37.62},
+    };
+    std::vector<geolocation> output;
+    for (size_t i=0; i<SAMPLE_COUNT; i++) {
+        double lat=0, lon=0;
+        switch (d) {
+            case distribution::uniform:
+                // Uniform on the sphere, not in degrees
+                lat=std::asin(2*unit(rng)-1)*180/M_PI;
+                lon=360*unit(rng)-180;
+                break;
+            case distribution::urban: {
+                const geolocation &c=cities[rng()%(sizeof(cities)/sizeof(cities[0]))];
+                lat=c.latitude+spread(rng);
+                lon=c.longitude+spread(rng);
+                break;
+            }
+            case distribution::poles:
+                lat=(rng()&1 ? 1 : -1)*(89+unit(rng));
+                lon=360*unit(rng)-180;
+                break;
+            case distribution::antimeridian:
+                lat=180*unit(rng)-90;
+                lon=rng()&1 ? 179.5+unit(rng)/2 : -180+unit(rng)/2;
+                break;
+        }
+        output.push_back(geolocation{lat, lon});
+    }
+    return output;
+}
+
+const std::vector<geolocation> &samples(distribution d) {
+    static const std::vector<geolocation> all[DISTRIBUTION_COUNT]={
+        make_samples(distribution::uniform),
+        make_samples(distribution::urban),
+        make_samples(distribution::poles),
+        make_samples(distribution::antimeridian),
+    };
+    return all[int(d)];
+}
+
+std::vector<geolocation> urban_points(size_t count, double spread, uint64_t seed, double urban_share) {
+    std::mt19937_64 rng(seed);
+    std::normal_distribution<double> jitter(0, spread);
+    std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+    const std::vector<geolocation> &urban=samples(distribution::urban);
+    std::vector<geolocation> output(count);
+    for (size_t i=0; i<count; i++) {
+        if (double(i%100)<100*urban_share) {
+            const geolocation &c=urban[i & (SAMPLE_COUNT-1)];
+            output[i]=geolocation{std::max(-90.0, std::min(90.0, c.latitude+jitter(rng))),
+                                  std::remainder(c.longitude+jitter(rng), 360.0)};
+        } else {
+            output[i]=geolocation{lat(rng), lon(rng)};
+        }
+    }
+    return output;
+}
+
+const char *distribution_name(distribution d) {
+    static const char *names[DISTRIBUTION_COUNT]={ "uniform", "urban", "poles", "antimeridian" };
+    return names[int(d)];
+}
+
+void precision_args(benchmark::internal::Benchmark *b) {
+    b->ArgNames({"precision", "distribution"});
+    b->ArgsProduct({benchmark::CreateDenseRange(1, int(MAX_GEOHASH_LENGTH), 1),
+                    benchmark::CreateDenseRange(0, DISTRIBUTION_COUNT-1, 1)});
+}
+
+void distribution_args(benchmark::internal::Benchmark *b) {
+    b->ArgNames({"distribution"});
+    b->DenseRange(0, DISTRIBUTION_COUNT-1, 1);
+}
+
+/// Samples encoded at a precision, built before timing starts
+template<typename Hash, typename Encode>
+static std::vector<Hash> encoded(distribution d, Encode encode) {
+    std::vector<Hash> output;
+    for (const geolocation &l : samples(d)) {
+        output.push_back(encode(l));
+    }
+    return output;
+}
+
+static const std::pair<int, int> east{0, 1};
+
+////////////////////////////////////////////////////////////////////////////////
+// encode and decode
+////////////////////////////////////////////////////////////////////////////////
+
+static void bench_encode(benchmark::State &state) {
+    size_t precision=size_t(state.range(0));
+    distribution d=distribution(state.range(1));
+    const std::vector<geolocation> &points=samples(d);
+    run_samples(state, d, [&](size_t i) { benchmark::DoNotOptimize(encode(points[i], precision)); });
+}
+BENCHMARK(bench_encode)->Apply(precision_args);
+
+static void bench_geohash_encode(benchmark::State &state) {
+    size_t precision=size_t(state.range(0));
+    distribution d=distribution(state.range(1));
+    const std::vector<geolocation> &points=samples(d);
+    run_samples(state, d, [&](size_t i) { benchmark::DoNotOptimize(geohash::encode(points[i], precision)); });
+}
+BENCHMARK(bench_geohash_encode)->Apply(precision_args);
+
+template<size_t N>
+static void bench_fixed_encode(benchmark::State &state) {
+    distribution d=distribution(state.range(0));
+    const std::vector<geolocation> &points=samples(d);
+    run_samples(state, d, [&](size_t i) { benchmark::DoNotOptimize(encode<N>(points[i])); });
+}
+BENCHMARK_TEMPLATE(bench_fixed_encode, 6)->Apply(distribution_args);
+BENCHMARK_TEMPLATE(bench_fixed_encode, 7)->Apply(distribution_args);
+BENCHMARK_TEMPLATE(bench_fixed_encode, 9)->Apply(distribution_args);
+
+template<size_t N>
+static void bench_fixed_decode(benchmark::State &state) {
+    distribution d=distribution(state.range(0));
+    auto hashes=encoded<geohash>(d, [](geolocation l) { return encode<N>(l); });
+    run_samples(state, d, [&](size_t i) { benchmark::DoNotOptimize(decode<N>(hashes[i])); });
+}
+BENCHMARK_TEMPLATE(bench_fixed_decode, 6)->Apply(distribution_args);
+BENCHMARK_TEMPLATE(bench_fixed_decode, 7)->Apply(distribution_args);
+BENCHMARK_TEMPLATE(bench_fixed_decode, 9)->Apply(distribution_args);
+
+static void bench_binary_encode(benchmark::State &state) {
+    size_t bits=5*size_t(state.range(0));
+    distribution d=distribution(state.range(1));
+    const std::vector<geolocation> &points=samples(d);
+    run_samples(state, d, [&](size_t i) { benchmark::DoNotOptimize(binary_encode(points[i], bits)); });
+}
+BENCHMARK(bench_binary_encode)->Apply(precision_args);
+
+static void bench_decode(benchmark::State &state) {
+    size_t precision=size_t(state.range(0));
+    distribution d=distribution(state.range(1));
+    auto hashes=encoded<std::string>(d, [=](geolocation l) { return encode(l, precision); });
+    run_samples(state, d, [&](size_t i) { benchmark::DoNotOptimize(decode(hashes[i])); });
+}
+BENCHMARK(bench_decode)->Apply(precision_args);
+
+static void bench_geohash_decode(benchmark::State &state) {
+    size_t precision=size_t(state.range(0));
+    distribution d=distribution(state.range(1));
+    auto hashes=encoded<geohash>(d, [=](geolocation l) { return geohash::encode(l, precision); });
+    run_samples(state, d, [&](size_t i) { benchmark::DoNotOptimize(decode(hashes[i])); });
+}
+BENCHMARK(bench_geohash_decode)->Apply(precision_args);
+
+static void bench_binary_decode(benchmark::State &state) {
+    size_t bits=5*size_t(state.range(0));
+    distribution d=distribution(state.range(1));
+    auto hashes=encoded<binary_hash>(d, [=](geolocation l) { return binary_encode(l, bits); });
+    run_samples(state, d, [&](size_t i) { benchmark::DoNotOptimize(decode(hashes[i])); });
+}
+BENCHMARK(bench_binary_decode)->Apply(precision_args);
+
+static void bench_from_string(benchmark::State &state) {
+    size_t precision=size_t(state.range(0));
+    distribution d=distribution(state.range(1));
+    auto hashes=encoded<std::string>(d, [=](geolocation l) { return encode(l, precision); });
+    run_samples(state, d, [&](size_t i) { benchmark::DoNotOptimize(geohash::from_string(hashes[i])); });
+}
+BENCHMARK(bench_from_string)->Apply(precision_args);
+
+/// Urban samples at precision 9, one in every 1000/permille with a character made invalid
+static std::vector<std::string> untrusted_hashes(int permille) {
+    auto hashes=encoded<std::string>(distribution::urban, [](geolocation l) { return encode(l, 9); });
+    std::mt19937_64 rng(permille);
+    for (std::string &hash : hashes) {
+        if (int(rng()%1000)<permille) {
+            hash[rng()%hash.size()]="ailo!~\x80"[rng()%7];
+        }
+    }
+    return hashes;
+}
+
+static void untrusted_args(benchmark::internal::Benchmark *b) {
+    b->ArgNames({"invalid_permille"})->Arg(0)->Arg(10)->Arg(100);
+}
+
+static void bench_decode_untrusted(benchmark::State &state) {
+    std::vector<std::string> hashes=untrusted_hashes(int(state.range(0)));
+    size_t valid=0;
+    run_samples(state, distribution::urban, [&](size_t i) {
+        try {
+            benchmark::DoNotOptimize(decode(hashes[i]));
+            valid++;
+        } catch (const std::invalid_argument &) {
+        }
+    });
+    benchmark::DoNotOptimize(valid);
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+BENCHMARK(bench_decode_untrusted)->Apply(untrusted_args);
+
+static void bench_try_decode_untrusted(benchmark::State &state) {
+    std::vector<std::string> hashes=untrusted_hashes(int(state.range(0)));
+    size_t valid=0;
+    run_samples(state, distribution::urban, [&](size_t i) {
+        decode_result r=try_decode(hashes[i]);
+        benchmark::DoNotOptimize(r);
+        valid+=r.ok();
+    });
+    benchmark::DoNotOptimize(valid);
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+BENCHMARK(bench_try_decode_untrusted)->Apply(untrusted_args);
+
+////////////////////////////////////////////////////////////////////////////////
+// neighbors
+////////////////////////////////////////////////////////////////////////////////
+
+static void bench_neighbor(benchmark::State &state) {
+    size_t precision=size_t(state.range(0));
+    distribution d=distribution(state.range(1));
+    auto hashes=encoded<std::string>(d, [=](geolocation l) { return encode(l, precision); });
+    run_samples(state, d, [&](size_t i) { benchmark::DoNotOptimize(neighbor(hashes[i], east)); });
+}
+BENCHMARK(bench_neighbor)->Apply(precision_args);
+
+static void bench_geohash_neighbor(benchmark::State &state) {
+    size_t precision=size_t(state.range(0));
+    distribution d=distribution(state.range(1));
+    auto hashes=encoded<geohash>(d, [=](geolocation l) { return geohash::encode(l, precision); });
+    run_samples(state, d, [&](size_t i) { benchmark::DoNotOptimize(neighbor(hashes[i], east)); });
+}
+BENCHMARK(bench_geohash_neighbor)->Apply(precision_args);
+
+static void bench_binary_neighbor(benchmark::State &state) {
+    size_t bits=5*size_t(state.range(0));
+    distribution d=distribution(state.range(1));
+    auto hashes=encoded<binary_hash>(d, [=](geolocation l) { return binary_encode(l, bits); });
+    run_samples(state, d, [&](size_t i) { benchmark::DoNotOptimize(neighbor(hashes[i], east)); });
+}
+BENCHMARK(bench_binary_neighbor)->Apply(precision_args);
+
+static void bench_neighbors(benchmark::State &state) {
+    size_t precision=size_t(state.range(0));
+    distribution d=distribution(state.range(1));
+    auto hashes=encoded<geohash>(d, [=](geolocation l) { return geohash::encode(l, precision); });
+    run_samples(state, d, [&](size_t i) { benchmark::DoNotOptimize(neighbors(hashes[i])); });
+}
+BENCHMARK(bench_neighbors)->Apply(precision_args);
+
+////////////////////////////////////////////////////////////////////////////////
+// radius queries
+////////////////////////////////////////////////////////////////////////////////
+
+/// Search radius of the cells at a precision, in km, so precision args map to radii
+static double precision_radius(size_t precision) {
+    return decode(encode(geolocation{0, 0}, precision)).min_span()/2;
+}
+
+static void bench_hash_precision(benchmark::State &state) {
+    double radius=precision_radius(size_t(state.range(0)));
+    distribution d=distribution(state.range(1));
+    const std::vector<geolocation> &points=samples(d);
+    run_samples(state, d, [&](size_t i) { benchmark::DoNotOptimize(hash_precision(points[i], radius)); });
+}
+BENCHMARK(bench_hash_precision)->Apply(precision_args);
+
+static void bench_base_hash(benchmark::State &state) {
+    double radius=precision_radius(size_t(state.range(0)));
+    distribution d=distribution(state.range(1));
+    const std::vector<geolocation> &points=samples(d);
+    run_samples(state, d, [&](size_t i) { benchmark::DoNotOptimize(base_hash(points[i], radius)); });
+}
+BENCHMARK(bench_base_hash)->Apply(precision_args);
+
+static void bench_binary_hash_precision(benchmark::State &state) {
+    double radius=precision_radius(size_t(state.range(0)));
+    distribution d=distribution(state.range(1));
+    const std::vector<geolocation> &points=samples(d);
+    run_samples(state, d, [&](size_t i) { benchmark::DoNotOptimize(binary_hash_precision(points[i], radius)); });
+}
+BENCHMARK(bench_binary_hash_precision)->Apply(precision_args);
+
+static void bench_hash_codes(benchmark::State &state) {
+    double radius=precision_radius(size_t(state.range(0)));
+    distribution d=distribution(state.range(1));
+    const std::vector<geolocation> &points=samples(d);
+    run_samples(state, d, [&](size_t i) { benchmark::DoNotOptimize(hash_codes(points[i], radius)); });
+}
+BENCHMARK(bench_hash_codes)->Apply(precision_args);
+
+static void bench_hash_codes_strings(benchmark::State &state) {
+    double radius=precision_radius(size_t(state.range(0)));
+    distribution d=distribution(state.range(1));
+    const std::vector<geolocation> &points=samples(d);
+    run_samples(state, d, [&](size_t i) {
+        std::vector<std::string> codes;
+        hash_codes(points[i], radius, codes);
+        benchmark::DoNotOptimize(codes.data());
+    });
+}
+BENCHMARK(bench_hash_codes_strings)->Apply(precision_args);
+
+static void bench_hash_contains(benchmark::State &state) {
+    size_t precision=size_t(state.range(0));
+    distribution d=distribution(state.range(1));
+    const std::vector<geolocation> &points=samples(d);
+    auto hashes=encoded<geohash>(d, [=](geolocation l) { return geohash::encode(l, precision); });
+    run_samples(state, d, [&](size_t i) {
+        benchmark::DoNotOptimize(hash_contains(hashes[i], points[(i+1) & (SAMPLE_COUNT-1)]));
+    });
+}
+BENCHMARK(bench_hash_contains)->Apply(precision_args);
+
+static void bench_cover(benchmark::State &state) {
+    double radius=precision_radius(size_t(state.range(0)));
+    distribution d=distribution(state.range(1));
+    const std::vector<geolocation> &points=samples(d);
+    double over_coverage=0;
+    run_samples(state, d, [&](size_t i) { over_coverage+=cover(points[i], radius).over_coverage; });
+    state.counters["over_coverage"]=benchmark::Counter(over_coverage, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(bench_cover)->Apply(precision_args);
+
+////////////////////////////////////////////////////////////////////////////////
+// distances
+////////////////////////////////////////////////////////////////////////////////
+
+static void bench_distance(benchmark::State &state) {
+    distribution d=distribution(state.range(0));
+    const std::vector<geolocation> &points=samples(d);
+    run_samples(state, d, [&](size_t i) {
+        benchmark::DoNotOptimize(distance(points[i], points[(i+1) & (SAMPLE_COUNT-1)]));
+    });
+}
+BENCHMARK(bench_distance)->Apply(distribution_args);
+
+static void bench_distance_mode(benchmark::State &state) {
+    distribution d=distribution(state.range(0));
+    distance_mode mode=distance_mode(state.range(1));
+    const std::vector<geolocation> &points=samples(d);
+    run_samples(state, d, [&](size_t i) {
+        benchmark::DoNotOptimize(distance(points[i], points[(i+1) & (SAMPLE_COUNT-1)], mode));
+    });
+}
+BENCHMARK(bench_distance_mode)->ArgNames({"distribution", "mode"})->ArgsProduct({{0, 1, 2, 3}, {0, 1, 2}});
+
+static void bench_within(benchmark::State &state) {
+    distribution d=distribution(state.range(0));
+    const std::vector<geolocation> &points=samples(d);
+    run_samples(state, d, [&](size_t i) {
+        benchmark::DoNotOptimize(within(points[i], points[(i+1) & (SAMPLE_COUNT-1)], 10));
+    });
+}
+BENCHMARK(bench_within)->Apply(distribution_args);
+
+////////////////////////////////////////////////////////////////////////////////
+// batches
+////////////////////////////////////////////////////////////////////////////////
+
+// Batch benchmarks process all samples per iteration and report items per second
+
+static void bench_batch_encode(benchmark::State &state) {
+    size_t precision=size_t(state.range(0));
+    distribution d=distribution(state.range(1));
+    const std::vector<geolocation> &points=samples(d);
+    std::vector<char> output(points.size()*precision);
+    run_samples(state, d, [&](size_t) { encode(points.data(), points.size(), precision, output.data()); });
+    state.SetItemsProcessed(int64_t(state.iterations()*points.size()));
+}
+BENCHMARK(bench_batch_encode)->Apply(precision_args);
+
+static void bench_batch_decode(benchmark::State &state) {
+    size_t precision=size_t(state.range(0));
+    distribution d=distribution(state.range(1));
+    const std::vector<geolocation> &points=samples(d);
+    std::vector<char> hashes(points.size()*precision);
+    encode(points.data(), points.size(), precision, hashes.data());
+    std::vector<bounding_box> output(points.size());
+    std::vector<uint64_t> invalid((points.size()+63)/64);
+    run_samples(state, d, [&](size_t) {
+        decode(hashes.data(), points.size(), precision, output.data(), invalid.data());
+    });
+    state.SetItemsProcessed(int64_t(state.iterations()*points.size()));
+}
+BENCHMARK(bench_batch_decode)->Apply(precision_args);
+
+static void bench_batch_distance(benchmark::State &state) {
+    distribution d=distribution(state.range(0));
+    distance_mode mode=distance_mode(state.range(1));
+    const std::vector<geolocation> &points=samples(d);
+    std::vector<double> output(points.size());
+    run_samples(state, d, [&](size_t i) {
+        distance(points[i], points.data(), points.size(), output.data(), mode);
+    });
+    state.SetItemsProcessed(int64_t(state.iterations()*points.size()));
+}
+BENCHMARK(bench_batch_distance)->ArgNames({"distribution", "mode"})->ArgsProduct({{0, 1, 2, 3}, {0, 1, 2}});
+
+BENCHMARK_MAIN();
@@ -0,0 +1,60 @@
+//
+//  bench_geohash.hpp
+//
+//  Shared sample data and helpers for the benchmarks.
+//
+
+#ifndef bench_geohash_hpp_included
+#define bench_geohash_hpp_included
+
+#include <cstddef>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "geohash.hpp"
+
+/// Where sample locations are drawn from
+enum class distribution {
+    uniform,
+    /// Gaussian clusters around a few large cities
+    urban,
+    /// Above 89 degrees of latitude, north and south
+    poles,
+    /// Within half a degree of longitude of the antimeridian
+    antimeridian,
+};
+
+constexpr int DISTRIBUTION_COUNT=4;
+/// Samples per distribution, a power of 2 so benchmarks can cycle with a mask
+constexpr size_t SAMPLE_COUNT=4096;
+
+/// Fixed samples, the same on every run
+const std::vector<geolocation> &samples(distribution d);
+const char *distribution_name(distribution d);
+
+/// Points normally spread around the urban samples, spread degrees of standard deviation,
+/// the same for a seed. Past the first urban_share of every 100 points they are uniform.
+std::vector<geolocation> urban_points(size_t count, double spread, uint64_t seed, double urban_share=1);
+
+/// Allocations made through operator new so far
+size_t allocation_count();
+
+/// Run body(i) for i cycling over the samples, report allocations per call and label the distribution
+template<typename Body>
+void run_samples(benchmark::State &state, distribution d, Body body) {
+    size_t i=0;
+    size_t allocations=allocation_count();
+    for (auto _ : state) {
+        body(i);
+        i=(i+1) & (SAMPLE_COUNT-1);
+    }
+    state.counters["allocs/op"]=benchmark::Counter(double(allocation_count()-allocations),
+                                                   benchmark::Counter::kAvgIterations);
+    state.SetLabel(distribution_name(d));
+}
+
+/// Precisions 1-12 times every distribution, as range(0) and range(1)
+void precision_args(benchmark::internal::Benchmark *b);
+/// Every distribution as range(0)
+void distribution_args(benchmark::internal::Benchmark *b);
+
+#endif
@@ -0,0 +1,83 @@
+//
+//  bench_geohash_aggregate.cpp
+//
+//  Per cell aggregation against hashing encode() strings into a map.
+//
+
+#include <random>
+#include <string>
+#include <unordered_map>
+#include "bench_geohash.hpp"
+#include "geohash_aggregate.hpp"
+
+constexpr size_t AGGREGATE_EVENTS=1000000;
+
+struct aggregate_events {
+    std::vector<geolocation> locations;
+    std::vector<double> values;
+};
+
+/// Events mostly around the urban samples, the rest uniform, made once per run
+static const aggregate_events &events() {
+    static const aggregate_events output=[] {
+        aggregate_events e;
+        std::mt19937_64 rng(19);
+        std::uniform_real_distribution<double> value(0, 100);
+        e.locations=urban_points(AGGREGATE_EVENTS, 0.5, 19, 0.7);
+        for (size_t i=0; i<AGGREGATE_EVENTS; i++) {
+            e.values.push_back(value(rng));
+        }
+        return e;
+    }();
+    return output;
+}
+
+/// The usual way: encode() strings of precision characters summed in an unordered_map
+static void bench_aggregate_string_map(benchmark::State &state) {
+    size_t precision=size_t(state.range(0));
+    const std::vector<geolocation> &locations=events().locations;
+    const std::vector<double> &values=events().values;
+    struct totals {
+        uint64_t count=0;
+        double sum=0;
+    };
+    for (auto _ : state) {
+        std::unordered_map<std::string, totals> cells;
+        for (size_t i=0; i<locations.size(); i++) {
+            totals &t=cells[encode(locations[i], precision)];
+            t.count++;
+            t.sum+=values[i];
+        }
+        benchmark::DoNotOptimize(cells.size());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()*locations.size()));
+}
+BENCHMARK(bench_aggregate_string_map)->ArgNames({"characters"})->Arg(3)->Arg(6)->Unit(benchmark::kMillisecond);
+
+static void bench_aggregate(benchmark::State &state) {
+    size_t bits=5*size_t(state.range(0));
+    size_t threads=size_t(state.range(1));
+    const std::vector<geolocation> &locations=events().locations;
+    const std::vector<double> &values=events().values;
+    for (auto _ : state) {
+        std::vector<cell_aggregate> cells=aggregate(locations, values, bits, threads);
+        benchmark::DoNotOptimize(cells.data());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()*locations.size()));
+}
+BENCHMARK(bench_aggregate)->ArgNames({"characters", "threads"})->ArgsProduct({{3, 6}, {1, 4}})
+    ->Unit(benchmark::kMillisecond);
+
+/// Zoom levels of 6 down to 1 character, from one pass at the finest
+static void bench_aggregate_rollup(benchmark::State &state) {
+    std::vector<cell_aggregate> fine=aggregate(events().locations, events().values, 30, 1);
+    for (auto _ : state) {
+        std::vector<cell_aggregate> level=fine;
+        for (size_t characters=5; characters>=1; characters--) {
+            level=rollup(level, 5*characters);
+            benchmark::DoNotOptimize(level.data());
+        }
+    }
+    state.counters["cells"]=double(fine.size());
+}
+BENCHMARK(bench_aggregate_rollup)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,33 @@
+//
+//  bench_geohash_alloc.cpp
+//
+//  Global operator new and delete counting allocations. In a translation unit of their own,
+//  so the compiler does not inline them into the benchmarks and mismatch new with free.
+//
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "bench_geohash.hpp"
+
+static std::atomic<size_t> allocations{0};
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p=std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+size_t allocation_count() {
+    return allocations.load(std::memory_order_relaxed);
+}
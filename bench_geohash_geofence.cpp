@@ -0,0 +1,101 @@
+//
+//  bench_geohash_geofence.cpp
+//
+//  Geofence lookups of fixes against city polygons, against bounding box filtering.
+//
+
+#include <random>
+#include "bench_geohash.hpp"
+#include "geohash_geofence.hpp"
+
+/// Concave stars of 0.5 to 5 km around the urban samples
+static const std::vector<std::vector<geolocation>> &zones() {
+    static const std::vector<std::vector<geolocation>> polygons=[] {
+        std::mt19937_64 rng(15);
+        std::uniform_real_distribution<double> unit(0, 1);
+        std::normal_distribution<double> spread(0, 0.2);
+        const std::vector<geolocation> &urban=samples(distribution::urban);
+        std::vector<std::vector<geolocation>> output;
+        for (size_t i=0; i<20000; i++) {
+            const geolocation &c=urban[i & (SAMPLE_COUNT-1)];
+            double lat=c.latitude+spread(rng), lon=c.longitude+spread(rng);
+            double size=(0.5+4.5*unit(rng))/111.2;
+            std::vector<geolocation> star;
+            for (int n=0; n<16; n++) {
+                double r=size*(n%2 ? 0.4+0.6*unit(rng) : 1), b=2*M_PI*n/16;
+                star.push_back(geolocation{lat+r*std::sin(b), lon+r*std::cos(b)/std::cos(lat*M_PI/180)});
+            }
+            output.push_back(star);
+        }
+        return output;
+    }();
+    return polygons;
+}
+
+static const geofence &zone_fence() {
+    static const geofence fence(zones());
+    return fence;
+}
+
+static void bench_geofence_build(benchmark::State &state) {
+    size_t cells=0;
+    for (auto _ : state) {
+        geofence fence(zones());
+        cells=fence.cell_count();
+    }
+    state.counters["cells"]=double(cells);
+    state.SetItemsProcessed(int64_t(state.iterations()*zones().size()));
+}
+BENCHMARK(bench_geofence_build)->Unit(benchmark::kMillisecond)->Iterations(1);
+
+static void bench_geofence_find(benchmark::State &state) {
+    distribution d=distribution(state.range(0));
+    const geofence &fence=zone_fence();
+    const std::vector<geolocation> &fixes=samples(d);
+    std::vector<size_t> found;
+    double matches=0;
+    run_samples(state, d, [&](size_t i) {
+        found.clear();
+        fence.find(fixes[i], found);
+        matches+=double(found.size());
+    });
+    state.counters["matches"]=benchmark::Counter(matches, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(bench_geofence_find)->Apply(distribution_args);
+
+static void bench_geofence_find_batch(benchmark::State &state) {
+    distribution d=distribution(state.range(0));
+    const geofence &fence=zone_fence();
+    const std::vector<geolocation> &fixes=samples(d);
+    std::vector<geofence_match> found;
+    for (auto _ : state) {
+        found.clear();
+        fence.find(fixes.data(), fixes.size(), found);
+        benchmark::DoNotOptimize(found.data());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()*fixes.size()));
+    state.SetLabel(distribution_name(d));
+}
+BENCHMARK(bench_geofence_find_batch)->Apply(distribution_args);
+
+/// The lookup as a scan of bounding boxes, ray casting the polygons whose box holds the fix
+static void bench_bounding_box_find(benchmark::State &state) {
+    distribution d=distribution(state.range(0));
+    std::vector<bounding_box> boxes;
+    for (const std::vector<geolocation> &polygon : zones()) {
+        boxes.push_back(polygon_bounds(polygon.data(), polygon.size()));
+    }
+    const std::vector<geolocation> &fixes=samples(d);
+    std::vector<size_t> found;
+    run_samples(state, d, [&](size_t i) {
+        found.clear();
+        for (size_t p=0; p<boxes.size(); p++) {
+            if (boxes[p].contains(fixes[i])
+                && polygon_contains(zones()[p].data(), zones()[p].size(), fixes[i])) {
+                found.push_back(p);
+            }
+        }
+        benchmark::DoNotOptimize(found.data());
+    });
+}
+BENCHMARK(bench_bounding_box_find)->Apply(distribution_args);
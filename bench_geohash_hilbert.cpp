@@ -0,0 +1,88 @@
+//
+//  bench_geohash_hilbert.cpp
+//
+//  Range counts and scan volume of Hilbert and interleaved keys for identical radius queries.
+//
+
+#include <algorithm>
+#include "bench_geohash.hpp"
+#include "geohash_cover.hpp"
+#include "geohash_hilbert.hpp"
+
+constexpr size_t HILBERT_POINTS=1000000;
+
+/// Sorted keys of points mostly around the urban samples, the rest uniform, on either curve
+static const std::vector<uint64_t> &sorted_keys(bool hilbert) {
+    static const std::vector<std::vector<uint64_t>> keys=[] {
+        std::vector<std::vector<uint64_t>> output(2);
+        for (const geolocation &l : urban_points(HILBERT_POINTS, 0.5, 20, 0.7)) {
+            output[0].push_back(encode_key(l));
+            output[1].push_back(hilbert_key(l));
+        }
+        std::sort(output[0].begin(), output[0].end());
+        std::sort(output[1].begin(), output[1].end());
+        return output;
+    }();
+    return keys[hilbert];
+}
+
+/// Points of sorted keys in [begin, end), end 0 for the top of the key space
+static size_t points_between(const std::vector<uint64_t> &keys, uint64_t begin, uint64_t end) {
+    auto first=std::lower_bound(keys.begin(), keys.end(), begin);
+    auto last=end==0 ? keys.end() : std::lower_bound(keys.begin(), keys.end(), end);
+    return size_t(last-first);
+}
+
+/// Merge the ranges across the gaps holding the fewest points until at most budget remain,
+/// what a store limited to budget seeks per query would scan
+static void close_gaps(std::vector<key_range> &ranges, size_t budget, const std::vector<uint64_t> &keys) {
+    while (ranges.size()>budget) {
+        size_t best=0, best_points=SIZE_MAX;
+        for (size_t i=0; i+1<ranges.size(); i++) {
+            size_t p=points_between(keys, ranges[i].end, ranges[i+1].begin);
+            if (p<best_points) {
+                best=i;
+                best_points=p;
+            }
+        }
+        ranges[best].end=ranges[best+1].end;
+        ranges.erase(ranges.begin()+best+1);
+    }
+}
+
+static void bench_hilbert_encode(benchmark::State &state) {
+    bool hilbert=state.range(0)!=0;
+    const std::vector<geolocation> &locations=samples(distribution::uniform);
+    run_samples(state, distribution::uniform, [&](size_t i) {
+        benchmark::DoNotOptimize(hilbert ? hilbert_key(locations[i]) : encode_key(locations[i]));
+    });
+}
+BENCHMARK(bench_hilbert_encode)->ArgNames({"hilbert"})->Arg(0)->Arg(1);
+
+/// The same 16 cell cover of each circle as ranges of either curve, scanned in full or with
+/// the ranges merged down to a budget of seeks, 0 for none
+static void bench_hilbert_radius(benchmark::State &state) {
+    double dist=double(state.range(0))/1000;
+    bool hilbert=state.range(1)!=0;
+    size_t budget=size_t(state.range(2));
+    const std::vector<uint64_t> &keys=sorted_keys(hilbert);
+    const std::vector<geolocation> &centers=samples(distribution::urban);
+    cover_options options;
+    options.level_bits=2;
+    size_t range_count=0, scanned=0;
+    run_samples(state, distribution::urban, [&](size_t i) {
+        geohash_cover c=cover(centers[i], dist, options);
+        std::vector<key_range> ranges=hilbert ? hilbert_ranges(c.cells) : c.ranges;
+        if (budget) {
+            close_gaps(ranges, budget, keys);
+        }
+        range_count+=ranges.size();
+        for (const key_range &r : ranges) {
+            scanned+=points_between(keys, r.begin, r.end);
+        }
+    });
+    state.counters["ranges/query"]=benchmark::Counter(double(range_count), benchmark::Counter::kAvgIterations);
+    state.counters["points/query"]=benchmark::Counter(double(scanned), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(bench_hilbert_radius)->ArgNames({"meters", "hilbert", "budget"})
+    ->ArgsProduct({{1000, 10000, 100000}, {0, 1}, {0, 4}});
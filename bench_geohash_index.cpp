@@ -0,0 +1,93 @@
+//
+//  bench_geohash_index.cpp
+//
+//  Bulk load throughput and query latency of geohash_index.
+//
+
+#include <cstdint>
+#include "bench_geohash.hpp"
+#include "geohash_index.hpp"
+
+/// Points mostly around the urban samples, the rest uniform
+static std::vector<geolocation> index_points(size_t count) {
+    return urban_points(count, 0.5, count, 0.7);
+}
+
+static void bench_index_bulk_load(benchmark::State &state) {
+    size_t count=size_t(state.range(0));
+    std::vector<geolocation> points=index_points(count);
+    std::vector<uint32_t> ids(count);
+    for (size_t i=0; i<count; i++) {
+        ids[i]=uint32_t(i);
+    }
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::vector<geolocation> l=points;
+        std::vector<uint32_t> v=ids;
+        state.ResumeTiming();
+        geohash_index<uint32_t> index(std::move(l), std::move(v));
+        benchmark::DoNotOptimize(index.key(0));
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()*count));
+}
+BENCHMARK(bench_index_bulk_load)->ArgNames({"points"})->Arg(1000000)->Arg(10000000)
+    ->Unit(benchmark::kMillisecond)->Iterations(1);
+
+/// One shared 10M point index for the query benchmarks
+static const geohash_index<uint32_t> &query_index() {
+    static const geohash_index<uint32_t> index=[] {
+        std::vector<geolocation> points=index_points(10000000);
+        std::vector<uint32_t> ids(points.size());
+        for (size_t i=0; i<ids.size(); i++) {
+            ids[i]=uint32_t(i);
+        }
+        return geohash_index<uint32_t>(std::move(points), std::move(ids));
+    }();
+    return index;
+}
+
+static void bench_index_radius(benchmark::State &state) {
+    double radius=double(state.range(0))/1000;
+    distribution d=distribution(state.range(1));
+    const geohash_index<uint32_t> &index=query_index();
+    const std::vector<geolocation> &centers=samples(d);
+    size_t found=0;
+    run_samples(state, d, [&](size_t i) {
+        index.visit_radius(centers[i], radius, [&](size_t) { found++; });
+    });
+    state.counters["points/query"]=benchmark::Counter(double(found), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(bench_index_radius)->ArgNames({"meters", "distribution"})
+    ->ArgsProduct({{100, 1000, 10000}, {0, 1, 2, 3}});
+
+static void bench_index_box(benchmark::State &state) {
+    double side=double(state.range(0))/1000;
+    distribution d=distribution(state.range(1));
+    const geohash_index<uint32_t> &index=query_index();
+    std::vector<bounding_box> boxes;
+    for (const geolocation &c : samples(d)) {
+        boxes.push_back(bounding_box(c, side/2));
+    }
+    size_t found=0;
+    run_samples(state, d, [&](size_t i) {
+        index.visit_box(boxes[i], [&](size_t) { found++; });
+    });
+    state.counters["points/query"]=benchmark::Counter(double(found), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(bench_index_box)->ArgNames({"meters", "distribution"})
+    ->ArgsProduct({{100, 1000, 10000}, {0, 1, 2, 3}});
+
+static void bench_index_nearest(benchmark::State &state) {
+    size_t k=size_t(state.range(0));
+    distribution d=distribution(state.range(1));
+    const geohash_index<uint32_t> &index=query_index();
+    const std::vector<geolocation> &centers=samples(d);
+    double kth=0;
+    run_samples(state, d, [&](size_t i) {
+        std::vector<index_match> found=index.nearest(centers[i], k);
+        kth+=found.back().distance;
+    });
+    state.counters["kth_km"]=benchmark::Counter(kth, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(bench_index_nearest)->ArgNames({"k", "distribution"})
+    ->ArgsProduct({{1, 10, 100}, {0, 1, 2, 3}});
@@ -0,0 +1,75 @@
+//
+//  bench_geohash_join.cpp
+//
+//  Proximity join of vehicles against points of interest, against hash_codes probing a hash map.
+//
+
+#include <unordered_map>
+#include "bench_geohash.hpp"
+#include "geohash_join.hpp"
+
+/// Spread of the points around the urban samples, 20 km in degrees of latitude
+constexpr double JOIN_SPREAD=20/111.2;
+
+static const std::vector<geolocation> &vehicles() {
+    static const std::vector<geolocation> points=urban_points(1000000, JOIN_SPREAD, 1);
+    return points;
+}
+
+static const std::vector<geolocation> &places() {
+    static const std::vector<geolocation> points=urban_points(100000, JOIN_SPREAD, 2);
+    return points;
+}
+
+static void bench_proximity_join(benchmark::State &state) {
+    double dist=double(state.range(0))/1000;
+    join_options options;
+    options.threads=size_t(state.range(1));
+    size_t pairs=0;
+    for (auto _ : state) {
+        pairs=proximity_join(vehicles(), places(), dist, [](const join_pair *p, size_t) { benchmark::DoNotOptimize(p); }, options);
+    }
+    state.counters["pairs"]=double(pairs);
+    state.SetItemsProcessed(int64_t(state.iterations()*vehicles().size()));
+}
+BENCHMARK(bench_proximity_join)->ArgNames({"meters", "threads"})->ArgsProduct({{200, 1000}, {1, 4}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/// The join as hash_codes per vehicle probing places hashed at every precision
+static void bench_hash_codes_join(benchmark::State &state) {
+    double dist=double(state.range(0))/1000;
+    std::unordered_map<geohash, std::vector<uint32_t>> cells;
+    for (size_t i=0; i<places().size(); i++) {
+        for (size_t precision=1; precision<=MAX_GEOHASH_LENGTH; precision++) {
+            cells[geohash::encode(places()[i], precision)].push_back(uint32_t(i));
+        }
+    }
+    size_t pairs=0;
+    for (auto _ : state) {
+        pairs=0;
+        std::vector<join_pair> batch;
+        for (size_t v=0; v<vehicles().size(); v++) {
+            for (const geohash &h : hash_codes(vehicles()[v], dist)) {
+                auto found=cells.find(h);
+                if (found==cells.end()) {
+                    continue;
+                }
+                for (uint32_t p : found->second) {
+                    double d=distance(vehicles()[v], places()[p], distance_mode::haversine);
+                    if (d<=dist) {
+                        batch.push_back(join_pair{v, p, d});
+                    }
+                }
+            }
+            if (batch.size()>=4096) {
+                pairs+=batch.size();
+                batch.clear();
+            }
+        }
+        pairs+=batch.size();
+    }
+    state.counters["pairs"]=double(pairs);
+    state.SetItemsProcessed(int64_t(state.iterations()*vehicles().size()));
+}
+BENCHMARK(bench_hash_codes_join)->ArgNames({"meters"})->Arg(200)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
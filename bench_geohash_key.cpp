@@ -0,0 +1,44 @@
+//
+//  bench_geohash_key.cpp
+//
+//  64 and 128-bit interleaved keys, encoded, decoded and turned into ranges.
+//
+
+#include "bench_geohash.hpp"
+#include "geohash_key.hpp"
+
+template<typename Key>
+static void bench_key_encode(benchmark::State &state) {
+    const std::vector<geolocation> &points=samples(distribution::uniform);
+    run_samples(state, distribution::uniform, [&](size_t i) {
+        benchmark::DoNotOptimize(interleaved_key<Key>::encode(points[i]));
+    });
+}
+BENCHMARK_TEMPLATE(bench_key_encode, uint64_t);
+BENCHMARK_TEMPLATE(bench_key_encode, uint128_t);
+
+template<typename Key>
+static void bench_key_decode(benchmark::State &state) {
+    std::vector<interleaved_key<Key>> keys;
+    for (const geolocation &l : samples(distribution::uniform)) {
+        keys.push_back(interleaved_key<Key>::encode(l));
+    }
+    run_samples(state, distribution::uniform, [&](size_t i) { benchmark::DoNotOptimize(keys[i].decode()); });
+}
+BENCHMARK_TEMPLATE(bench_key_decode, uint64_t);
+BENCHMARK_TEMPLATE(bench_key_decode, uint128_t);
+
+/// Prefix, parent and range, as a storage engine scanning a cell would
+template<typename Key>
+static void bench_key_prefix_range(benchmark::State &state) {
+    std::vector<interleaved_key<Key>> keys;
+    for (const geolocation &l : samples(distribution::uniform)) {
+        keys.push_back(interleaved_key<Key>::encode(l));
+    }
+    size_t bits=size_t(state.range(0));
+    run_samples(state, distribution::uniform, [&](size_t i) {
+        benchmark::DoNotOptimize(keys[i].prefix(bits).parent().range());
+    });
+}
+BENCHMARK_TEMPLATE(bench_key_prefix_range, uint64_t)->Arg(40);
+BENCHMARK_TEMPLATE(bench_key_prefix_range, uint128_t)->Arg(40)->Arg(100);
@@ -0,0 +1,76 @@
+//
+//  bench_geohash_mapped.cpp
+//
+//  Startup and queries of a mapped index file against building geohash_index in memory.
+//
+
+#include <cstdio>
+#include <string>
+#include "bench_geohash.hpp"
+#include "geohash_mapped.hpp"
+
+constexpr size_t MAPPED_POINTS=10000000;
+
+/// Points mostly around the urban samples, the rest uniform, with 8-byte payloads
+static void mapped_points(std::vector<geolocation> &locations, std::vector<std::string> &payloads) {
+    locations=urban_points(MAPPED_POINTS, 0.5, 17, 0.7);
+    for (size_t i=0; i<MAPPED_POINTS; i++) {
+        payloads.push_back(std::string(reinterpret_cast<const char *>(&i), sizeof(i)));
+    }
+}
+
+/// The index file, written once per run
+static const std::string &index_path() {
+    static const std::string path=[] {
+        std::string p="/tmp/bench_geohash_mapped.idx";
+        std::vector<geolocation> locations;
+        std::vector<std::string> payloads;
+        mapped_points(locations, payloads);
+        write_index_file(p, locations, payloads);
+        std::atexit([] { std::remove("/tmp/bench_geohash_mapped.idx"); });
+        return p;
+    }();
+    return path;
+}
+
+static void bench_mapped_open(benchmark::State &state) {
+    const std::string &path=index_path();
+    for (auto _ : state) {
+        mapped_index index(path);
+        benchmark::DoNotOptimize(index.size());
+    }
+}
+BENCHMARK(bench_mapped_open)->Unit(benchmark::kMicrosecond);
+
+/// Startup without a file, the index rebuilt from the points
+static void bench_mapped_rebuild(benchmark::State &state) {
+    std::vector<geolocation> locations;
+    std::vector<std::string> payloads;
+    mapped_points(locations, payloads);
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::vector<geolocation> l=locations;
+        std::vector<std::string> p=payloads;
+        state.ResumeTiming();
+        geohash_index<std::string> index(std::move(l), std::move(p));
+        benchmark::DoNotOptimize(index.size());
+    }
+}
+BENCHMARK(bench_mapped_rebuild)->Unit(benchmark::kMillisecond)->Iterations(1);
+
+static void bench_mapped_box(benchmark::State &state) {
+    double side=double(state.range(0))/1000;
+    distribution d=distribution(state.range(1));
+    static const mapped_index index(index_path());
+    std::vector<bounding_box> boxes;
+    for (const geolocation &c : samples(d)) {
+        boxes.push_back(bounding_box(c, side/2));
+    }
+    size_t found=0;
+    run_samples(state, d, [&](size_t i) {
+        index.visit_box(boxes[i], [&](size_t p) { found+=index.payload(p).size()/8; });
+    });
+    state.counters["points/query"]=benchmark::Counter(double(found), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(bench_mapped_box)->ArgNames({"meters", "distribution"})
+    ->ArgsProduct({{100, 1000, 10000}, {0, 1}});
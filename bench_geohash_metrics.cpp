@@ -0,0 +1,42 @@
+//
+//  bench_geohash_metrics.cpp
+//
+//  The string API with the instrumentation, compare a tree built with -DGEOHASH_INSTRUMENTATION=ON
+//  against one without.
+//
+
+#include "bench_geohash.hpp"
+#include "geohash_metrics.hpp"
+
+static void bench_metrics_encode_decode(benchmark::State &state) {
+    const std::vector<geolocation> &points=samples(distribution::urban);
+    size_t i=0;
+    for (auto _ : state) {
+        std::string hash=encode(points[i & (SAMPLE_COUNT-1)], 9);
+        benchmark::DoNotOptimize(decode(hash));
+        i++;
+    }
+    state.SetLabel(INSTRUMENTED ? "instrumented" : "plain");
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+BENCHMARK(bench_metrics_encode_decode)->ThreadRange(1, 4);
+
+static void bench_metrics_base_hash(benchmark::State &state) {
+    const std::vector<geolocation> &points=samples(distribution::urban);
+    size_t i=0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(base_hash(points[i & (SAMPLE_COUNT-1)], 0.5));
+        i++;
+    }
+    state.SetLabel(INSTRUMENTED ? "instrumented" : "plain");
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+BENCHMARK(bench_metrics_base_hash);
+
+/// What a scraper pays, a snapshot of every thread and its export
+static void bench_metrics_export(benchmark::State &state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(format_metrics(snapshot_metrics()));
+    }
+}
+BENCHMARK(bench_metrics_export);
@@ -0,0 +1,85 @@
+//
+//  bench_geohash_moving.cpp
+//
+//  Mixed updates and radius queries on moving_index from many threads.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include "bench_geohash.hpp"
+#include "geohash_moving.hpp"
+
+constexpr size_t MOVING_OBJECTS=200000;
+/// Cells of about 150 m by 230 m at mid latitudes
+constexpr size_t MOVING_BITS=34;
+/// Length of a run
+constexpr double MOVING_SECONDS=1;
+
+/// Every thread moves its own objects by about 10 m, 1 step in 20 is a timed 1 km query
+static void bench_moving_stress(benchmark::State &state) {
+    size_t thread_count=size_t(state.range(0));
+    const std::vector<geolocation> &urban=samples(distribution::urban);
+    moving_index index(MOVING_OBJECTS, MOVING_BITS);
+    std::vector<geolocation> start=urban_points(MOVING_OBJECTS, 0.05, 18);
+    for (size_t id=0; id<MOVING_OBJECTS; id++) {
+        index.update(id, start[id]);
+    }
+    std::vector<size_t> updates(thread_count);
+    std::vector<std::vector<double>> latencies(thread_count);
+    for (auto _ : state) {
+        auto stop=std::chrono::steady_clock::now()+std::chrono::duration<double>(MOVING_SECONDS);
+        std::vector<std::thread> threads;
+        for (size_t t=0; t<thread_count; t++) {
+            threads.emplace_back([&, t] {
+                std::mt19937_64 rng(t);
+                std::normal_distribution<double> step(0, 0.0001);
+                std::vector<geolocation> own;
+                for (size_t id=t; id<MOVING_OBJECTS; id+=thread_count) {
+                    own.push_back(start[id]);
+                }
+                // Counted in locals and stored once, the vectors' slots of the threads share cache lines
+                size_t found=0, moved=0;
+                std::vector<double> timed;
+                for (size_t n=0; ; n++) {
+                    if ((n & 255)==0 && std::chrono::steady_clock::now()>=stop) {
+                        break;
+                    }
+                    if (n%20==19) {
+                        auto begin=std::chrono::steady_clock::now();
+                        index.visit_radius(urban[rng() & (SAMPLE_COUNT-1)], 1, [&](size_t, geolocation) { found++; });
+                        timed.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now()-begin).count());
+                        continue;
+                    }
+                    size_t i=rng()%own.size();
+                    own[i].latitude=std::max(-90.0, std::min(90.0, own[i].latitude+step(rng)));
+                    own[i].longitude=std::remainder(own[i].longitude+step(rng), 360.0);
+                    index.update(t+i*thread_count, own[i]);
+                    moved++;
+                }
+                updates[t]+=moved;
+                latencies[t].insert(latencies[t].end(), timed.begin(), timed.end());
+                benchmark::DoNotOptimize(found);
+            });
+        }
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+    }
+    std::vector<double> all;
+    for (const std::vector<double> &l : latencies) {
+        all.insert(all.end(), l.begin(), l.end());
+    }
+    std::sort(all.begin(), all.end());
+    double total=0;
+    for (size_t u : updates) {
+        total+=double(u);
+    }
+    state.counters["updates/s"]=benchmark::Counter(total, benchmark::Counter::kIsRate);
+    state.counters["queries/s"]=benchmark::Counter(double(all.size()), benchmark::Counter::kIsRate);
+    state.counters["query_p50_us"]=all.empty() ? 0 : all[all.size()/2];
+    state.counters["query_p99_us"]=all.empty() ? 0 : all[all.size()*99/100];
+}
+BENCHMARK(bench_moving_stress)->ArgNames({"threads"})->Arg(1)->Arg(4)->Arg(16)->Arg(64)
+    ->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
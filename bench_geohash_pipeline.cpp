@@ -0,0 +1,65 @@
+//
+//  bench_geohash_pipeline.cpp
+//
+//  Bulk encoding throughput by input format and thread count.
+//
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include "bench_geohash.hpp"
+#include "geohash_pipeline.hpp"
+
+/// Records in each input, about 40 MB of CSV and 32 MB packed
+constexpr size_t PIPELINE_RECORDS=size_t(1)<<21;
+
+static const std::vector<geolocation> &pipeline_points() {
+    static const std::vector<geolocation> points=[] {
+        std::mt19937_64 rng(PIPELINE_RECORDS);
+        std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+        std::vector<geolocation> output(PIPELINE_RECORDS);
+        for (geolocation &l : output) {
+            l=geolocation{lat(rng), lon(rng)};
+        }
+        return output;
+    }();
+    return points;
+}
+
+static const std::string &pipeline_csv() {
+    static const std::string text=[] {
+        std::string output;
+        char line[64];
+        for (const geolocation &l : pipeline_points()) {
+            std::snprintf(line, sizeof(line), "%.7f,%.7f\n", l.latitude, l.longitude);
+            output+=line;
+        }
+        return output;
+    }();
+    return text;
+}
+
+static void bench_pipeline(benchmark::State &state) {
+    pipeline_options options;
+    options.input=record_format(state.range(0));
+    options.threads=size_t(state.range(1));
+    const char *data;
+    size_t size;
+    if (options.input==record_format::csv) {
+        data=pipeline_csv().data();
+        size=pipeline_csv().size();
+    } else {
+        data=reinterpret_cast<const char *>(pipeline_points().data());
+        size=pipeline_points().size()*sizeof(geolocation);
+    }
+    size_t written=0;
+    for (auto _ : state) {
+        encode_records(data, size, options, [&](const char *, size_t n) { written+=n; });
+    }
+    benchmark::DoNotOptimize(written);
+    state.SetBytesProcessed(int64_t(state.iterations()*size));
+    state.SetItemsProcessed(int64_t(state.iterations()*PIPELINE_RECORDS));
+    state.SetLabel(options.input==record_format::csv ? "csv" : "packed");
+}
+BENCHMARK(bench_pipeline)->ArgNames({"format", "threads"})->ArgsProduct({{0, 1}, {1, 2, 4, 8}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
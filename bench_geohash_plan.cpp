@@ -0,0 +1,91 @@
+//
+//  bench_geohash_plan.cpp
+//
+//  A burst of clustered radius queries, one by one and planned as a batch.
+//
+
+#include <random>
+#include "bench_geohash.hpp"
+#include "geohash_index.hpp"
+#include "geohash_plan.hpp"
+
+constexpr size_t PLAN_POINTS=1000000;
+
+/// Points mostly around the urban samples, the rest uniform
+static const geohash_index<uint32_t> &plan_index() {
+    static const geohash_index<uint32_t> index=[] {
+        std::vector<geolocation> points=urban_points(PLAN_POINTS, 0.5, 21, 0.7);
+        std::vector<uint32_t> ids;
+        for (size_t i=0; i<PLAN_POINTS; i++) {
+            ids.push_back(uint32_t(i));
+        }
+        return geohash_index<uint32_t>(std::move(points), std::move(ids));
+    }();
+    return index;
+}
+
+/// A burst of queries, a few hundred meters around the first urban samples
+static std::vector<radius_query> burst(size_t count, double dist) {
+    std::mt19937_64 rng(count);
+    std::normal_distribution<double> spread(0, 0.003);
+    const std::vector<geolocation> &urban=samples(distribution::urban);
+    std::vector<radius_query> output;
+    for (size_t q=0; q<count; q++) {
+        const geolocation &c=urban[q%64];
+        output.push_back(radius_query{geolocation{c.latitude+spread(rng), c.longitude+spread(rng)}, dist});
+    }
+    return output;
+}
+
+static void bench_plan_one_by_one(benchmark::State &state) {
+    const geohash_index<uint32_t> &index=plan_index();
+    std::vector<radius_query> queries=burst(size_t(state.range(0)), double(state.range(1))/1000);
+    size_t found=0, scanned=0;
+    for (auto _ : state) {
+        for (const radius_query &q : queries) {
+            for (const key_range &r : radius_ranges(q.center, q.dist)) {
+                index.visit(r, [&](size_t i) {
+                    scanned++;
+                    found+=within(q.center, index.location(i), q.dist);
+                });
+            }
+        }
+    }
+    state.counters["scanned/query"]=benchmark::Counter(double(scanned)/double(queries.size()), benchmark::Counter::kAvgIterations);
+    state.counters["found/query"]=benchmark::Counter(double(found)/double(queries.size()), benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(int64_t(state.iterations()*queries.size()));
+}
+BENCHMARK(bench_plan_one_by_one)->ArgNames({"queries", "meters"})->ArgsProduct({{1000, 10000}, {300, 2000}})
+    ->Unit(benchmark::kMillisecond);
+
+static void bench_plan_batch(benchmark::State &state) {
+    const geohash_index<uint32_t> &index=plan_index();
+    std::vector<radius_query> queries=burst(size_t(state.range(0)), double(state.range(1))/1000);
+    size_t found=0;
+    for (auto _ : state) {
+        query_plan plan(queries);
+        plan.run(index, [&](size_t, size_t) { found++; });
+    }
+    query_plan plan(queries);
+    size_t scanned=0;
+    for (size_t r=0; r<plan.size(); r++) {
+        index.visit(plan.range(r), [&](size_t) { scanned++; });
+    }
+    state.counters["scanned/query"]=double(scanned)/double(queries.size());
+    state.counters["found/query"]=benchmark::Counter(double(found)/double(queries.size()), benchmark::Counter::kAvgIterations);
+    state.counters["ranges"]=double(plan.size());
+    state.counters["unplanned ranges"]=double(plan.unplanned_size());
+    state.SetItemsProcessed(int64_t(state.iterations()*queries.size()));
+}
+BENCHMARK(bench_plan_batch)->ArgNames({"queries", "meters"})->ArgsProduct({{1000, 10000}, {300, 2000}})
+    ->Unit(benchmark::kMillisecond);
+
+static void bench_plan_build(benchmark::State &state) {
+    std::vector<radius_query> queries=burst(size_t(state.range(0)), double(state.range(1))/1000);
+    for (auto _ : state) {
+        query_plan plan(queries);
+        benchmark::DoNotOptimize(plan.size());
+    }
+}
+BENCHMARK(bench_plan_build)->ArgNames({"queries", "meters"})->ArgsProduct({{1000, 10000}, {300, 2000}})
+    ->Unit(benchmark::kMillisecond);
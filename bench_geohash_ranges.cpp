@@ -0,0 +1,74 @@
+//
+//  bench_geohash_ranges.cpp
+//
+//  hash_codes turned into scan ranges, and a large sorted cover streamed into ranges.
+//
+
+#include <random>
+#include "bench_geohash.hpp"
+#include "geohash_ranges.hpp"
+
+static void bench_ranges_hash_codes(benchmark::State &state) {
+    distribution d=distribution(state.range(0));
+    const std::vector<geolocation> &points=samples(d);
+    size_t ranges=0;
+    run_samples(state, d, [&](size_t i) {
+        std::vector<key_range> r=cell_ranges(hash_codes(points[i], 0.5));
+        ranges+=r.size();
+        benchmark::DoNotOptimize(r.data());
+    });
+    // Each of the 9 cells is a seek without coalescing
+    state.counters["ranges/query"]=benchmark::Counter(double(ranges), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(bench_ranges_hash_codes)->Apply(distribution_args);
+
+static void bench_ranges_hash_code_strings(benchmark::State &state) {
+    distribution d=distribution(state.range(0));
+    const std::vector<geolocation> &points=samples(d);
+    run_samples(state, d, [&](size_t i) {
+        benchmark::DoNotOptimize(string_ranges(hash_codes(points[i], 0.5)));
+    });
+}
+BENCHMARK(bench_ranges_hash_code_strings)->Apply(distribution_args);
+
+/// Sorted cells at precision 7, runs of neighbors with gaps, like a cover of a large region
+static const std::vector<geohash> &large_cover() {
+    static const std::vector<geohash> cells=[] {
+        std::mt19937_64 rng(25);
+        std::vector<geohash> output;
+        uint64_t key=0;
+        const uint64_t step=uint64_t(1)<<(64-35);
+        while (output.size()<1000000) {
+            key+=step*(1+rng()%64);
+            for (size_t run=rng()%16; run>0; run--, key+=step) {
+                output.push_back(geohash::from_key(key, 7));
+            }
+        }
+        return output;
+    }();
+    return cells;
+}
+
+static void bench_ranges_stream(benchmark::State &state) {
+    const std::vector<geohash> &cells=large_cover();
+    size_t ranges=0;
+    for (auto _ : state) {
+        ranges=0;
+        for (const key_range &r : stream_ranges(cells.begin(), cells.end())) {
+            benchmark::DoNotOptimize(r);
+            ranges++;
+        }
+    }
+    state.counters["ranges"]=double(ranges);
+    state.SetItemsProcessed(int64_t(state.iterations()*cells.size()));
+}
+BENCHMARK(bench_ranges_stream)->Unit(benchmark::kMillisecond);
+
+static void bench_ranges_materialized(benchmark::State &state) {
+    const std::vector<geohash> &cells=large_cover();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cell_ranges(cells).size());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()*cells.size()));
+}
+BENCHMARK(bench_ranges_materialized)->Unit(benchmark::kMillisecond);
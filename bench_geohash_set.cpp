@@ -0,0 +1,105 @@
+//
+//  bench_geohash_set.cpp
+//
+//  Memory and lookups of geohash_set against an unordered_set of strings.
+//
+
+#include <malloc.h>
+#include <string>
+#include <unordered_set>
+#include "bench_geohash.hpp"
+#include "geohash_set.hpp"
+
+/// Hotspot cells of precision 6 to 9, most around the urban samples
+static const std::vector<std::string> &hotspots() {
+    static const std::vector<std::string> hashes=[] {
+        std::vector<geolocation> points=urban_points(1000000, 0.5, 16, 0.75);
+        std::vector<std::string> output;
+        for (size_t i=0; i<points.size(); i++) {
+            output.push_back(encode(points[i], 6+i%4));
+        }
+        return output;
+    }();
+    return hashes;
+}
+
+/// Heap bytes in use
+static size_t heap_bytes() {
+    return mallinfo2().uordblks;
+}
+
+static void bench_set_memory(benchmark::State &state) {
+    const std::vector<std::string> &hashes=hotspots();
+    for (auto _ : state) {
+        size_t before=heap_bytes();
+        if (state.range(0)) {
+            geohash_set set(hashes);
+            state.counters["bytes/entry"]=double(heap_bytes()-before)/double(set.size());
+            state.counters["reported"]=double(set.memory_usage())/double(set.size());
+        } else {
+            std::unordered_set<std::string> set(hashes.begin(), hashes.end());
+            state.counters["bytes/entry"]=double(heap_bytes()-before)/double(set.size());
+        }
+    }
+    state.SetLabel(state.range(0) ? "geohash_set" : "unordered_set");
+}
+BENCHMARK(bench_set_memory)->ArgNames({"compact"})->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->Iterations(1);
+
+/// Members and misses of precision 6 to 9 at the samples
+static std::vector<std::string> probes(distribution d) {
+    std::vector<std::string> output;
+    const std::vector<geolocation> &locations=samples(d);
+    for (size_t i=0; i<SAMPLE_COUNT; i++) {
+        output.push_back(i%2 ? encode(locations[i], 6+i%4) : hotspots()[i*97]);
+    }
+    return output;
+}
+
+static void bench_set_contains(benchmark::State &state) {
+    distribution d=distribution(state.range(0));
+    static const geohash_set set(hotspots());
+    std::vector<geohash> cells;
+    for (const std::string &hash : probes(d)) {
+        cells.push_back(geohash::from_string(hash));
+    }
+    run_samples(state, d, [&](size_t i) {
+        benchmark::DoNotOptimize(set.contains(cells[i]));
+    });
+}
+BENCHMARK(bench_set_contains)->Apply(distribution_args);
+
+static void bench_string_set_contains(benchmark::State &state) {
+    distribution d=distribution(state.range(0));
+    static const std::unordered_set<std::string> set(hotspots().begin(), hotspots().end());
+    std::vector<std::string> hashes=probes(d);
+    run_samples(state, d, [&](size_t i) {
+        benchmark::DoNotOptimize(set.count(hashes[i]));
+    });
+}
+BENCHMARK(bench_string_set_contains)->Apply(distribution_args);
+
+static void bench_set_longest_prefix(benchmark::State &state) {
+    distribution d=distribution(state.range(0));
+    static const geohash_set set(hotspots());
+    const std::vector<geolocation> &locations=samples(d);
+    run_samples(state, d, [&](size_t i) {
+        benchmark::DoNotOptimize(set.longest_prefix(locations[i]));
+    });
+}
+BENCHMARK(bench_set_longest_prefix)->Apply(distribution_args);
+
+/// The same with strings, the location hashed once and probed at every precision
+static void bench_string_set_longest_prefix(benchmark::State &state) {
+    distribution d=distribution(state.range(0));
+    static const std::unordered_set<std::string> set(hotspots().begin(), hotspots().end());
+    const std::vector<geolocation> &locations=samples(d);
+    std::string hash;
+    run_samples(state, d, [&](size_t i) {
+        hash=encode(locations[i], MAX_GEOHASH_LENGTH);
+        while (!hash.empty() && !set.count(hash)) {
+            hash.pop_back();
+        }
+        benchmark::DoNotOptimize(hash.data());
+    });
+}
+BENCHMARK(bench_string_set_longest_prefix)->Apply(distribution_args);
@@ -6,8 +6,11 @@
 //
 
 #include <cmath>
+#include <cstring>
 #include <algorithm>
+#include <stdexcept>
 #include "geohash.hpp"
+#include "geohash_metrics.hpp"
 
 ////////////////////////////////////////////////////////////////////////////////
 // geolocation
@@ -77,40 +80,60 @@ double bounding_box::min_span() const {
 // geohash
 ////////////////////////////////////////////////////////////////////////////////
 
-static const char base32_codes[] = {
-    '0', '1', '2', '3', '4', '5', '6', '7',
-    '8', '9', 'b', 'c', 'd', 'e', 'f', 'g',
-    'h', 'j', 'k', 'm', 'n', 'p', 'q', 'r',
-    's', 't', 'u', 'v', 'w', 'x', 'y', 'z',
-};
-
-static const int base32_indexes[]={
-     0,  1,  2,  3,  4,  5,  6,  7, // 30-37, '0'..'7'
-     8,  9, -1, -1, -1, -1, -1, -1, // 38-2F, '8','9'
-    -1, -1, 10, 11, 12, 13, 14, 15, // 40-47, 'B'..'G'
-    16, -1, 17, 18, -1, 19, 20, -1, // 48-4F, 'H','J','K','M','N'
-    21, 22, 23, 24, 25, 26, 27, 28, // 50-57, 'P'..'W'
-    29, 30, 31, -1, -1, -1, -1, -1, // 58-5F, 'X'..'Z'
-    -1, -1, 10, 11, 12, 13, 14, 15, // 60-67, 'b'..'g'
-    16, -1, 17, 18, -1, 19, 20, -1, // 68-6F, 'h','j','k','m','n'
-    21, 22, 23, 24, 25, 26, 27, 28, // 70-77, 'p'..'w'
-    29, 30, 31,                     // 78-7A, 'x'..'z'
-};
+/// Side of a cell with the given number of latitude or longitude bits, in km at the equator
+/// Coarse to fine, cell_sides[0] covers the whole range
+static std::array<double, 33> cell_sides(long double range) {
+    std::array<double, 33> output;
+    for (size_t i=0; i<output.size(); i++) {
+        output[i]=double(std::ldexp(radians(range)*EARTH_RADIUS, -int(i)));
+    }
+    return output;
+}
 
-size_t binary_hash_precision(geolocation l, double dist) {
-    for (size_t i = MAX_BINHASH_LENGTH; i >= 1; i--) {
-        bounding_box box=decode(binary_encode(l, i));
-        if (box.min_span()>=dist*2) {
-            return i;
+static const std::array<double, 33> latitude_sides=cell_sides(180);
+static const std::array<double, 33> longitude_sides=cell_sides(360);
+
+/// Finest bit precision whose cells could span dist*2 at this latitude
+/// Longitude spans shrink with the cosine of the farther cell edge, which is never closer to
+/// the equator than the location, so the estimate never undershoots the exact search.
+static int estimate_bit_precision(double latitude, double dist) {
+    double span=dist*2*(1-1e-9);
+    double lon_scale=std::abs(latitude)<=90 ? double(std::cos(radians(latitude)))+1e-9 : 1;
+    auto fits=[](const std::array<double, 33> &sides, double span) {
+        // Number of bits of the finest side still >= span, -1 if none
+        return int(std::partition_point(sides.begin(), sides.end(),
+                                        [span](double side) { return side>=span; })-sides.begin())-1;
+    };
+    int lat_bits=fits(latitude_sides, span);
+    int lon_bits=fits(longitude_sides, span/lon_scale);
+    // p bits have p/2 latitude and (p+1)/2 longitude bits
+    return std::min({2*lat_bits+1, 2*lon_bits, int(MAX_BINHASH_LENGTH)});
+}
+
+/// Walk down from the estimate in steps of step bits, checking the exact cell
+static size_t finest_bit_precision(geolocation l, double dist, size_t step) {
+    int estimate=estimate_bit_precision(l.latitude, dist);
+    uint64_t key=encode_key(l);
+    for (int i=estimate/int(step)*int(step); i>=int(step); i-=int(step)) {
+        if (decode_key(key, size_t(i)).min_span()>=dist*2) {
+            return size_t(i);
         }
     }
     return 0;
 }
 
+size_t binary_hash_precision(geolocation l, double dist) {
+    GEOHASH_MEASURE(metric::binary_hash_precision);
+    return finest_bit_precision(l, dist, 1);
+}
+
 binary_hash::binary_hash(const std::string &bit_string)
 : bits(0)
 , precision(bit_string.size())
 {
+    if (precision>MAX_BINHASH_LENGTH) {
+        throw std::invalid_argument("binary hash precision is at most MAX_BINHASH_LENGTH");
+    }
     for(auto c : bit_string) {
         if (c=='1') {
             bits = (bits<<1) | 1;
@@ -125,12 +148,13 @@ binary_hash::binary_hash(geolocation l, double dist) {
 }
 
 binary_hash binary_hash::from_geohash(const std::string &hash) {
+    GEOHASH_MEASURE(metric::from_geohash);
+    if (hash.size()>MAX_GEOHASH_LENGTH || find_invalid_char(hash)!=std::string::npos) {
+        throw std::invalid_argument("Invalid geohash");
+    }
     binary_hash output;
     for(auto c : hash) {
-        int char_index = base32_indexes[c-48];
-        if (char_index<0) {
-            throw std::invalid_argument("Invalid geohash");
-        }
+        int char_index = base32_indexes[c-'0'];
         for (int bits = 4; bits >= 0; --bits) {
             output.push_back(((char_index >> bits) & 1)!=0);
         }
@@ -140,126 +164,56 @@ binary_hash binary_hash::from_geohash(const std::string &hash) {
 
 std::string binary_hash::to_string() const {
     std::string output(precision, ' ');
-    uint64_t b=bits<<(64-precision);
-    for (int i=0; i<precision; i++) {
-        output[i]=(b & 0x8000000000000000LL) ? '1' : '0';
-        b<<=1;
+    for (size_t i=0; i<precision; i++) {
+        output[i]=((bits>>(precision-1-i)) & 1) ? '1' : '0';
     }
     return output;
 }
 
-binary_hash binary_encode(geolocation l, size_t precision) {
-    // bbox for the lat/lon + errors/ranges
-    bounding_box bbox{ -90, 90, -180, 180 };
-    bool is_longitude = true;
-    
-    binary_hash output;
-    
-    while(output.size() < precision) {
-        if (is_longitude) {
-            if(l.longitude > bbox.lon_center()) {
-                output.push_back(true);
-                bbox.min_lon=bbox.lon_center();
-            } else {
-                output.push_back(false);
-                bbox.max_lon=bbox.lon_center();
-            }
-        } else {
-            if(l.latitude > bbox.lat_center() ) {
-                output.push_back(true);
-                bbox.min_lat = bbox.lat_center();
-            } else {
-                output.push_back(false);
-                bbox.max_lat = bbox.lat_center();
-            }
-        }
-        is_longitude = !is_longitude;
+static inline int base32_index(char c) {
+    if (c<'0' || c>'z') {
+        throw std::invalid_argument("Invalid geohash");
     }
-    return output;
-}
-
-std::string encode(geolocation l, size_t precision) {
-    // DecodedBBox for the lat/lon + errors
-    bounding_box bbox{ -90, 90, -180, 180 };
-    bool is_longitude = true;
-    int num_bits = 0;
-    int hash_index = 0;
-    
-    // Pre-Allocate the hash string
-    std::string output(precision, ' ');
-    size_t output_length = 0;
-    
-    while(output_length < precision) {
-        if (is_longitude) {
-            if(l.longitude > bbox.lon_center()) {
-                hash_index = (hash_index << 1) + 1;
-                bbox.min_lon=bbox.lon_center();
-            } else {
-                hash_index = (hash_index << 1) + 0;
-                bbox.max_lon=bbox.lon_center();
-            }
-        } else {
-            if(l.latitude > bbox.lat_center() ) {
-                hash_index = (hash_index << 1) + 1;
-                bbox.min_lat = bbox.lat_center();
-            } else {
-                hash_index = (hash_index << 1) + 0;
-                bbox.max_lat = bbox.lat_center();
-            }
-        }
-        is_longitude = !is_longitude;
-        
-        ++num_bits;
-        if (5 == num_bits) {
-            output[output_length] = base32_codes[hash_index];
-            output_length++;
-            num_bits = 0;
-            hash_index = 0;
-        }
+    int char_index = base32_indexes[c-48];
+    if (char_index<0) {
+        throw std::invalid_argument("Invalid geohash");
     }
-    return output;
+    return char_index;
 }
 
-bounding_box decode(const binary_hash &hash) {
-    // bbox for the lat/lon + errors/ranges
-    bounding_box output{ -90, 90, -180, 180 };
-    
+/// Keep bisecting for hash characters beyond the 64-bit key
+static void encode_tail(geolocation l, bounding_box bbox, char *output, size_t count) {
     bool is_longitude = true;
-    
-    for(size_t i=1; i<=hash.size(); i++) {
-        bool bit = hash.test(i);
-        if (is_longitude) {
-            if(bit) {
-                output.min_lon = output.lon_center();
-            } else {
-                output.max_lon = output.lon_center();
-            }
-        } else {
-            if(bit) {
-                output.min_lat = output.lat_center();
+    for (size_t i=0; i<count; i++) {
+        int hash_index = 0;
+        for (int n=0; n<5; n++) {
+            if (is_longitude) {
+                if(l.longitude > bbox.lon_center()) {
+                    hash_index = (hash_index << 1) + 1;
+                    bbox.min_lon=bbox.lon_center();
+                } else {
+                    hash_index = (hash_index << 1) + 0;
+                    bbox.max_lon=bbox.lon_center();
+                }
             } else {
-                output.max_lat = output.lat_center();
+                if(l.latitude > bbox.lat_center() ) {
+                    hash_index = (hash_index << 1) + 1;
+                    bbox.min_lat = bbox.lat_center();
+                } else {
+                    hash_index = (hash_index << 1) + 0;
+                    bbox.max_lat = bbox.lat_center();
+                }
             }
+            is_longitude = !is_longitude;
         }
-        is_longitude = !is_longitude;
+        output[i] = base32_codes[hash_index];
     }
-    return output;
 }
 
-bounding_box decode(const std::string &hash) {
-    bounding_box output{ -90, 90, -180, 180 };
-    
+static void decode_tail(bounding_box &output, const char *hash, size_t count) {
     bool is_longitude = true;
-    
-    for(auto &c : hash) {
-        if (c<'0' || c>'z') {
-            throw std::invalid_argument("Invalid geohash");
-        }
-        int char_index = base32_indexes[c-48];
-        if (char_index<0) {
-            throw std::invalid_argument("Invalid geohash");
-        }
-        
+    for (size_t i=0; i<count; i++) {
+        int char_index = base32_index(hash[i]);
         for (int bits = 4; bits >= 0; --bits) {
             int bit = (char_index >> bits) & 1;
             if (is_longitude) {
@@ -278,25 +232,224 @@ bounding_box decode(const std::string &hash) {
             is_longitude = !is_longitude;
         }
     }
+}
+
+std::string encode(geolocation l, size_t precision) {
+    GEOHASH_MEASURE(metric::encode);
+    // Pre-Allocate the hash string
+    std::string output(precision, ' ');
+    uint64_t key=encode_key(l);
+    size_t length=std::min(precision, MAX_GEOHASH_LENGTH);
+    for (size_t i=0; i<length; i++) {
+        output[i]=base32_codes[(key>>(59-5*i)) & 0x1f];
+    }
+    if (precision>MAX_GEOHASH_LENGTH) {
+        encode_tail(l, decode_key(key, MAX_GEOHASH_LENGTH*5), &output[length], precision-length);
+    }
     return output;
 }
 
-size_t hash_precision(geolocation l, double dist) {
-    for (size_t i = MAX_GEOHASH_LENGTH; i >= 1; i--) {
-        bounding_box box=decode(encode(l, i));
-        if (box.min_span()>=dist*2) {
-            return i;
+/// Left-aligned key of the first MAX_GEOHASH_LENGTH characters
+static uint64_t string_key(const std::string &hash) {
+    size_t length=std::min(hash.size(), MAX_GEOHASH_LENGTH);
+    uint64_t key=0;
+    for (size_t i=0; i<length; i++) {
+        key=(key<<5) | uint64_t(base32_index(hash[i]));
+    }
+    return length ? key<<(64-5*length) : 0;
+}
+
+bounding_box decode(const std::string &hash) {
+    GEOHASH_MEASURE(metric::decode);
+    decode_result output=try_decode(hash);
+    if (!output) {
+        throw std::invalid_argument("Invalid geohash");
+    }
+    return output.box;
+}
+
+void coalesce(std::vector<key_range> &ranges) {
+    if (ranges.empty()) {
+        return;
+    }
+    std::sort(ranges.begin(), ranges.end(),
+              [](const key_range &r1, const key_range &r2) { return r1.begin<r2.begin; });
+    size_t n=0;
+    for (size_t i=1; i<ranges.size(); i++) {
+        key_range &last=ranges[n];
+        if (last.end==0) {
+            // Already runs to the top of the key space
+            break;
+        }
+        if (ranges[i].begin<=last.end) {
+            if (ranges[i].end==0 || ranges[i].end>last.end) {
+                last.end=ranges[i].end;
+            }
+        } else {
+            ranges[++n]=ranges[i];
         }
     }
-    return 0;
+    ranges.resize(n+1);
+}
+
+std::string neighbor(const std::string &hash,
+                     const std::pair<int, int> &direction)
+{
+    GEOHASH_MEASURE(metric::neighbor);
+    if (hash.size()>MAX_GEOHASH_LENGTH) {
+        // Past the 64-bit key, step by the box size like bisection would
+        bounding_box b=decode(hash);
+        geolocation cp=b.center();
+        cp.latitude += direction.first * b.lat_range();
+        cp.longitude += direction.second * b.lon_range();
+        if (cp.longitude>180) cp.longitude-=360;
+        if (cp.longitude<-180) cp.longitude+=360;
+        return encode(cp, hash.size());
+    }
+    return geohash::from_key(neighbor_key(string_key(hash), 5*hash.size(), direction.first, direction.second),
+                             hash.size());
+}
+
+std::array<std::string, 8> neighbors(const std::string &hash) {
+    GEOHASH_MEASURE(metric::neighbors);
+    std::array<std::string, 8> output;
+    if (hash.size()>MAX_GEOHASH_LENGTH) {
+        static const std::pair<int, int> directions[8]={
+            {-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1},
+        };
+        for (size_t i=0; i<8; i++) {
+            output[i]=neighbor(hash, directions[i]);
+        }
+        return output;
+    }
+    std::array<uint64_t, 8> keys=neighbor_keys(string_key(hash), 5*hash.size());
+    for (size_t i=0; i<8; i++) {
+        output[i]=geohash::from_key(keys[i], hash.size());
+    }
+    return output;
+}
+
+size_t hash_precision(geolocation l, double dist) {
+    GEOHASH_MEASURE(metric::hash_precision);
+    size_t precision=finest_bit_precision(l, dist, 5)/5;
+    GEOHASH_RECORD_PRECISION(precision);
+    return precision;
 }
 
 std::string base_hash(geolocation l, double dist) {
-    for (size_t i = MAX_GEOHASH_LENGTH; i >= 1; i--) {
-        std::string hash=encode(l, i);
-        if (decode(hash).min_span()>=dist*2) {
-            return hash;
+    GEOHASH_MEASURE(metric::base_hash);
+    size_t precision=hash_precision(l, dist);
+    if (precision==0) {
+        GEOHASH_RECORD_EMPTY_BASE_HASH();
+    }
+    return encode(l, precision);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// validation
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr uint64_t BYTES_01=0x0101010101010101ull;
+constexpr uint64_t BYTES_80=0x8080808080808080ull;
+
+/// High bit of each byte of x within [lo, hi], the bytes of x are below 0x80 so no sum carries
+static inline uint64_t bytes_in_range(uint64_t x, uint8_t lo, uint8_t hi) {
+    uint64_t at_least_lo=x+BYTES_01*(0x80-lo);
+    uint64_t above_hi=x+BYTES_01*(0x7f-hi);
+    return at_least_lo & ~above_hi & BYTES_80;
+}
+
+/// High bit of each byte of word that is a base32 character, digits or letters but a, i, l and o
+static inline uint64_t base32_bytes(uint64_t word) {
+    uint64_t x=word & ~BYTES_80;
+    // Setting bit 5 folds 'B'..'Z' onto 'b'..'z', and nothing else into that range
+    uint64_t lower=x | (BYTES_01*0x20);
+    uint64_t letters=bytes_in_range(lower, 'b', 'z') & ~bytes_in_range(lower, 'i', 'i')
+        & ~bytes_in_range(lower, 'l', 'l') & ~bytes_in_range(lower, 'o', 'o');
+    return (bytes_in_range(x, '0', '9') | letters) & ~word;
+}
+
+/// 8 characters, character i in byte i counting from the least significant
+static inline uint64_t load_chars(const char *chars) {
+    uint64_t word;
+    std::memcpy(&word, chars, 8);
+#if __BYTE_ORDER__==__ORDER_BIG_ENDIAN__
+    word=__builtin_bswap64(word);
+#endif
+    return word;
+}
+
+/// Byte of the first invalid character of word, 8 if they are all valid
+static inline size_t invalid_byte(uint64_t word) {
+    uint64_t invalid=~base32_bytes(word) & BYTES_80;
+    return invalid ? size_t(__builtin_ctzll(invalid))/8 : 8;
+}
+
+size_t find_invalid_char(std::string_view hash) noexcept {
+    const char *chars=hash.data();
+    size_t size=hash.size();
+    if (size<8) {
+        // Pad with '0', a valid character. A copy of a variable length would go through
+        // memory and stall the load that follows it.
+        uint64_t word=BYTES_01*'0';
+        for (size_t i=0; i<size; i++) {
+            word=(word & ~(0xffull<<8*i)) | uint64_t(uint8_t(chars[i]))<<8*i;
+        }
+        size_t at=invalid_byte(word);
+        return at<8 ? at : std::string_view::npos;
+    }
+    for (size_t i=0; i+8<=size; i+=8) {
+        size_t at=invalid_byte(load_chars(chars+i));
+        if (at<8) {
+            return i+at;
+        }
+    }
+    if (size%8) {
+        // The last 8 characters, those already checked are valid
+        size_t at=invalid_byte(load_chars(chars+size-8));
+        if (at<8) {
+            return size-8+at;
         }
     }
-    return "";
+    return std::string_view::npos;
+}
+
+/// Base32 values of every byte, 0x80 for those outside the alphabet
+static constexpr std::array<uint8_t, 256> base32_values=[] {
+    std::array<uint8_t, 256> output{};
+    for (int c=0; c<256; c++) {
+        output[c]=(c>='0' && c<='z' && base32_indexes[c-'0']>=0) ? uint8_t(base32_indexes[c-'0']) : 0x80;
+    }
+    return output;
+}();
+
+decode_result try_decode(std::string_view hash) noexcept {
+    decode_result output;
+    size_t length=std::min(hash.size(), MAX_GEOHASH_LENGTH);
+    // Gather the key and the invalid flags together, so a valid hash takes no branch per character
+    uint64_t key=0;
+    uint8_t invalid=0;
+    for (size_t i=0; i<length; i++) {
+        uint8_t value=base32_values[uint8_t(hash[i])];
+        invalid|=value;
+        key=(key<<5) | uint64_t(value & 0x1f);
+    }
+    if ((invalid & 0x80) || (hash.size()>MAX_GEOHASH_LENGTH && find_invalid_char(hash.substr(length))!=std::string_view::npos)) {
+        output.error_position=find_invalid_char(hash);
+        return output;
+    }
+    output.box=decode_key(length ? key<<(64-5*length) : 0, 5*length);
+    if (hash.size()>MAX_GEOHASH_LENGTH) {
+        decode_tail(output.box, &hash[length], hash.size()-length);
+    }
+    return output;
+}
+
+size_t try_decode(const std::string_view *hashes, size_t count, decode_result *output) noexcept {
+    size_t valid=0;
+    for (size_t i=0; i<count; i++) {
+        output[i]=try_decode(hashes[i]);
+        valid+=output[i].ok();
+    }
+    return valid;
 }
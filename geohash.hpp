@@ -9,21 +9,59 @@
 #define geohash_hpp_included
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// The BMI2 instructions are not constexpr, use them only outside constant evaluation
+#if defined(__BMI2__) && defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define GEOHASH_BMI2 1
+#include <immintrin.h>
+#endif
+#endif
 
 constexpr size_t MAX_GEOHASH_LENGTH=12;
 constexpr size_t MAX_BINHASH_LENGTH=64;
 
+/// Geohash base32 alphabet
+constexpr char base32_codes[] = {
+    '0', '1', '2', '3', '4', '5', '6', '7',
+    '8', '9', 'b', 'c', 'd', 'e', 'f', 'g',
+    'h', 'j', 'k', 'm', 'n', 'p', 'q', 'r',
+    's', 't', 'u', 'v', 'w', 'x', 'y', 'z',
+};
+
+/// Base32 character values from '0' to 'z', -1 for invalid characters
+constexpr int base32_indexes[]={
+     0,  1,  2,  3,  4,  5,  6,  7, // 30-37, '0'..'7'
+     8,  9, -1, -1, -1, -1, -1, -1, // 38-2F, '8','9'
+    -1, -1, 10, 11, 12, 13, 14, 15, // 40-47, 'B'..'G'
+    16, -1, 17, 18, -1, 19, 20, -1, // 48-4F, 'H','J','K','M','N'
+    21, 22, 23, 24, 25, 26, 27, 28, // 50-57, 'P'..'W'
+    29, 30, 31, -1, -1, -1, -1, -1, // 58-5F, 'X'..'Z'
+    -1, -1, 10, 11, 12, 13, 14, 15, // 60-67, 'b'..'g'
+    16, -1, 17, 18, -1, 19, 20, -1, // 68-6F, 'h','j','k','m','n'
+    21, 22, 23, 24, 25, 26, 27, 28, // 70-77, 'p'..'w'
+    29, 30, 31,                     // 78-7A, 'x'..'z'
+};
+
 /// WGS84 point
 struct geolocation {
     double latitude;
     double longitude;
 };
 
-inline bool operator==(const geolocation &l, const geolocation &r)
+constexpr bool operator==(const geolocation &l, const geolocation &r)
 { return (l.latitude==r.latitude) && (l.longitude==r.longitude); }
 
-inline bool operator!=(const geolocation &l, const geolocation &r)
+constexpr bool operator!=(const geolocation &l, const geolocation &r)
 { return (l.latitude!=r.latitude) || (l.longitude!=r.longitude); }
 
 /// Distance of 2 geolocations
@@ -36,14 +74,14 @@ inline double operator-(const geolocation &l, const geolocation &r)
 struct bounding_box {
     bounding_box()=default;
     
-    bounding_box(double lat1, double lat2, double lon1, double lon2)
+    constexpr bounding_box(double lat1, double lat2, double lon1, double lon2)
     : min_lat(std::min(lat1, lat2))
     , max_lat(std::max(lat1, lat2))
     , min_lon(std::min(lon1, lon2))
     , max_lon(std::max(lon1, lon2))
     {}
     
-    bounding_box(geolocation l1, geolocation l2)
+    constexpr bounding_box(geolocation l1, geolocation l2)
     : min_lat(std::min(l1.latitude, l2.latitude))
     , max_lat(std::max(l1.latitude, l2.latitude))
     , min_lon(std::min(l1.longitude, l2.longitude))
@@ -54,28 +92,28 @@ struct bounding_box {
     bounding_box(geolocation l, double distance);
     
     /// Test if a point in the box
-    bool contains(geolocation l) const {
+    constexpr bool contains(geolocation l) const {
         return (l.latitude>=min_lat) && (l.latitude<=max_lat) && (l.longitude>=min_lon) && (l.longitude<=max_lon);
     }
     
     /// Center
-    geolocation center() const { return geolocation{lat_center(), lon_center()};}
+    constexpr geolocation center() const { return geolocation{lat_center(), lon_center()};}
     /// Corners
-    geolocation bottom_left() const { return geolocation{min_lat, min_lon}; }
-    geolocation bottom_right() const { return geolocation{min_lat, max_lon}; }
-    geolocation top_left() const { return geolocation{max_lat, min_lon}; }
-    geolocation top_right() const { return geolocation{max_lat, max_lon}; }
+    constexpr geolocation bottom_left() const { return geolocation{min_lat, min_lon}; }
+    constexpr geolocation bottom_right() const { return geolocation{min_lat, max_lon}; }
+    constexpr geolocation top_left() const { return geolocation{max_lat, min_lon}; }
+    constexpr geolocation top_right() const { return geolocation{max_lat, max_lon}; }
     
     /// Edges
-    double lat_range() const { return max_lat-min_lat; }
-    double lon_range() const { return max_lon-min_lon; }
-    double lat_err() const { return (max_lat-min_lat)/2; }
-    double lon_err() const { return (max_lon-min_lon)/2; }
-    double lat_center() const { return (min_lat+max_lat)/2; }
-    double lon_center() const { return (min_lon+max_lon)/2; }
+    constexpr double lat_range() const { return max_lat-min_lat; }
+    constexpr double lon_range() const { return max_lon-min_lon; }
+    constexpr double lat_err() const { return (max_lat-min_lat)/2; }
+    constexpr double lon_err() const { return (max_lon-min_lon)/2; }
+    constexpr double lat_center() const { return (min_lat+max_lat)/2; }
+    constexpr double lon_center() const { return (min_lon+max_lon)/2; }
 
     /// Merge with other box
-    bounding_box &merge(const bounding_box &b) {
+    constexpr bounding_box &merge(const bounding_box &b) {
         min_lat=std::min(min_lat, b.min_lat);
         max_lat=std::max(max_lat, b.max_lat);
         min_lon=std::min(min_lon, b.min_lon);
@@ -93,17 +131,17 @@ struct bounding_box {
     double max_lon=180.0;
 };
 
-inline bool operator==(const bounding_box &b1, const bounding_box &b2) {
+constexpr bool operator==(const bounding_box &b1, const bounding_box &b2) {
     return (b1.min_lat==b2.min_lat) && (b1.max_lat==b2.max_lat)
     && (b1.min_lon==b2.min_lon) && (b1.max_lon==b2.max_lon);
 }
 
-inline bool operator!=(const bounding_box &b1, const bounding_box &b2) {
+constexpr bool operator!=(const bounding_box &b1, const bounding_box &b2) {
     return !(b1==b2);
 }
 
 /// Merge 2 bounding boxes
-inline bounding_box merge(const bounding_box &b1, const bounding_box &b2) {
+constexpr bounding_box merge(const bounding_box &b1, const bounding_box &b2) {
     return bounding_box{
         std::min(b1.min_lat, b2.min_lat),
         std::max(b1.max_lat, b2.max_lat),
@@ -112,19 +150,229 @@ inline bounding_box merge(const bounding_box &b1, const bounding_box &b2) {
     };
 }
 
+/// Interleaving engine
+///
+/// A location is quantized to 32-bit cell indexes on each axis, then the indexes are
+/// interleaved into a 64-bit Z-order key, longitude bit first. The top n bits of the
+/// key are exactly the n-bit binary hash produced by bisecting the lat/lon ranges.
+
+/// Spread the 32 bits of v onto the even bits of a 64-bit word
+constexpr uint64_t spread_bits(uint32_t v) {
+#if defined(GEOHASH_BMI2)
+    if (!__builtin_is_constant_evaluated()) {
+        return _pdep_u64(v, 0x5555555555555555ull);
+    }
+#endif
+    uint64_t x=v;
+    x=(x | (x<<16)) & 0x0000ffff0000ffffull;
+    x=(x | (x<<8))  & 0x00ff00ff00ff00ffull;
+    x=(x | (x<<4))  & 0x0f0f0f0f0f0f0f0full;
+    x=(x | (x<<2))  & 0x3333333333333333ull;
+    x=(x | (x<<1))  & 0x5555555555555555ull;
+    return x;
+}
+
+/// Gather the even bits of a 64-bit word, inverse of spread_bits
+constexpr uint32_t compact_bits(uint64_t x) {
+#if defined(GEOHASH_BMI2)
+    if (!__builtin_is_constant_evaluated()) {
+        return uint32_t(_pext_u64(x, 0x5555555555555555ull));
+    }
+#endif
+    x&=0x5555555555555555ull;
+    x=(x | (x>>1))  & 0x3333333333333333ull;
+    x=(x | (x>>2))  & 0x0f0f0f0f0f0f0f0full;
+    x=(x | (x>>4))  & 0x00ff00ff00ff00ffull;
+    x=(x | (x>>8))  & 0x0000ffff0000ffffull;
+    x=(x | (x>>16)) & 0x00000000ffffffffull;
+    return uint32_t(x);
+}
+
+/// Interleave longitude and latitude cell indexes into a 64-bit key
+constexpr uint64_t interleave(uint32_t lon, uint32_t lat) {
+    return (spread_bits(lon)<<1) | spread_bits(lat);
+}
+
+/// Split a 64-bit key into longitude and latitude cell indexes
+constexpr void deinterleave(uint64_t key, uint32_t &lon, uint32_t &lat) {
+    lon=compact_bits(key>>1);
+    lat=compact_bits(key);
+}
+
+/// Index of the 2^32 equal cells of [lo, lo+range] that bisection puts x in
+constexpr uint32_t quantize(double x, double lo, double range) {
+    const double cells=4294967296.0;
+    const double step=range/cells;
+    double t=(x-lo)*(cells/range);
+    t=t>0 ? t : 0;
+    t=t<cells-1 ? t : cells-1;
+    double m=double(uint32_t(t));
+    // The estimate may be off by one near a cell edge, fix it to the number of edges
+    // strictly below x, cell edges are exact doubles. Both fixes are rare and well predicted.
+    m+=((m<cells-1) & (x>lo+(m+1)*step)) ? 1 : 0;
+    m-=((m>0) & !(x>lo+m*step)) ? 1 : 0;
+    return uint32_t(m);
+}
+
+constexpr uint32_t quantize_longitude(double lon) { return quantize(lon, -180, 360); }
+constexpr uint32_t quantize_latitude(double lat) { return quantize(lat, -90, 180); }
+
+/// Full 64-bit interleaved key of the location
+constexpr uint64_t encode_key(geolocation l) {
+    return interleave(quantize_longitude(l.longitude), quantize_latitude(l.latitude));
+}
+
+/// 2^-n for n up to 32, exact for the cell spans
+constexpr std::array<double, 33> inv_pow2=[] {
+    std::array<double, 33> output{};
+    double d=1;
+    for (double &x : output) {
+        x=d;
+        d/=2;
+    }
+    return output;
+}();
+
+/// Decode the cell given by the top bit_count bits of a 64-bit key
+constexpr bounding_box decode_key(uint64_t key, size_t bit_count) {
+    uint32_t lon=0, lat=0;
+    deinterleave(key, lon, lat);
+    size_t lon_bits=(bit_count+1)/2;
+    size_t lat_bits=bit_count/2;
+    // Cell edges are multiples of exact binary fractions, so they match bisection bit by bit
+    double lon_step=360*inv_pow2[lon_bits];
+    double lat_step=180*inv_pow2[lat_bits];
+    double lon_index=double(uint64_t(lon)>>(32-lon_bits));
+    double lat_index=double(uint64_t(lat)>>(32-lat_bits));
+    bounding_box output;
+    output.min_lon=-180+lon_index*lon_step;
+    output.max_lon=-180+(lon_index+1)*lon_step;
+    output.min_lat=-90+lat_index*lat_step;
+    output.max_lat=-90+(lat_index+1)*lat_step;
+    return output;
+}
+
+/// Neighbor arithmetic
+///
+/// Neighbors are found on the cell indexes of the key, without decoding to a box.
+/// Longitude wraps around the antimeridian. Latitude saturates at the poles, so the
+/// neighbor beyond a pole is the cell itself.
+
+/// Cell indexes of the top bit_count bits of a key, and their bit widths
+struct cell_indexes {
+    constexpr cell_indexes(uint64_t key, size_t bit_count)
+    : lon_shift(unsigned(32-(bit_count+1)/2))
+    , lat_shift(unsigned(32-bit_count/2))
+    {
+        uint32_t lon32=0, lat32=0;
+        deinterleave(key, lon32, lat32);
+        lon=uint64_t(lon32)>>lon_shift;
+        lat=uint64_t(lat32)>>lat_shift;
+    }
+
+    constexpr uint64_t lon_count() const { return 1ull<<(32-lon_shift); }
+    constexpr uint64_t lat_count() const { return 1ull<<(32-lat_shift); }
+    constexpr uint64_t wrap_lon(int64_t d) const { return (lon+uint64_t(d)) & (lon_count()-1); }
+    constexpr uint64_t clamp_lat(int64_t d) const {
+        int64_t n=int64_t(lat)+d;
+        return uint64_t(std::min(std::max(n, int64_t(0)), int64_t(lat_count()-1)));
+    }
+
+    /// Key of the cell with the given indexes at the same precision
+    constexpr uint64_t key(uint64_t lon_index, uint64_t lat_index) const {
+        return interleave(uint32_t(lon_index<<lon_shift), uint32_t(lat_index<<lat_shift));
+    }
+
+    uint64_t lon=0;
+    uint64_t lat=0;
+    unsigned lon_shift;
+    unsigned lat_shift;
+};
+
+/// Neighbor of the cell given by the top bit_count bits of a key
+constexpr uint64_t neighbor_key(uint64_t key, size_t bit_count, int dlat, int dlon) {
+    if (bit_count==0) {
+        return 0;
+    }
+    cell_indexes c(key, bit_count);
+    return c.key(c.wrap_lon(dlon), c.clamp_lat(dlat));
+}
+
+/// All 8 neighbors, in the order (-1,-1), (-1,0), (-1,1), (0,-1), (0,1), (1,-1), (1,0), (1,1)
+constexpr std::array<uint64_t, 8> neighbor_keys(uint64_t key, size_t bit_count) {
+    if (bit_count==0) {
+        return std::array<uint64_t, 8>{};
+    }
+    cell_indexes c(key, bit_count);
+    // Spread each of the 3 columns and 3 rows once
+    uint64_t lon[3]={}, lat[3]={};
+    for (int d=-1; d<=1; d++) {
+        lon[d+1]=spread_bits(uint32_t(c.wrap_lon(d)<<c.lon_shift))<<1;
+        lat[d+1]=spread_bits(uint32_t(c.clamp_lat(d)<<c.lat_shift));
+    }
+    return {
+        lat[0] | lon[0], lat[0] | lon[1], lat[0] | lon[2],
+        lat[1] | lon[0], lat[1] | lon[2],
+        lat[2] | lon[0], lat[2] | lon[1], lat[2] | lon[2],
+    };
+}
+
+/// Key ranges
+///
+/// The cell given by a key prefix holds a contiguous range of full 64-bit keys, so a sorted
+/// key array answers cell queries with range scans.
+
+/// Half-open range [begin, end) of 64-bit keys, end 0 stands for 2^64
+struct key_range {
+    uint64_t begin=0;
+    uint64_t end=0;
+
+    constexpr bool contains(uint64_t key) const { return key>=begin && (end==0 || key<end); }
+};
+
+constexpr bool operator==(const key_range &r1, const key_range &r2) {
+    return r1.begin==r2.begin && r1.end==r2.end;
+}
+
+constexpr bool operator!=(const key_range &r1, const key_range &r2) {
+    return !(r1==r2);
+}
+
+/// Keys of the cell given by the top bit_count bits of a key
+constexpr key_range cell_range(uint64_t key, size_t bit_count) {
+    if (bit_count==0) {
+        return key_range{0, 0};
+    }
+    uint64_t size=1ull<<(64-std::min(bit_count, MAX_BINHASH_LENGTH));
+    uint64_t begin=key & ~(size-1);
+    return key_range{begin, begin+size};
+}
+
+/// Sort ranges and merge the overlapping or adjacent ones, in place
+void coalesce(std::vector<key_range> &ranges);
+
 /// Binary hash code
 struct binary_hash {
     binary_hash()=default;
-    binary_hash(uint64_t b, size_t p) : bits(b), precision(p) {}
+    constexpr binary_hash(uint64_t b, size_t p) : bits(b), precision(p) {}
     binary_hash(const std::string &bit_string);
     binary_hash(geolocation l, double dist);
 
     static binary_hash from_geohash(const std::string &hash);
     
-    size_t size() const { return precision; }
-    bool empty() const { return size()==0; }
-    bool test(size_t n) const { return (bits & (1ull << (precision-n)))!=0; }
-    void push_back(bool b) { bits<<=1; bits|=(b?1:0); precision++; }
+    constexpr size_t size() const { return precision; }
+    constexpr bool empty() const { return size()==0; }
+    /// Bit n counting from 1, the most significant, false past the precision
+    constexpr bool test(size_t n) const { return n>=1 && n<=precision && ((bits>>(precision-n)) & 1)!=0; }
+    /// Append bit b, throws std::invalid_argument past MAX_BINHASH_LENGTH
+    constexpr void push_back(bool b) {
+        if (precision>=MAX_BINHASH_LENGTH) {
+            throw std::invalid_argument("binary hash is at most MAX_BINHASH_LENGTH bits");
+        }
+        bits<<=1;
+        bits|=(b?1:0);
+        precision++;
+    }
 
     operator std::string() const { return to_string(); }
     
@@ -134,42 +382,238 @@ struct binary_hash {
     size_t precision=0;
 };
 
-inline bool operator==(const binary_hash &b1, const binary_hash &b2) {
+constexpr bool operator==(const binary_hash &b1, const binary_hash &b2) {
     return b1.empty() ? b2.empty() : (b1.bits==b2.bits && b1.precision==b2.precision);
 }
 
-inline bool operator!=(const binary_hash &b1, const binary_hash &b2) {
+constexpr bool operator!=(const binary_hash &b1, const binary_hash &b2) {
     return !(b1==b2);
 }
 
 /// Required precision to represent the area
 size_t binary_hash_precision(geolocation l, double dist);
 /// Binary encode with specific precision
-binary_hash binary_encode(geolocation l, size_t bit_count);
+constexpr binary_hash binary_encode(geolocation l, size_t bit_count) {
+    bit_count=std::min(bit_count, MAX_BINHASH_LENGTH);
+    if (bit_count==0) {
+        return binary_hash();
+    }
+    return binary_hash(encode_key(l)>>(64-bit_count), bit_count);
+}
 /// Decode binary code into a bounding box
-bounding_box decode(const binary_hash &bits);
+constexpr bounding_box decode(const binary_hash &hash) {
+    size_t bit_count=std::min(hash.size(), MAX_BINHASH_LENGTH);
+    if (bit_count==0) {
+        return bounding_box();
+    }
+    return decode_key(hash.bits<<(64-bit_count), bit_count);
+}
 /// Get the neighbor on specific direction of this binary code
-inline binary_hash neighbor(const binary_hash &hash,
+constexpr binary_hash neighbor(const binary_hash &hash,
                             const std::pair<int, int> &direction)
 {
-    bounding_box b=decode(hash);
-    geolocation cp=b.center();
-    cp.latitude += direction.first * b.lat_range();
-    cp.longitude += direction.second * b.lon_range();
-    return binary_encode(cp, hash.size());
+    if (hash.empty()) {
+        return hash;
+    }
+    uint64_t key=neighbor_key(hash.bits<<(64-hash.size()), hash.size(), direction.first, direction.second);
+    return binary_hash(key>>(64-hash.size()), hash.size());
+}
+
+/// Get all 8 neighbors, in the same order as hash_codes
+constexpr std::array<binary_hash, 8> neighbors(const binary_hash &hash) {
+    std::array<binary_hash, 8> output{};
+    if (hash.empty()) {
+        for (binary_hash &h : output) {
+            h=hash;
+        }
+        return output;
+    }
+    std::array<uint64_t, 8> keys=neighbor_keys(hash.bits<<(64-hash.size()), hash.size());
+    for (size_t i=0; i<8; i++) {
+        output[i]=binary_hash(keys[i]>>(64-hash.size()), hash.size());
+    }
+    return output;
 }
 
 /// Base32 hash string
 std::string encode(geolocation l, size_t precision);
 bounding_box decode(const std::string &hash);
-inline std::string neighbor(const std::string &hash,
-                            const std::pair<int, int> &direction)
+std::string neighbor(const std::string &hash,
+                     const std::pair<int, int> &direction);
+std::array<std::string, 8> neighbors(const std::string &hash);
+
+/// Result of try_decode, the box of a valid hash or where an invalid one goes wrong
+struct decode_result {
+    bounding_box box;
+    /// First character outside the base32 alphabet, npos when the hash is valid
+    size_t error_position=std::string_view::npos;
+
+    constexpr bool ok() const { return error_position==std::string_view::npos; }
+    constexpr explicit operator bool() const { return ok(); }
+};
+
+/// First character of a hash outside the base32 alphabet, in either case, npos if there is none.
+/// Checks 8 characters at a time with word arithmetic, without a branch per character.
+size_t find_invalid_char(std::string_view hash) noexcept;
+
+/// Decode like decode(), but report invalid characters instead of throwing, never allocates
+decode_result try_decode(std::string_view hash) noexcept;
+/// Decode count hashes into output, returns how many of them were valid
+size_t try_decode(const std::string_view *hashes, size_t count, decode_result *output) noexcept;
+
+/// Base32 hash code stored inline, never allocates
+/// Characters past the length are always zero, so the hash can be compared as raw bytes
+struct geohash {
+    /// Encode with specific precision, capped at MAX_GEOHASH_LENGTH
+    static constexpr geohash encode(geolocation l, size_t precision) {
+        return from_key(encode_key(l), precision);
+    }
+
+    /// Hash of the top 5*precision bits of a 64-bit key
+    static constexpr geohash from_key(uint64_t key, size_t precision) {
+        geohash output;
+        output.length=uint8_t(std::min(precision, MAX_GEOHASH_LENGTH));
+        for (size_t i=0; i<output.length; i++) {
+            output.chars[i]=base32_codes[(key>>(59-5*i)) & 0x1f];
+        }
+        return output;
+    }
+
+    /// Parse a hash, upper case characters are folded to lower case
+    static constexpr geohash from_string(std::string_view hash) {
+        if (hash.size()>MAX_GEOHASH_LENGTH) {
+            throw std::invalid_argument("Invalid geohash");
+        }
+        geohash output;
+        output.length=uint8_t(hash.size());
+        for (size_t i=0; i<hash.size(); i++) {
+            char c=hash[i];
+            int char_index=(c>='0' && c<='z') ? base32_indexes[c-'0'] : -1;
+            if (char_index<0) {
+                throw std::invalid_argument("Invalid geohash");
+            }
+            output.chars[i]=base32_codes[char_index];
+        }
+        return output;
+    }
+
+    constexpr size_t size() const { return length; }
+    constexpr bool empty() const { return length==0; }
+    constexpr const char *data() const { return chars; }
+    constexpr char operator[](size_t n) const { return chars[n]; }
+
+    /// Left-aligned interleaved key of the hash bits
+    constexpr uint64_t key() const {
+        uint64_t k=0;
+        for (size_t i=0; i<length; i++) {
+            k=(k<<5) | uint64_t(base32_indexes[chars[i]-'0']);
+        }
+        return length ? k<<(64-5*length) : 0;
+    }
+
+    constexpr std::string_view view() const { return std::string_view(chars, length); }
+    constexpr operator std::string_view() const { return view(); }
+    operator std::string() const { return to_string(); }
+    std::string to_string() const { return std::string(chars, length); }
+
+    char chars[MAX_GEOHASH_LENGTH]={};
+    uint8_t length=0;
+};
+
+constexpr bool operator==(const geohash &h1, const geohash &h2) {
+    return std::char_traits<char>::compare(h1.chars, h2.chars, MAX_GEOHASH_LENGTH)==0;
+}
+
+constexpr bool operator!=(const geohash &h1, const geohash &h2) {
+    return !(h1==h2);
+}
+
+/// Same order as the hash strings, zero padding sorts before any character
+constexpr bool operator<(const geohash &h1, const geohash &h2) {
+    return std::char_traits<char>::compare(h1.chars, h2.chars, MAX_GEOHASH_LENGTH)<0;
+}
+
+namespace std {
+template<>
+struct hash<geohash> {
+    size_t operator()(const geohash &h) const {
+        uint64_t head, tail=0;
+        std::memcpy(&head, h.chars, 8);
+        std::memcpy(&tail, h.chars+8, 4);
+        uint64_t x=head*0x9e3779b97f4a7c15ull ^ tail;
+        x^=x>>33;
+        x*=0xff51afd7ed558ccdull;
+        x^=x>>33;
+        return size_t(x);
+    }
+};
+}
+
+constexpr bounding_box decode(const geohash &hash) {
+    return decode_key(hash.key(), 5*hash.size());
+}
+
+constexpr geohash neighbor(const geohash &hash,
+                        const std::pair<int, int> &direction)
 {
-    bounding_box b=decode(hash);
-    geolocation cp=b.center();
-    cp.latitude += direction.first * b.lat_range();
-    cp.longitude += direction.second * b.lon_range();
-    return encode(cp, hash.size());
+    size_t bits=5*hash.size();
+    return geohash::from_key(neighbor_key(hash.key(), bits, direction.first, direction.second), hash.size());
+}
+
+constexpr std::array<geohash, 8> neighbors(const geohash &hash) {
+    std::array<uint64_t, 8> keys=neighbor_keys(hash.key(), 5*hash.size());
+    std::array<geohash, 8> output{};
+    for (size_t i=0; i<8; i++) {
+        output[i]=geohash::from_key(keys[i], hash.size());
+    }
+    return output;
+}
+
+/// Fixed precision
+///
+/// The precision is a template argument, so the character loop unrolls and precision checks
+/// fail at compile time. Like the rest of the core they are constexpr, tables of hashes can
+/// be built by the compiler.
+
+/// Encode with N characters
+template<size_t N>
+constexpr geohash encode(geolocation l) {
+    static_assert(N<=MAX_GEOHASH_LENGTH, "geohash precision is at most MAX_GEOHASH_LENGTH");
+    return geohash::from_key(encode_key(l), N);
+}
+
+/// Binary encode with Bits bits
+template<size_t Bits>
+constexpr binary_hash binary_encode(geolocation l) {
+    static_assert(Bits<=MAX_BINHASH_LENGTH, "binary hash precision is at most MAX_BINHASH_LENGTH");
+    if constexpr (Bits==0) {
+        return binary_hash();
+    } else {
+        return binary_hash(encode_key(l)>>(64-Bits), Bits);
+    }
+}
+
+/// Decode a hash of exactly N characters, throws std::invalid_argument otherwise
+template<size_t N>
+constexpr bounding_box decode(std::string_view hash) {
+    static_assert(N<=MAX_GEOHASH_LENGTH, "geohash precision is at most MAX_GEOHASH_LENGTH");
+    if (hash.size()!=N) {
+        throw std::invalid_argument("Invalid geohash");
+    }
+    uint64_t key=0;
+    for (size_t i=0; i<N; i++) {
+        char c=hash[i];
+        int char_index=(c>='0' && c<='z') ? base32_indexes[c-'0'] : -1;
+        if (char_index<0) {
+            throw std::invalid_argument("Invalid geohash");
+        }
+        key=(key<<5) | uint64_t(char_index);
+    }
+    if constexpr (N==0) {
+        return bounding_box();
+    } else {
+        return decode_key(key<<(64-5*N), 5*N);
+    }
 }
 
 /// Encode with specific ranges
@@ -180,7 +624,11 @@ void encode_precision_range(geolocation l,
                             size_t range_smallest=MAX_GEOHASH_LENGTH)
 {
     for (size_t n=range_largest; n<range_smallest+1; n++) {
-        *i++=encode(l, n);
+        if constexpr (std::is_same<typename Container::value_type, geohash>::value) {
+            *i++=geohash::encode(l, n);
+        } else {
+            *i++=encode(l, n);
+        }
     }
 }
 
@@ -199,6 +647,10 @@ inline bool hash_contains(const std::string &hash, geolocation l) {
     return decode(hash).contains(l);
 }
 
+constexpr bool hash_contains(const geohash &hash, geolocation l) {
+    return decode(hash).contains(l);
+}
+
 /// Returns hash precision for given location and distance range
 size_t hash_precision(geolocation l, double dist);
 
@@ -209,18 +661,17 @@ std::string base_hash(geolocation l, double dist);
 
 /// Get the minimal geohash and its neighbors for given location and range
 /// Returns 9 geohash codes instead of one big box, which contains 32 smaller boxes
+inline std::array<geohash, 9> hash_codes(geolocation l, double dist) {
+    geohash hash=geohash::encode(l, hash_precision(l, dist));
+    std::array<geohash, 8> n=neighbors(hash);
+    return { n[0], n[1], n[2], n[3], n[4], n[5], n[6], n[7], hash };
+}
+
 template<typename Container>
 void hash_codes(geolocation l, double dist, std::back_insert_iterator<Container> i) {
-    std::string hash=base_hash(l, dist);
-    *i++=neighbor(hash, {-1, -1});
-    *i++=neighbor(hash, {-1,  0});
-    *i++=neighbor(hash, {-1,  1});
-    *i++=neighbor(hash, { 0, -1});
-    *i++=neighbor(hash, { 0,  1});
-    *i++=neighbor(hash, { 1, -1});
-    *i++=neighbor(hash, { 1,  0});
-    *i++=neighbor(hash, { 1,  1});
-    *i++=std::move(hash);
+    for (const geohash &hash : hash_codes(l, dist)) {
+        *i++=hash;
+    }
 }
 
 template<typename Container>
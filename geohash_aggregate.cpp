@@ -0,0 +1,177 @@
+//
+//  geohash_aggregate.cpp
+//
+//  Per cell totals in dense or open addressing tables, merged and rolled up in key order.
+//
+
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include "geohash_aggregate.hpp"
+#include "geohash_batch.hpp"
+
+/// Locations encoded per call of the batch encoder
+constexpr size_t AGGREGATE_BATCH=256;
+/// Entries of a new sparse table, a power of 2
+constexpr size_t AGGREGATE_SPARSE_INITIAL=1024;
+/// Events a worker gets at least, fewer are not worth a thread
+constexpr size_t AGGREGATE_MIN_SLICE=65536;
+
+geohash_aggregator::geohash_aggregator(size_t bit_count)
+: bits(std::min(bit_count, MAX_BINHASH_LENGTH))
+, dense(bits<=AGGREGATE_DENSE_BITS)
+, entries(dense ? size_t(1)<<bits : AGGREGATE_SPARSE_INITIAL, totals{0, 0, 0, 0, 0})
+{
+}
+
+void geohash_aggregator::add(const totals &t) {
+    totals *e;
+    if (dense) {
+        e=&entries[t.cell];
+    } else {
+        // Linear probing, the table is kept at most half full
+        if (2*(used+1)>entries.size()) {
+            grow();
+        }
+        size_t mask=entries.size()-1;
+        size_t i=slot(t.cell);
+        while (entries[i].count!=0 && entries[i].cell!=t.cell) {
+            i=(i+1) & mask;
+        }
+        e=&entries[i];
+    }
+    if (e->count==0) {
+        *e=t;
+        used++;
+        return;
+    }
+    e->count+=t.count;
+    e->sum+=t.sum;
+    e->min=std::min(e->min, t.min);
+    e->max=std::max(e->max, t.max);
+}
+
+void geohash_aggregator::grow() {
+    std::vector<totals> old_entries(entries.size()*2, totals{0, 0, 0, 0, 0});
+    old_entries.swap(entries);
+    used=0;
+    for (const totals &t : old_entries) {
+        if (t.count!=0) {
+            add(t);
+        }
+    }
+}
+
+void geohash_aggregator::add(geolocation l, double value) {
+    add(totals{binary_encode(l, bits).bits, 1, value, value, value});
+}
+
+void geohash_aggregator::add(const geolocation *locations, const double *values, size_t count) {
+    uint64_t cells[AGGREGATE_BATCH];
+    for (size_t begin=0; begin<count; begin+=AGGREGATE_BATCH) {
+        size_t n=std::min(count-begin, AGGREGATE_BATCH);
+        binary_encode(locations+begin, n, bits, cells);
+        for (size_t i=0; i<n; i++) {
+            double v=values[begin+i];
+            add(totals{cells[i], 1, v, v, v});
+        }
+    }
+}
+
+void geohash_aggregator::merge(const geohash_aggregator &other) {
+    if (other.bits!=bits) {
+        throw std::invalid_argument("geohash_aggregator: merging different precisions");
+    }
+    // Adding may grow the table, so merging into itself reads a copy of the entries
+    if (&other==this) {
+        std::vector<totals> copy=entries;
+        for (const totals &t : copy) {
+            if (t.count!=0) {
+                add(t);
+            }
+        }
+        return;
+    }
+    for (const totals &t : other.entries) {
+        if (t.count!=0) {
+            add(t);
+        }
+    }
+}
+
+std::vector<cell_aggregate> geohash_aggregator::cells() const {
+    std::vector<cell_aggregate> output;
+    output.reserve(used);
+    for (const totals &t : entries) {
+        if (t.count!=0) {
+            output.push_back(cell_aggregate{binary_hash(t.cell, bits), t.count, t.sum, t.min, t.max});
+        }
+    }
+    // Dense tables are in key order already, at one precision the bits order the keys
+    if (!dense) {
+        std::sort(output.begin(), output.end(), [](const cell_aggregate &a, const cell_aggregate &b) {
+            return a.cell.bits<b.cell.bits;
+        });
+    }
+    return output;
+}
+
+std::vector<cell_aggregate> rollup(const std::vector<cell_aggregate> &cells, size_t bit_count) {
+    std::vector<cell_aggregate> output;
+    for (const cell_aggregate &c : cells) {
+        size_t from=c.cell.size();
+        if (bit_count>from) {
+            throw std::invalid_argument("rollup: cells are coarser than the rollup");
+        }
+        // The parent is a prefix, so children in key order are runs of one parent
+        uint64_t parent=bit_count==0 ? 0 : c.cell.bits>>(from-bit_count);
+        if (!output.empty() && output.back().cell.bits==parent) {
+            cell_aggregate &o=output.back();
+            o.count+=c.count;
+            o.sum+=c.sum;
+            o.min=std::min(o.min, c.min);
+            o.max=std::max(o.max, c.max);
+        } else {
+            output.push_back(cell_aggregate{binary_hash(parent, bit_count), c.count, c.sum, c.min, c.max});
+        }
+    }
+    return output;
+}
+
+std::vector<cell_aggregate> aggregate(const geolocation *locations, const double *values, size_t count,
+                                      size_t bit_count, size_t threads)
+{
+    size_t workers=threads ? threads : std::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+    workers=std::max(std::min(workers, count/AGGREGATE_MIN_SLICE), size_t(1));
+    std::vector<geohash_aggregator> aggregators(workers, geohash_aggregator(bit_count));
+    std::mutex error_lock;
+    std::exception_ptr error;
+    auto work=[&](size_t w) {
+        try {
+            size_t begin=count*w/workers, end=count*(w+1)/workers;
+            aggregators[w].add(locations+begin, values+begin, end-begin);
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(error_lock);
+            if (!error) {
+                error=std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t w=1; w<workers; w++) {
+        pool.emplace_back(work, w);
+    }
+    work(0);
+    for (std::thread &t : pool) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    for (size_t w=1; w<workers; w++) {
+        aggregators[0].merge(aggregators[w]);
+    }
+    return aggregators[0].cells();
+}
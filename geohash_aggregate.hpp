@@ -0,0 +1,105 @@
+//
+//  geohash_aggregate.hpp
+//
+//  Counts, sums and extremes of values per cell, rolled up to coarser cells by key shifting.
+//
+
+#ifndef geohash_aggregate_hpp_included
+#define geohash_aggregate_hpp_included
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "geohash.hpp"
+
+/// Values of the events in one cell
+struct cell_aggregate {
+    binary_hash cell;
+    uint64_t count;
+    double sum;
+    double min;
+    double max;
+
+    double mean() const { return sum/double(count); }
+};
+
+/// Cells at most this fine are kept in a dense table, 2^16 cells of 40 bytes
+constexpr size_t AGGREGATE_DENSE_BITS=16;
+
+/// Accumulates events per cell of bit_count bits
+///
+/// Coarse precisions use a table of every cell, finer ones an open addressing table of the
+/// cells seen. One aggregator belongs to one thread, parallel work gives each thread its own
+/// and merges them at the end, see aggregate().
+class geohash_aggregator {
+public:
+    /// Cells of bit_count bits, capped at 64
+    explicit geohash_aggregator(size_t bit_count);
+
+    size_t bit_count() const { return bits; }
+    /// Cells with at least one event
+    size_t size() const { return used; }
+
+    void add(geolocation l, double value);
+    /// Add count events, value[i] at locations[i]
+    void add(const geolocation *locations, const double *values, size_t count);
+    /// Throws std::invalid_argument when the vectors differ in size
+    void add(const std::vector<geolocation> &locations, const std::vector<double> &values) {
+        if (locations.size()!=values.size()) {
+            throw std::invalid_argument("geohash_aggregator: locations and values differ in size");
+        }
+        add(locations.data(), values.data(), locations.size());
+    }
+
+    /// Add the events of another aggregator, throws std::invalid_argument when its
+    /// precision differs
+    void merge(const geohash_aggregator &other);
+
+    /// Cells with events, in key order
+    std::vector<cell_aggregate> cells() const;
+
+private:
+    struct totals {
+        uint64_t cell;
+        uint64_t count;
+        double sum;
+        double min;
+        double max;
+    };
+
+    void add(const totals &t);
+    /// Home entry of a cell in a sparse table
+    size_t slot(uint64_t cell) const {
+        return size_t((cell*0x9E3779B97F4A7C15)>>(64-__builtin_ctzll(entries.size())));
+    }
+    void grow();
+
+    size_t bits;
+    size_t used=0;
+    bool dense;
+    /// Dense tables are indexed by cell, sparse ones by a hash of it, count 0 marks free entries
+    std::vector<totals> entries;
+};
+
+/// Roll cells in key order, all of one precision, up to cells of bit_count bits, the output
+/// is in key order. Throws std::invalid_argument when bit_count is finer than the cells.
+std::vector<cell_aggregate> rollup(const std::vector<cell_aggregate> &cells, size_t bit_count);
+
+/// Aggregate count events into cells of bit_count bits on threads workers, 0 for one per
+/// hardware thread. Each worker fills its own aggregator from a slice of the events,
+/// the aggregators are merged once at the end. Returns the cells in key order.
+std::vector<cell_aggregate> aggregate(const geolocation *locations, const double *values, size_t count,
+                                      size_t bit_count, size_t threads=0);
+
+/// Throws std::invalid_argument when the vectors differ in size
+inline std::vector<cell_aggregate> aggregate(const std::vector<geolocation> &locations, const std::vector<double> &values,
+                                             size_t bit_count, size_t threads=0)
+{
+    if (locations.size()!=values.size()) {
+        throw std::invalid_argument("aggregate: locations and values differ in size");
+    }
+    return aggregate(locations.data(), values.data(), locations.size(), bit_count, threads);
+}
+
+#endif
@@ -0,0 +1,695 @@
+//
+//  geohash_batch.cpp
+//
+//  Batch encoding over arrays of locations, with SIMD kernels selected at runtime.
+//
+
+#include <atomic>
+#include <cstring>
+#include "geohash_batch.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define GEOHASH_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+static_assert(sizeof(geolocation)==2*sizeof(double), "geolocation must be 2 packed doubles");
+
+////////////////////////////////////////////////////////////////////////////////
+// dispatch
+////////////////////////////////////////////////////////////////////////////////
+
+simd_level detect_simd_level() {
+#if defined(GEOHASH_X86_KERNELS)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return simd_level::avx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return simd_level::avx2;
+    }
+#endif
+    return simd_level::scalar;
+}
+
+static std::atomic<int> &current_level() {
+    static std::atomic<int> level{int(detect_simd_level())};
+    return level;
+}
+
+simd_level active_simd_level() {
+    return simd_level(current_level().load(std::memory_order_relaxed));
+}
+
+simd_level set_simd_level(simd_level level) {
+    level=simd_level(std::min(int(level), int(detect_simd_level())));
+    current_level().store(int(level), std::memory_order_relaxed);
+    return level;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// kernels
+////////////////////////////////////////////////////////////////////////////////
+
+// All kernels write full 64-bit keys, callers shift or pack them. The vector kernels clear
+// the upper halves of the registers before their scalar tails, GCC does not do it before a
+// tail call, and dirty upper halves slow down every later SSE instruction of the process.
+
+static void encode_keys_scalar(const double *lat, const double *lon, size_t count, uint64_t *keys) {
+    for (size_t i=0; i<count; i++) {
+        keys[i]=interleave(quantize_longitude(lon[i]), quantize_latitude(lat[i]));
+    }
+}
+
+static void encode_keys_scalar(const geolocation *l, size_t count, uint64_t *keys) {
+    for (size_t i=0; i<count; i++) {
+        keys[i]=encode_key(l[i]);
+    }
+}
+
+#if defined(GEOHASH_X86_KERNELS)
+
+// Same steps as quantize(), 4 lanes at a time
+__attribute__((target("avx2")))
+static inline __m256i quantize_avx2(__m256d x, double lo, double range) {
+    const double cells=4294967296.0;
+    const __m256d vlo=_mm256_set1_pd(lo);
+    const __m256d step=_mm256_set1_pd(range/cells);
+    const __m256d last=_mm256_set1_pd(cells-1);
+    const __m256d zero=_mm256_setzero_pd();
+    const __m256d one=_mm256_set1_pd(1);
+    // max/min return the second operand for NaN, which maps NaN to cell 0
+    __m256d t=_mm256_mul_pd(_mm256_sub_pd(x, vlo), _mm256_set1_pd(cells/range));
+    t=_mm256_min_pd(_mm256_max_pd(t, zero), last);
+    __m256d m=_mm256_floor_pd(t);
+    __m256d up=_mm256_and_pd(_mm256_cmp_pd(m, last, _CMP_LT_OQ),
+                             _mm256_cmp_pd(x, _mm256_add_pd(vlo, _mm256_mul_pd(_mm256_add_pd(m, one), step)), _CMP_GT_OQ));
+    m=_mm256_add_pd(m, _mm256_and_pd(up, one));
+    __m256d down=_mm256_andnot_pd(_mm256_cmp_pd(x, _mm256_add_pd(vlo, _mm256_mul_pd(m, step)), _CMP_GT_OQ),
+                                  _mm256_cmp_pd(m, zero, _CMP_GT_OQ));
+    m=_mm256_sub_pd(m, _mm256_and_pd(down, one));
+    // m is an integer below 2^32, adding 2^52 leaves it in the low mantissa bits
+    const __m256d magic=_mm256_set1_pd(4503599627370496.0);
+    return _mm256_xor_si256(_mm256_castpd_si256(_mm256_add_pd(m, magic)), _mm256_castpd_si256(magic));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i spread_avx2(__m256i x) {
+    x=_mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 16)), _mm256_set1_epi64x(0x0000ffff0000ffffll));
+    x=_mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 8)), _mm256_set1_epi64x(0x00ff00ff00ff00ffll));
+    x=_mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 4)), _mm256_set1_epi64x(0x0f0f0f0f0f0f0f0fll));
+    x=_mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 2)), _mm256_set1_epi64x(0x3333333333333333ll));
+    x=_mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 1)), _mm256_set1_epi64x(0x5555555555555555ll));
+    return x;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i encode_avx2(__m256d lat, __m256d lon) {
+    __m256i qlon=spread_avx2(quantize_avx2(lon, -180, 360));
+    __m256i qlat=spread_avx2(quantize_avx2(lat, -90, 180));
+    return _mm256_or_si256(_mm256_slli_epi64(qlon, 1), qlat);
+}
+
+__attribute__((target("avx2")))
+static void encode_keys_avx2(const double *lat, const double *lon, size_t count, uint64_t *keys) {
+    size_t i=0;
+    for (; i+4<=count; i+=4) {
+        __m256i k=encode_avx2(_mm256_loadu_pd(lat+i), _mm256_loadu_pd(lon+i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(keys+i), k);
+    }
+    _mm256_zeroupper();
+    encode_keys_scalar(lat+i, lon+i, count-i, keys+i);
+}
+
+__attribute__((target("avx2")))
+static void encode_keys_avx2(const geolocation *l, size_t count, uint64_t *keys) {
+    size_t i=0;
+    for (; i+4<=count; i+=4) {
+        const double *p=&l[i].latitude;
+        __m256d a=_mm256_loadu_pd(p);     // lat0 lon0 lat1 lon1
+        __m256d b=_mm256_loadu_pd(p+4);   // lat2 lon2 lat3 lon3
+        __m256d lat=_mm256_permute4x64_pd(_mm256_unpacklo_pd(a, b), 0xd8);
+        __m256d lon=_mm256_permute4x64_pd(_mm256_unpackhi_pd(a, b), 0xd8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(keys+i), encode_avx2(lat, lon));
+    }
+    _mm256_zeroupper();
+    encode_keys_scalar(l+i, count-i, keys+i);
+}
+
+// Same steps as quantize(), 8 lanes at a time
+__attribute__((target("avx512f")))
+static inline __m512i quantize_avx512(__m512d x, double lo, double range) {
+    const double cells=4294967296.0;
+    const __m512d vlo=_mm512_set1_pd(lo);
+    const __m512d step=_mm512_set1_pd(range/cells);
+    const __m512d last=_mm512_set1_pd(cells-1);
+    const __m512d zero=_mm512_setzero_pd();
+    const __m512d one=_mm512_set1_pd(1);
+    __m512d t=_mm512_mul_pd(_mm512_sub_pd(x, vlo), _mm512_set1_pd(cells/range));
+    t=_mm512_min_pd(_mm512_max_pd(t, zero), last);
+    __m512d m=_mm512_roundscale_pd(t, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    __mmask8 up=_mm512_cmp_pd_mask(m, last, _CMP_LT_OQ)
+        & _mm512_cmp_pd_mask(x, _mm512_add_pd(vlo, _mm512_mul_pd(_mm512_add_pd(m, one), step)), _CMP_GT_OQ);
+    m=_mm512_mask_add_pd(m, up, m, one);
+    __mmask8 down=_mm512_cmp_pd_mask(m, zero, _CMP_GT_OQ)
+        & ~_mm512_cmp_pd_mask(x, _mm512_add_pd(vlo, _mm512_mul_pd(m, step)), _CMP_GT_OQ);
+    m=_mm512_mask_sub_pd(m, down, m, one);
+    const __m512d magic=_mm512_set1_pd(4503599627370496.0);
+    return _mm512_xor_si512(_mm512_castpd_si512(_mm512_add_pd(m, magic)), _mm512_castpd_si512(magic));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i spread_avx512(__m512i x) {
+    x=_mm512_and_si512(_mm512_or_si512(x, _mm512_slli_epi64(x, 16)), _mm512_set1_epi64(0x0000ffff0000ffffll));
+    x=_mm512_and_si512(_mm512_or_si512(x, _mm512_slli_epi64(x, 8)), _mm512_set1_epi64(0x00ff00ff00ff00ffll));
+    x=_mm512_and_si512(_mm512_or_si512(x, _mm512_slli_epi64(x, 4)), _mm512_set1_epi64(0x0f0f0f0f0f0f0f0fll));
+    x=_mm512_and_si512(_mm512_or_si512(x, _mm512_slli_epi64(x, 2)), _mm512_set1_epi64(0x3333333333333333ll));
+    x=_mm512_and_si512(_mm512_or_si512(x, _mm512_slli_epi64(x, 1)), _mm512_set1_epi64(0x5555555555555555ll));
+    return x;
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i encode_avx512(__m512d lat, __m512d lon) {
+    __m512i qlon=spread_avx512(quantize_avx512(lon, -180, 360));
+    __m512i qlat=spread_avx512(quantize_avx512(lat, -90, 180));
+    return _mm512_or_si512(_mm512_slli_epi64(qlon, 1), qlat);
+}
+
+__attribute__((target("avx512f")))
+static void encode_keys_avx512(const double *lat, const double *lon, size_t count, uint64_t *keys) {
+    size_t i=0;
+    for (; i+8<=count; i+=8) {
+        _mm512_storeu_si512(keys+i, encode_avx512(_mm512_loadu_pd(lat+i), _mm512_loadu_pd(lon+i)));
+    }
+    _mm256_zeroupper();
+    encode_keys_scalar(lat+i, lon+i, count-i, keys+i);
+}
+
+__attribute__((target("avx512f")))
+static void encode_keys_avx512(const geolocation *l, size_t count, uint64_t *keys) {
+    const __m512i even=_mm512_set_epi64(14, 12, 10, 8, 6, 4, 2, 0);
+    const __m512i odd=_mm512_set_epi64(15, 13, 11, 9, 7, 5, 3, 1);
+    size_t i=0;
+    for (; i+8<=count; i+=8) {
+        const double *p=&l[i].latitude;
+        __m512d a=_mm512_loadu_pd(p);
+        __m512d b=_mm512_loadu_pd(p+8);
+        __m512d lat=_mm512_permutex2var_pd(a, even, b);
+        __m512d lon=_mm512_permutex2var_pd(a, odd, b);
+        _mm512_storeu_si512(keys+i, encode_avx512(lat, lon));
+    }
+    _mm256_zeroupper();
+    encode_keys_scalar(l+i, count-i, keys+i);
+}
+
+#endif
+
+static void encode_keys(const double *lat, const double *lon, size_t count, uint64_t *keys) {
+    switch (active_simd_level()) {
+#if defined(GEOHASH_X86_KERNELS)
+        case simd_level::avx512:
+            return encode_keys_avx512(lat, lon, count, keys);
+        case simd_level::avx2:
+            return encode_keys_avx2(lat, lon, count, keys);
+#endif
+        default:
+            return encode_keys_scalar(lat, lon, count, keys);
+    }
+}
+
+static void encode_keys(const geolocation *l, size_t count, uint64_t *keys) {
+    switch (active_simd_level()) {
+#if defined(GEOHASH_X86_KERNELS)
+        case simd_level::avx512:
+            return encode_keys_avx512(l, count, keys);
+        case simd_level::avx2:
+            return encode_keys_avx2(l, count, keys);
+#endif
+        default:
+            return encode_keys_scalar(l, count, keys);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// batch API
+////////////////////////////////////////////////////////////////////////////////
+
+static void shift_keys(uint64_t *keys, size_t count, size_t bit_count) {
+    if (bit_count>=MAX_BINHASH_LENGTH) {
+        return;
+    }
+    // A shift by 64 is undefined, an empty hash has no bits
+    const unsigned shift=unsigned(64-bit_count);
+    for (size_t i=0; i<count; i++) {
+        keys[i]=shift<64 ? keys[i]>>shift : 0;
+    }
+}
+
+/// Map 5-bit values held in the bytes of a word to base32 characters, without table lookups
+static inline uint64_t base32_chars(uint64_t v) {
+    const uint64_t ones=0x0101010101010101ull;
+    // Bit 7 of v+128-t is set in bytes with a value >= t, values are below 32 so nothing carries
+    uint64_t ge10=((v+0x76*ones)>>7) & ones;
+    uint64_t ge17=((v+0x6f*ones)>>7) & ones;
+    uint64_t ge19=((v+0x6d*ones)>>7) & ones;
+    uint64_t ge21=((v+0x6b*ones)>>7) & ones;
+    // '0'..'9', then 'b'..'h', 'j'..'k', 'm'..'n', 'p'..'z'
+    return v+'0'*ones+40*ge10+ge17+ge19+ge21;
+}
+
+/// Spread 8 5-bit groups of a 40-bit value into bytes, most significant group in the lowest byte
+static inline uint64_t spread_groups(uint64_t x) {
+    x=((x & 0x000000fffff00000ull)<<12) | (x & 0x00000000000fffffull);
+    x=((x & 0x000ffc00000ffc00ull)<<6)  | (x & 0x000003ff000003ffull);
+    x=((x & 0x03e003e003e003e0ull)<<3)  | (x & 0x001f001f001f001full);
+#if __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+    x=__builtin_bswap64(x);
+#endif
+    return x;
+}
+
+static void pack_base32(const uint64_t *keys, size_t count, size_t precision, char *output) {
+    const char *end=output+count*precision;
+    for (size_t i=0; i<count; i++) {
+        // Characters 0..7 come from key bits 63..24, 8..11 from bits 23..4
+        uint64_t head=base32_chars(spread_groups(keys[i]>>24));
+        uint64_t tail=base32_chars(spread_groups((keys[i]>>4) & 0xfffff)>>32);
+        // Rows are written in order, spilling into the next row is harmless until the last ones
+        if (end-output>=16) {
+            std::memcpy(output, &head, 8);
+            std::memcpy(output+8, &tail, 8);
+        } else {
+            char chars[16];
+            std::memcpy(chars, &head, 8);
+            std::memcpy(chars+8, &tail, 8);
+            std::memcpy(output, chars, precision);
+        }
+        output+=precision;
+    }
+}
+
+#if defined(GEOHASH_X86_KERNELS)
+
+// Same steps as pack_base32, 4 keys at a time
+__attribute__((target("avx2")))
+static inline __m256i base32_chars_avx2(__m256i v) {
+    __m256i c=_mm256_add_epi8(v, _mm256_set1_epi8('0'));
+    // Signed byte compares are fine, values are below 32
+    c=_mm256_add_epi8(c, _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(9)), _mm256_set1_epi8(40)));
+    c=_mm256_sub_epi8(c, _mm256_cmpgt_epi8(v, _mm256_set1_epi8(16)));
+    c=_mm256_sub_epi8(c, _mm256_cmpgt_epi8(v, _mm256_set1_epi8(18)));
+    c=_mm256_sub_epi8(c, _mm256_cmpgt_epi8(v, _mm256_set1_epi8(20)));
+    return c;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i spread_groups_avx2(__m256i x) {
+    x=_mm256_or_si256(_mm256_slli_epi64(_mm256_and_si256(x, _mm256_set1_epi64x(0x000000fffff00000ll)), 12),
+                      _mm256_and_si256(x, _mm256_set1_epi64x(0x00000000000fffffll)));
+    x=_mm256_or_si256(_mm256_slli_epi64(_mm256_and_si256(x, _mm256_set1_epi64x(0x000ffc00000ffc00ll)), 6),
+                      _mm256_and_si256(x, _mm256_set1_epi64x(0x000003ff000003ffll)));
+    x=_mm256_or_si256(_mm256_slli_epi64(_mm256_and_si256(x, _mm256_set1_epi64x(0x03e003e003e003e0ll)), 3),
+                      _mm256_and_si256(x, _mm256_set1_epi64x(0x001f001f001f001fll)));
+    const __m256i reverse=_mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                           7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    return _mm256_shuffle_epi8(x, reverse);
+}
+
+__attribute__((target("avx2")))
+static void pack_base32_avx2(const uint64_t *keys, size_t count, size_t precision, char *output) {
+    size_t i=0;
+    // Each row takes a 16-byte store, the last rows are left to the scalar loop
+    for (; i+4<=count && (count-i-4)*precision>=16; i+=4) {
+        __m256i k=_mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys+i));
+        __m256i head=base32_chars_avx2(spread_groups_avx2(_mm256_srli_epi64(k, 24)));
+        __m256i tail=base32_chars_avx2(_mm256_srli_epi64(
+            spread_groups_avx2(_mm256_and_si256(_mm256_srli_epi64(k, 4), _mm256_set1_epi64x(0xfffff))), 32));
+        __m256i even=_mm256_unpacklo_epi64(head, tail);
+        __m256i odd=_mm256_unpackhi_epi64(head, tail);
+        char *row=output+i*precision;
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(row), _mm256_castsi256_si128(even));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(row+precision), _mm256_castsi256_si128(odd));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(row+2*precision), _mm256_extracti128_si256(even, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(row+3*precision), _mm256_extracti128_si256(odd, 1));
+    }
+    _mm256_zeroupper();
+    pack_base32(keys+i, count-i, precision, output+i*precision);
+}
+
+#endif
+
+static void pack_chars(const uint64_t *keys, size_t count, size_t precision, char *output) {
+#if defined(GEOHASH_X86_KERNELS)
+    if (active_simd_level()!=simd_level::scalar) {
+        return pack_base32_avx2(keys, count, precision, output);
+    }
+#endif
+    pack_base32(keys, count, precision, output);
+}
+
+/// Keys are staged on the stack before packing into characters
+constexpr size_t ENCODE_BLOCK=256;
+
+void binary_encode(const double *latitudes, const double *longitudes, size_t count,
+                   size_t bit_count, uint64_t *output)
+{
+    encode_keys(latitudes, longitudes, count, output);
+    shift_keys(output, count, bit_count);
+}
+
+void binary_encode(const geolocation *locations, size_t count,
+                   size_t bit_count, uint64_t *output)
+{
+    encode_keys(locations, count, output);
+    shift_keys(output, count, bit_count);
+}
+
+void encode(const double *latitudes, const double *longitudes, size_t count,
+            size_t precision, char *output)
+{
+    precision=std::min(precision, MAX_GEOHASH_LENGTH);
+    uint64_t keys[ENCODE_BLOCK];
+    for (size_t i=0; i<count; i+=ENCODE_BLOCK) {
+        size_t n=std::min(ENCODE_BLOCK, count-i);
+        encode_keys(latitudes+i, longitudes+i, n, keys);
+        pack_chars(keys, n, precision, output+i*precision);
+    }
+}
+
+void encode(const geolocation *locations, size_t count,
+            size_t precision, char *output)
+{
+    precision=std::min(precision, MAX_GEOHASH_LENGTH);
+    uint64_t keys[ENCODE_BLOCK];
+    for (size_t i=0; i<count; i+=ENCODE_BLOCK) {
+        size_t n=std::min(ENCODE_BLOCK, count-i);
+        encode_keys(locations+i, n, keys);
+        pack_chars(keys, n, precision, output+i*precision);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// batch decode
+////////////////////////////////////////////////////////////////////////////////
+
+/// A block of rows to decode, parsed into left-aligned keys and bit counts
+struct decode_block {
+    const char *rows[ENCODE_BLOCK];
+    size_t lengths[ENCODE_BLOCK];
+    uint64_t keys[ENCODE_BLOCK];
+    uint8_t bits[ENCODE_BLOCK];
+    // Bit i set when row i is invalid
+    uint64_t invalid[ENCODE_BLOCK/64];
+    size_t count;
+};
+
+static void parse_rows_scalar(decode_block &block, size_t first) {
+    for (size_t i=first; i<block.count; i++) {
+        const char *row=block.rows[i];
+        size_t length=block.lengths[i];
+        uint64_t key=0;
+        bool valid=length<=MAX_GEOHASH_LENGTH;
+        for (size_t n=0; valid && n<length; n++) {
+            unsigned c=static_cast<unsigned char>(row[n]);
+            int index=(c>='0' && c<='z') ? base32_indexes[c-'0'] : -1;
+            valid=index>=0;
+            key=(key<<5) | uint64_t(index & 0x1f);
+        }
+        if (valid) {
+            block.keys[i]=length ? key<<(64-5*length) : 0;
+            block.bits[i]=uint8_t(5*length);
+        } else {
+            block.keys[i]=0;
+            block.bits[i]=0;
+            block.invalid[i/64]|=1ull<<(i%64);
+        }
+    }
+}
+
+static void decode_boxes_scalar(const decode_block &block, size_t first, bounding_box *output) {
+    for (size_t i=first; i<block.count; i++) {
+        output[i]=decode_key(block.keys[i], block.bits[i]);
+    }
+}
+
+static void decode_centers_scalar(const decode_block &block, size_t first, geolocation *output) {
+    for (size_t i=first; i<block.count; i++) {
+        output[i]=decode_key(block.keys[i], block.bits[i]).center();
+    }
+}
+
+#if defined(GEOHASH_X86_KERNELS)
+
+/// Map characters to their 5-bit values, 0xff for invalid ones, by high and low nibble
+__attribute__((target("avx2")))
+static inline __m256i base32_values_avx2(__m256i c) {
+    const __m256i low_nibble=_mm256_set1_epi8(0x0f);
+    const char x=char(0xff);
+    // '0'..'9'
+    const __m256i digits=_mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, x, x, x, x, x, x,
+                                          0, 1, 2, 3, 4, 5, 6, 7, 8, 9, x, x, x, x, x, x);
+    // '@'..'O' and '`'..'o'
+    const __m256i letters1=_mm256_setr_epi8(x, x, 10, 11, 12, 13, 14, 15, 16, x, 17, 18, x, 19, 20, x,
+                                            x, x, 10, 11, 12, 13, 14, 15, 16, x, 17, 18, x, 19, 20, x);
+    // 'P'..'_' and 'p'..DEL
+    const __m256i letters2=_mm256_setr_epi8(21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, x, x, x, x, x,
+                                            21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, x, x, x, x, x);
+    __m256i lo=_mm256_and_si256(c, low_nibble);
+    __m256i hi=_mm256_and_si256(_mm256_srli_epi16(c, 4), low_nibble);
+    // Fold lower case rows 0x6/0x7 onto upper case rows 0x4/0x5, the other rows never match
+    __m256i lower=_mm256_and_si256(_mm256_cmpgt_epi8(hi, _mm256_set1_epi8(5)),
+                                   _mm256_cmpgt_epi8(_mm256_set1_epi8(8), hi));
+    __m256i folded=_mm256_sub_epi8(hi, _mm256_and_si256(lower, _mm256_set1_epi8(2)));
+    __m256i v=_mm256_set1_epi8(x);
+    v=_mm256_blendv_epi8(v, _mm256_shuffle_epi8(digits, lo), _mm256_cmpeq_epi8(folded, _mm256_set1_epi8(3)));
+    v=_mm256_blendv_epi8(v, _mm256_shuffle_epi8(letters1, lo), _mm256_cmpeq_epi8(folded, _mm256_set1_epi8(4)));
+    v=_mm256_blendv_epi8(v, _mm256_shuffle_epi8(letters2, lo), _mm256_cmpeq_epi8(folded, _mm256_set1_epi8(5)));
+    return v;
+}
+
+__attribute__((target("avx2")))
+static inline __m128i load_row(const char *row, size_t length, const char *end) {
+    if (end-row>=16) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(row));
+    }
+    // Never read past the caller's buffer
+    char buffer[16]={0};
+    std::memcpy(buffer, row, std::min<size_t>(length, 16));
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(buffer));
+}
+
+/// Validate and pack 2 rows at a time, one per 128-bit lane
+__attribute__((target("avx2")))
+static void parse_rows_avx2(decode_block &block, const char *end) {
+    const __m256i positions=_mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                             0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m256i pair_weights=_mm256_set1_epi16(0x0120);        // 32*c0 + c1
+    const __m256i quad_weights=_mm256_set1_epi32(0x00010400);    // 1024*p0 + p1
+    const __m256i low32=_mm256_set1_epi64x(0xffffffffll);
+    const __m256i high_shifts=_mm256_setr_epi64x(44, 4, 44, 4);
+    const __m256i mid_shifts=_mm256_setr_epi64x(24, 0, 24, 0);
+    size_t i=0;
+    for (; i+2<=block.count; i+=2) {
+        size_t len0=block.lengths[i], len1=block.lengths[i+1];
+        if (len0>MAX_GEOHASH_LENGTH || len1>MAX_GEOHASH_LENGTH) {
+            break;
+        }
+        __m256i c=_mm256_inserti128_si256(_mm256_castsi128_si256(load_row(block.rows[i], len0, end)),
+                                          load_row(block.rows[i+1], len1, end), 1);
+        __m256i lengths=_mm256_inserti128_si256(_mm256_castsi128_si256(_mm_set1_epi8(char(len0))),
+                                                _mm_set1_epi8(char(len1)), 1);
+        __m256i in_row=_mm256_cmpgt_epi8(lengths, positions);
+        __m256i v=base32_values_avx2(c);
+        uint32_t bad=uint32_t(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(char(0xff))), in_row)));
+        v=_mm256_and_si256(v, in_row);
+        // 5-bit values -> 10-bit pairs -> 20-bit quads -> one 60-bit key per lane
+        __m256i quads=_mm256_madd_epi16(_mm256_maddubs_epi16(v, pair_weights), quad_weights);
+        __m256i key=_mm256_or_si256(_mm256_sllv_epi64(_mm256_and_si256(quads, low32), high_shifts),
+                                    _mm256_sllv_epi64(_mm256_srli_epi64(quads, 32), mid_shifts));
+        key=_mm256_or_si256(key, _mm256_bsrli_epi128(key, 8));
+        block.keys[i]=(bad & 0xffff) ? 0 : uint64_t(_mm256_extract_epi64(key, 0));
+        block.keys[i+1]=(bad>>16) ? 0 : uint64_t(_mm256_extract_epi64(key, 2));
+        block.bits[i]=(bad & 0xffff) ? 0 : uint8_t(5*len0);
+        block.bits[i+1]=(bad>>16) ? 0 : uint8_t(5*len1);
+        block.invalid[i/64]|=uint64_t((bad & 0xffff)!=0)<<(i%64);
+        block.invalid[(i+1)/64]|=uint64_t((bad>>16)!=0)<<((i+1)%64);
+    }
+    _mm256_zeroupper();
+    parse_rows_scalar(block, i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i compact_avx2(__m256i x) {
+    x=_mm256_and_si256(x, _mm256_set1_epi64x(0x5555555555555555ll));
+    x=_mm256_and_si256(_mm256_or_si256(x, _mm256_srli_epi64(x, 1)), _mm256_set1_epi64x(0x3333333333333333ll));
+    x=_mm256_and_si256(_mm256_or_si256(x, _mm256_srli_epi64(x, 2)), _mm256_set1_epi64x(0x0f0f0f0f0f0f0f0fll));
+    x=_mm256_and_si256(_mm256_or_si256(x, _mm256_srli_epi64(x, 4)), _mm256_set1_epi64x(0x00ff00ff00ff00ffll));
+    x=_mm256_and_si256(_mm256_or_si256(x, _mm256_srli_epi64(x, 8)), _mm256_set1_epi64x(0x0000ffff0000ffffll));
+    x=_mm256_and_si256(_mm256_or_si256(x, _mm256_srli_epi64(x, 16)), _mm256_set1_epi64x(0x00000000ffffffffll));
+    return x;
+}
+
+/// Cell index and span of one axis, 4 keys at a time, same arithmetic as decode_key
+__attribute__((target("avx2")))
+static inline void cell_avx2(__m256i index, __m256i bits, double range, __m256d &first, __m256d &step) {
+    const __m256i magic=_mm256_set1_epi64x(0x4330000000000000ll);
+    index=_mm256_srlv_epi64(index, _mm256_sub_epi64(_mm256_set1_epi64x(32), bits));
+    first=_mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(index, magic)), _mm256_castsi256_pd(magic));
+    // 2^-bits built from its exponent
+    __m256d scale=_mm256_castsi256_pd(_mm256_slli_epi64(_mm256_sub_epi64(_mm256_set1_epi64x(1023), bits), 52));
+    step=_mm256_mul_pd(_mm256_set1_pd(range), scale);
+}
+
+__attribute__((target("avx2")))
+static inline void cells_avx2(const decode_block &block, size_t i,
+                              __m256d &lat_index, __m256d &lat_step, __m256d &lon_index, __m256d &lon_step)
+{
+    __m256i key=_mm256_loadu_si256(reinterpret_cast<const __m256i *>(block.keys+i));
+    uint32_t packed;
+    std::memcpy(&packed, block.bits+i, sizeof(packed));
+    __m256i bits=_mm256_cvtepu8_epi64(_mm_cvtsi32_si128(int(packed)));
+    __m256i lon_bits=_mm256_srli_epi64(_mm256_add_epi64(bits, _mm256_set1_epi64x(1)), 1);
+    __m256i lat_bits=_mm256_srli_epi64(bits, 1);
+    cell_avx2(compact_avx2(_mm256_srli_epi64(key, 1)), lon_bits, 360, lon_index, lon_step);
+    cell_avx2(compact_avx2(key), lat_bits, 180, lat_index, lat_step);
+}
+
+__attribute__((target("avx2")))
+static void decode_boxes_avx2(const decode_block &block, bounding_box *output) {
+    static_assert(sizeof(bounding_box)==4*sizeof(double), "bounding_box must be 4 packed doubles");
+    const __m256d one=_mm256_set1_pd(1);
+    size_t i=0;
+    for (; i+4<=block.count; i+=4) {
+        __m256d lat_index, lat_step, lon_index, lon_step;
+        cells_avx2(block, i, lat_index, lat_step, lon_index, lon_step);
+        __m256d min_lat=_mm256_add_pd(_mm256_set1_pd(-90), _mm256_mul_pd(lat_index, lat_step));
+        __m256d max_lat=_mm256_add_pd(_mm256_set1_pd(-90), _mm256_mul_pd(_mm256_add_pd(lat_index, one), lat_step));
+        __m256d min_lon=_mm256_add_pd(_mm256_set1_pd(-180), _mm256_mul_pd(lon_index, lon_step));
+        __m256d max_lon=_mm256_add_pd(_mm256_set1_pd(-180), _mm256_mul_pd(_mm256_add_pd(lon_index, one), lon_step));
+        // Transpose the 4 fields of 4 boxes
+        __m256d t0=_mm256_unpacklo_pd(min_lat, max_lat);
+        __m256d t1=_mm256_unpackhi_pd(min_lat, max_lat);
+        __m256d t2=_mm256_unpacklo_pd(min_lon, max_lon);
+        __m256d t3=_mm256_unpackhi_pd(min_lon, max_lon);
+        double *out=&output[i].min_lat;
+        _mm256_storeu_pd(out, _mm256_permute2f128_pd(t0, t2, 0x20));
+        _mm256_storeu_pd(out+4, _mm256_permute2f128_pd(t1, t3, 0x20));
+        _mm256_storeu_pd(out+8, _mm256_permute2f128_pd(t0, t2, 0x31));
+        _mm256_storeu_pd(out+12, _mm256_permute2f128_pd(t1, t3, 0x31));
+    }
+    _mm256_zeroupper();
+    decode_boxes_scalar(block, i, output);
+}
+
+__attribute__((target("avx2")))
+static void decode_centers_avx2(const decode_block &block, geolocation *output) {
+    const __m256d half=_mm256_set1_pd(0.5);
+    size_t i=0;
+    for (; i+4<=block.count; i+=4) {
+        __m256d lat_index, lat_step, lon_index, lon_step;
+        cells_avx2(block, i, lat_index, lat_step, lon_index, lon_step);
+        __m256d lat=_mm256_add_pd(_mm256_set1_pd(-90), _mm256_mul_pd(_mm256_add_pd(lat_index, half), lat_step));
+        __m256d lon=_mm256_add_pd(_mm256_set1_pd(-180), _mm256_mul_pd(_mm256_add_pd(lon_index, half), lon_step));
+        __m256d lo=_mm256_unpacklo_pd(lat, lon);
+        __m256d hi=_mm256_unpackhi_pd(lat, lon);
+        double *out=&output[i].latitude;
+        _mm256_storeu_pd(out, _mm256_permute2f128_pd(lo, hi, 0x20));
+        _mm256_storeu_pd(out+4, _mm256_permute2f128_pd(lo, hi, 0x31));
+    }
+    _mm256_zeroupper();
+    decode_centers_scalar(block, i, output);
+}
+
+#endif
+
+static void parse_rows(decode_block &block, const char *end) {
+    std::fill(block.invalid, block.invalid+ENCODE_BLOCK/64, 0);
+#if defined(GEOHASH_X86_KERNELS)
+    if (active_simd_level()!=simd_level::scalar) {
+        return parse_rows_avx2(block, end);
+    }
+#endif
+    (void)end;
+    parse_rows_scalar(block, 0);
+}
+
+static void decode_block_output(const decode_block &block, bounding_box *output) {
+#if defined(GEOHASH_X86_KERNELS)
+    if (active_simd_level()!=simd_level::scalar) {
+        return decode_boxes_avx2(block, output);
+    }
+#endif
+    decode_boxes_scalar(block, 0, output);
+}
+
+static void decode_block_output(const decode_block &block, geolocation *output) {
+#if defined(GEOHASH_X86_KERNELS)
+    if (active_simd_level()!=simd_level::scalar) {
+        return decode_centers_avx2(block, output);
+    }
+#endif
+    decode_centers_scalar(block, 0, output);
+}
+
+/// Copy the block's invalid bits to the caller's mask starting at row first
+static size_t store_invalid(const decode_block &block, size_t first, uint64_t *invalid) {
+    size_t found=0;
+    for (size_t w=0; w<(block.count+63)/64; w++) {
+        uint64_t bits=block.invalid[w];
+        found+=size_t(__builtin_popcountll(bits));
+        // Blocks are whole words, so first is a multiple of 64
+        invalid[first/64+w]=bits;
+    }
+    return found;
+}
+
+template<typename Output, typename Row>
+static size_t decode_rows(size_t count, const char *end, Output *output, uint64_t *invalid, Row row) {
+    static_assert(ENCODE_BLOCK%64==0, "blocks must cover whole mask words");
+    decode_block block;
+    size_t found=0;
+    for (size_t i=0; i<count; i+=ENCODE_BLOCK) {
+        block.count=std::min(ENCODE_BLOCK, count-i);
+        for (size_t n=0; n<block.count; n++) {
+            row(i+n, block.rows[n], block.lengths[n]);
+        }
+        parse_rows(block, end);
+        decode_block_output(block, output+i);
+        found+=store_invalid(block, i, invalid);
+    }
+    return found;
+}
+
+size_t decode(const char *hashes, size_t count, size_t width,
+              bounding_box *output, uint64_t *invalid)
+{
+    return decode_rows(count, hashes+count*width, output, invalid,
+                       [=](size_t i, const char *&row, size_t &length) { row=hashes+i*width; length=width; });
+}
+
+size_t decode(const char *hashes, size_t count, size_t width,
+              geolocation *centers, uint64_t *invalid)
+{
+    return decode_rows(count, hashes+count*width, centers, invalid,
+                       [=](size_t i, const char *&row, size_t &length) { row=hashes+i*width; length=width; });
+}
+
+size_t decode(const char *buffer, const size_t *offsets, size_t count,
+              bounding_box *output, uint64_t *invalid)
+{
+    return decode_rows(count, buffer+offsets[count], output, invalid,
+                       [=](size_t i, const char *&row, size_t &length) {
+                           row=buffer+offsets[i];
+                           length=offsets[i+1]-offsets[i];
+                       });
+}
+
+size_t decode(const char *buffer, const size_t *offsets, size_t count,
+              geolocation *centers, uint64_t *invalid)
+{
+    return decode_rows(count, buffer+offsets[count], centers, invalid,
+                       [=](size_t i, const char *&row, size_t &length) {
+                           row=buffer+offsets[i];
+                           length=offsets[i+1]-offsets[i];
+                       });
+}
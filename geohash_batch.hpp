@@ -0,0 +1,54 @@
+//
+//  geohash_batch.hpp
+//
+//  Batch encoding and decoding over arrays, with SIMD kernels selected at runtime.
+//
+
+#ifndef geohash_batch_hpp_included
+#define geohash_batch_hpp_included
+
+#include "geohash.hpp"
+
+/// Instruction sets the batch kernels can use
+enum class simd_level {
+    scalar,
+    avx2,
+    avx512,
+};
+
+/// Best instruction set supported by the CPU
+simd_level detect_simd_level();
+/// Instruction set currently used by the batch functions
+simd_level active_simd_level();
+/// Force an instruction set, it is capped to what the CPU supports, returns the one in effect
+simd_level set_simd_level(simd_level level);
+
+/// Binary encode count locations, output[i] is the bits of binary_encode(location i, bit_count)
+void binary_encode(const double *latitudes, const double *longitudes, size_t count,
+                   size_t bit_count, uint64_t *output);
+void binary_encode(const geolocation *locations, size_t count,
+                   size_t bit_count, uint64_t *output);
+
+/// Encode count locations into fixed width hashes, precision characters each, no terminators
+/// precision is capped at MAX_GEOHASH_LENGTH
+void encode(const double *latitudes, const double *longitudes, size_t count,
+            size_t precision, char *output);
+void encode(const geolocation *locations, size_t count,
+            size_t precision, char *output);
+
+/// Decode count fixed width hashes of width characters each, as written by the batch encode
+/// Rows that are invalid or longer than MAX_GEOHASH_LENGTH get their bit set in invalid,
+/// which holds (count+63)/64 words, and decode to the largest box.
+/// Returns the number of invalid rows.
+size_t decode(const char *hashes, size_t count, size_t width,
+              bounding_box *output, uint64_t *invalid);
+size_t decode(const char *hashes, size_t count, size_t width,
+              geolocation *centers, uint64_t *invalid);
+
+/// Decode count variable length hashes, hash i is buffer[offsets[i]..offsets[i+1])
+size_t decode(const char *buffer, const size_t *offsets, size_t count,
+              bounding_box *output, uint64_t *invalid);
+size_t decode(const char *buffer, const size_t *offsets, size_t count,
+              geolocation *centers, uint64_t *invalid);
+
+#endif
@@ -0,0 +1,461 @@
+//
+//  geohash_cover.cpp
+//
+//  Greedy refinement of cell covers, largest crossing cell first.
+//
+
+#include <cmath>
+#include <algorithm>
+#include <queue>
+#include <stdexcept>
+#include "geohash_cover.hpp"
+#include "geohash_distance.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// geometry
+////////////////////////////////////////////////////////////////////////////////
+
+/// Shortest central angle from a location to a box
+static double min_angle(double lat, double lon, const bounding_box &b) {
+    auto in_lon=[&](double x) { return x>=b.min_lon && x<=b.max_lon; };
+    if (in_lon(lon) || in_lon(lon-360) || in_lon(lon+360)) {
+        // Straight along the meridian
+        return std::max({b.min_lat-lat, lat-b.max_lat, 0.0})*RADIANS;
+    }
+    // Along a parallel edge the distance grows with the longitude difference, so the closest
+    // point is on a meridian edge: the foot of the perpendicular, or else a corner.
+    // Distances are chords between unit vectors, in a frame where the location has longitude 0,
+    // which stay accurate for tiny angles.
+    double sp=std::sin(lat*RADIANS), cp=std::cos(lat*RADIANS);
+    double s_lo=std::sin(b.min_lat*RADIANS), c_lo=std::cos(b.min_lat*RADIANS);
+    double s_hi=std::sin(b.max_lat*RADIANS), c_hi=std::cos(b.max_lat*RADIANS);
+    double chord=2;
+    for (double edge : {b.min_lon, b.max_lon}) {
+        double dl=(edge-lon)*RADIANS;
+        double sd=std::sin(dl), cd=std::cos(dl);
+        // The foot is at atan2(sp, cp*cd), compare it with the edge's ends by the sine of the difference
+        if (cd>0 && sp*c_lo-cp*cd*s_lo>=0 && sp*c_hi-cp*cd*s_hi<=0) {
+            double sine=std::min(1.0, std::abs(cp*sd));
+            chord=std::min(chord, 2*std::sin(std::asin(sine)*0.5));
+        } else {
+            for (double corner : {0, 1}) {
+                double s=corner ? s_hi : s_lo, c=corner ? c_hi : c_lo;
+                double x=cp-c*cd, y=c*sd, z=sp-s;
+                chord=std::min(chord, std::sqrt(x*x+y*y+z*z));
+            }
+        }
+    }
+    return 2*std::asin(std::min(1.0, chord*0.5));
+}
+
+double distance(geolocation l, const bounding_box &box) {
+    return min_angle(l.latitude, l.longitude, box)*EARTH_RADIUS;
+}
+
+/// Area of a box on the unit sphere
+static double area(const bounding_box &b) {
+    return (b.max_lon-b.min_lon)*RADIANS*(std::sin(b.max_lat*RADIANS)-std::sin(b.min_lat*RADIANS));
+}
+
+/// Left-aligned keys of the cells at a precision that a box touches
+static std::vector<uint64_t> grid_cells(const bounding_box &box, size_t bits) {
+    std::vector<uint64_t> output;
+    unsigned lon_shift=unsigned(32-(bits+1)/2), lat_shift=unsigned(32-bits/2);
+    uint64_t lon_lo=uint64_t(quantize_longitude(box.min_lon))>>lon_shift;
+    uint64_t lon_hi=uint64_t(quantize_longitude(box.max_lon))>>lon_shift;
+    uint64_t lat_lo=uint64_t(quantize_latitude(box.min_lat))>>lat_shift;
+    uint64_t lat_hi=uint64_t(quantize_latitude(box.max_lat))>>lat_shift;
+    if ((lon_hi-lon_lo+1)*(lat_hi-lat_lo+1)>64) {
+        // Only small grids are wanted, the size is enough
+        output.resize(65);
+        return output;
+    }
+    for (uint64_t lat=lat_lo; lat<=lat_hi; lat++) {
+        for (uint64_t lon=lon_lo; lon<=lon_hi; lon++) {
+            output.push_back(interleave(uint32_t(lon<<lon_shift), uint32_t(lat<<lat_shift)));
+        }
+    }
+    return output;
+}
+
+std::vector<bounding_box> circle_bounds(geolocation center, double dist) {
+    std::vector<bounding_box> output;
+    if (!(dist>=0)) {
+        return output;
+    }
+    // Bounding box of the spherical cap, widened a little against rounding
+    const double slack=1+1e-9;
+    double angle=dist/EARTH_RADIUS;
+    double lat_range=angle/RADIANS*slack;
+    double min_lat=center.latitude-lat_range, max_lat=center.latitude+lat_range;
+    double lon_range=180;
+    if (min_lat>-90 && max_lat<90) {
+        // The cap misses both poles, so sin(angle)<cos(latitude)
+        lon_range=std::asin(std::min(1.0, std::sin(angle)/std::cos(center.latitude*RADIANS)))/RADIANS*slack;
+    }
+    min_lat=std::max(min_lat, -90.0);
+    max_lat=std::min(max_lat, 90.0);
+    double min_lon=center.longitude-lon_range, max_lon=center.longitude+lon_range;
+    if (lon_range>=180) {
+        output.push_back(bounding_box(min_lat, max_lat, -180, 180));
+    } else if (min_lon<-180) {
+        // Split at the antimeridian
+        output.push_back(bounding_box(min_lat, max_lat, min_lon+360, 180));
+        output.push_back(bounding_box(min_lat, max_lat, -180, max_lon));
+    } else if (max_lon>180) {
+        output.push_back(bounding_box(min_lat, max_lat, min_lon, 180));
+        output.push_back(bounding_box(min_lat, max_lat, -180, max_lon-360));
+    } else {
+        output.push_back(bounding_box(min_lat, max_lat, min_lon, max_lon));
+    }
+    return output;
+}
+
+bounding_box polygon_bounds(const geolocation *vertices, size_t count) {
+    bounding_box output(vertices[0], vertices[0]);
+    for (size_t i=1; i<count; i++) {
+        output.merge(bounding_box(vertices[i], vertices[i]));
+    }
+    return output;
+}
+
+bool polygon_contains(const geolocation *vertices, size_t count, geolocation l) {
+    // Crossings of a ray towards the east, half-open in latitude so shared vertices count once
+    bool inside=false;
+    for (size_t i=0, j=count-1; i<count; j=i++) {
+        const geolocation &a=vertices[j], &b=vertices[i];
+        if ((a.latitude>l.latitude)!=(b.latitude>l.latitude)) {
+            double lon=a.longitude+(l.latitude-a.latitude)/(b.latitude-a.latitude)*(b.longitude-a.longitude);
+            if (l.longitude<lon) {
+                inside=!inside;
+            }
+        }
+    }
+    return inside;
+}
+
+/// Area on the unit sphere between straight edges in latitude and longitude, the integral
+/// of sin(latitude) over longitude around the boundary
+static double polygon_area(const geolocation *vertices, size_t count) {
+    double sum=0;
+    for (size_t i=0, j=count-1; i<count; j=i++) {
+        double p1=vertices[j].latitude*RADIANS, p2=vertices[i].latitude*RADIANS;
+        double dl=(vertices[i].longitude-vertices[j].longitude)*RADIANS;
+        // sin averaged over the edge, its latitude being linear in the longitude
+        double mean=std::abs(p2-p1)<1e-9 ? std::sin((p1+p2)*0.5) : (std::cos(p1)-std::cos(p2))/(p2-p1);
+        sum+=dl*mean;
+    }
+    return std::abs(sum);
+}
+
+/// Whether the segment from a to b touches the box, by clipping it to the box's slabs
+static bool segment_touches(geolocation a, geolocation b, const bounding_box &box) {
+    double t0=0, t1=1;
+    auto clip=[&](double p, double q) {
+        // Keep the t where p*t<=q
+        if (p==0) {
+            return q>=0;
+        }
+        double t=q/p;
+        if (p<0) {
+            t0=std::max(t0, t);
+        } else {
+            t1=std::min(t1, t);
+        }
+        return t0<=t1;
+    };
+    double dlat=b.latitude-a.latitude, dlon=b.longitude-a.longitude;
+    return clip(-dlat, a.latitude-box.min_lat) && clip(dlat, box.max_lat-a.latitude)
+        && clip(-dlon, a.longitude-box.min_lon) && clip(dlon, box.max_lon-a.longitude);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// regions
+////////////////////////////////////////////////////////////////////////////////
+
+// Regions answer 2 questions about a cell: may it intersect, and is it inside.
+// Both are conservative in the direction that keeps the cover complete.
+
+struct box_region {
+    bounding_box box;
+
+    bool empty() const { return !(box.min_lat<=box.max_lat) || !(box.min_lon<=box.max_lon); }
+    double area() const { return ::area(box); }
+    std::vector<bounding_box> bounds() const { return {box}; }
+    bool intersects(const bounding_box &cell) const {
+        return cell.min_lat<=box.max_lat && cell.max_lat>=box.min_lat
+            && cell.min_lon<=box.max_lon && cell.max_lon>=box.min_lon;
+    }
+    bool contains(const bounding_box &cell) const {
+        return cell.min_lat>=box.min_lat && cell.max_lat<=box.max_lat
+            && cell.min_lon>=box.min_lon && cell.max_lon<=box.max_lon;
+    }
+};
+
+struct circle_region {
+    geolocation center;
+    /// Radius as a central angle
+    double angle;
+    /// circle_bounds(), cells outside them are rejected without trigonometry
+    std::vector<bounding_box> boxes;
+
+    circle_region(geolocation c, double dist)
+    : center(c)
+    , angle(dist/EARTH_RADIUS)
+    , boxes(circle_bounds(c, dist))
+    {}
+
+    bool empty() const { return !(angle>=0); }
+    double area() const {
+        // 2π(1-cos), without the cancellation for tiny circles
+        double s=std::sin(std::min(angle, M_PI)*0.5);
+        return 4*M_PI*s*s;
+    }
+    std::vector<bounding_box> bounds() const { return boxes; }
+    bool intersects(const bounding_box &cell) const {
+        bool near=false;
+        for (const bounding_box &b : boxes) {
+            near=near || box_region{b}.intersects(cell);
+        }
+        return near && min_angle(center.latitude, center.longitude, cell)<=angle*(1+1e-9)+1e-15;
+    }
+    bool contains(const bounding_box &cell) const {
+        // The farthest point of the cell is the closest to the antipode
+        double lon=center.longitude>0 ? center.longitude-180 : center.longitude+180;
+        return M_PI-min_angle(-center.latitude, lon, cell)<=angle*(1-1e-9);
+    }
+};
+
+/// Straight edges in latitude and longitude, cells touching an edge cross it
+struct polygon_region {
+    const geolocation *vertices;
+    size_t count;
+    bounding_box box;
+
+    bool valid;
+
+    polygon_region(const geolocation *v, size_t n)
+    : vertices(v)
+    , count(n)
+    , box(n ? polygon_bounds(v, n) : bounding_box(0, 0, 0, 0))
+    , valid(n>=3)
+    {
+        for (size_t i=0; i<n; i++) {
+            valid=valid && std::abs(v[i].latitude)<=90 && std::abs(v[i].longitude)<=180;
+        }
+    }
+
+    bool empty() const { return !valid; }
+    double area() const { return polygon_area(vertices, count); }
+    std::vector<bounding_box> bounds() const { return {box}; }
+    bool intersects(const bounding_box &cell) const {
+        return box_region{box}.intersects(cell) && (crosses(cell) || polygon_contains(vertices, count, cell.center()));
+    }
+    bool contains(const bounding_box &cell) const {
+        return !crosses(cell) && polygon_contains(vertices, count, cell.center());
+    }
+
+    /// Whether an edge touches the cell, widened a little against rounding
+    bool crosses(const bounding_box &cell) const {
+        const double slack=1e-9;
+        bounding_box b(cell.min_lat-slack, cell.max_lat+slack, cell.min_lon-slack, cell.max_lon+slack);
+        for (size_t i=0, j=count-1; i<count; j=i++) {
+            if (segment_touches(vertices[j], vertices[i], b)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// refinement
+////////////////////////////////////////////////////////////////////////////////
+
+/// Cell during refinement, key left-aligned
+struct cover_candidate {
+    uint64_t key;
+    size_t bits;
+    double area;
+    bool inside=false;
+
+    bool operator<(const cover_candidate &c) const {
+        // Largest first, then key order so covers are deterministic
+        return area<c.area || (area==c.area && key>c.key);
+    }
+};
+
+/// Replace complete sets of sibling cells by their parent
+static void merge_siblings(std::vector<cover_candidate> &cells, size_t level_bits) {
+    const size_t siblings=size_t(1)<<level_bits;
+    bool changed=true;
+    while (changed) {
+        changed=false;
+        std::sort(cells.begin(), cells.end(), [](const cover_candidate &c1, const cover_candidate &c2) {
+            return c1.key<c2.key || (c1.key==c2.key && c1.bits<c2.bits);
+        });
+        std::vector<cover_candidate> merged;
+        for (size_t i=0; i<cells.size();) {
+            const cover_candidate &c=cells[i];
+            size_t parent_bits=c.bits>=level_bits ? c.bits-level_bits : 0;
+            key_range parent=cell_range(c.key, parent_bits);
+            bool complete=c.bits>=level_bits && c.key==parent.begin && i+siblings<=cells.size();
+            for (size_t n=1; complete && n<siblings; n++) {
+                const cover_candidate &s=cells[i+n];
+                complete=s.bits==c.bits && s.key==c.key+(uint64_t(n)<<(64-c.bits));
+            }
+            if (complete) {
+                double total=0;
+                bool inside=true;
+                for (size_t n=0; n<siblings; n++) {
+                    total+=cells[i+n].area;
+                    inside=inside && cells[i+n].inside;
+                }
+                merged.push_back(cover_candidate{c.key, parent_bits, total, inside});
+                i+=siblings;
+                changed=true;
+            } else {
+                merged.push_back(c);
+                i++;
+            }
+        }
+        cells.swap(merged);
+    }
+}
+
+template<typename Region>
+static geohash_cover refine(const Region &region, const cover_options &options) {
+    geohash_cover output;
+    if (region.empty()) {
+        return output;
+    }
+    size_t level_bits=std::min(std::max(options.level_bits, size_t(1)), size_t(16));
+    size_t max_bits=std::min(options.max_bits, MAX_BINHASH_LENGTH);
+    std::vector<cover_candidate> done;
+    std::priority_queue<cover_candidate> crossing;
+    // Seed with the grid cells of the deepest level where the region's bounds span at most
+    // 4 cells, the levels above would only narrow down to them one child at a time
+    std::vector<bounding_box> bounds=region.bounds();
+    size_t seed_bits=0;
+    for (size_t bits=level_bits; bits<=max_bits; bits+=level_bits) {
+        size_t count=0;
+        for (const bounding_box &b : bounds) {
+            count+=grid_cells(b, bits).size();
+        }
+        if (count>4) {
+            break;
+        }
+        seed_bits=bits;
+    }
+    // Coarser seeds while those the region meets exceed the budget, the root cell always fits
+    size_t max_cells=std::max(options.max_cells, size_t(1));
+    std::vector<uint64_t> seeds;
+    for (;; seed_bits-=level_bits) {
+        seeds.clear();
+        for (const bounding_box &b : bounds) {
+            std::vector<uint64_t> grid=grid_cells(b, seed_bits);
+            seeds.insert(seeds.end(), grid.begin(), grid.end());
+        }
+        // The boxes of a region across the antimeridian share the cells too coarse to split them
+        std::sort(seeds.begin(), seeds.end());
+        seeds.erase(std::unique(seeds.begin(), seeds.end()), seeds.end());
+        seeds.erase(std::remove_if(seeds.begin(), seeds.end(), [&](uint64_t key) {
+            return !region.intersects(decode_key(key, seed_bits));
+        }), seeds.end());
+        if (seeds.size()<=max_cells || seed_bits==0) {
+            break;
+        }
+    }
+    double total=0;
+    for (uint64_t key : seeds) {
+        bounding_box box=decode_key(key, seed_bits);
+        cover_candidate c{key, seed_bits, area(box)};
+        total+=c.area;
+        if (region.contains(box)) {
+            c.inside=true;
+            done.push_back(c);
+        } else {
+            crossing.push(c);
+        }
+    }
+    double target=options.target_over_coverage*region.area();
+    std::vector<cover_candidate> children;
+    while (!crossing.empty() && total>target) {
+        cover_candidate c=crossing.top();
+        crossing.pop();
+        size_t bits=c.bits+level_bits;
+        if (done.size()+crossing.size()+1>max_cells) {
+            // No split fits the budget any more
+            done.push_back(c);
+            break;
+        }
+        if (bits>max_bits) {
+            done.push_back(c);
+            continue;
+        }
+        children.clear();
+        for (uint64_t n=0; n<(uint64_t(1)<<level_bits); n++) {
+            uint64_t key=c.key | (n<<(64-bits));
+            bounding_box box=decode_key(key, bits);
+            if (region.intersects(box)) {
+                children.push_back(cover_candidate{key, bits, area(box)});
+            }
+        }
+        // Refining replaces 1 cell by its children
+        if (done.size()+crossing.size()+children.size()>max_cells) {
+            done.push_back(c);
+            continue;
+        }
+        total-=c.area;
+        for (cover_candidate &child : children) {
+            total+=child.area;
+            if (region.contains(decode_key(child.key, child.bits))) {
+                child.inside=true;
+                done.push_back(child);
+            } else {
+                crossing.push(child);
+            }
+        }
+    }
+    for (; !crossing.empty(); crossing.pop()) {
+        done.push_back(crossing.top());
+    }
+    merge_siblings(done, level_bits);
+    double cells_area=0;
+    for (const cover_candidate &c : done) {
+        output.cells.push_back(binary_hash(c.bits ? c.key>>(64-c.bits) : 0, c.bits));
+        output.interior.push_back(c.inside);
+        output.ranges.push_back(cell_range(c.key, c.bits));
+        cells_area+=c.area;
+    }
+    coalesce(output.ranges);
+    output.over_coverage=cells_area/region.area();
+    return output;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// API
+////////////////////////////////////////////////////////////////////////////////
+
+geohash_cover cover(const bounding_box &box, const cover_options &options) {
+    return refine(box_region{box}, options);
+}
+
+geohash_cover cover(geolocation center, double dist, const cover_options &options) {
+    return refine(circle_region(center, dist), options);
+}
+
+geohash_cover cover(const geolocation *vertices, size_t count, const cover_options &options) {
+    return refine(polygon_region(vertices, count), options);
+}
+
+std::vector<geohash> geohash_cover::hashes() const {
+    std::vector<geohash> output;
+    for (const binary_hash &cell : cells) {
+        if (cell.size()%5) {
+            throw std::invalid_argument("geohash_cover: cell is not a whole number of characters");
+        }
+        output.push_back(geohash::from_key(cell.size() ? cell.bits<<(64-cell.size()) : 0, cell.size()/5));
+    }
+    return output;
+}
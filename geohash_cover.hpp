@@ -0,0 +1,73 @@
+//
+//  geohash_cover.hpp
+//
+//  Mixed precision cell covers of boxes and circles.
+//
+
+#ifndef geohash_cover_hpp_included
+#define geohash_cover_hpp_included
+
+#include <vector>
+#include "geohash.hpp"
+
+/// How a cover is refined
+struct cover_options {
+    /// Upper bound on the number of cells, at least 1
+    size_t max_cells=16;
+    /// Bits added per refinement, 5 gives geohash cells, 1 gives binary hash cells of any precision
+    size_t level_bits=5;
+    /// Finest cells, in bits
+    size_t max_bits=60;
+    /// Stop refining once the cells cover at most this multiple of the region's area
+    double target_over_coverage=1;
+};
+
+/// Cells covering a region
+///
+/// Refinement splits the largest cell crossing the region's edge while the cell budget allows,
+/// cells inside the region are never split. Cells the region misses are dropped, so the cover
+/// may have fewer cells than the budget. Cells get narrow in longitude towards the poles, so
+/// circles there need more cells for the same over-coverage.
+struct geohash_cover {
+    /// Cells in key order, none contains another
+    std::vector<binary_hash> cells;
+    /// Whether each cell lies inside the region, the others cross its edge
+    std::vector<bool> interior;
+    /// Keys of the cells, coalesced
+    std::vector<key_range> ranges;
+    /// Area of the cells over the area of the region, on the sphere
+    double over_coverage=0;
+
+    /// Cells as geohash strings, throws std::invalid_argument when a cell is not a whole number of characters
+    std::vector<geohash> hashes() const;
+};
+
+/// Cover a box, an inverted box gives an empty cover
+geohash_cover cover(const bounding_box &box, const cover_options &options=cover_options());
+
+/// Cover the locations within dist km of center, by haversine
+geohash_cover cover(geolocation center, double dist, const cover_options &options=cover_options());
+
+/// Cover a polygon, edges run straight in latitude and longitude between the vertices and
+/// back to the first one. Polygons crossing the antimeridian must be split at it. Fewer than
+/// 3 vertices, or vertices out of range, give an empty cover.
+geohash_cover cover(const geolocation *vertices, size_t count, const cover_options &options=cover_options());
+
+inline geohash_cover cover(const std::vector<geolocation> &polygon, const cover_options &options=cover_options()) {
+    return cover(polygon.data(), polygon.size(), options);
+}
+
+/// Whether a location is inside a polygon, by ray casting. Locations on an edge may go either way.
+bool polygon_contains(const geolocation *vertices, size_t count, geolocation l);
+
+/// Bounding box of a polygon's vertices, count must not be 0
+bounding_box polygon_bounds(const geolocation *vertices, size_t count);
+
+/// Bounding boxes of the locations within dist km of center, 2 when the circle crosses
+/// the antimeridian. A circle over a pole spans all longitudes.
+std::vector<bounding_box> circle_bounds(geolocation center, double dist);
+
+/// Shortest haversine distance from a location to any point of a box, in km
+double distance(geolocation l, const bounding_box &box);
+
+#endif
@@ -0,0 +1,483 @@
+//
+//  geohash_distance.cpp
+//
+//  Distance modes, with SIMD kernels using polynomial sin, cos and atan.
+//
+
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include "geohash_distance.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define GEOHASH_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+/// Locations handled per kernel call, keeps the intermediates in L1
+constexpr size_t DISTANCE_BLOCK=256;
+
+////////////////////////////////////////////////////////////////////////////////
+// measures
+////////////////////////////////////////////////////////////////////////////////
+
+// Kernels compute a measure that grows with the distance, so within() can compare it directly:
+// the haversine of the central angle for haversine, the squared projected angle otherwise.
+// finish turns measures into km.
+
+/// Terms of the origin shared by every location
+struct origin_terms {
+    explicit origin_terms(const geolocation &l)
+    : latitude(l.latitude)
+    , longitude(l.longitude)
+    , cos_latitude(std::cos(l.latitude*RADIANS))
+    {}
+
+    double latitude;
+    double longitude;
+    double cos_latitude;
+};
+
+/// Half longitude difference folded into [-90, 90] degrees, its squared sine is unchanged
+static inline double half_longitude_delta(double delta) {
+    double h=delta*0.5;
+    if (h>90) {
+        h-=180;
+    } else if (h<-90) {
+        h+=180;
+    }
+    return h;
+}
+
+/// Longitude difference wrapped into [-180, 180] degrees
+static inline double longitude_delta(double delta) {
+    if (delta>180) {
+        delta-=360;
+    } else if (delta<-180) {
+        delta+=360;
+    }
+    return delta;
+}
+
+static inline double measure(const origin_terms &o, double lat, double lon, distance_mode mode) {
+    if (mode==distance_mode::haversine) {
+        double s1=std::sin((lat-o.latitude)*0.5*RADIANS);
+        double s2=std::sin(half_longitude_delta(lon-o.longitude)*RADIANS);
+        double a=s1*s1+o.cos_latitude*std::cos(lat*RADIANS)*s2*s2;
+        // cos rounds below 0 at the poles
+        return std::min(std::max(a, 0.0), 1.0);
+    }
+    double c=mode==distance_mode::fast_local ? o.cos_latitude : std::cos((lat+o.latitude)*0.5*RADIANS);
+    double x=longitude_delta(lon-o.longitude)*RADIANS*c;
+    double y=(lat-o.latitude)*RADIANS;
+    return x*x+y*y;
+}
+
+static inline double finish(double q, distance_mode mode) {
+    if (mode==distance_mode::haversine) {
+        return 2*EARTH_RADIUS*std::atan2(std::sqrt(q), std::sqrt(1-q));
+    }
+    return EARTH_RADIUS*std::sqrt(q);
+}
+
+/// Largest measure within dist, negative when nothing can be
+static double max_measure(double dist, distance_mode mode) {
+    if (!(dist>=0)) {
+        return -1;
+    }
+    double angle=dist/EARTH_RADIUS;
+    if (mode==distance_mode::haversine) {
+        if (angle>=M_PI) {
+            return 1;
+        }
+        double s=std::sin(angle*0.5);
+        return s*s;
+    }
+    return angle*angle;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// kernels
+////////////////////////////////////////////////////////////////////////////////
+
+static void measure_scalar(const origin_terms &o, const double *lat, const double *lon,
+                           size_t count, double *q, distance_mode mode)
+{
+    for (size_t i=0; i<count; i++) {
+        q[i]=measure(o, lat[i], lon[i], mode);
+    }
+}
+
+static void finish_scalar(const double *q, size_t count, double *output, distance_mode mode) {
+    for (size_t i=0; i<count; i++) {
+        output[i]=finish(q[i], mode);
+    }
+}
+
+#if defined(GEOHASH_X86_KERNELS)
+
+// Taylor coefficients in x^2, truncation errors are below 1e-17 on the reduced ranges:
+// sin and cos on [-pi/2, pi/2], atan on [-tan(pi/16), tan(pi/16)]
+static const double sin_coefficients[]={
+    1.0, -1.0/6, 1.0/120, -1.0/5040, 1.0/362880, -1.0/39916800, 1.0/6227020800.0,
+    -1.0/1307674368000.0, 1.0/355687428096000.0, -1.0/121645100408832000.0,
+    1.0/51090942171709440000.0,
+};
+static const double cos_coefficients[]={
+    1.0, -1.0/2, 1.0/24, -1.0/720, 1.0/40320, -1.0/3628800, 1.0/479001600,
+    -1.0/87178291200.0, 1.0/20922789888000.0, -1.0/6402373705728000.0,
+    1.0/2432902008176640000.0, -1.0/1124000727777607680000.0,
+};
+static const double atan_coefficients[]={
+    1.0, -1.0/3, 1.0/5, -1.0/7, 1.0/9, -1.0/11, 1.0/13, -1.0/15, 1.0/17, -1.0/19, 1.0/21,
+};
+constexpr size_t SIN_TERMS=sizeof(sin_coefficients)/sizeof(double);
+constexpr size_t COS_TERMS=sizeof(cos_coefficients)/sizeof(double);
+constexpr size_t ATAN_TERMS=sizeof(atan_coefficients)/sizeof(double);
+constexpr double TAN_PI_8=0.41421356237309504880;
+
+__attribute__((target("avx2")))
+static inline __m256d horner_avx2(__m256d x, const double *c, size_t n) {
+    __m256d r=_mm256_set1_pd(c[n-1]);
+    for (size_t i=n-1; i-->0;) {
+        r=_mm256_add_pd(_mm256_mul_pd(r, x), _mm256_set1_pd(c[i]));
+    }
+    return r;
+}
+
+__attribute__((target("avx2")))
+static inline __m256d sin_avx2(__m256d x) {
+    return _mm256_mul_pd(x, horner_avx2(_mm256_mul_pd(x, x), sin_coefficients, SIN_TERMS));
+}
+
+__attribute__((target("avx2")))
+static inline __m256d cos_avx2(__m256d x) {
+    return horner_avx2(_mm256_mul_pd(x, x), cos_coefficients, COS_TERMS);
+}
+
+/// atan2(y, x) for y, x >= 0, not both 0
+__attribute__((target("avx2")))
+static inline __m256d atan2_avx2(__m256d y, __m256d x) {
+    const __m256d one=_mm256_set1_pd(1);
+    // Reduce to t in [0, 1], then to |u| <= tan(pi/8), then halve the angle once more
+    __m256d swap=_mm256_cmp_pd(y, x, _CMP_GT_OQ);
+    __m256d t=_mm256_div_pd(_mm256_blendv_pd(y, x, swap), _mm256_blendv_pd(x, y, swap));
+    __m256d big=_mm256_cmp_pd(t, _mm256_set1_pd(TAN_PI_8), _CMP_GT_OQ);
+    __m256d u=_mm256_blendv_pd(t, _mm256_div_pd(_mm256_sub_pd(t, one), _mm256_add_pd(t, one)), big);
+    __m256d v=_mm256_div_pd(u, _mm256_add_pd(one, _mm256_sqrt_pd(_mm256_add_pd(one, _mm256_mul_pd(u, u)))));
+    __m256d r=_mm256_mul_pd(_mm256_add_pd(v, v), horner_avx2(_mm256_mul_pd(v, v), atan_coefficients, ATAN_TERMS));
+    r=_mm256_add_pd(r, _mm256_and_pd(big, _mm256_set1_pd(M_PI/4)));
+    return _mm256_blendv_pd(r, _mm256_sub_pd(_mm256_set1_pd(M_PI/2), r), swap);
+}
+
+/// Same steps as measure(), 4 lanes at a time
+__attribute__((target("avx2")))
+static inline __m256d measure_avx2(const origin_terms &o, __m256d lat, __m256d lon, distance_mode mode) {
+    const __m256d radians=_mm256_set1_pd(RADIANS);
+    const __m256d half=_mm256_set1_pd(0.5);
+    __m256d dlat=_mm256_sub_pd(lat, _mm256_set1_pd(o.latitude));
+    __m256d dlon=_mm256_sub_pd(lon, _mm256_set1_pd(o.longitude));
+    if (mode==distance_mode::haversine) {
+        const __m256d limit=_mm256_set1_pd(90);
+        const __m256d turn=_mm256_set1_pd(180);
+        __m256d s1=sin_avx2(_mm256_mul_pd(_mm256_mul_pd(dlat, half), radians));
+        __m256d h=_mm256_mul_pd(dlon, half);
+        h=_mm256_sub_pd(h, _mm256_and_pd(_mm256_cmp_pd(h, limit, _CMP_GT_OQ), turn));
+        h=_mm256_add_pd(h, _mm256_and_pd(_mm256_cmp_pd(h, _mm256_sub_pd(_mm256_setzero_pd(), limit), _CMP_LT_OQ), turn));
+        __m256d s2=sin_avx2(_mm256_mul_pd(h, radians));
+        __m256d c=_mm256_mul_pd(_mm256_set1_pd(o.cos_latitude), cos_avx2(_mm256_mul_pd(lat, radians)));
+        __m256d a=_mm256_add_pd(_mm256_mul_pd(s1, s1), _mm256_mul_pd(_mm256_mul_pd(c, s2), s2));
+        // max/min return the second operand for NaN, which keeps NaN
+        return _mm256_min_pd(_mm256_set1_pd(1), _mm256_max_pd(_mm256_setzero_pd(), a));
+    }
+    __m256d c=mode==distance_mode::fast_local
+        ? _mm256_set1_pd(o.cos_latitude)
+        : cos_avx2(_mm256_mul_pd(_mm256_mul_pd(_mm256_add_pd(lat, _mm256_set1_pd(o.latitude)), half), radians));
+    const __m256d limit=_mm256_set1_pd(180);
+    const __m256d turn=_mm256_set1_pd(360);
+    dlon=_mm256_sub_pd(dlon, _mm256_and_pd(_mm256_cmp_pd(dlon, limit, _CMP_GT_OQ), turn));
+    dlon=_mm256_add_pd(dlon, _mm256_and_pd(_mm256_cmp_pd(dlon, _mm256_sub_pd(_mm256_setzero_pd(), limit), _CMP_LT_OQ), turn));
+    __m256d x=_mm256_mul_pd(_mm256_mul_pd(dlon, radians), c);
+    __m256d y=_mm256_mul_pd(dlat, radians);
+    return _mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y));
+}
+
+__attribute__((target("avx2")))
+static inline __m256d finish_avx2(__m256d q, distance_mode mode) {
+    if (mode==distance_mode::haversine) {
+        __m256d y=_mm256_sqrt_pd(q);
+        __m256d x=_mm256_sqrt_pd(_mm256_sub_pd(_mm256_set1_pd(1), q));
+        return _mm256_mul_pd(_mm256_set1_pd(2*EARTH_RADIUS), atan2_avx2(y, x));
+    }
+    return _mm256_mul_pd(_mm256_set1_pd(EARTH_RADIUS), _mm256_sqrt_pd(q));
+}
+
+// Tails are padded to a full vector, so every location gets the same arithmetic wherever it is
+
+__attribute__((target("avx2")))
+static void measure_avx2(const origin_terms &o, const double *lat, const double *lon,
+                         size_t count, double *q, distance_mode mode)
+{
+    size_t i=0;
+    for (; i+4<=count; i+=4) {
+        _mm256_storeu_pd(q+i, measure_avx2(o, _mm256_loadu_pd(lat+i), _mm256_loadu_pd(lon+i), mode));
+    }
+    if (i<count) {
+        double tail_lat[4]={o.latitude, o.latitude, o.latitude, o.latitude};
+        double tail_lon[4]={o.longitude, o.longitude, o.longitude, o.longitude};
+        double tail[4];
+        std::copy(lat+i, lat+count, tail_lat);
+        std::copy(lon+i, lon+count, tail_lon);
+        _mm256_storeu_pd(tail, measure_avx2(o, _mm256_loadu_pd(tail_lat), _mm256_loadu_pd(tail_lon), mode));
+        std::copy(tail, tail+(count-i), q+i);
+    }
+}
+
+__attribute__((target("avx2")))
+static void finish_avx2(const double *q, size_t count, double *output, distance_mode mode) {
+    size_t i=0;
+    for (; i+4<=count; i+=4) {
+        _mm256_storeu_pd(output+i, finish_avx2(_mm256_loadu_pd(q+i), mode));
+    }
+    if (i<count) {
+        double tail[4]={};
+        std::copy(q+i, q+count, tail);
+        _mm256_storeu_pd(tail, finish_avx2(_mm256_loadu_pd(tail), mode));
+        std::copy(tail, tail+(count-i), output+i);
+    }
+}
+
+__attribute__((target("avx512f")))
+static inline __m512d horner_avx512(__m512d x, const double *c, size_t n) {
+    __m512d r=_mm512_set1_pd(c[n-1]);
+    for (size_t i=n-1; i-->0;) {
+        r=_mm512_fmadd_pd(r, x, _mm512_set1_pd(c[i]));
+    }
+    return r;
+}
+
+__attribute__((target("avx512f")))
+static inline __m512d sin_avx512(__m512d x) {
+    return _mm512_mul_pd(x, horner_avx512(_mm512_mul_pd(x, x), sin_coefficients, SIN_TERMS));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512d cos_avx512(__m512d x) {
+    return horner_avx512(_mm512_mul_pd(x, x), cos_coefficients, COS_TERMS);
+}
+
+/// Same steps as atan2_avx2, 8 lanes at a time
+__attribute__((target("avx512f")))
+static inline __m512d atan2_avx512(__m512d y, __m512d x) {
+    const __m512d one=_mm512_set1_pd(1);
+    __mmask8 swap=_mm512_cmp_pd_mask(y, x, _CMP_GT_OQ);
+    __m512d t=_mm512_div_pd(_mm512_mask_blend_pd(swap, y, x), _mm512_mask_blend_pd(swap, x, y));
+    __mmask8 big=_mm512_cmp_pd_mask(t, _mm512_set1_pd(TAN_PI_8), _CMP_GT_OQ);
+    __m512d u=_mm512_mask_div_pd(t, big, _mm512_sub_pd(t, one), _mm512_add_pd(t, one));
+    __m512d v=_mm512_div_pd(u, _mm512_add_pd(one, _mm512_sqrt_pd(_mm512_fmadd_pd(u, u, one))));
+    __m512d r=_mm512_mul_pd(_mm512_add_pd(v, v), horner_avx512(_mm512_mul_pd(v, v), atan_coefficients, ATAN_TERMS));
+    r=_mm512_mask_add_pd(r, big, r, _mm512_set1_pd(M_PI/4));
+    return _mm512_mask_sub_pd(r, swap, _mm512_set1_pd(M_PI/2), r);
+}
+
+/// Same steps as measure(), 8 lanes at a time
+__attribute__((target("avx512f")))
+static inline __m512d measure_avx512(const origin_terms &o, __m512d lat, __m512d lon, distance_mode mode) {
+    const __m512d radians=_mm512_set1_pd(RADIANS);
+    const __m512d half=_mm512_set1_pd(0.5);
+    __m512d dlat=_mm512_sub_pd(lat, _mm512_set1_pd(o.latitude));
+    __m512d dlon=_mm512_sub_pd(lon, _mm512_set1_pd(o.longitude));
+    if (mode==distance_mode::haversine) {
+        const __m512d limit=_mm512_set1_pd(90);
+        const __m512d turn=_mm512_set1_pd(180);
+        __m512d s1=sin_avx512(_mm512_mul_pd(_mm512_mul_pd(dlat, half), radians));
+        __m512d h=_mm512_mul_pd(dlon, half);
+        h=_mm512_mask_sub_pd(h, _mm512_cmp_pd_mask(h, limit, _CMP_GT_OQ), h, turn);
+        h=_mm512_mask_add_pd(h, _mm512_cmp_pd_mask(h, _mm512_set1_pd(-90), _CMP_LT_OQ), h, turn);
+        __m512d s2=sin_avx512(_mm512_mul_pd(h, radians));
+        __m512d c=_mm512_mul_pd(_mm512_set1_pd(o.cos_latitude), cos_avx512(_mm512_mul_pd(lat, radians)));
+        __m512d a=_mm512_fmadd_pd(_mm512_mul_pd(c, s2), s2, _mm512_mul_pd(s1, s1));
+        return _mm512_min_pd(_mm512_set1_pd(1), _mm512_max_pd(_mm512_setzero_pd(), a));
+    }
+    __m512d c=mode==distance_mode::fast_local
+        ? _mm512_set1_pd(o.cos_latitude)
+        : cos_avx512(_mm512_mul_pd(_mm512_mul_pd(_mm512_add_pd(lat, _mm512_set1_pd(o.latitude)), half), radians));
+    const __m512d turn=_mm512_set1_pd(360);
+    dlon=_mm512_mask_sub_pd(dlon, _mm512_cmp_pd_mask(dlon, _mm512_set1_pd(180), _CMP_GT_OQ), dlon, turn);
+    dlon=_mm512_mask_add_pd(dlon, _mm512_cmp_pd_mask(dlon, _mm512_set1_pd(-180), _CMP_LT_OQ), dlon, turn);
+    __m512d x=_mm512_mul_pd(_mm512_mul_pd(dlon, radians), c);
+    __m512d y=_mm512_mul_pd(dlat, radians);
+    return _mm512_fmadd_pd(x, x, _mm512_mul_pd(y, y));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512d finish_avx512(__m512d q, distance_mode mode) {
+    if (mode==distance_mode::haversine) {
+        __m512d y=_mm512_sqrt_pd(q);
+        __m512d x=_mm512_sqrt_pd(_mm512_sub_pd(_mm512_set1_pd(1), q));
+        return _mm512_mul_pd(_mm512_set1_pd(2*EARTH_RADIUS), atan2_avx512(y, x));
+    }
+    return _mm512_mul_pd(_mm512_set1_pd(EARTH_RADIUS), _mm512_sqrt_pd(q));
+}
+
+__attribute__((target("avx512f")))
+static void measure_avx512(const origin_terms &o, const double *lat, const double *lon,
+                           size_t count, double *q, distance_mode mode)
+{
+    size_t i=0;
+    for (; i+8<=count; i+=8) {
+        _mm512_storeu_pd(q+i, measure_avx512(o, _mm512_loadu_pd(lat+i), _mm512_loadu_pd(lon+i), mode));
+    }
+    if (i<count) {
+        // Masked lanes load the origin, which is harmless
+        __mmask8 m=__mmask8((1u<<(count-i))-1);
+        __m512d tail_lat=_mm512_mask_loadu_pd(_mm512_set1_pd(o.latitude), m, lat+i);
+        __m512d tail_lon=_mm512_mask_loadu_pd(_mm512_set1_pd(o.longitude), m, lon+i);
+        _mm512_mask_storeu_pd(q+i, m, measure_avx512(o, tail_lat, tail_lon, mode));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void finish_avx512(const double *q, size_t count, double *output, distance_mode mode) {
+    size_t i=0;
+    for (; i+8<=count; i+=8) {
+        _mm512_storeu_pd(output+i, finish_avx512(_mm512_loadu_pd(q+i), mode));
+    }
+    if (i<count) {
+        __mmask8 m=__mmask8((1u<<(count-i))-1);
+        __m512d tail=_mm512_mask_loadu_pd(_mm512_setzero_pd(), m, q+i);
+        _mm512_mask_storeu_pd(output+i, m, finish_avx512(tail, mode));
+    }
+}
+
+#endif
+
+static void measure_block(const origin_terms &o, const double *lat, const double *lon,
+                          size_t count, double *q, distance_mode mode)
+{
+    switch (active_simd_level()) {
+#if defined(GEOHASH_X86_KERNELS)
+        case simd_level::avx512:
+            return measure_avx512(o, lat, lon, count, q, mode);
+        case simd_level::avx2:
+            return measure_avx2(o, lat, lon, count, q, mode);
+#endif
+        default:
+            return measure_scalar(o, lat, lon, count, q, mode);
+    }
+}
+
+static void finish_block(const double *q, size_t count, double *output, distance_mode mode) {
+    switch (active_simd_level()) {
+#if defined(GEOHASH_X86_KERNELS)
+        case simd_level::avx512:
+            return finish_avx512(q, count, output, mode);
+        case simd_level::avx2:
+            return finish_avx2(q, count, output, mode);
+#endif
+        default:
+            return finish_scalar(q, count, output, mode);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// API
+////////////////////////////////////////////////////////////////////////////////
+
+double distance(const geolocation &l, const geolocation &r, distance_mode mode) {
+    return finish(measure(origin_terms(l), r.latitude, r.longitude, mode), mode);
+}
+
+bool within(const geolocation &l, const geolocation &r, double dist, distance_mode mode) {
+    return measure(origin_terms(l), r.latitude, r.longitude, mode)<=max_measure(dist, mode);
+}
+
+void distance(const geolocation &origin, const double *latitudes, const double *longitudes,
+              size_t count, double *output, distance_mode mode)
+{
+    origin_terms o(origin);
+    for (size_t i=0; i<count; i+=DISTANCE_BLOCK) {
+        size_t n=std::min(DISTANCE_BLOCK, count-i);
+        measure_block(o, latitudes+i, longitudes+i, n, output+i, mode);
+        finish_block(output+i, n, output+i, mode);
+    }
+}
+
+/// Split a block of locations into latitude and longitude arrays
+static void split_block(const geolocation *locations, size_t count, double *lat, double *lon) {
+    for (size_t i=0; i<count; i++) {
+        lat[i]=locations[i].latitude;
+        lon[i]=locations[i].longitude;
+    }
+}
+
+void distance(const geolocation &origin, const geolocation *locations,
+              size_t count, double *output, distance_mode mode)
+{
+    double lat[DISTANCE_BLOCK], lon[DISTANCE_BLOCK];
+    origin_terms o(origin);
+    for (size_t i=0; i<count; i+=DISTANCE_BLOCK) {
+        size_t n=std::min(DISTANCE_BLOCK, count-i);
+        split_block(locations+i, n, lat, lon);
+        measure_block(o, lat, lon, n, output+i, mode);
+        finish_block(output+i, n, output+i, mode);
+    }
+}
+
+void distance(const geolocation *rows, size_t row_count,
+              const geolocation *columns, size_t column_count,
+              double *output, distance_mode mode)
+{
+    // Split the columns once, every row reuses them
+    std::vector<double> lat(column_count), lon(column_count);
+    split_block(columns, column_count, lat.data(), lon.data());
+    for (size_t r=0; r<row_count; r++) {
+        distance(rows[r], lat.data(), lon.data(), column_count, output+r*column_count, mode);
+    }
+}
+
+/// Set the mask bits of a block starting at row first, a multiple of 64
+static size_t store_within(const double *q, size_t count, double limit, size_t first, uint64_t *mask) {
+    size_t found=0;
+    for (size_t w=0; w<(count+63)/64; w++) {
+        uint64_t bits=0;
+        for (size_t i=w*64; i<std::min(count, w*64+64); i++) {
+            bits|=uint64_t(q[i]<=limit)<<(i%64);
+        }
+        found+=size_t(__builtin_popcountll(bits));
+        mask[first/64+w]=bits;
+    }
+    return found;
+}
+
+size_t within(const geolocation &origin, const double *latitudes, const double *longitudes,
+              size_t count, double dist, uint64_t *mask, distance_mode mode)
+{
+    static_assert(DISTANCE_BLOCK%64==0, "blocks must cover whole mask words");
+    double q[DISTANCE_BLOCK];
+    origin_terms o(origin);
+    double limit=max_measure(dist, mode);
+    size_t found=0;
+    for (size_t i=0; i<count; i+=DISTANCE_BLOCK) {
+        size_t n=std::min(DISTANCE_BLOCK, count-i);
+        measure_block(o, latitudes+i, longitudes+i, n, q, mode);
+        found+=store_within(q, n, limit, i, mask);
+    }
+    return found;
+}
+
+size_t within(const geolocation &origin, const geolocation *locations,
+              size_t count, double dist, uint64_t *mask, distance_mode mode)
+{
+    double lat[DISTANCE_BLOCK], lon[DISTANCE_BLOCK], q[DISTANCE_BLOCK];
+    origin_terms o(origin);
+    double limit=max_measure(dist, mode);
+    size_t found=0;
+    for (size_t i=0; i<count; i+=DISTANCE_BLOCK) {
+        size_t n=std::min(DISTANCE_BLOCK, count-i);
+        split_block(locations+i, n, lat, lon);
+        measure_block(o, lat, lon, n, q, mode);
+        found+=store_within(q, n, limit, i, mask);
+    }
+    return found;
+}
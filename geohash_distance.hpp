@@ -0,0 +1,65 @@
+//
+//  geohash_distance.hpp
+//
+//  Distances with selectable accuracy, and batch kernels selected at runtime like geohash_batch.
+//
+
+#ifndef geohash_distance_hpp_included
+#define geohash_distance_hpp_included
+
+#include <cmath>
+#include "geohash_batch.hpp"
+
+/// Mean earth radius in km, the one of distance()
+constexpr double EARTH_RADIUS=6371.009;
+/// Degrees to radians
+constexpr double RADIANS=M_PI/180;
+
+/// How distances are computed, all in km on the sphere of the mean earth radius used by distance()
+///
+/// Locations are in degrees, latitudes within [-90, 90] and longitudes within [-180, 180].
+/// Error bounds below are relative to distance(), measured with random pairs below 70 degrees
+/// of latitude. The flat modes degrade toward the poles.
+enum class distance_mode {
+    /// Great circle by the haversine formula in double.
+    /// Within 1e-13, except within ~1 km of antipodal pairs where the formula itself
+    /// loses digits, there the error stays below 1e-4 km.
+    haversine,
+    /// Flat projection at the mean latitude of the pair, longitudes wrap at the antimeridian.
+    /// Within 1e-6 up to 10 km, 1e-4 up to 100 km and 1% up to 1000 km.
+    equirectangular,
+    /// Flat projection at the latitude of the first location, the origin in batch calls,
+    /// so its cosine is computed once. Within 0.1% up to 10 km and 1% up to 100 km.
+    fast_local,
+};
+
+/// Distance between 2 locations
+double distance(const geolocation &l, const geolocation &r, distance_mode mode);
+
+/// Whether r is at most dist km from l, compares before the inverse trigonometric step.
+/// Agrees with distance(l, r, mode)<=dist except for rounding at the boundary.
+bool within(const geolocation &l, const geolocation &r, double dist,
+            distance_mode mode=distance_mode::haversine);
+
+/// Distances from origin to count locations
+void distance(const geolocation &origin, const double *latitudes, const double *longitudes,
+              size_t count, double *output, distance_mode mode);
+void distance(const geolocation &origin, const geolocation *locations,
+              size_t count, double *output, distance_mode mode);
+
+/// Distances from every row location to every column location,
+/// output holds row_count*column_count distances, row after row
+void distance(const geolocation *rows, size_t row_count,
+              const geolocation *columns, size_t column_count,
+              double *output, distance_mode mode);
+
+/// Set bit i in mask, which holds (count+63)/64 words, when location i is within dist of origin
+/// Returns the number of locations within dist.
+size_t within(const geolocation &origin, const double *latitudes, const double *longitudes,
+              size_t count, double dist, uint64_t *mask,
+              distance_mode mode=distance_mode::haversine);
+size_t within(const geolocation &origin, const geolocation *locations,
+              size_t count, double dist, uint64_t *mask,
+              distance_mode mode=distance_mode::haversine);
+
+#endif
@@ -0,0 +1,124 @@
+//
+//  geohash_geofence.cpp
+//
+//  Segments of the key space from nested cover cells, probed by binary search.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "geohash_batch.hpp"
+#include "geohash_geofence.hpp"
+
+/// Locations encoded per call of the batch kernel
+constexpr size_t GEOFENCE_BLOCK=1024;
+
+/// A cover cell of a polygon during construction
+struct geofence_cell {
+    uint64_t begin;
+    /// Last key, inclusive, so the end of the key space needs no special case
+    uint64_t last;
+    size_t bits;
+    uint32_t entry;
+};
+
+geofence::geofence(const std::vector<std::vector<geolocation>> &polygons, const cover_options &options)
+: polygon_offsets{0}
+{
+    if (polygons.size()>=(size_t(1)<<31)) {
+        throw std::invalid_argument("geofence: too many polygons");
+    }
+    std::vector<geofence_cell> all;
+    for (size_t p=0; p<polygons.size(); p++) {
+        const std::vector<geolocation> &polygon=polygons[p];
+        bool valid=polygon.size()>=3;
+        for (const geolocation &v : polygon) {
+            valid=valid && std::abs(v.latitude)<=90 && std::abs(v.longitude)<=180;
+        }
+        if (!valid) {
+            throw std::invalid_argument("geofence: polygon needs 3 vertices within range");
+        }
+        vertices.insert(vertices.end(), polygon.begin(), polygon.end());
+        polygon_offsets.push_back(vertices.size());
+        geohash_cover c=cover(polygon, options);
+        for (size_t i=0; i<c.cells.size(); i++) {
+            size_t bits=c.cells[i].size();
+            key_range range=cell_range(bits ? c.cells[i].bits<<(64-bits) : 0, bits);
+            all.push_back(geofence_cell{range.begin, range.end-1, bits, uint32_t(p<<1 | (c.interior[i] ? 0 : 1))});
+        }
+    }
+    cells=all.size();
+    // Outer cells first where cells start together
+    std::sort(all.begin(), all.end(), [](const geofence_cell &c1, const geofence_cell &c2) {
+        return c1.begin<c2.begin || (c1.begin==c2.begin && c1.bits<c2.bits);
+    });
+    std::vector<uint64_t> bounds{0};
+    for (const geofence_cell &c : all) {
+        bounds.push_back(c.begin);
+        if (c.last!=~uint64_t(0)) {
+            bounds.push_back(c.last+1);
+        }
+    }
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+    // Cells containing a key form a chain of nested cells, a stack while sweeping the bounds
+    std::vector<const geofence_cell *> open;
+    size_t next=0;
+    segment_offsets.push_back(0);
+    for (uint64_t b : bounds) {
+        while (!open.empty() && open.back()->last<b) {
+            open.pop_back();
+        }
+        for (; next<all.size() && all[next].begin==b; next++) {
+            open.push_back(&all[next]);
+        }
+        for (const geofence_cell *c : open) {
+            entries.push_back(c->entry);
+        }
+        if (entries.size()>UINT32_MAX) {
+            throw std::invalid_argument("geofence: too many cells");
+        }
+        starts.push_back(b);
+        segment_offsets.push_back(uint32_t(entries.size()));
+    }
+}
+
+void geofence::probe(geolocation l, uint64_t key, std::vector<size_t> &output) const {
+    size_t s=size_t(std::upper_bound(starts.begin(), starts.end(), key)-starts.begin())-1;
+    size_t first=output.size();
+    for (uint32_t i=segment_offsets[s]; i<segment_offsets[s+1]; i++) {
+        size_t p=entries[i]>>1;
+        if (!(entries[i] & 1)
+            || polygon_contains(&vertices[polygon_offsets[p]], polygon_offsets[p+1]-polygon_offsets[p], l)) {
+            output.push_back(p);
+        }
+    }
+    std::sort(output.begin()+ptrdiff_t(first), output.end());
+}
+
+void geofence::find(geolocation l, std::vector<size_t> &output) const {
+    if (std::abs(l.latitude)<=90 && std::abs(l.longitude)<=180) {
+        probe(l, encode_key(l), output);
+    }
+}
+
+void geofence::find(const geolocation *l, size_t count, std::vector<geofence_match> &output) const {
+    uint64_t keys[GEOFENCE_BLOCK];
+    std::vector<size_t> found;
+    for (size_t block=0; block<count; block+=GEOFENCE_BLOCK) {
+        size_t n=std::min(GEOFENCE_BLOCK, count-block);
+        binary_encode(l+block, n, MAX_BINHASH_LENGTH, keys);
+        for (size_t i=0; i<n; i++) {
+            const geolocation &location=l[block+i];
+            if (!(std::abs(location.latitude)<=90 && std::abs(location.longitude)<=180)) {
+                continue;
+            }
+            found.clear();
+            probe(location, keys[i], found);
+            for (size_t p : found) {
+                output.push_back(geofence_match{block+i, p});
+            }
+        }
+    }
+}
@@ -0,0 +1,85 @@
+//
+//  geohash_geofence.hpp
+//
+//  Point in polygon lookups over many polygons, through their cell covers.
+//
+
+#ifndef geohash_geofence_hpp_included
+#define geohash_geofence_hpp_included
+
+#include <cstdint>
+#include <vector>
+#include "geohash.hpp"
+#include "geohash_cover.hpp"
+
+/// A location inside a polygon, found by a batch lookup
+struct geofence_match {
+    size_t location;
+    size_t polygon;
+};
+
+/// Covers for geofences: quarter cells, 64 per polygon, refined until the budget is spent
+inline cover_options geofence_cover_options() {
+    cover_options options;
+    options.max_cells=64;
+    options.level_bits=2;
+    options.target_over_coverage=0;
+    return options;
+}
+
+/// Polygons indexed by the cells of their covers
+///
+/// Each polygon is covered by cells that lie inside it or cross its boundary. Cells are
+/// nested or disjoint key ranges, so together they split the key space into segments, each
+/// listing the cells that contain it. A lookup finds the segment of a location's key by binary
+/// search, inside cells match at once and only boundary cells need ray casting. Nothing changes
+/// after construction, so any number of threads may look up at the same time.
+class geofence {
+public:
+    /// Index polygons as taken by cover(), throws std::invalid_argument for one with fewer
+    /// than 3 vertices or vertices out of range
+    explicit geofence(const std::vector<std::vector<geolocation>> &polygons,
+                      const cover_options &options=geofence_cover_options());
+
+    /// Number of polygons
+    size_t size() const { return polygon_offsets.size()-1; }
+
+    /// Cells of all covers
+    size_t cell_count() const { return cells; }
+
+    /// Polygons containing l, in increasing order
+    std::vector<size_t> find(geolocation l) const {
+        std::vector<size_t> output;
+        find(l, output);
+        return output;
+    }
+
+    /// Same, appended to output
+    void find(geolocation l, std::vector<size_t> &output) const;
+
+    /// Matches of count locations, appended to output in location then polygon order
+    void find(const geolocation *l, size_t count, std::vector<geofence_match> &output) const;
+
+    std::vector<geofence_match> find(const std::vector<geolocation> &l) const {
+        std::vector<geofence_match> output;
+        find(l.data(), l.size(), output);
+        return output;
+    }
+
+private:
+    /// Append the polygons containing l, with the key of l
+    void probe(geolocation l, uint64_t key, std::vector<size_t> &output) const;
+
+    std::vector<geolocation> vertices;
+    /// Vertices of polygon p are [polygon_offsets[p], polygon_offsets[p+1])
+    std::vector<size_t> polygon_offsets;
+    /// First key of each segment, starting at 0
+    std::vector<uint64_t> starts;
+    /// Entries of segment s are [segment_offsets[s], segment_offsets[s+1])
+    std::vector<uint32_t> segment_offsets;
+    /// Polygon<<1, plus 1 for a boundary cell
+    std::vector<uint32_t> entries;
+    size_t cells=0;
+};
+
+#endif
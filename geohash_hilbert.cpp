@@ -0,0 +1,80 @@
+//
+//  geohash_hilbert.cpp
+//
+//  Conversions of cells between the curves, and Hilbert range covers.
+//
+
+#include <stdexcept>
+#include "geohash_cover.hpp"
+#include "geohash_hilbert.hpp"
+
+static void check_even(const binary_hash &cell) {
+    if (cell.size()%2) {
+        throw std::invalid_argument("geohash_hilbert: cells of odd precision differ between the curves");
+    }
+}
+
+binary_hash hilbert_from_geohash(const binary_hash &cell) {
+    check_even(cell);
+    if (cell.empty()) {
+        return cell;
+    }
+    return binary_hash(hilbert_from_key(cell.bits<<(64-cell.size()))>>(64-cell.size()), cell.size());
+}
+
+binary_hash geohash_from_hilbert(const binary_hash &hilbert) {
+    check_even(hilbert);
+    if (hilbert.empty()) {
+        return hilbert;
+    }
+    return binary_hash(key_from_hilbert(hilbert.bits<<(64-hilbert.size()))>>(64-hilbert.size()), hilbert.size());
+}
+
+binary_hash hilbert_neighbor(const binary_hash &hilbert, const std::pair<int, int> &direction) {
+    return hilbert_from_geohash(neighbor(geohash_from_hilbert(hilbert), direction));
+}
+
+std::array<binary_hash, 8> hilbert_neighbors(const binary_hash &hilbert) {
+    std::array<binary_hash, 8> output=neighbors(geohash_from_hilbert(hilbert));
+    for (binary_hash &h : output) {
+        h=hilbert_from_geohash(h);
+    }
+    return output;
+}
+
+std::vector<key_range> hilbert_ranges(const std::vector<binary_hash> &cells) {
+    std::vector<key_range> output;
+    output.reserve(cells.size());
+    for (const binary_hash &cell : cells) {
+        size_t bit_count=cell.size();
+        if (bit_count==0) {
+            return std::vector<key_range>{key_range{0, 0}};
+        }
+        uint64_t key=cell.bits<<(64-bit_count);
+        if (bit_count%2) {
+            // Both halves along latitude, each a square of the next level
+            bit_count++;
+            output.push_back(cell_range(hilbert_from_key(key), bit_count));
+            key|=uint64_t(1)<<(64-bit_count);
+        }
+        output.push_back(cell_range(hilbert_from_key(key), bit_count));
+    }
+    coalesce(output);
+    return output;
+}
+
+/// Covers with even precisions only, so every cell is one Hilbert range
+static cover_options hilbert_cover_options(size_t max_cells) {
+    cover_options options;
+    options.max_cells=max_cells;
+    options.level_bits=2;
+    return options;
+}
+
+std::vector<key_range> hilbert_box_ranges(const bounding_box &box, size_t max_cells) {
+    return hilbert_ranges(cover(box, hilbert_cover_options(max_cells)).cells);
+}
+
+std::vector<key_range> hilbert_radius_ranges(geolocation center, double dist, size_t max_cells) {
+    return hilbert_ranges(cover(center, dist, hilbert_cover_options(max_cells)).cells);
+}
@@ -0,0 +1,150 @@
+//
+//  geohash_hilbert.hpp
+//
+//  Hilbert curve keys over the grid of the interleaved keys, and conversions between them.
+//
+
+#ifndef geohash_hilbert_hpp_included
+#define geohash_hilbert_hpp_included
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "geohash.hpp"
+
+/// Hilbert keys
+///
+/// The Hilbert curve orders the same 2^32 by 2^32 grid of longitude and latitude cells as the
+/// interleaved key, but consecutive cells always share an edge, so a region splits into fewer
+/// key ranges. A cell of an even number of bits, a square of the grid at some level, holds a
+/// contiguous range of Hilbert keys just like it holds a range of interleaved keys, so cells
+/// convert one to one. A Hilbert prefix of odd length is half of such a square, split across
+/// longitude or latitude depending on the orientation of the curve there, so it is not the
+/// geohash cell of that length.
+///
+/// Each level turns a longitude and a latitude bit into 2 Hilbert bits and an orientation,
+/// one of 4: whether the axes are swapped and whether both are mirrored.
+
+/// One level: the Hilbert digit of the bits (lon, lat) in an orientation, and the orientation below
+constexpr std::pair<unsigned, unsigned> hilbert_step(unsigned orientation, unsigned lon, unsigned lat) {
+    unsigned swap=orientation>>1, mirror=orientation & 1;
+    unsigned x=(swap ? lat : lon)^mirror, y=(swap ? lon : lat)^mirror;
+    unsigned digit=(3*x)^y;
+    if (y==0) {
+        mirror^=x;
+        swap^=1;
+    }
+    return std::make_pair(digit, swap<<1 | mirror);
+}
+
+/// Tables of 4 levels at a time, indexed by orientation<<8 | 8 input bits, entries are
+/// orientation<<8 | 8 output bits. Forward maps interleaved bits to Hilbert digits.
+constexpr std::array<uint16_t, 1024> hilbert_forward=[] {
+    std::array<uint16_t, 1024> output{};
+    for (unsigned entry=0; entry<1024; entry++) {
+        unsigned orientation=entry>>8, digits=0;
+        for (int level=3; level>=0; level--) {
+            auto step=hilbert_step(orientation, (entry>>(2*level+1)) & 1, (entry>>(2*level)) & 1);
+            digits=digits<<2 | step.first;
+            orientation=step.second;
+        }
+        output[entry]=uint16_t(orientation<<8 | digits);
+    }
+    return output;
+}();
+
+constexpr std::array<uint16_t, 1024> hilbert_inverse=[] {
+    std::array<uint16_t, 1024> output{};
+    for (unsigned entry=0; entry<1024; entry++) {
+        unsigned orientation=entry>>8, bits=0;
+        for (int level=3; level>=0; level--) {
+            unsigned digit=(entry>>(2*level)) & 3;
+            // Invert the step: find the input bits giving this digit
+            for (unsigned b=0; b<4; b++) {
+                auto step=hilbert_step(orientation, b>>1, b & 1);
+                if (step.first==digit) {
+                    bits=bits<<2 | b;
+                    orientation=step.second;
+                    break;
+                }
+            }
+        }
+        output[entry]=uint16_t(orientation<<8 | bits);
+    }
+    return output;
+}();
+
+/// Hilbert key of the grid cell of a full 64-bit interleaved key
+constexpr uint64_t hilbert_from_key(uint64_t key) {
+    uint64_t output=0;
+    unsigned orientation=0;
+    for (int shift=56; shift>=0; shift-=8) {
+        uint16_t entry=hilbert_forward[orientation<<8 | unsigned(key>>shift & 0xff)];
+        output=output<<8 | (entry & 0xff);
+        orientation=entry>>8;
+    }
+    return output;
+}
+
+/// Interleaved key of the grid cell of a full 64-bit Hilbert key
+constexpr uint64_t key_from_hilbert(uint64_t hilbert) {
+    uint64_t output=0;
+    unsigned orientation=0;
+    for (int shift=56; shift>=0; shift-=8) {
+        uint16_t entry=hilbert_inverse[orientation<<8 | unsigned(hilbert>>shift & 0xff)];
+        output=output<<8 | (entry & 0xff);
+        orientation=entry>>8;
+    }
+    return output;
+}
+
+/// Full 64-bit Hilbert key of the location
+constexpr uint64_t hilbert_key(geolocation l) {
+    return hilbert_from_key(encode_key(l));
+}
+
+/// Hilbert prefix of bit_count bits of the location, capped at 64, like binary_encode
+constexpr binary_hash hilbert_encode(geolocation l, size_t bit_count) {
+    bit_count=std::min(bit_count, MAX_BINHASH_LENGTH);
+    if (bit_count==0) {
+        return binary_hash();
+    }
+    return binary_hash(hilbert_key(l)>>(64-bit_count), bit_count);
+}
+
+/// Box of a Hilbert prefix, a prefix of odd length is the 2 halves of the next level merged
+constexpr bounding_box hilbert_decode(const binary_hash &hash) {
+    size_t bit_count=hash.size();
+    if (bit_count==0) {
+        return bounding_box(-90, 90, -180, 180);
+    }
+    if (bit_count%2) {
+        return merge(hilbert_decode(binary_hash(hash.bits<<1, bit_count+1)),
+                     hilbert_decode(binary_hash(hash.bits<<1 | 1, bit_count+1)));
+    }
+    return decode_key(key_from_hilbert(hash.bits<<(64-bit_count)), bit_count);
+}
+
+/// The Hilbert prefix of a binary hash cell, throws std::invalid_argument for an odd precision
+binary_hash hilbert_from_geohash(const binary_hash &cell);
+
+/// The binary hash cell of a Hilbert prefix, throws std::invalid_argument for an odd precision
+binary_hash geohash_from_hilbert(const binary_hash &hilbert);
+
+/// Neighbor of a Hilbert prefix, direction is (dlat, dlon) like neighbor(), throws
+/// std::invalid_argument for an odd precision
+binary_hash hilbert_neighbor(const binary_hash &hilbert, const std::pair<int, int> &direction);
+
+/// All 8 neighbors, in the same order as neighbors()
+std::array<binary_hash, 8> hilbert_neighbors(const binary_hash &hilbert);
+
+/// Hilbert key ranges of binary hash cells, such as the cells of a cover, coalesced.
+/// A cell of odd precision becomes its 2 halves.
+std::vector<key_range> hilbert_ranges(const std::vector<binary_hash> &cells);
+
+/// Hilbert key ranges of a cover of at most max_cells cells of even precision
+std::vector<key_range> hilbert_box_ranges(const bounding_box &box, size_t max_cells=16);
+std::vector<key_range> hilbert_radius_ranges(geolocation center, double dist, size_t max_cells=16);
+
+#endif
@@ -0,0 +1,170 @@
+//
+//  geohash_index.cpp
+//
+//  Cell covers used by the index queries.
+//
+
+#include <cmath>
+#include "geohash_index.hpp"
+
+/// Append the grid cells covering the box, uncoalesced
+static void append_box_ranges(const bounding_box &box, size_t max_cells, std::vector<key_range> &output) {
+    if (!(box.min_lat<=box.max_lat) || !(box.min_lon<=box.max_lon)) {
+        return;
+    }
+    // Every location in the box quantizes between the quantized corners
+    uint64_t lon_lo=quantize_longitude(box.min_lon), lon_hi=quantize_longitude(box.max_lon);
+    uint64_t lat_lo=quantize_latitude(box.min_lat), lat_hi=quantize_latitude(box.max_lat);
+    size_t bits=0;
+    for (size_t p=1; p<=MAX_BINHASH_LENGTH; p++) {
+        unsigned lon_shift=unsigned(32-(p+1)/2), lat_shift=unsigned(32-p/2);
+        uint64_t cells=((lon_hi>>lon_shift)-(lon_lo>>lon_shift)+1)*((lat_hi>>lat_shift)-(lat_lo>>lat_shift)+1);
+        if (cells>max_cells) {
+            break;
+        }
+        bits=p;
+    }
+    if (bits==0) {
+        output.push_back(key_range{0, 0});
+        return;
+    }
+    unsigned lon_shift=unsigned(32-(bits+1)/2), lat_shift=unsigned(32-bits/2);
+    for (uint64_t lat=lat_lo>>lat_shift; lat<=lat_hi>>lat_shift; lat++) {
+        for (uint64_t lon=lon_lo>>lon_shift; lon<=lon_hi>>lon_shift; lon++) {
+            uint64_t key=interleave(uint32_t(lon<<lon_shift), uint32_t(lat<<lat_shift));
+            output.push_back(cell_range(key, bits));
+        }
+    }
+}
+
+std::vector<key_range> box_ranges(const bounding_box &box, size_t max_cells) {
+    std::vector<key_range> output;
+    output.reserve(max_cells);
+    append_box_ranges(box, max_cells, output);
+    coalesce(output);
+    return output;
+}
+
+std::vector<key_range> box_radius_ranges(const bounding_box &box, double dist, size_t max_cells) {
+    std::vector<key_range> output;
+    if (!(dist>=0) || !(box.min_lat<=box.max_lat) || !(box.min_lon<=box.max_lon)) {
+        return output;
+    }
+    // Bounding box of the caps around the box, widened a little against rounding
+    const double slack=1+1e-9;
+    double angle=dist/EARTH_RADIUS;
+    double lat_range=angle*180/M_PI*slack;
+    double min_lat=box.min_lat-lat_range, max_lat=box.max_lat+lat_range;
+    double lon_range=180;
+    if (min_lat>-90 && max_lat<90) {
+        // The caps miss both poles, so sin(angle)<cos(latitude), the widest is the most poleward
+        double latitude=std::max(std::abs(box.min_lat), std::abs(box.max_lat));
+        lon_range=std::asin(std::min(1.0, std::sin(angle)/std::cos(latitude*M_PI/180)))*180/M_PI*slack;
+    }
+    min_lat=std::max(min_lat, -90.0);
+    max_lat=std::min(max_lat, 90.0);
+    double min_lon=box.min_lon-lon_range, max_lon=box.max_lon+lon_range;
+    output.reserve(2*max_cells);
+    if (max_lon-min_lon>=360) {
+        append_box_ranges(bounding_box(min_lat, max_lat, -180, 180), max_cells, output);
+    } else if (min_lon<-180) {
+        // Split at the antimeridian
+        append_box_ranges(bounding_box(min_lat, max_lat, min_lon+360, 180), max_cells, output);
+        append_box_ranges(bounding_box(min_lat, max_lat, -180, max_lon), max_cells, output);
+    } else if (max_lon>180) {
+        append_box_ranges(bounding_box(min_lat, max_lat, min_lon, 180), max_cells, output);
+        append_box_ranges(bounding_box(min_lat, max_lat, -180, max_lon-360), max_cells, output);
+    } else {
+        append_box_ranges(bounding_box(min_lat, max_lat, min_lon, max_lon), max_cells, output);
+    }
+    coalesce(output);
+    return output;
+}
+
+std::vector<key_range> radius_ranges(geolocation center, double dist, size_t max_cells) {
+    return box_radius_ranges(bounding_box(center, center), dist, max_cells);
+}
+
+std::vector<key_range> ring_ranges(uint64_t key, size_t bit_count, size_t r) {
+    std::vector<key_range> output;
+    if (bit_count==0) {
+        if (r==0) {
+            output.push_back(key_range{0, 0});
+        }
+        return output;
+    }
+    cell_indexes c(key, bit_count);
+    int64_t d=int64_t(r);
+    for (int64_t dlat=-d; dlat<=d; dlat++) {
+        int64_t lat=int64_t(c.lat)+dlat;
+        if (lat<0 || lat>=int64_t(c.lat_count())) {
+            continue;
+        }
+        // Whole rows at the top and bottom of the ring, the 2 ends of the rows between
+        int64_t step=(dlat==-d || dlat==d) ? 1 : std::max(2*d, int64_t(1));
+        for (int64_t dlon=-d; dlon<=d; dlon+=step) {
+            output.push_back(cell_range(c.key(c.wrap_lon(dlon), uint64_t(lat)), bit_count));
+        }
+    }
+    // Wide rings wrap around onto themselves
+    coalesce(output);
+    return output;
+}
+
+double ring_bound(geolocation center, size_t bit_count, size_t r) {
+    if (bit_count==0) {
+        return HUGE_VAL;
+    }
+    cell_indexes c(encode_key(center), bit_count);
+    double lat_step=180*inv_pow2[bit_count/2], lon_step=360*inv_pow2[(bit_count+1)/2];
+    double rows=double(c.lat), columns=double(c.lon), d=double(r);
+    double bound=HUGE_VAL;
+    // Parallel edges, the closest point of a parallel is along the meridian
+    if (rows-d>0) {
+        bound=std::min(bound, center.latitude-(-90+(rows-d)*lat_step));
+    }
+    if (rows+d+1<double(c.lat_count())) {
+        bound=std::min(bound, -90+(rows+d+1)*lat_step-center.latitude);
+    }
+    bound*=M_PI/180;
+    // Meridian edges, to the foot of the perpendicular, or to the pole past a right angle
+    if (2*d+1<double(c.lon_count())) {
+        double west=center.longitude-(-180+(columns-d)*lon_step);
+        double east=-180+(columns+d+1)*lon_step-center.longitude;
+        double phi=center.latitude*M_PI/180;
+        for (double dl : {west, east}) {
+            double angle=dl>=90 ? (90-std::abs(center.latitude))*M_PI/180
+                                : std::asin(std::min(1.0, std::cos(phi)*std::sin(dl*M_PI/180)));
+            bound=std::min(bound, angle);
+        }
+    }
+    return std::max(bound, 0.0)*EARTH_RADIUS;
+}
+
+std::vector<key_range> subtract_ranges(const key_range &range, const std::vector<key_range> &sorted) {
+    std::vector<key_range> output;
+    // Inclusive ends, so the end of the key space needs no special case
+    uint64_t at=range.begin, last=range.end-1;
+    bool more=range.end==0 || range.begin<range.end;
+    for (const key_range &s : sorted) {
+        uint64_t s_last=s.end-1;
+        if (!more || s.begin>last) {
+            break;
+        }
+        if (s_last<at) {
+            continue;
+        }
+        if (s.begin>at) {
+            output.push_back(key_range{at, s.begin});
+        }
+        if (s_last>=last) {
+            more=false;
+        } else {
+            at=s_last+1;
+        }
+    }
+    if (more) {
+        output.push_back(key_range{at, last+1});
+    }
+    return output;
+}
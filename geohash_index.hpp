@@ -0,0 +1,270 @@
+//
+//  geohash_index.hpp
+//
+//  In-memory spatial index, points sorted by 64-bit interleaved key in flat arrays.
+//
+
+#ifndef geohash_index_hpp_included
+#define geohash_index_hpp_included
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "geohash.hpp"
+#include "geohash_distance.hpp"
+
+/// Cells of the finest precision whose grid covers the box with at most max_cells cells,
+/// as coalesced key ranges. An inverted box covers nothing.
+std::vector<key_range> box_ranges(const bounding_box &box, size_t max_cells=16);
+
+/// Cells covering the bounding box of the circle, split at the antimeridian,
+/// as coalesced key ranges. A circle over a pole covers all longitudes.
+std::vector<key_range> radius_ranges(geolocation center, double dist, size_t max_cells=16);
+
+/// Same for the locations within dist km of any point of a box
+std::vector<key_range> box_radius_ranges(const bounding_box &box, double dist, size_t max_cells=16);
+
+/// Cells at ring distance r around the cell of key, the neighbors of the cell for r=1,
+/// as coalesced key ranges. Rows past a pole are left out.
+std::vector<key_range> ring_ranges(uint64_t key, size_t bit_count, size_t r);
+
+/// Lower bound of the distance in km from center to any location outside rings 0..r
+/// around its cell, infinite once the rings cover the sphere
+double ring_bound(geolocation center, size_t bit_count, size_t r);
+
+/// Parts of a range outside sorted, disjoint ranges
+std::vector<key_range> subtract_ranges(const key_range &range, const std::vector<key_range> &sorted);
+
+/// Cells of the last pass of a nearest neighbor query, and how many times the points scanned
+/// so far it may hold before the query rather keeps scanning rings
+constexpr size_t NEAREST_CELLS=64;
+constexpr size_t NEAREST_FACTOR=4;
+
+/// A point found by a nearest neighbor query
+struct index_match {
+    size_t position;
+    double distance;
+};
+
+inline bool operator<(const index_match &m1, const index_match &m2) {
+    return m1.distance<m2.distance || (m1.distance==m2.distance && m1.position<m2.position);
+}
+
+/// Points with a value each, sorted by key
+///
+/// Keys, locations and values live in separate arrays, so range scans only touch the keys
+/// until a candidate has to be checked. Bulk load sorts once; insert() appends and build()
+/// restores the order, queries in between throw std::logic_error.
+template<typename T>
+class geohash_index {
+public:
+    geohash_index()=default;
+
+    /// Bulk load, locations[i] holds values[i]
+    geohash_index(std::vector<geolocation> l, std::vector<T> v)
+    : locations(std::move(l))
+    , values(std::move(v))
+    {
+        if (locations.size()!=values.size()) {
+            throw std::invalid_argument("geohash_index: locations and values differ in size");
+        }
+        keys.resize(locations.size());
+        binary_encode(locations.data(), locations.size(), MAX_BINHASH_LENGTH, keys.data());
+        sorted=false;
+        build();
+    }
+
+    /// Append a point, the index needs build() before the next query
+    void insert(geolocation l, T value) {
+        keys.push_back(encode_key(l));
+        locations.push_back(l);
+        values.push_back(std::move(value));
+        sorted=false;
+    }
+
+    /// Sort by key, ties keep their insertion order
+    void build() {
+        if (sorted) {
+            return;
+        }
+        std::vector<std::pair<uint64_t, size_t>> order(keys.size());
+        for (size_t i=0; i<keys.size(); i++) {
+            order[i]={keys[i], i};
+        }
+        std::sort(order.begin(), order.end());
+        std::vector<geolocation> sorted_locations(locations.size());
+        std::vector<T> sorted_values;
+        sorted_values.reserve(values.size());
+        for (size_t i=0; i<order.size(); i++) {
+            keys[i]=order[i].first;
+            sorted_locations[i]=locations[order[i].second];
+            sorted_values.push_back(std::move(values[order[i].second]));
+        }
+        locations.swap(sorted_locations);
+        values.swap(sorted_values);
+        sorted=true;
+    }
+
+    size_t size() const { return keys.size(); }
+    bool empty() const { return keys.empty(); }
+
+    /// Point i in key order
+    uint64_t key(size_t i) const { return keys[i]; }
+    const geolocation &location(size_t i) const { return locations[i]; }
+    const T &value(size_t i) const { return values[i]; }
+    T &value(size_t i) { return values[i]; }
+
+    /// Position of the first point with a key not below key
+    size_t lower_bound(uint64_t key) const {
+        require_sorted();
+        return size_t(std::lower_bound(keys.begin(), keys.end(), key)-keys.begin());
+    }
+
+    /// Call visitor(i) for every point with a key in the range
+    template<typename Visitor>
+    void visit(const key_range &range, Visitor &&visitor) const {
+        size_t last=range.end==0 ? keys.size() : lower_bound(range.end);
+        for (size_t i=lower_bound(range.begin); i<last; i++) {
+            visitor(i);
+        }
+    }
+
+    /// Call visitor(i) for every point in a cell, such as the output of hash_codes
+    template<typename Visitor>
+    void visit(const geohash &cell, Visitor &&visitor) const {
+        visit(cell_range(cell.key(), 5*cell.size()), visitor);
+    }
+
+    /// Call visitor(i) for every point within dist km of center, by haversine
+    template<typename Visitor>
+    void visit_radius(geolocation center, double dist, Visitor &&visitor) const {
+        for (const key_range &range : radius_ranges(center, dist)) {
+            visit(range, [&](size_t i) {
+                if (within(center, locations[i], dist)) {
+                    visitor(i);
+                }
+            });
+        }
+    }
+
+    /// Call visitor(i) for every point in the box
+    template<typename Visitor>
+    void visit_box(const bounding_box &box, Visitor &&visitor) const {
+        for (const key_range &range : box_ranges(box)) {
+            visit(range, [&](size_t i) {
+                if (box.contains(locations[i])) {
+                    visitor(i);
+                }
+            });
+        }
+    }
+
+    /// The k points nearest to center by haversine, closest first
+    ///
+    /// The search starts at the finest even precision where the cell of center holds k points,
+    /// and scans rings of neighbor cells outward, keeping the k best in a max-heap, coarsening
+    /// by one level after every 2 rings. It stops once no location beyond the rings can beat
+    /// the kth best, or with one pass over the unscanned ranges within the kth distance, as
+    /// soon as they hold few enough points.
+    std::vector<index_match> nearest(geolocation center, size_t k) const {
+        require_sorted();
+        std::vector<index_match> heap;
+        if (k==0 || keys.empty()) {
+            return heap;
+        }
+        uint64_t key=encode_key(center);
+        size_t lo=0, hi=MAX_BINHASH_LENGTH/2;
+        while (lo<hi) {
+            size_t mid=(lo+hi+1)/2;
+            key_range cell=cell_range(key, 2*mid);
+            size_t last=cell.end==0 ? keys.size() : lower_bound(cell.end);
+            if (last-lower_bound(cell.begin)>=k) {
+                lo=mid;
+            } else {
+                hi=mid-1;
+            }
+        }
+        heap.reserve(k);
+        size_t scanned=0;
+        auto scan=[&](const key_range &range, const std::vector<key_range> &visited) {
+            for (const key_range &part : subtract_ranges(range, visited)) {
+                visit(part, [&](size_t i) {
+                    scanned++;
+                    index_match m{i, distance(center, locations[i], distance_mode::haversine)};
+                    if (heap.size()<k) {
+                        heap.push_back(m);
+                        std::push_heap(heap.begin(), heap.end());
+                    } else if (m<heap.front()) {
+                        std::pop_heap(heap.begin(), heap.end());
+                        heap.back()=m;
+                        std::push_heap(heap.begin(), heap.end());
+                    }
+                });
+            }
+        };
+        std::vector<key_range> visited;
+        for (size_t bits=2*lo, r=0;; r++) {
+            std::vector<key_range> ring=ring_ranges(key, bits, r);
+            for (const key_range &range : ring) {
+                scan(range, visited);
+            }
+            visited.insert(visited.end(), ring.begin(), ring.end());
+            coalesce(visited);
+            double bound=ring_bound(center, bits, r);
+            if (bound==HUGE_VAL || (heap.size()==k && bound>=heap.front().distance)) {
+                break;
+            }
+            if (heap.size()==k) {
+                // The rest lies within the kth distance, which rings cover badly near the poles,
+                // but coarse ranges around it can hold far more points than a few more rings
+                std::vector<key_range> rest=radius_ranges(center, heap.front().distance, NEAREST_CELLS);
+                size_t count=0;
+                for (const key_range &range : rest) {
+                    count+=(range.end==0 ? keys.size() : lower_bound(range.end))-lower_bound(range.begin);
+                }
+                if (count<=NEAREST_FACTOR*scanned) {
+                    for (const key_range &range : rest) {
+                        scan(range, visited);
+                    }
+                    break;
+                }
+            }
+            if (r==2 && bits>0) {
+                bits-=2;
+                r=size_t(-1);
+            }
+        }
+        std::sort_heap(heap.begin(), heap.end());
+        return heap;
+    }
+
+    /// Positions of the points within dist km of center, in key order
+    std::vector<size_t> radius(geolocation center, double dist) const {
+        std::vector<size_t> output;
+        visit_radius(center, dist, [&](size_t i) { output.push_back(i); });
+        return output;
+    }
+
+    /// Positions of the points in the box, in key order
+    std::vector<size_t> box(const bounding_box &b) const {
+        std::vector<size_t> output;
+        visit_box(b, [&](size_t i) { output.push_back(i); });
+        return output;
+    }
+
+private:
+    void require_sorted() const {
+        if (!sorted) {
+            throw std::logic_error("geohash_index: build() must follow insert() before queries");
+        }
+    }
+
+    std::vector<uint64_t> keys;
+    std::vector<geolocation> locations;
+    std::vector<T> values;
+    bool sorted=true;
+};
+
+#endif
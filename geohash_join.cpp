@@ -0,0 +1,185 @@
+//
+//  geohash_join.cpp
+//
+//  Sort-merge proximity join, parallel over partitions of left key groups.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "geohash_batch.hpp"
+#include "geohash_index.hpp"
+#include "geohash_join.hpp"
+
+/// Right candidates measured per call of the batch distance kernel
+constexpr size_t JOIN_BLOCK=1024;
+
+/// Locations sorted by key, with their original positions
+struct sorted_side {
+    sorted_side(const geolocation *l, size_t count)
+    : keys(count)
+    , positions(count)
+    , latitudes(count)
+    , longitudes(count)
+    {
+        binary_encode(l, count, MAX_BINHASH_LENGTH, keys.data());
+        std::vector<std::pair<uint64_t, size_t>> order(count);
+        for (size_t i=0; i<count; i++) {
+            order[i]={keys[i], i};
+        }
+        std::sort(order.begin(), order.end());
+        for (size_t i=0; i<count; i++) {
+            keys[i]=order[i].first;
+            positions[i]=order[i].second;
+            latitudes[i]=l[order[i].second].latitude;
+            longitudes[i]=l[order[i].second].longitude;
+        }
+    }
+
+    std::vector<uint64_t> keys;
+    std::vector<size_t> positions;
+    // Columns for the batch distance kernels
+    std::vector<double> latitudes;
+    std::vector<double> longitudes;
+};
+
+/// Bits of the cells grouping the left side, whose latitude side is at least dist
+static size_t group_bits(double dist) {
+    double cells=180*EARTH_RADIUS*RADIANS/dist;
+    double lat_bits=cells>=double(1ull<<31) ? 31 : std::floor(std::log2(std::max(cells, 1.0)));
+    return 2*size_t(lat_bits);
+}
+
+/// Pairs of one worker, flushed to the sink when the batch is full
+class join_batch {
+public:
+    join_batch(size_t batch_size, const join_sink &sink, std::mutex &sink_lock)
+    : batch_size(std::max(batch_size, size_t(1)))
+    , sink(sink)
+    , sink_lock(sink_lock)
+    {
+        pairs.reserve(this->batch_size);
+    }
+
+    void push_back(const join_pair &pair) {
+        pairs.push_back(pair);
+        if (pairs.size()==batch_size) {
+            flush();
+        }
+    }
+
+    void flush() {
+        if (!pairs.empty()) {
+            std::lock_guard<std::mutex> guard(sink_lock);
+            sink(pairs.data(), pairs.size());
+        }
+        count+=pairs.size();
+        pairs.clear();
+    }
+
+    size_t count=0;
+
+private:
+    size_t batch_size;
+    const join_sink &sink;
+    std::mutex &sink_lock;
+    std::vector<join_pair> pairs;
+};
+
+/// Join the left locations of one group, positions [first, last) of the sorted left side
+static void join_group(const sorted_side &left, size_t first, size_t last, const sorted_side &right,
+                       double dist, distance_mode mode, join_batch &batch)
+{
+    bounding_box box(left.latitudes[first], left.latitudes[first], left.longitudes[first], left.longitudes[first]);
+    for (size_t i=first+1; i<last; i++) {
+        box.merge(bounding_box(left.latitudes[i], left.latitudes[i], left.longitudes[i], left.longitudes[i]));
+    }
+    double distances[JOIN_BLOCK];
+    for (const key_range &range : box_radius_ranges(box, dist)) {
+        size_t begin=size_t(std::lower_bound(right.keys.begin(), right.keys.end(), range.begin)-right.keys.begin());
+        size_t end=range.end==0 ? right.keys.size()
+                                : size_t(std::lower_bound(right.keys.begin()+begin, right.keys.end(), range.end)-right.keys.begin());
+        for (size_t block=begin; block<end; block+=JOIN_BLOCK) {
+            size_t n=std::min(JOIN_BLOCK, end-block);
+            for (size_t i=first; i<last; i++) {
+                geolocation origin{left.latitudes[i], left.longitudes[i]};
+                distance(origin, &right.latitudes[block], &right.longitudes[block], n, distances, mode);
+                for (size_t j=0; j<n; j++) {
+                    if (distances[j]<=dist) {
+                        batch.push_back(join_pair{left.positions[i], right.positions[block+j], distances[j]});
+                    }
+                }
+            }
+        }
+    }
+}
+
+size_t proximity_join(const geolocation *left, size_t left_count,
+                      const geolocation *right, size_t right_count,
+                      double dist, const join_sink &sink,
+                      const join_options &options)
+{
+    if (!(dist>=0) || left_count==0 || right_count==0) {
+        return 0;
+    }
+    sorted_side l(left, left_count), r(right, right_count);
+
+    // Groups are runs of left keys in one cell, partitions are runs of groups
+    size_t bits=group_bits(dist);
+    std::vector<size_t> groups;
+    for (size_t i=0; i<left_count; i++) {
+        if (i==0 || bits==0 || (l.keys[i]>>(64-bits))!=(l.keys[i-1]>>(64-bits))) {
+            groups.push_back(i);
+        }
+    }
+    groups.push_back(left_count);
+    size_t workers=options.threads ? options.threads : std::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+    size_t partition_size=std::max(left_count/(workers*16), size_t(64));
+    std::vector<size_t> partitions{0};
+    for (size_t g=1; g<groups.size(); g++) {
+        if (groups[g]-groups[partitions.back()]>=partition_size || g+1==groups.size()) {
+            partitions.push_back(g);
+        }
+    }
+    size_t partition_count=partitions.size()-1;
+    workers=std::max(std::min(workers, partition_count), size_t(1));
+
+    std::atomic<size_t> next_partition{0}, pair_count{0};
+    std::atomic<bool> failed{false};
+    std::mutex sink_lock, error_lock;
+    std::exception_ptr error;
+    auto work=[&]() {
+        try {
+            join_batch batch(options.batch_size, sink, sink_lock);
+            for (size_t p=next_partition++; p<partition_count && !failed.load(std::memory_order_relaxed); p=next_partition++) {
+                for (size_t g=partitions[p]; g<partitions[p+1]; g++) {
+                    join_group(l, groups[g], groups[g+1], r, dist, options.mode, batch);
+                }
+            }
+            batch.flush();
+            pair_count+=batch.count;
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(error_lock);
+            if (!error) {
+                error=std::current_exception();
+            }
+            failed=true;
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t w=1; w<workers; w++) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return pair_count;
+}
@@ -0,0 +1,52 @@
+//
+//  geohash_join.hpp
+//
+//  Proximity join of 2 point sets, a sort-merge over interleaved keys.
+//
+
+#ifndef geohash_join_hpp_included
+#define geohash_join_hpp_included
+
+#include <functional>
+#include <vector>
+#include "geohash.hpp"
+#include "geohash_distance.hpp"
+
+/// A left and a right location within the join distance
+struct join_pair {
+    size_t left;
+    size_t right;
+    double distance;
+};
+
+struct join_options {
+    /// Worker threads, 0 for one per hardware thread
+    size_t threads=0;
+    /// Pairs per call of the sink
+    size_t batch_size=4096;
+    distance_mode mode=distance_mode::haversine;
+};
+
+/// Receives the pairs in batches of at most batch_size, one call at a time
+using join_sink=std::function<void(const join_pair *pairs, size_t count)>;
+
+/// Find every pair of a left and a right location at most dist km apart
+///
+/// Both sides are sorted by key. The left side is grouped into cells about dist across,
+/// each group probes the right key ranges around its points, like hash_codes probes the
+/// neighbors of a cell, and the candidates are refined by exact distance. Groups are split
+/// into partitions for the workers, and each worker streams its pairs to the sink, so batches
+/// come in no particular order. Returns the number of pairs, exceptions of the sink pass through.
+size_t proximity_join(const geolocation *left, size_t left_count,
+                      const geolocation *right, size_t right_count,
+                      double dist, const join_sink &sink,
+                      const join_options &options=join_options());
+
+inline size_t proximity_join(const std::vector<geolocation> &left, const std::vector<geolocation> &right,
+                             double dist, const join_sink &sink,
+                             const join_options &options=join_options())
+{
+    return proximity_join(left.data(), left.size(), right.data(), right.size(), dist, sink, options);
+}
+
+#endif
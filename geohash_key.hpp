@@ -0,0 +1,220 @@
+//
+//  geohash_key.hpp
+//
+//  Cells as left-aligned interleaved keys of 64 or 128 bits, for use as sort keys.
+//
+
+#ifndef geohash_key_hpp_included
+#define geohash_key_hpp_included
+
+#include <cstdint>
+#include <stdexcept>
+#include "geohash.hpp"
+
+/// Unsigned 128-bit integer of GCC and Clang
+__extension__ using uint128_t=unsigned __int128;
+
+/// Half-open range [begin, end) of 128-bit keys, end 0 stands for 2^128
+struct key_range128 {
+    uint128_t begin=0;
+    uint128_t end=0;
+
+    constexpr bool contains(uint128_t key) const { return key>=begin && (end==0 || key<end); }
+};
+
+constexpr bool operator==(const key_range128 &r1, const key_range128 &r2) {
+    return r1.begin==r2.begin && r1.end==r2.end;
+}
+
+constexpr bool operator!=(const key_range128 &r1, const key_range128 &r2) {
+    return !(r1==r2);
+}
+
+/// 128-bit keys
+///
+/// Each axis is quantized to 64 bits. The top 32 are the cell of encode_key(), the low 32
+/// quantize the location again within that cell, so the top 64 bits of a 128-bit key are
+/// the 64-bit key. A double carries 53 bits, so the lowest bits of an axis near its far
+/// end only repeat the rounding of the input.
+
+/// Low half of a 64-bit cell index, the 2^32 cells within the cell [lo, lo+step]
+constexpr uint32_t quantize_within(double x, double lo, double step, uint32_t cell) {
+    return quantize(x, lo+double(cell)*step, step);
+}
+
+/// Full 128-bit interleaved key of the location, longitude bit first
+constexpr uint128_t encode_key128(geolocation l) {
+    const double lon_step=360*inv_pow2[32], lat_step=180*inv_pow2[32];
+    uint32_t lon=quantize_longitude(l.longitude), lat=quantize_latitude(l.latitude);
+    uint32_t lon_low=quantize_within(l.longitude, -180, lon_step, lon);
+    uint32_t lat_low=quantize_within(l.latitude, -90, lat_step, lat);
+    return (uint128_t(interleave(lon, lat))<<64) | interleave(lon_low, lat_low);
+}
+
+/// Decode the cell given by the top bit_count bits of a 128-bit key
+constexpr bounding_box decode_key128(uint128_t key, size_t bit_count) {
+    if (bit_count<=64) {
+        return decode_key(uint64_t(key>>64), bit_count);
+    }
+    // Edges are the edges of the 64-bit cell, plus a fraction of that cell
+    uint32_t lon=0, lat=0, lon_low=0, lat_low=0;
+    deinterleave(uint64_t(key>>64), lon, lat);
+    deinterleave(uint64_t(key), lon_low, lat_low);
+    size_t lon_bits=(bit_count-63)/2;
+    size_t lat_bits=(bit_count-64)/2;
+    double lon_step=360*inv_pow2[32], lat_step=180*inv_pow2[32];
+    double lon_lo=-180+double(lon)*lon_step, lat_lo=-90+double(lat)*lat_step;
+    double lon_index=double(uint64_t(lon_low)>>(32-lon_bits));
+    double lat_index=double(uint64_t(lat_low)>>(32-lat_bits));
+    bounding_box output;
+    output.min_lon=lon_lo+lon_index*lon_step*inv_pow2[lon_bits];
+    output.max_lon=lon_lo+(lon_index+1)*lon_step*inv_pow2[lon_bits];
+    output.min_lat=lat_lo+lat_index*lat_step*inv_pow2[lat_bits];
+    output.max_lat=lat_lo+(lat_index+1)*lat_step*inv_pow2[lat_bits];
+    return output;
+}
+
+/// Key ranges of a prefix
+
+/// Keys starting with the top bit_count bits of prefix, the same as cell_range()
+constexpr key_range key_range_for_prefix(uint64_t prefix, size_t bit_count) {
+    return cell_range(prefix, bit_count);
+}
+
+/// 128-bit keys starting with the top bit_count bits of prefix
+constexpr key_range128 key_range_for_prefix(uint128_t prefix, size_t bit_count) {
+    if (bit_count==0) {
+        return key_range128{0, 0};
+    }
+    uint128_t size=uint128_t(1)<<(128-std::min(bit_count, size_t(128)));
+    uint128_t begin=prefix & ~(size-1);
+    return key_range128{begin, begin+size};
+}
+
+/// Width, codec and range type of a key type
+template<typename Key>
+struct key_traits;
+
+template<>
+struct key_traits<uint64_t> {
+    static constexpr size_t BITS=64;
+    using range_type=key_range;
+    static constexpr uint64_t encode(geolocation l) { return encode_key(l); }
+    static constexpr bounding_box decode(uint64_t key, size_t bit_count) { return decode_key(key, bit_count); }
+};
+
+template<>
+struct key_traits<uint128_t> {
+    static constexpr size_t BITS=128;
+    using range_type=key_range128;
+    static constexpr uint128_t encode(geolocation l) { return encode_key128(l); }
+    static constexpr bounding_box decode(uint128_t key, size_t bit_count) { return decode_key128(key, bit_count); }
+};
+
+/// A cell as the top bits of a left-aligned interleaved key, the bits below are always zero
+///
+/// Keys compare as the cells' positions on the Z-order curve, a cell right before the cells
+/// inside it, so sorted keys keep every cell's descendants contiguous after it. Every
+/// operation is a few shifts and masks, and defined for any length from 0 to the full width.
+template<typename Key>
+struct interleaved_key {
+    static constexpr size_t BITS=key_traits<Key>::BITS;
+    using range_type=typename key_traits<Key>::range_type;
+
+    interleaved_key()=default;
+
+    /// Cell of the top bit_count bits of key, throws std::invalid_argument past the full width
+    constexpr interleaved_key(Key key, size_t bit_count)
+    : bits(key & mask(bit_count))
+    , length(uint8_t(bit_count))
+    {
+        if (bit_count>BITS) {
+            throw std::invalid_argument("interleaved key is at most its full width");
+        }
+    }
+
+    /// Cell of bit_count bits holding the location, capped at the full width
+    static constexpr interleaved_key encode(geolocation l, size_t bit_count=BITS) {
+        return interleaved_key(key_traits<Key>::encode(l), std::min(bit_count, BITS));
+    }
+
+    constexpr bounding_box decode() const { return key_traits<Key>::decode(bits, length); }
+
+    /// Left-aligned key, zero past size()
+    constexpr Key key() const { return bits; }
+    constexpr size_t size() const { return length; }
+    constexpr bool empty() const { return length==0; }
+
+    /// Bit n counting from 1, the most significant, false past size()
+    constexpr bool test(size_t n) const {
+        return n>=1 && n<=length && ((bits>>(BITS-n)) & 1)!=0;
+    }
+
+    /// The cell of the first bit_count bits, itself if it is not longer
+    constexpr interleaved_key prefix(size_t bit_count) const {
+        return bit_count>=length ? *this : interleaved_key(bits, bit_count);
+    }
+
+    /// The cell levels bits up, the whole world past the root
+    constexpr interleaved_key parent(size_t levels=1) const {
+        return prefix(levels>=length ? 0 : length-levels);
+    }
+
+    /// Half of the cell with the next bit b, throws std::invalid_argument at the full width
+    constexpr interleaved_key child(bool b) const {
+        if (length>=BITS) {
+            throw std::invalid_argument("interleaved key is at most its full width");
+        }
+        interleaved_key output=*this;
+        output.bits|=Key(b)<<(BITS-1-length);
+        output.length++;
+        return output;
+    }
+
+    /// Whether cell is this cell or inside it
+    constexpr bool contains(const interleaved_key &cell) const {
+        return cell.length>=length && (cell.bits & mask(length))==bits;
+    }
+
+    /// Full-width keys inside the cell
+    constexpr range_type range() const { return key_range_for_prefix(bits, length); }
+
+    /// Top bit_count bits set
+    static constexpr Key mask(size_t bit_count) {
+        return bit_count==0 ? Key(0) : ~Key(0)<<(BITS-std::min(bit_count, BITS));
+    }
+
+    Key bits=0;
+    uint8_t length=0;
+};
+
+template<typename Key>
+constexpr bool operator==(const interleaved_key<Key> &k1, const interleaved_key<Key> &k2) {
+    return k1.bits==k2.bits && k1.length==k2.length;
+}
+
+template<typename Key>
+constexpr bool operator!=(const interleaved_key<Key> &k1, const interleaved_key<Key> &k2) {
+    return !(k1==k2);
+}
+
+/// Z-order, and a cell before the cells inside it
+template<typename Key>
+constexpr bool operator<(const interleaved_key<Key> &k1, const interleaved_key<Key> &k2) {
+    return k1.bits<k2.bits || (k1.bits==k2.bits && k1.length<k2.length);
+}
+
+using key64=interleaved_key<uint64_t>;
+using key128=interleaved_key<uint128_t>;
+
+/// The same cell as a right-aligned binary hash, and back
+constexpr binary_hash to_binary_hash(const key64 &cell) {
+    return cell.empty() ? binary_hash() : binary_hash(cell.key()>>(64-cell.size()), cell.size());
+}
+
+constexpr key64 to_key64(const binary_hash &hash) {
+    size_t bit_count=std::min(hash.size(), MAX_BINHASH_LENGTH);
+    return bit_count==0 ? key64() : key64(hash.bits<<(64-bit_count), bit_count);
+}
+
+#endif
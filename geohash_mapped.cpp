@@ -0,0 +1,332 @@
+//
+//  geohash_mapped.cpp
+//
+//  Writing and mapping index files.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "geohash_batch.hpp"
+#include "geohash_mapped.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// format
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr char INDEX_FILE_MAGIC[8]={'G', 'E', 'O', 'H', 'I', 'D', 'X', 0};
+/// Written as is, a file from a machine of the other byte order reads it swapped
+constexpr uint32_t INDEX_FILE_BYTE_ORDER=0x01020304;
+/// Sections start at multiples of a cache line
+constexpr uint64_t INDEX_FILE_ALIGNMENT=64;
+/// Bytes gathered per write call
+constexpr size_t INDEX_FILE_BUFFER=1<<20;
+/// Largest directory, 16M slots
+constexpr size_t INDEX_FILE_MAX_DIRECTORY_BITS=24;
+/// Points per directory slot, when the writer picks the size
+constexpr size_t INDEX_FILE_POINTS_PER_SLOT=64;
+
+struct index_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t count;
+    uint64_t directory_bits;
+    uint64_t keys_offset;
+    uint64_t locations_offset;
+    uint64_t payload_offsets_offset;
+    uint64_t payloads_offset;
+    uint64_t payload_size;
+    uint64_t directory_offset;
+    uint64_t file_size;
+    uint64_t reserved[5];
+};
+static_assert(sizeof(index_file_header)==128, "index file header is 128 bytes");
+static_assert(sizeof(geolocation)==16, "locations are stored as 2 doubles");
+
+static uint64_t align(uint64_t offset) {
+    return (offset+INDEX_FILE_ALIGNMENT-1) & ~(INDEX_FILE_ALIGNMENT-1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writing
+////////////////////////////////////////////////////////////////////////////////
+
+/// Buffered sequential writes to a file descriptor, padded to the section offsets
+class file_writer {
+public:
+    file_writer(int fd, const std::string &path) : fd(fd), path(path) {
+        buffer.reserve(INDEX_FILE_BUFFER);
+    }
+
+    void write(const void *data, size_t size) {
+        const char *p=static_cast<const char *>(data);
+        if (buffer.size()+size>INDEX_FILE_BUFFER) {
+            flush();
+        }
+        if (size>=INDEX_FILE_BUFFER) {
+            write_all(p, size);
+        } else {
+            buffer.insert(buffer.end(), p, p+size);
+        }
+        position+=size;
+    }
+
+    void pad_to(uint64_t offset) {
+        static const char zeros[INDEX_FILE_ALIGNMENT]={};
+        while (position<offset) {
+            write(zeros, size_t(std::min(offset-position, INDEX_FILE_ALIGNMENT)));
+        }
+    }
+
+    void flush() {
+        write_all(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+private:
+    void write_all(const char *p, size_t size) {
+        while (size>0) {
+            ssize_t written=::write(fd, p, size);
+            if (written<0 && errno==EINTR) {
+                continue;
+            }
+            if (written<0) {
+                throw std::system_error(errno, std::generic_category(), "geohash_mapped: cannot write "+path);
+            }
+            p+=written;
+            size-=size_t(written);
+        }
+    }
+
+    int fd;
+    const std::string &path;
+    std::vector<char> buffer;
+    uint64_t position=0;
+};
+
+void write_index_file(const std::string &path, const std::vector<geolocation> &locations,
+                      const std::vector<std::string> &payloads, size_t directory_bits)
+{
+    if (locations.size()!=payloads.size()) {
+        throw std::invalid_argument("geohash_mapped: locations and payloads differ in size");
+    }
+    size_t count=locations.size();
+    if (directory_bits==0) {
+        while (directory_bits<INDEX_FILE_MAX_DIRECTORY_BITS
+               && (size_t(2)<<directory_bits)*INDEX_FILE_POINTS_PER_SLOT<=count) {
+            directory_bits++;
+        }
+    }
+    directory_bits=std::min(directory_bits, INDEX_FILE_MAX_DIRECTORY_BITS);
+
+    // Key order, ties keep their input order like geohash_index
+    std::vector<uint64_t> keys(count);
+    binary_encode(locations.data(), count, MAX_BINHASH_LENGTH, keys.data());
+    std::vector<std::pair<uint64_t, size_t>> order(count);
+    for (size_t i=0; i<count; i++) {
+        order[i]={keys[i], i};
+    }
+    std::sort(order.begin(), order.end());
+
+    size_t slots=size_t(1)<<directory_bits;
+    std::vector<uint64_t> directory(slots+1);
+    std::vector<uint64_t> payload_offsets(count+1);
+    uint64_t payload_size=0;
+    for (size_t i=0, t=0; i<=count; i++) {
+        // Slots up to the one of key i start at i
+        size_t slot=i==count ? slots : (directory_bits ? size_t(order[i].first>>(64-directory_bits)) : 0);
+        for (; t<=slot && t<=slots; t++) {
+            directory[t]=i;
+        }
+        payload_offsets[i]=payload_size;
+        if (i<count) {
+            keys[i]=order[i].first;
+            payload_size+=payloads[order[i].second].size();
+        }
+    }
+
+    index_file_header header{};
+    std::memcpy(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic));
+    header.version=INDEX_FILE_VERSION;
+    header.byte_order=INDEX_FILE_BYTE_ORDER;
+    header.count=count;
+    header.directory_bits=directory_bits;
+    header.keys_offset=align(sizeof(header));
+    header.locations_offset=align(header.keys_offset+count*sizeof(uint64_t));
+    header.payload_offsets_offset=align(header.locations_offset+count*sizeof(geolocation));
+    header.payloads_offset=align(header.payload_offsets_offset+(count+1)*sizeof(uint64_t));
+    header.payload_size=payload_size;
+    header.directory_offset=align(header.payloads_offset+payload_size);
+    header.file_size=header.directory_offset+(slots+1)*sizeof(uint64_t);
+
+    std::string temporary=path+".tmp";
+    int fd=::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd<0) {
+        throw std::system_error(errno, std::generic_category(), "geohash_mapped: cannot create "+temporary);
+    }
+    try {
+        file_writer out(fd, temporary);
+        out.write(&header, sizeof(header));
+        out.pad_to(header.keys_offset);
+        out.write(keys.data(), count*sizeof(uint64_t));
+        out.pad_to(header.locations_offset);
+        for (size_t i=0; i<count; i++) {
+            out.write(&locations[order[i].second], sizeof(geolocation));
+        }
+        out.pad_to(header.payload_offsets_offset);
+        out.write(payload_offsets.data(), payload_offsets.size()*sizeof(uint64_t));
+        out.pad_to(header.payloads_offset);
+        for (size_t i=0; i<count; i++) {
+            const std::string &payload=payloads[order[i].second];
+            out.write(payload.data(), payload.size());
+        }
+        out.pad_to(header.directory_offset);
+        out.write(directory.data(), directory.size()*sizeof(uint64_t));
+        out.flush();
+        if (::fsync(fd)!=0) {
+            throw std::system_error(errno, std::generic_category(), "geohash_mapped: cannot sync "+temporary);
+        }
+    } catch (...) {
+        ::close(fd);
+        ::unlink(temporary.c_str());
+        throw;
+    }
+    ::close(fd);
+    if (::rename(temporary.c_str(), path.c_str())!=0) {
+        int e=errno;
+        ::unlink(temporary.c_str());
+        throw std::system_error(e, std::generic_category(), "geohash_mapped: cannot rename to "+path);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// mapping
+////////////////////////////////////////////////////////////////////////////////
+
+mapped_index::mapped_index(const std::string &path) {
+    int fd=::open(path.c_str(), O_RDONLY);
+    if (fd<0) {
+        throw std::system_error(errno, std::generic_category(), "geohash_mapped: cannot open "+path);
+    }
+    struct stat st;
+    if (::fstat(fd, &st)!=0) {
+        int e=errno;
+        ::close(fd);
+        throw std::system_error(e, std::generic_category(), "geohash_mapped: cannot stat "+path);
+    }
+    length=size_t(st.st_size);
+    if (length<sizeof(index_file_header)) {
+        ::close(fd);
+        throw std::invalid_argument("geohash_mapped: "+path+" is not an index file");
+    }
+    void *p=::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    int e=errno;
+    // The mapping keeps the file
+    ::close(fd);
+    if (p==MAP_FAILED) {
+        throw std::system_error(e, std::generic_category(), "geohash_mapped: cannot map "+path);
+    }
+    address=static_cast<const char *>(p);
+
+    index_file_header header;
+    std::memcpy(&header, address, sizeof(header));
+    auto fail=[&](const char *what) {
+        close();
+        throw std::invalid_argument("geohash_mapped: "+path+" "+what);
+    };
+    if (std::memcmp(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic))!=0) {
+        fail("is not an index file");
+    }
+    if (header.byte_order!=INDEX_FILE_BYTE_ORDER) {
+        fail("has the wrong byte order");
+    }
+    if (header.version!=INDEX_FILE_VERSION) {
+        fail("has an unsupported version");
+    }
+    // Sections in order, aligned and within the file, offsets and sizes are at most the
+    // length, far from overflowing
+    uint64_t n=header.count;
+    bool valid=header.file_size==length && header.directory_bits<=INDEX_FILE_MAX_DIRECTORY_BITS
+        && n<=length/sizeof(geolocation)
+        && header.keys_offset>=sizeof(header)
+        && header.locations_offset>=header.keys_offset+n*sizeof(uint64_t)
+        && header.payload_offsets_offset>=header.locations_offset+n*sizeof(geolocation)
+        && header.payloads_offset>=header.payload_offsets_offset+(n+1)*sizeof(uint64_t)
+        && header.payload_size<=length
+        && header.directory_offset>=header.payloads_offset+header.payload_size
+        && header.directory_offset<=length
+        && (length-header.directory_offset)/sizeof(uint64_t)>=(uint64_t(1)<<header.directory_bits)+1;
+    for (uint64_t offset : {header.keys_offset, header.locations_offset, header.payload_offsets_offset,
+                            header.payloads_offset, header.directory_offset}) {
+        valid=valid && offset<=length && offset%alignof(uint64_t)==0;
+    }
+    if (!valid) {
+        fail("is damaged");
+    }
+    count=size_t(n);
+    directory_bits=size_t(header.directory_bits);
+    keys=reinterpret_cast<const uint64_t *>(address+header.keys_offset);
+    locations=reinterpret_cast<const geolocation *>(address+header.locations_offset);
+    payload_offsets=reinterpret_cast<const uint64_t *>(address+header.payload_offsets_offset);
+    payloads=address+header.payloads_offset;
+    payload_size=size_t(header.payload_size);
+    directory=reinterpret_cast<const uint64_t *>(address+header.directory_offset);
+    // Lookups trust the directory, so check it, it is small
+    size_t slots=size_t(1)<<directory_bits;
+    for (size_t t=0; t<slots; t++) {
+        if (directory[t]>directory[t+1]) {
+            fail("is damaged");
+        }
+    }
+    if (directory[0]!=0 || directory[slots]!=count || payload_offsets[count]!=payload_size) {
+        fail("is damaged");
+    }
+}
+
+mapped_index::~mapped_index() {
+    close();
+}
+
+mapped_index::mapped_index(mapped_index &&other) noexcept {
+    *this=std::move(other);
+}
+
+mapped_index &mapped_index::operator=(mapped_index &&other) noexcept {
+    if (this!=&other) {
+        close();
+        address=std::exchange(other.address, nullptr);
+        length=std::exchange(other.length, 0);
+        count=std::exchange(other.count, 0);
+        directory_bits=std::exchange(other.directory_bits, 0);
+        keys=std::exchange(other.keys, nullptr);
+        locations=std::exchange(other.locations, nullptr);
+        payload_offsets=std::exchange(other.payload_offsets, nullptr);
+        payloads=std::exchange(other.payloads, nullptr);
+        payload_size=std::exchange(other.payload_size, 0);
+        directory=std::exchange(other.directory, nullptr);
+    }
+    return *this;
+}
+
+void mapped_index::close() {
+    if (address) {
+        ::munmap(const_cast<char *>(address), length);
+        address=nullptr;
+    }
+}
+
+std::string_view mapped_index::payload(size_t i) const {
+    uint64_t begin=payload_offsets[i], end=payload_offsets[i+1];
+    if (begin>end || end>payload_size) {
+        throw std::invalid_argument("geohash_mapped: damaged payload offsets");
+    }
+    return std::string_view(payloads+begin, size_t(end-begin));
+}
@@ -0,0 +1,133 @@
+//
+//  geohash_mapped.hpp
+//
+//  Index files queried in place through a read-only shared mapping.
+//
+
+#ifndef geohash_mapped_hpp_included
+#define geohash_mapped_hpp_included
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "geohash.hpp"
+#include "geohash_distance.hpp"
+#include "geohash_index.hpp"
+
+/// Version written by write_index_file, and the only one mapped_index opens
+constexpr uint32_t INDEX_FILE_VERSION=1;
+
+/// Write the points to an index file, payloads[i] is stored with locations[i]
+///
+/// The file is a 128-byte header followed by sections, each 64-byte aligned, in native byte
+/// order: the keys sorted, the locations in key order, count+1 payload offsets, the payload
+/// bytes, and a directory of the first position of every value of the top directory_bits key
+/// bits, plus one for the end. directory_bits=0 picks about 64 points per directory slot.
+/// The file is written next to path and renamed over it, so readers never see half a file.
+/// Throws std::invalid_argument when the sizes differ, std::system_error when writing fails.
+void write_index_file(const std::string &path, const std::vector<geolocation> &locations,
+                      const std::vector<std::string> &payloads, size_t directory_bits=0);
+
+/// An index file mapped read-only
+///
+/// Opening checks the header and the section bounds and maps the file, nothing is read or
+/// copied, so it takes about as long for any size. The mapping is shared, processes on a host
+/// opening the same file share its pages in the page cache. Queries match geohash_index.
+class mapped_index {
+public:
+    /// Map an index file, throws std::system_error when it cannot be opened or mapped, and
+    /// std::invalid_argument when it is not an index file of a supported version
+    explicit mapped_index(const std::string &path);
+    ~mapped_index();
+
+    mapped_index(mapped_index &&other) noexcept;
+    mapped_index &operator=(mapped_index &&other) noexcept;
+    mapped_index(const mapped_index &)=delete;
+    mapped_index &operator=(const mapped_index &)=delete;
+
+    size_t size() const { return count; }
+    bool empty() const { return count==0; }
+
+    /// Point i in key order
+    uint64_t key(size_t i) const { return keys[i]; }
+    const geolocation &location(size_t i) const { return locations[i]; }
+    /// Payload bytes of point i, valid while the index is open
+    std::string_view payload(size_t i) const;
+
+    /// Position of the first point with a key not below key
+    size_t lower_bound(uint64_t key) const {
+        size_t t=directory_bits ? size_t(key>>(64-directory_bits)) : 0;
+        return size_t(std::lower_bound(keys+directory[t], keys+directory[t+1], key)-keys);
+    }
+
+    /// Call visitor(i) for every point with a key in the range
+    template<typename Visitor>
+    void visit(const key_range &range, Visitor &&visitor) const {
+        size_t last=range.end==0 ? count : lower_bound(range.end);
+        for (size_t i=lower_bound(range.begin); i<last; i++) {
+            visitor(i);
+        }
+    }
+
+    /// Call visitor(i) for every point in a cell, such as the output of hash_codes
+    template<typename Visitor>
+    void visit(const geohash &cell, Visitor &&visitor) const {
+        visit(cell_range(cell.key(), 5*cell.size()), visitor);
+    }
+
+    /// Call visitor(i) for every point within dist km of center, by haversine
+    template<typename Visitor>
+    void visit_radius(geolocation center, double dist, Visitor &&visitor) const {
+        for (const key_range &range : radius_ranges(center, dist)) {
+            visit(range, [&](size_t i) {
+                if (within(center, locations[i], dist)) {
+                    visitor(i);
+                }
+            });
+        }
+    }
+
+    /// Call visitor(i) for every point in the box
+    template<typename Visitor>
+    void visit_box(const bounding_box &box, Visitor &&visitor) const {
+        for (const key_range &range : box_ranges(box)) {
+            visit(range, [&](size_t i) {
+                if (box.contains(locations[i])) {
+                    visitor(i);
+                }
+            });
+        }
+    }
+
+    /// Positions of the points within dist km of center, in key order
+    std::vector<size_t> radius(geolocation center, double dist) const {
+        std::vector<size_t> output;
+        visit_radius(center, dist, [&](size_t i) { output.push_back(i); });
+        return output;
+    }
+
+    /// Positions of the points in the box, in key order
+    std::vector<size_t> box(const bounding_box &b) const {
+        std::vector<size_t> output;
+        visit_box(b, [&](size_t i) { output.push_back(i); });
+        return output;
+    }
+
+private:
+    void close();
+
+    const char *address=nullptr;
+    size_t length=0;
+    size_t count=0;
+    size_t directory_bits=0;
+    const uint64_t *keys=nullptr;
+    const geolocation *locations=nullptr;
+    const uint64_t *payload_offsets=nullptr;
+    const char *payloads=nullptr;
+    size_t payload_size=0;
+    const uint64_t *directory=nullptr;
+};
+
+#endif
@@ -0,0 +1,221 @@
+//
+//  geohash_metrics.cpp
+//
+//  Per thread counters on their own cache lines, summed under a registry lock.
+//
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include "geohash_metrics.hpp"
+
+const char *metric_name(metric m) {
+    static const char *const names[METRIC_COUNT]={
+        "encode", "decode", "neighbor", "neighbors", "hash_precision", "base_hash",
+        "binary_hash_precision", "from_geohash",
+    };
+    return names[size_t(m)];
+}
+
+#if GEOHASH_INSTRUMENTATION
+
+namespace {
+
+/// Counters of one thread, only it writes them, so a load and a store replace a locked add
+struct alignas(64) thread_counters {
+    struct function {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> errors{0};
+        std::atomic<uint64_t> timed{0};
+        std::atomic<uint64_t> timed_ns{0};
+        std::array<std::atomic<uint64_t>, METRIC_BUCKETS> latency{};
+    };
+    std::array<function, METRIC_COUNT> functions;
+    std::array<std::atomic<uint64_t>, MAX_GEOHASH_LENGTH+1> hash_precisions{};
+    std::atomic<uint64_t> empty_base_hashes{0};
+};
+
+void bump(std::atomic<uint64_t> &counter, uint64_t by=1) {
+    counter.store(counter.load(std::memory_order_relaxed)+by, std::memory_order_relaxed);
+}
+
+/// Threads counting now, and the totals of those gone
+std::mutex registry_lock;
+std::vector<thread_counters *> registry;
+metrics_snapshot departed;
+
+void add_to(metrics_snapshot &output, const thread_counters &t) {
+    for (size_t f=0; f<METRIC_COUNT; f++) {
+        function_metrics &o=output.functions[f];
+        const thread_counters::function &i=t.functions[f];
+        o.calls+=i.calls.load(std::memory_order_relaxed);
+        o.errors+=i.errors.load(std::memory_order_relaxed);
+        o.timed+=i.timed.load(std::memory_order_relaxed);
+        o.timed_ns+=i.timed_ns.load(std::memory_order_relaxed);
+        for (size_t b=0; b<METRIC_BUCKETS; b++) {
+            o.latency[b]+=i.latency[b].load(std::memory_order_relaxed);
+        }
+    }
+    for (size_t p=0; p<=MAX_GEOHASH_LENGTH; p++) {
+        output.hash_precisions[p]+=t.hash_precisions[p].load(std::memory_order_relaxed);
+    }
+    output.empty_base_hashes+=t.empty_base_hashes.load(std::memory_order_relaxed);
+}
+
+/// Trivial, so reaching it skips the guard of a thread_local with a constructor
+struct thread_state {
+    thread_counters *counters;
+    uint32_t countdown;
+};
+
+thread_local thread_state local;
+
+/// Moves a thread's counts to the departed totals as it exits
+struct thread_owner {
+    ~thread_owner() {
+        std::lock_guard<std::mutex> guard(registry_lock);
+        add_to(departed, *local.counters);
+        for (thread_counters *&t : registry) {
+            if (t==local.counters) {
+                t=registry.back();
+                registry.pop_back();
+                break;
+            }
+        }
+        delete local.counters;
+        local.counters=nullptr;
+    }
+};
+
+thread_local thread_owner owner;
+
+thread_counters &counters() {
+    if (!local.counters) {
+        (void)&owner;
+        local.counters=new thread_counters();
+        std::lock_guard<std::mutex> guard(registry_lock);
+        registry.push_back(local.counters);
+    }
+    return *local.counters;
+}
+
+uint64_t now_ns() {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+}
+
+uint64_t geohash_metrics::start_call() {
+    if (local.countdown!=0) {
+        local.countdown--;
+        return 0;
+    }
+    local.countdown=METRIC_SAMPLE_PERIOD-1;
+    return std::max<uint64_t>(now_ns(), 1);
+}
+
+void geohash_metrics::record_call(metric m, uint64_t start, bool failed) {
+    thread_counters::function &f=counters().functions[size_t(m)];
+    bump(f.calls);
+    if (failed) {
+        bump(f.errors);
+    }
+    if (start) {
+        uint64_t ns=now_ns()-start;
+        bump(f.timed);
+        bump(f.timed_ns, ns);
+        size_t bucket=ns ? size_t(63-__builtin_clzll(ns)) : 0;
+        bump(f.latency[std::min(bucket, METRIC_BUCKETS-1)]);
+    }
+}
+
+void geohash_metrics::record_precision(size_t precision) {
+    bump(counters().hash_precisions[std::min(precision, MAX_GEOHASH_LENGTH)]);
+}
+
+void geohash_metrics::record_empty_base_hash() {
+    bump(counters().empty_base_hashes);
+}
+
+metrics_snapshot snapshot_metrics() {
+    std::lock_guard<std::mutex> guard(registry_lock);
+    metrics_snapshot output=departed;
+    for (const thread_counters *t : registry) {
+        add_to(output, *t);
+    }
+    return output;
+}
+
+void reset_metrics() {
+    std::lock_guard<std::mutex> guard(registry_lock);
+    departed=metrics_snapshot();
+    for (thread_counters *t : registry) {
+        // Racy against the owner's load and store, a call in flight may survive the reset
+        for (thread_counters::function &f : t->functions) {
+            f.calls.store(0, std::memory_order_relaxed);
+            f.errors.store(0, std::memory_order_relaxed);
+            f.timed.store(0, std::memory_order_relaxed);
+            f.timed_ns.store(0, std::memory_order_relaxed);
+            for (std::atomic<uint64_t> &b : f.latency) {
+                b.store(0, std::memory_order_relaxed);
+            }
+        }
+        for (std::atomic<uint64_t> &p : t->hash_precisions) {
+            p.store(0, std::memory_order_relaxed);
+        }
+        t->empty_base_hashes.store(0, std::memory_order_relaxed);
+    }
+}
+
+#else
+
+metrics_snapshot snapshot_metrics() {
+    return metrics_snapshot();
+}
+
+void reset_metrics() {
+}
+
+#endif
+
+std::string format_metrics(const metrics_snapshot &snapshot) {
+    std::string output;
+    auto line=[&](const std::string &name, const std::string &labels, uint64_t value) {
+        output+=name;
+        if (!labels.empty()) {
+            output+="{"+labels+"}";
+        }
+        output+=" "+std::to_string(value)+"\n";
+    };
+    output+="# TYPE geohash_calls_total counter\n";
+    for (size_t f=0; f<METRIC_COUNT; f++) {
+        line("geohash_calls_total", "function=\""+std::string(metric_name(metric(f)))+"\"", snapshot.functions[f].calls);
+    }
+    output+="# TYPE geohash_errors_total counter\n";
+    for (size_t f=0; f<METRIC_COUNT; f++) {
+        line("geohash_errors_total", "function=\""+std::string(metric_name(metric(f)))+"\"", snapshot.functions[f].errors);
+    }
+    // Cumulative buckets of the timed calls, le is the bucket's upper edge in seconds
+    output+="# TYPE geohash_call_seconds histogram\n";
+    for (size_t f=0; f<METRIC_COUNT; f++) {
+        const function_metrics &m=snapshot.functions[f];
+        std::string name="function=\""+std::string(metric_name(metric(f)))+"\"";
+        uint64_t cumulative=0;
+        for (size_t b=0; b+1<METRIC_BUCKETS; b++) {
+            cumulative+=m.latency[b];
+            line("geohash_call_seconds_bucket", name+",le=\""+std::to_string(double(uint64_t(2)<<b)*1e-9)+"\"", cumulative);
+        }
+        line("geohash_call_seconds_bucket", name+",le=\"+Inf\"", m.timed);
+        output+="geohash_call_seconds_sum{"+name+"} "+std::to_string(double(m.timed_ns)*1e-9)+"\n";
+        line("geohash_call_seconds_count", name, m.timed);
+    }
+    output+="# TYPE geohash_hash_precision_total counter\n";
+    for (size_t p=0; p<=MAX_GEOHASH_LENGTH; p++) {
+        line("geohash_hash_precision_total", "precision=\""+std::to_string(p)+"\"", snapshot.hash_precisions[p]);
+    }
+    output+="# TYPE geohash_empty_base_hash_total counter\n";
+    line("geohash_empty_base_hash_total", "", snapshot.empty_base_hashes);
+    return output;
+}
@@ -0,0 +1,123 @@
+//
+//  geohash_metrics.hpp
+//
+//  Optional call counters and sampled latency histograms of the string API, per thread.
+//
+
+#ifndef geohash_metrics_hpp_included
+#define geohash_metrics_hpp_included
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include "geohash.hpp"
+
+#ifndef GEOHASH_INSTRUMENTATION
+#define GEOHASH_INSTRUMENTATION 0
+#endif
+
+/// Whether the library was built with -DGEOHASH_INSTRUMENTATION=ON, the snapshots stay empty otherwise
+constexpr bool INSTRUMENTED=GEOHASH_INSTRUMENTATION!=0;
+
+/// Measured functions, the out of line ones of the string API. The constexpr key functions
+/// take a few nanoseconds, timing them would cost more than the call.
+enum class metric {
+    encode,
+    decode,
+    neighbor,
+    neighbors,
+    hash_precision,
+    base_hash,
+    binary_hash_precision,
+    from_geohash,
+};
+
+constexpr size_t METRIC_COUNT=8;
+/// Latency buckets, bucket b counts calls of [2^b, 2^(b+1)) ns, the last one everything longer
+constexpr size_t METRIC_BUCKETS=24;
+/// Each thread times one call in this many, reading the clock costs about as much as a call
+constexpr uint32_t METRIC_SAMPLE_PERIOD=16;
+
+const char *metric_name(metric m);
+
+struct function_metrics {
+    uint64_t calls=0;
+    /// Calls that threw
+    uint64_t errors=0;
+    /// Calls timed, about one in METRIC_SAMPLE_PERIOD, their total and their histogram
+    uint64_t timed=0;
+    uint64_t timed_ns=0;
+    std::array<uint64_t, METRIC_BUCKETS> latency{};
+};
+
+/// Totals over every thread, including threads that exited
+struct metrics_snapshot {
+    std::array<function_metrics, METRIC_COUNT> functions{};
+    /// Precisions returned by hash_precision, base_hash included
+    std::array<uint64_t, MAX_GEOHASH_LENGTH+1> hash_precisions{};
+    /// base_hash calls giving an empty string, the distance spans more than any cell
+    uint64_t empty_base_hashes=0;
+
+    const function_metrics &operator[](metric m) const { return functions[size_t(m)]; }
+};
+
+/// Sum the counters of every thread. Threads keep counting meanwhile, so a snapshot may
+/// catch a call counted but not yet in its histogram. Takes a lock, not the counting threads.
+metrics_snapshot snapshot_metrics();
+
+/// Zero every counter. Calls in flight on other threads may be partly kept.
+void reset_metrics();
+
+/// A snapshot in the Prometheus text format, as counters labelled by function
+std::string format_metrics(const metrics_snapshot &snapshot);
+
+#if GEOHASH_INSTRUMENTATION
+
+#include <exception>
+
+namespace geohash_metrics {
+
+/// Start time in ns of a call to time, 0 for the calls left out of the sample
+uint64_t start_call();
+/// Count a call of m in the calling thread's counters, and time it unless start is 0
+void record_call(metric m, uint64_t start, bool failed);
+void record_precision(size_t precision);
+void record_empty_base_hash();
+
+/// Counts the enclosing call, as an error when it unwinds by an exception
+class scope {
+public:
+    explicit scope(metric m)
+    : which(m)
+    , exceptions(std::uncaught_exceptions())
+    , start(start_call())
+    {}
+
+    ~scope() {
+        record_call(which, start, std::uncaught_exceptions()>exceptions);
+    }
+
+    scope(const scope &)=delete;
+    scope &operator=(const scope &)=delete;
+
+private:
+    metric which;
+    int exceptions;
+    uint64_t start;
+};
+
+}
+
+#define GEOHASH_MEASURE(m) geohash_metrics::scope geohash_measure_scope(m)
+#define GEOHASH_RECORD_PRECISION(p) geohash_metrics::record_precision(p)
+#define GEOHASH_RECORD_EMPTY_BASE_HASH() geohash_metrics::record_empty_base_hash()
+
+#else
+
+#define GEOHASH_MEASURE(m) ((void)0)
+#define GEOHASH_RECORD_PRECISION(p) ((void)0)
+#define GEOHASH_RECORD_EMPTY_BASE_HASH() ((void)0)
+
+#endif
+
+#endif
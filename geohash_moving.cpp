@@ -0,0 +1,492 @@
+//
+//  geohash_moving.cpp
+//
+//  Moving objects under sequence locks, cells of append-only member arrays, epoch reclamation.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "geohash_cover.hpp"
+#include "geohash_distance.hpp"
+#include "geohash_moving.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// Epochs
+
+/// Reader slots, threads past these share one counter that holds the epoch back
+constexpr size_t EPOCH_SLOTS=256;
+/// Retired objects per thread between attempts to free them
+constexpr size_t EPOCH_BATCH=64;
+
+namespace {
+
+struct alignas(64) epoch_slot {
+    /// Epoch the reader entered at, 0 when idle
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<bool> taken{false};
+};
+
+struct retired {
+    uint64_t epoch;
+    void *object;
+    void (*release)(void *);
+};
+
+/// Epochs start at 2 so that 0 means idle
+std::atomic<uint64_t> global_epoch{2};
+epoch_slot epoch_slots[EPOCH_SLOTS];
+std::atomic<size_t> overflow_readers{0};
+
+/// Objects retired by threads that exited before they could be freed
+std::mutex orphan_lock;
+std::vector<retired> orphans;
+std::atomic<bool> has_orphans{false};
+
+/// Advance the epoch when every reader has seen the current one
+void try_advance() {
+    uint64_t e=global_epoch.load(std::memory_order_seq_cst);
+    if (overflow_readers.load(std::memory_order_seq_cst)!=0) {
+        return;
+    }
+    for (const epoch_slot &s : epoch_slots) {
+        uint64_t r=s.epoch.load(std::memory_order_seq_cst);
+        if (r!=0 && r!=e) {
+            return;
+        }
+    }
+    global_epoch.compare_exchange_strong(e, e+1, std::memory_order_seq_cst);
+}
+
+/// Free the objects no reader can hold, those retired at least 2 epochs ago
+void release_expired(std::vector<retired> &list) {
+    uint64_t e=global_epoch.load(std::memory_order_seq_cst);
+    size_t kept=0;
+    for (const retired &r : list) {
+        if (r.epoch+2<=e) {
+            r.release(r.object);
+        } else {
+            list[kept++]=r;
+        }
+    }
+    list.resize(kept);
+}
+
+struct epoch_thread {
+    epoch_slot *slot=nullptr;
+    size_t depth=0;
+    std::vector<retired> retire_list;
+
+    epoch_thread() {
+        for (epoch_slot &s : epoch_slots) {
+            bool free=false;
+            if (!s.taken.load(std::memory_order_relaxed) &&
+                s.taken.compare_exchange_strong(free, true, std::memory_order_acquire)) {
+                slot=&s;
+                break;
+            }
+        }
+    }
+
+    ~epoch_thread() {
+        try_advance();
+        release_expired(retire_list);
+        if (!retire_list.empty()) {
+            std::lock_guard<std::mutex> guard(orphan_lock);
+            orphans.insert(orphans.end(), retire_list.begin(), retire_list.end());
+            has_orphans.store(true, std::memory_order_release);
+        }
+        if (slot) {
+            slot->taken.store(false, std::memory_order_release);
+        }
+    }
+
+    void enter() {
+        if (depth++>0) {
+            return;
+        }
+        if (!slot) {
+            overflow_readers.fetch_add(1, std::memory_order_seq_cst);
+            return;
+        }
+        // Publish an epoch that is still current, so an advance that missed it cannot pass it
+        uint64_t e;
+        do {
+            e=global_epoch.load(std::memory_order_seq_cst);
+            slot->epoch.store(e, std::memory_order_seq_cst);
+        } while (global_epoch.load(std::memory_order_seq_cst)!=e);
+    }
+
+    void exit() {
+        if (--depth>0) {
+            return;
+        }
+        if (!slot) {
+            overflow_readers.fetch_sub(1, std::memory_order_seq_cst);
+        } else {
+            slot->epoch.store(0, std::memory_order_release);
+        }
+    }
+
+    void retire(void *object, void (*release)(void *)) {
+        retire_list.push_back(retired{global_epoch.load(std::memory_order_seq_cst), object, release});
+        if (retire_list.size()%EPOCH_BATCH==0) {
+            try_advance();
+            release_expired(retire_list);
+            if (has_orphans.load(std::memory_order_acquire)) {
+                std::lock_guard<std::mutex> guard(orphan_lock);
+                release_expired(orphans);
+                has_orphans.store(!orphans.empty(), std::memory_order_release);
+            }
+        }
+    }
+};
+
+thread_local epoch_thread this_thread;
+
+/// Keeps what the thread reads from being freed while it lives
+struct epoch_guard {
+    epoch_guard() { this_thread.enter(); }
+    ~epoch_guard() { this_thread.exit(); }
+    epoch_guard(const epoch_guard &)=delete;
+    epoch_guard &operator=(const epoch_guard &)=delete;
+};
+
+/// Orphans left at exit have no readers
+struct orphan_cleanup {
+    ~orphan_cleanup() {
+        for (const retired &r : orphans) {
+            r.release(r.object);
+        }
+    }
+} cleanup;
+
+template<typename T>
+void retire(const T *object) {
+    this_thread.retire(const_cast<T *>(object), [](void *p) { delete static_cast<T *>(p); });
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Slots and cells
+
+/// Key of no cell, cell keys have at most 63 bits so the last is always clear
+constexpr uint64_t NO_CELL=~uint64_t(0);
+/// Cells visited one by one before a query scans every cell instead
+constexpr size_t MOVING_PROBES=4096;
+/// Smallest member array
+constexpr size_t MOVING_MIN_MEMBERS=4;
+
+/// Ids that joined a cell, appended under the shard lock. Readers see the first count, some
+/// of them may have left since, or joined twice, so readers check the slots.
+struct moving_index::member_block {
+    explicit member_block(size_t capacity) : ids(capacity) {}
+
+    std::vector<uint32_t> ids;
+    std::atomic<size_t> count{0};
+};
+
+struct moving_index::slot {
+    /// Odd while a write is in progress
+    std::atomic<uint64_t> version{0};
+    std::atomic<uint64_t> latitude{0};
+    std::atomic<uint64_t> longitude{0};
+    std::atomic<uint64_t> cell_key{NO_CELL};
+};
+
+struct moving_index::cell {
+    uint64_t key;
+    /// Replaced by a compacted copy under the shard lock when full or mostly left
+    std::atomic<member_block *> members;
+    std::atomic<cell *> next;
+    /// Objects whose slot names the cell, under the shard lock
+    size_t live;
+};
+
+struct alignas(64) moving_index::shard {
+    std::mutex lock;
+    std::atomic<cell *> head{nullptr};
+};
+
+static uint64_t double_bits(double x) {
+    uint64_t output;
+    std::memcpy(&output, &x, sizeof(output));
+    return output;
+}
+
+static double bits_double(uint64_t x) {
+    double output;
+    std::memcpy(&output, &x, sizeof(output));
+    return output;
+}
+
+moving_index::moving_index(size_t capacity, size_t bit_count)
+: slot_count(capacity)
+, bits(bit_count)
+{
+    if (bit_count>=MAX_BINHASH_LENGTH) {
+        throw std::invalid_argument("moving_index: cells have at most 63 bits");
+    }
+    if (capacity>size_t(UINT32_MAX)) {
+        throw std::invalid_argument("moving_index: at most 2^32-1 objects");
+    }
+    slots.reset(new slot[capacity]);
+    // About 8 objects per shard, so moves rarely wait on each other
+    shard_bits=6;
+    while (shard_bits<24 && (size_t(1)<<shard_bits)*8<capacity) {
+        shard_bits++;
+    }
+    shards.reset(new shard[size_t(1)<<shard_bits]);
+}
+
+moving_index::~moving_index() {
+    for (size_t s=0; s<(size_t(1)<<shard_bits); s++) {
+        for (cell *c=shards[s].head.load(); c;) {
+            cell *next=c->next.load();
+            delete c->members.load();
+            delete c;
+            c=next;
+        }
+    }
+}
+
+moving_index::shard &moving_index::shard_of(uint64_t cell_key) const {
+    return shards[(cell_key*0x9E3779B97F4A7C15)>>(64-shard_bits)];
+}
+
+/// Let the other hyperthread run while spinning
+static inline void spin_pause() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+bool moving_index::read(size_t id, geolocation &l, uint64_t &cell_key) const {
+    const slot &s=slots[id];
+    for (;;) {
+        uint64_t v=s.version.load(std::memory_order_acquire);
+        if (v & 1) {
+            spin_pause();
+            continue;
+        }
+        uint64_t lat=s.latitude.load(std::memory_order_relaxed);
+        uint64_t lon=s.longitude.load(std::memory_order_relaxed);
+        uint64_t key=s.cell_key.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.version.load(std::memory_order_relaxed)==v) {
+            l=geolocation{bits_double(lat), bits_double(lon)};
+            cell_key=key;
+            return key!=NO_CELL;
+        }
+    }
+}
+
+void moving_index::write(size_t id, geolocation l, uint64_t cell_key) {
+    slot &s=slots[id];
+    uint64_t v=s.version.load(std::memory_order_relaxed);
+    s.version.store(v+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.latitude.store(double_bits(l.latitude), std::memory_order_relaxed);
+    s.longitude.store(double_bits(l.longitude), std::memory_order_relaxed);
+    s.cell_key.store(cell_key, std::memory_order_relaxed);
+    s.version.store(v+2, std::memory_order_release);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Updates
+
+/// Replace the members of a cell by those still in it, each once, under the shard lock.
+/// Room for as many again, so appends until the next compaction pay for this one.
+void moving_index::compact(cell &c) {
+    const member_block *old=c.members.load(std::memory_order_relaxed);
+    std::vector<uint32_t> ids(old->ids.begin(), old->ids.begin()+std::ptrdiff_t(old->count.load(std::memory_order_relaxed)));
+    // Objects leaving or joining the cell need this lock, so the slots naming it are stable
+    ids.erase(std::remove_if(ids.begin(), ids.end(), [&](uint32_t id) {
+        return slots[id].cell_key.load(std::memory_order_relaxed)!=c.key;
+    }), ids.end());
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    member_block *m=new member_block(std::max(2*ids.size(), MOVING_MIN_MEMBERS));
+    std::copy(ids.begin(), ids.end(), m->ids.begin());
+    m->count.store(ids.size(), std::memory_order_relaxed);
+    c.members.store(m, std::memory_order_release);
+    retire(old);
+}
+
+/// Append an object to a cell, under the shard lock
+void moving_index::join(cell &c, size_t id) {
+    member_block *m=c.members.load(std::memory_order_relaxed);
+    if (m->count.load(std::memory_order_relaxed)==m->ids.size()) {
+        compact(c);
+        m=c.members.load(std::memory_order_relaxed);
+    }
+    size_t n=m->count.load(std::memory_order_relaxed);
+    m->ids[n]=uint32_t(id);
+    // Readers load the count with acquire, so they see the id it covers
+    m->count.store(n+1, std::memory_order_release);
+    c.live++;
+}
+
+/// Remove an object from a cell, unlinking the cell when it empties, under the shard lock.
+/// The object's slot no longer names the cell, so its id stays in the array until compacted.
+void moving_index::leave(shard &from, uint64_t cell_key) {
+    std::atomic<cell *> *link=&from.head;
+    cell *o=link->load(std::memory_order_relaxed);
+    while (o->key!=cell_key) {
+        link=&o->next;
+        o=link->load(std::memory_order_relaxed);
+    }
+    if (--o->live==0) {
+        link->store(o->next.load(std::memory_order_relaxed), std::memory_order_release);
+        retire(o->members.load(std::memory_order_relaxed));
+        retire(o);
+    } else if (4*o->live<o->members.load(std::memory_order_relaxed)->count.load(std::memory_order_relaxed)) {
+        // Readers would mostly skip departed ids
+        compact(*o);
+    }
+}
+
+void moving_index::update(size_t id, geolocation l) {
+    if (id>=slot_count) {
+        throw std::invalid_argument("moving_index: id past the capacity");
+    }
+    uint64_t key=bits ? encode_key(l) & ~(~uint64_t(0)>>bits) : 0;
+    // Only this thread writes the slot, so its cell cannot change under us
+    uint64_t old_key=slots[id].cell_key.load(std::memory_order_relaxed);
+    if (old_key==key) {
+        write(id, l, key);
+        return;
+    }
+    shard &to=shard_of(key);
+    shard *from=old_key==NO_CELL ? nullptr : &shard_of(old_key);
+    std::unique_lock<std::mutex> first, second;
+    if (!from || from==&to) {
+        first=std::unique_lock<std::mutex>(to.lock);
+    } else {
+        first=std::unique_lock<std::mutex>(std::min(from, &to)->lock);
+        second=std::unique_lock<std::mutex>(std::max(from, &to)->lock);
+    }
+    // Join the new cell before the slot names it, so readers of the cell find the object
+    cell *c=to.head.load(std::memory_order_relaxed);
+    while (c && c->key!=key) {
+        c=c->next.load(std::memory_order_relaxed);
+    }
+    if (!c) {
+        c=new cell{key, {new member_block(MOVING_MIN_MEMBERS)}, {to.head.load(std::memory_order_relaxed)}, 0};
+        join(*c, id);
+        to.head.store(c, std::memory_order_release);
+    } else {
+        join(*c, id);
+    }
+    write(id, l, key);
+    if (from) {
+        leave(*from, old_key);
+    } else {
+        present.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void moving_index::erase(size_t id) {
+    if (id>=slot_count) {
+        return;
+    }
+    uint64_t key=slots[id].cell_key.load(std::memory_order_relaxed);
+    if (key==NO_CELL) {
+        return;
+    }
+    shard &from=shard_of(key);
+    std::lock_guard<std::mutex> guard(from.lock);
+    write(id, geolocation{0, 0}, NO_CELL);
+    leave(from, key);
+    present.fetch_sub(1, std::memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Queries
+
+bool moving_index::find(size_t id, geolocation &l) const {
+    uint64_t key;
+    return id<slot_count && read(id, l, key);
+}
+
+void moving_index::collect(const cell &c, geolocation center, double dist, std::vector<moving_object> &output) const {
+    const member_block *members=c.members.load(std::memory_order_acquire);
+    size_t count=members->count.load(std::memory_order_acquire);
+    for (size_t i=0; i<count; i++) {
+        uint32_t id=members->ids[i];
+        geolocation l;
+        uint64_t key;
+        // An object is taken from the cell its slot names, it sits in 2 arrays mid move and
+        // departed ids stay until compacted
+        if (read(id, l, key) && key==c.key && within(center, l, dist)) {
+            output.push_back(moving_object{id, l});
+        }
+    }
+}
+
+/// Objects in id order, each once, the first taken of an object that changed cell mid query
+static std::vector<moving_object> unique_objects(std::vector<moving_object> objects) {
+    std::stable_sort(objects.begin(), objects.end(), [](const moving_object &a, const moving_object &b) { return a.id<b.id; });
+    objects.erase(std::unique(objects.begin(), objects.end(), [](const moving_object &a, const moving_object &b) { return a.id==b.id; }),
+                  objects.end());
+    return objects;
+}
+
+std::vector<moving_object> moving_index::radius(geolocation center, double dist) const {
+    std::vector<moving_object> output;
+    std::vector<bounding_box> boxes=circle_bounds(center, dist);
+    if (boxes.empty()) {
+        return output;
+    }
+    epoch_guard guard;
+    size_t lon_bits=(bits+1)/2, lat_bits=bits/2;
+    struct span {
+        uint64_t lon_begin, lon_end, lat_begin, lat_end;
+    };
+    std::vector<span> spans;
+    size_t probes=0;
+    for (const bounding_box &b : boxes) {
+        span s{uint64_t(quantize_longitude(b.min_lon))>>(32-lon_bits),
+               (uint64_t(quantize_longitude(b.max_lon))>>(32-lon_bits))+1,
+               uint64_t(quantize_latitude(b.min_lat))>>(32-lat_bits),
+               (uint64_t(quantize_latitude(b.max_lat))>>(32-lat_bits))+1};
+        probes+=(s.lon_end-s.lon_begin)*(s.lat_end-s.lat_begin);
+        spans.push_back(s);
+    }
+    if (probes>MOVING_PROBES) {
+        // Large circles go through every cell, those out of reach are skipped on their box
+        for (size_t s=0; s<(size_t(1)<<shard_bits); s++) {
+            for (const cell *c=shards[s].head.load(std::memory_order_acquire); c; c=c->next.load(std::memory_order_acquire)) {
+                if (distance(center, decode_key(c->key, bits))<=dist) {
+                    collect(*c, center, dist, output);
+                }
+            }
+        }
+        return unique_objects(std::move(output));
+    }
+    // Coarse cells may lie in both boxes of a circle split at the antimeridian
+    std::vector<uint64_t> keys;
+    keys.reserve(probes);
+    for (const span &s : spans) {
+        for (uint64_t lat=s.lat_begin; lat<s.lat_end; lat++) {
+            for (uint64_t lon=s.lon_begin; lon<s.lon_end; lon++) {
+                keys.push_back(interleave(uint32_t(lon<<(32-lon_bits)), uint32_t(lat<<(32-lat_bits))));
+            }
+        }
+    }
+    if (spans.size()>1) {
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
+    for (uint64_t key : keys) {
+        const cell *c=shard_of(key).head.load(std::memory_order_acquire);
+        while (c && c->key!=key) {
+            c=c->next.load(std::memory_order_acquire);
+        }
+        if (c) {
+            collect(*c, center, dist, output);
+        }
+    }
+    return unique_objects(std::move(output));
+}
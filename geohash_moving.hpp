@@ -0,0 +1,98 @@
+//
+//  geohash_moving.hpp
+//
+//  Concurrent index of moving objects, bucketed by cell, read under epoch protection.
+//
+
+#ifndef geohash_moving_hpp_included
+#define geohash_moving_hpp_included
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "geohash.hpp"
+
+/// An object found by a query, with the location it had when read
+struct moving_object {
+    size_t id;
+    geolocation location;
+};
+
+/// Objects 0..capacity-1 with a location each, bucketed by the cell of their key
+///
+/// Every object has a slot holding its location and cell under a sequence lock. An update
+/// that stays in its cell only rewrites the slot, no lock is taken. An update that changes
+/// the cell locks the shards of both cells, appends the object to the new cell's members,
+/// moves the slot, then counts it out of the old cell, whose array keeps the id. Arrays are
+/// compacted into a copy when full or when 3 in 4 of their ids have left, so a move costs
+/// amortized constant time and an allocation only once per compaction. Readers take no lock:
+/// they walk the cells under an epoch guard, which keeps replaced arrays alive until every
+/// reader that could hold them is gone, and take an object only from the cell its slot
+/// names. An object that changes cell during a query can be taken from both, queries drop
+/// the second.
+///
+/// Any number of threads may update and query at once, but updates of one object must come
+/// from one thread at a time. An object changing cell during a query may be missed by it.
+class moving_index {
+public:
+    /// Objects with ids below capacity, bucketed into cells of bit_count bits, at most 63,
+    /// throws std::invalid_argument for more
+    moving_index(size_t capacity, size_t bit_count);
+    ~moving_index();
+
+    moving_index(const moving_index &)=delete;
+    moving_index &operator=(const moving_index &)=delete;
+
+    size_t capacity() const { return slot_count; }
+    size_t bit_count() const { return bits; }
+    /// Objects present
+    size_t size() const { return present.load(std::memory_order_relaxed); }
+
+    /// Set the location of an object, adding it if absent, throws std::invalid_argument for
+    /// an id past the capacity. Locations out of range go to the nearest cell, like encode_key.
+    void update(size_t id, geolocation l);
+
+    /// Remove an object, nothing happens when it is absent
+    void erase(size_t id);
+
+    /// Location of an object, false when it is absent
+    bool find(size_t id, geolocation &l) const;
+
+    /// Objects within dist km of center, by haversine, in id order
+    std::vector<moving_object> radius(geolocation center, double dist) const;
+
+    /// Call visitor(id, location) for every object within dist km of center, in id order
+    template<typename Visitor>
+    void visit_radius(geolocation center, double dist, Visitor &&visitor) const {
+        for (const moving_object &o : radius(center, dist)) {
+            visitor(o.id, o.location);
+        }
+    }
+
+private:
+    struct slot;
+    struct member_block;
+    struct cell;
+    struct shard;
+
+    /// Read a slot consistently, false when the object is absent
+    bool read(size_t id, geolocation &l, uint64_t &cell_key) const;
+    void write(size_t id, geolocation l, uint64_t cell_key);
+    shard &shard_of(uint64_t cell_key) const;
+    void compact(cell &c);
+    void join(cell &c, size_t id);
+    void leave(shard &from, uint64_t cell_key);
+    /// Add the members of a cell within the circle to output
+    void collect(const cell &c, geolocation center, double dist, std::vector<moving_object> &output) const;
+
+    size_t slot_count;
+    size_t bits;
+    std::unique_ptr<slot[]> slots;
+    size_t shard_bits;
+    std::unique_ptr<shard[]> shards;
+    std::atomic<size_t> present{0};
+};
+
+#endif
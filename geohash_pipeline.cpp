@@ -0,0 +1,431 @@
+//
+//  geohash_pipeline.cpp
+//
+//  Chunked parsing and encoding on a work-stealing thread pool, with ordered output.
+//
+
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "geohash_batch.hpp"
+#include "geohash_pipeline.hpp"
+
+/// Records parsed before each call to the batch encoder
+constexpr size_t PIPELINE_BLOCK=1024;
+
+////////////////////////////////////////////////////////////////////////////////
+// scheduling
+////////////////////////////////////////////////////////////////////////////////
+
+/// Chunks dealt round robin to the workers
+///
+/// Worker w owns chunks w, w+workers, w+2*workers..., numbered by position in that sequence.
+/// It takes its own from the front, so the chunks in flight stay close together and the
+/// output rarely waits, and steals from the back of the others when it runs out.
+class chunk_scheduler {
+public:
+    chunk_scheduler(size_t chunks, size_t workers)
+    : queues(workers)
+    {
+        for (size_t w=0; w<workers; w++) {
+            uint64_t owned=chunks>w ? (chunks-w+workers-1)/workers : 0;
+            queues[w].range.store(owned, std::memory_order_relaxed);
+        }
+    }
+
+    /// Next chunk for a worker, false when every chunk is taken
+    bool next(size_t worker, size_t &chunk) {
+        size_t workers=queues.size();
+        for (size_t n=0; n<workers; n++) {
+            size_t victim=(worker+n)%workers;
+            std::atomic<uint64_t> &range=queues[victim].range;
+            uint64_t r=range.load(std::memory_order_relaxed);
+            for (;;) {
+                // Positions [begin, end) are left, packed as begin<<32 | end
+                uint64_t begin=r>>32, end=r & 0xffffffffull;
+                if (begin>=end) {
+                    break;
+                }
+                uint64_t position=n==0 ? begin : end-1;
+                uint64_t taken=n==0 ? ((begin+1)<<32 | end) : (begin<<32 | (end-1));
+                if (range.compare_exchange_weak(r, taken, std::memory_order_relaxed)) {
+                    chunk=size_t(victim+position*workers);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+private:
+    struct alignas(64) queue {
+        std::atomic<uint64_t> range{0};
+    };
+    std::vector<queue> queues;
+};
+
+/// Hands chunk buffers to the sink in chunk order
+///
+/// Whichever worker completes the next chunk becomes the writer and drains every buffer that
+/// is ready, the others only park theirs. Workers wait before taking more input while the
+/// writer is busy and too much output is parked.
+class ordered_output {
+public:
+    ordered_output(size_t chunks, size_t max_pending, const pipeline_sink &sink)
+    : buffers(chunks)
+    , ready(chunks, false)
+    , max_pending(max_pending)
+    , sink(sink)
+    {}
+
+    void commit(size_t chunk, std::vector<char> buffer) {
+        std::unique_lock<std::mutex> guard(lock);
+        pending+=buffer.size();
+        buffers[chunk]=std::move(buffer);
+        ready[chunk]=true;
+        if (writing) {
+            return;
+        }
+        writing=true;
+        while (next<ready.size() && ready[next]) {
+            std::vector<char> out=std::move(buffers[next]);
+            next++;
+            guard.unlock();
+            try {
+                if (!out.empty()) {
+                    sink(out.data(), out.size());
+                }
+            } catch (...) {
+                guard.lock();
+                writing=false;
+                room.notify_all();
+                throw;
+            }
+            guard.lock();
+            pending-=out.size();
+            room.notify_all();
+        }
+        writing=false;
+        room.notify_all();
+    }
+
+    /// Block while the writer is behind, the writer always finishes so this cannot deadlock
+    void wait_for_room() {
+        std::unique_lock<std::mutex> guard(lock);
+        room.wait(guard, [&] { return !writing || pending<=max_pending; });
+    }
+
+private:
+    std::mutex lock;
+    std::condition_variable room;
+    std::vector<std::vector<char>> buffers;
+    std::vector<bool> ready;
+    size_t next=0;
+    size_t pending=0;
+    bool writing=false;
+    size_t max_pending;
+    const pipeline_sink &sink;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// encoding
+////////////////////////////////////////////////////////////////////////////////
+
+/// Batch encode a block of records onto the end of a chunk buffer
+template<typename Encode, typename BinaryEncode>
+static void append_block(size_t count, const pipeline_options &options, std::vector<char> &out,
+                         Encode encode_block, BinaryEncode binary_encode_block)
+{
+    size_t at=out.size();
+    if (options.output==output_format::keys) {
+        uint64_t keys[PIPELINE_BLOCK];
+        binary_encode_block(5*options.precision, keys);
+        out.resize(at+count*sizeof(uint64_t));
+        std::memcpy(out.data()+at, keys, count*sizeof(uint64_t));
+        return;
+    }
+    char chars[PIPELINE_BLOCK*MAX_GEOHASH_LENGTH];
+    encode_block(options.precision, chars);
+    size_t width=options.precision+1;
+    out.resize(at+count*width);
+    char *o=out.data()+at;
+    for (size_t i=0; i<count; i++) {
+        std::memcpy(o+i*width, chars+i*options.precision, options.precision);
+        o[i*width+options.precision]='\n';
+    }
+}
+
+static void append_locations(const geolocation *l, size_t count, const pipeline_options &options,
+                             std::vector<char> &out)
+{
+    append_block(count, options, out,
+                 [&](size_t precision, char *chars) { encode(l, count, precision, chars); },
+                 [&](size_t bits, uint64_t *keys) { binary_encode(l, count, bits, keys); });
+}
+
+static void append_columns(const double *lat, const double *lon, size_t count, const pipeline_options &options,
+                           std::vector<char> &out)
+{
+    append_block(count, options, out,
+                 [&](size_t precision, char *chars) { encode(lat, lon, count, precision, chars); },
+                 [&](size_t bits, uint64_t *keys) { binary_encode(lat, lon, count, bits, keys); });
+}
+
+/// Encode packed records, straight from the input when it is aligned
+static size_t encode_packed(const char *begin, const char *end, const pipeline_options &options,
+                            std::vector<char> &out)
+{
+    size_t count=size_t(end-begin)/sizeof(geolocation);
+    bool aligned=reinterpret_cast<uintptr_t>(begin)%alignof(geolocation)==0;
+    geolocation staged[PIPELINE_BLOCK];
+    for (size_t i=0; i<count; i+=PIPELINE_BLOCK) {
+        size_t n=std::min(PIPELINE_BLOCK, count-i);
+        const char *records=begin+i*sizeof(geolocation);
+        if (aligned) {
+            append_locations(reinterpret_cast<const geolocation *>(records), n, options, out);
+        } else {
+            std::memcpy(staged, records, n*sizeof(geolocation));
+            append_locations(staged, n, options, out);
+        }
+    }
+    return count;
+}
+
+static const char *skip_blanks(const char *p, const char *end) {
+    while (p<end && (*p==' ' || *p=='\t')) {
+        p++;
+    }
+    return p;
+}
+
+/// Parse a finite number and the blanks after it, nullptr when there is none
+static const char *parse_number(const char *p, const char *end, double &value) {
+    p=skip_blanks(p, end);
+    std::from_chars_result r=std::from_chars(p, end, value);
+    if (r.ec!=std::errc() || !std::isfinite(value)) {
+        return nullptr;
+    }
+    return skip_blanks(r.ptr, end);
+}
+
+/// Parse a line without its '\n', false when it is malformed
+static bool parse_line(const char *p, const char *end, double &lat, double &lon) {
+    if (end>p && end[-1]=='\r') {
+        end--;
+    }
+    p=parse_number(p, end, lat);
+    if (!p || p==end || *p!=',') {
+        return false;
+    }
+    p=parse_number(p+1, end, lon);
+    return p && (p==end || *p==',');
+}
+
+static bool blank_line(const char *p, const char *end) {
+    p=skip_blanks(p, end);
+    return p==end || (p+1==end && *p=='\r');
+}
+
+/// Encode the CSV lines of a chunk, the first line of the input may be a header
+static size_t encode_csv(const char *data, const char *begin, const char *end, const pipeline_options &options,
+                         std::vector<char> &out)
+{
+    double lat[PIPELINE_BLOCK], lon[PIPELINE_BLOCK];
+    size_t n=0, count=0;
+    for (const char *line=begin; line<end;) {
+        const char *eol=static_cast<const char *>(std::memchr(line, '\n', size_t(end-line)));
+        eol=eol ? eol : end;
+        if (!blank_line(line, eol)) {
+            if (parse_line(line, eol, lat[n], lon[n])) {
+                n++;
+            } else if (line!=data) {
+                throw std::invalid_argument("geohash_pipeline: malformed record at byte "+std::to_string(line-data));
+            }
+        }
+        if (n==PIPELINE_BLOCK) {
+            append_columns(lat, lon, n, options, out);
+            count+=n;
+            n=0;
+        }
+        line=eol+1;
+    }
+    append_columns(lat, lon, n, options, out);
+    return count+n;
+}
+
+/// Start of the first line at or after offset
+static size_t line_start(const char *data, size_t size, size_t offset) {
+    if (offset==0 || offset>=size) {
+        return std::min(offset, size);
+    }
+    const void *eol=std::memchr(data+offset-1, '\n', size-offset+1);
+    return eol ? size_t(static_cast<const char *>(eol)-data)+1 : size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// API
+////////////////////////////////////////////////////////////////////////////////
+
+pipeline_stats encode_records(const char *data, size_t size, const pipeline_options &options,
+                              const pipeline_sink &sink)
+{
+    pipeline_options o=options;
+    o.precision=std::min(o.precision, MAX_GEOHASH_LENGTH);
+    size_t chunk_size=std::max(o.chunk_size, size_t(1));
+    if (o.input==record_format::packed) {
+        if (size%sizeof(geolocation)) {
+            throw std::invalid_argument("geohash_pipeline: packed input is not a whole number of records");
+        }
+        chunk_size=std::max(chunk_size/sizeof(geolocation), size_t(1))*sizeof(geolocation);
+    }
+    size_t chunks=(size+chunk_size-1)/chunk_size;
+    size_t workers=o.threads ? o.threads : std::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+    workers=std::max(std::min(workers, chunks), size_t(1));
+
+    chunk_scheduler scheduler(chunks, workers);
+    ordered_output output(chunks, o.max_pending, sink);
+    std::atomic<size_t> records{0}, output_bytes{0};
+    std::atomic<bool> failed{false};
+    std::mutex error_lock;
+    std::exception_ptr error;
+
+    auto work=[&](size_t worker) {
+        try {
+            size_t chunk;
+            while (!failed.load(std::memory_order_relaxed) && scheduler.next(worker, chunk)) {
+                output.wait_for_room();
+                std::vector<char> out;
+                size_t count;
+                if (o.input==record_format::packed) {
+                    size_t begin=chunk*chunk_size;
+                    count=encode_packed(data+begin, data+std::min(begin+chunk_size, size), o, out);
+                } else {
+                    size_t begin=line_start(data, size, chunk*chunk_size);
+                    size_t end=line_start(data, size, (chunk+1)*chunk_size);
+                    count=encode_csv(data, data+begin, data+end, o, out);
+                }
+                records+=count;
+                output_bytes+=out.size();
+                output.commit(chunk, std::move(out));
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(error_lock);
+            if (!error) {
+                error=std::current_exception();
+            }
+            failed=true;
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t w=1; w<workers; w++) {
+        threads.emplace_back(work, w);
+    }
+    work(0);
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    pipeline_stats stats;
+    stats.records=records;
+    stats.input_bytes=size;
+    stats.output_bytes=output_bytes;
+    return stats;
+}
+
+/// Read-only mapping of a whole file
+class mapped_file {
+public:
+    explicit mapped_file(const std::string &path) {
+        fd=::open(path.c_str(), O_RDONLY);
+        if (fd<0) {
+            throw std::system_error(errno, std::generic_category(), "geohash_pipeline: cannot open "+path);
+        }
+        struct stat st;
+        if (::fstat(fd, &st)!=0) {
+            int e=errno;
+            ::close(fd);
+            throw std::system_error(e, std::generic_category(), "geohash_pipeline: cannot stat "+path);
+        }
+        length=size_t(st.st_size);
+        if (length==0) {
+            return;
+        }
+        void *p=::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p==MAP_FAILED) {
+            int e=errno;
+            ::close(fd);
+            throw std::system_error(e, std::generic_category(), "geohash_pipeline: cannot map "+path);
+        }
+        ::madvise(p, length, MADV_SEQUENTIAL);
+        address=static_cast<const char *>(p);
+    }
+
+    ~mapped_file() {
+        if (address) {
+            ::munmap(const_cast<char *>(address), length);
+        }
+        ::close(fd);
+    }
+
+    mapped_file(const mapped_file &)=delete;
+    mapped_file &operator=(const mapped_file &)=delete;
+
+    const char *data() const { return address; }
+    size_t size() const { return length; }
+
+private:
+    int fd=-1;
+    const char *address=nullptr;
+    size_t length=0;
+};
+
+pipeline_stats encode_file(const std::string &input, const std::string &output,
+                           const pipeline_options &options)
+{
+    mapped_file in(input);
+    int fd=output=="-" ? STDOUT_FILENO : ::open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd<0) {
+        throw std::system_error(errno, std::generic_category(), "geohash_pipeline: cannot create "+output);
+    }
+    auto write_all=[&](const char *p, size_t n) {
+        while (n>0) {
+            ssize_t written=::write(fd, p, n);
+            if (written<0 && errno==EINTR) {
+                continue;
+            }
+            if (written<0) {
+                throw std::system_error(errno, std::generic_category(), "geohash_pipeline: cannot write "+output);
+            }
+            p+=written;
+            n-=size_t(written);
+        }
+    };
+    pipeline_stats stats;
+    try {
+        stats=encode_records(in.data(), in.size(), options, write_all);
+    } catch (...) {
+        if (fd!=STDOUT_FILENO) {
+            ::close(fd);
+        }
+        throw;
+    }
+    if (fd!=STDOUT_FILENO && ::close(fd)!=0) {
+        throw std::system_error(errno, std::generic_category(), "geohash_pipeline: cannot write "+output);
+    }
+    return stats;
+}
@@ -0,0 +1,69 @@
+//
+//  geohash_pipeline.hpp
+//
+//  Multithreaded bulk encoding of lat/lon record files.
+//
+
+#ifndef geohash_pipeline_hpp_included
+#define geohash_pipeline_hpp_included
+
+#include <functional>
+#include <string>
+#include "geohash.hpp"
+
+/// Layout of the input records
+enum class record_format {
+    /// Text lines of "latitude,longitude", further fields are ignored, a first line that
+    /// does not parse is taken as a header
+    csv,
+    /// Pairs of native byte order doubles, latitude first, the layout of geolocation
+    packed,
+};
+
+/// Layout of the output records
+enum class output_format {
+    /// One hash per line
+    text,
+    /// Native byte order uint64_t, the bits of binary_encode with 5 bits per character
+    keys,
+};
+
+struct pipeline_options {
+    /// Characters per hash, capped at MAX_GEOHASH_LENGTH
+    size_t precision=MAX_GEOHASH_LENGTH;
+    record_format input=record_format::csv;
+    output_format output=output_format::text;
+    /// Worker threads, 0 for one per hardware thread
+    size_t threads=0;
+    /// Input bytes per chunk, the unit of work stealing and of output appends
+    size_t chunk_size=size_t(1)<<20;
+    /// Encoded chunks waiting for the sink, in bytes, before workers wait for it
+    size_t max_pending=size_t(64)<<20;
+};
+
+struct pipeline_stats {
+    size_t records=0;
+    size_t input_bytes=0;
+    size_t output_bytes=0;
+};
+
+/// Receives the output in input order, one call per chunk
+using pipeline_sink=std::function<void(const char *data, size_t size)>;
+
+/// Encode the records of a buffer
+///
+/// The input is split into chunks that are dealt round robin to the workers, a worker that
+/// runs out steals from the back of the others. Each chunk is parsed and batch encoded into
+/// its own buffer, which is handed to the sink as is once the chunks before it are out.
+/// Throws std::invalid_argument on a malformed record, the exceptions of the sink pass through.
+pipeline_stats encode_records(const char *data, size_t size, const pipeline_options &options,
+                              const pipeline_sink &sink);
+
+/// Encode a file into another, "-" writes to the standard output
+///
+/// The input is memory mapped, and chunks are written straight from their buffers.
+/// Throws std::system_error when a file cannot be read or written.
+pipeline_stats encode_file(const std::string &input, const std::string &output,
+                           const pipeline_options &options=pipeline_options());
+
+#endif
@@ -0,0 +1,135 @@
+//
+//  geohash_plan.cpp
+//
+//  A sweep over the cover ranges of a batch of queries.
+//
+
+#include <algorithm>
+#include "geohash_index.hpp"
+#include "geohash_plan.hpp"
+
+namespace {
+
+/// A cover range of a query starting or ending, ends at 2^64 are left out
+struct plan_event {
+    uint64_t key;
+    uint32_t query;
+    bool start;
+};
+
+/// Queries covering the sweep position, with a bitmap of the nonzero words to find the first
+/// and the last quickly
+struct active_queries {
+    std::vector<uint64_t> words;
+    std::vector<uint64_t> nonzero;
+    size_t count=0;
+
+    explicit active_queries(size_t query_count)
+    : words((query_count+63)/64)
+    , nonzero((words.size()+63)/64)
+    {}
+
+    void flip(size_t q, bool on) {
+        size_t w=q/64;
+        words[w]^=uint64_t(1)<<(q%64);
+        if (on) {
+            count++;
+        } else {
+            count--;
+        }
+        uint64_t bit=uint64_t(1)<<(w%64);
+        nonzero[w/64]=words[w] ? nonzero[w/64] | bit : nonzero[w/64] & ~bit;
+    }
+
+    size_t first_word() const {
+        size_t n=0;
+        while (nonzero[n]==0) {
+            n++;
+        }
+        return 64*n+size_t(__builtin_ctzll(nonzero[n]));
+    }
+
+    size_t last_word() const {
+        size_t n=nonzero.size()-1;
+        while (nonzero[n]==0) {
+            n--;
+        }
+        return 64*n+63-size_t(__builtin_clzll(nonzero[n]));
+    }
+};
+
+/// Sort events by key, least significant digit first over the bits where keys differ. Keys
+/// of a burst in one area share their top bits, so this takes a few passes.
+void sort_events(std::vector<plan_event> &events) {
+    uint64_t differ=0;
+    for (const plan_event &e : events) {
+        differ|=e.key^events[0].key;
+    }
+    size_t bit_count=differ ? 64-size_t(__builtin_clzll(differ)) : 0;
+    const size_t digit_bits=11, digits=size_t(1)<<digit_bits;
+    std::vector<plan_event> buffer(events.size());
+    std::vector<size_t> counts(digits+1);
+    for (size_t shift=0; shift<bit_count; shift+=digit_bits) {
+        std::fill(counts.begin(), counts.end(), 0);
+        for (const plan_event &e : events) {
+            counts[((e.key>>shift) & (digits-1))+1]++;
+        }
+        for (size_t d=1; d<=digits; d++) {
+            counts[d]+=counts[d-1];
+        }
+        for (const plan_event &e : events) {
+            buffer[counts[(e.key>>shift) & (digits-1)]++]=e;
+        }
+        events.swap(buffer);
+    }
+}
+
+}
+
+query_plan::query_plan(const radius_query *batch, size_t count, size_t max_cells) {
+    std::vector<std::pair<uint64_t, size_t>> keyed(count);
+    for (size_t q=0; q<count; q++) {
+        keyed[q]=std::make_pair(encode_key(batch[q].center), q);
+    }
+    std::sort(keyed.begin(), keyed.end());
+    queries.reserve(count);
+    order.reserve(count);
+    std::vector<plan_event> events;
+    events.reserve(4*count);
+    for (size_t s=0; s<count; s++) {
+        order.push_back(keyed[s].second);
+        queries.push_back(batch[keyed[s].second]);
+        // Ranges of one query are coalesced, so they never touch and a query is active once
+        for (const key_range &r : radius_ranges(queries[s].center, queries[s].dist, max_cells)) {
+            events.push_back(plan_event{r.begin, uint32_t(s), true});
+            if (r.end!=0) {
+                events.push_back(plan_event{r.end, uint32_t(s), false});
+            }
+            unplanned++;
+        }
+    }
+    sort_events(events);
+
+    active_queries active(count);
+    uint64_t begin=0;
+    auto emit=[&](uint64_t end) {
+        // The queries in force from begin up to end
+        size_t first=active.first_word(), last=active.last_word();
+        ranges.push_back(planned_range{key_range{begin, end}, words.size(), uint32_t(first), uint32_t(last-first+1)});
+        words.insert(words.end(), active.words.begin()+first, active.words.begin()+last+1);
+    };
+    for (size_t e=0; e<events.size();) {
+        uint64_t key=events[e].key;
+        if (active.count>0) {
+            emit(key);
+        }
+        for (; e<events.size() && events[e].key==key; e++) {
+            active.flip(events[e].query, events[e].start);
+        }
+        begin=key;
+    }
+    // Whatever is left runs to the top of the key space
+    if (active.count>0) {
+        emit(0);
+    }
+}
@@ -0,0 +1,103 @@
+//
+//  geohash_plan.hpp
+//
+//  Batches of radius queries planned into one pass over disjoint key ranges.
+//
+
+#ifndef geohash_plan_hpp_included
+#define geohash_plan_hpp_included
+
+#include <cstdint>
+#include <vector>
+#include "geohash.hpp"
+#include "geohash_distance.hpp"
+
+/// Locations within dist km of center, by haversine
+struct radius_query {
+    geolocation center;
+    double dist;
+};
+
+/// Radius queries merged into disjoint key ranges, each with the queries that need it
+///
+/// Queries are sorted by the key of their center, and each is covered by radius_ranges(). A sweep
+/// over the ends of all the ranges splits them where the set of queries changes, so a key
+/// shared by several covers lands in one range, scanned once for all of them. Each range keeps a
+/// bitmap of the sorted queries over the words from its first to its last query. Queries near
+/// each other in key order tend to be near each other on the map, so the bitmaps stay short.
+class query_plan {
+public:
+    /// Plan count queries, each covered with at most max_cells cells
+    query_plan(const radius_query *queries, size_t count, size_t max_cells=16);
+    explicit query_plan(const std::vector<radius_query> &queries, size_t max_cells=16)
+    : query_plan(queries.data(), queries.size(), max_cells)
+    {}
+
+    size_t query_count() const { return queries.size(); }
+    /// Ranges to scan, in key order
+    size_t size() const { return ranges.size(); }
+    const key_range &range(size_t r) const { return ranges[r].keys; }
+
+    /// Call visitor(q) with the index q given to the constructor of every query needing range r
+    template<typename Visitor>
+    void visit_queries(size_t r, Visitor &&visitor) const {
+        const planned_range &p=ranges[r];
+        for (size_t w=0; w<p.word_count; w++) {
+            for (uint64_t word=words[p.offset+w]; word; word&=word-1) {
+                visitor(order[64*(p.first_word+w)+size_t(__builtin_ctzll(word))]);
+            }
+        }
+    }
+
+    /// Scan each range of an index once, such as geohash_index or mapped_index, and call
+    /// visitor(q, i) for every point i within query q. The points of a range are tested
+    /// against each of its queries in one batch call of within().
+    template<typename Index, typename Visitor>
+    void run(const Index &index, Visitor &&visitor) const {
+        std::vector<uint64_t> mask;
+        for (size_t r=0; r<ranges.size(); r++) {
+            const planned_range &p=ranges[r];
+            size_t first=index.lower_bound(p.keys.begin);
+            size_t last=p.keys.end==0 ? index.size() : index.lower_bound(p.keys.end);
+            if (first==last) {
+                continue;
+            }
+            const geolocation *locations=&index.location(first);
+            mask.resize((last-first+63)/64);
+            for (size_t w=0; w<p.word_count; w++) {
+                for (uint64_t word=words[p.offset+w]; word; word&=word-1) {
+                    size_t s=64*(p.first_word+w)+size_t(__builtin_ctzll(word));
+                    if (within(queries[s].center, locations, last-first, queries[s].dist, mask.data())==0) {
+                        continue;
+                    }
+                    for (size_t m=0; m<mask.size(); m++) {
+                        for (uint64_t bits=mask[m]; bits; bits&=bits-1) {
+                            visitor(order[s], first+64*m+size_t(__builtin_ctzll(bits)));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /// Ranges the queries would scan one by one, for comparison with size()
+    size_t unplanned_size() const { return unplanned; }
+
+private:
+    struct planned_range {
+        key_range keys;
+        /// Position of the bitmap in words, it holds words first_word on of the full bitmap
+        size_t offset;
+        uint32_t first_word;
+        uint32_t word_count;
+    };
+
+    /// Queries in key order, and their indexes as given
+    std::vector<radius_query> queries;
+    std::vector<size_t> order;
+    std::vector<planned_range> ranges;
+    std::vector<uint64_t> words;
+    size_t unplanned=0;
+};
+
+#endif
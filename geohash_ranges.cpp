@@ -0,0 +1,46 @@
+//
+//  geohash_ranges.cpp
+//
+//  Cells to key ranges, and key ranges to hash string bounds.
+//
+
+#include "geohash_ranges.hpp"
+
+key_range cell_range(const binary_hash &cell) {
+    size_t bit_count=std::min(cell.size(), MAX_BINHASH_LENGTH);
+    return cell_range(bit_count ? cell.bits<<(64-bit_count) : 0, bit_count);
+}
+
+key_range cell_range(std::string_view hash) {
+    if (find_invalid_char(hash)!=std::string_view::npos) {
+        throw std::invalid_argument("Invalid geohash");
+    }
+    geohash cell=geohash::from_string(hash.substr(0, MAX_GEOHASH_LENGTH));
+    return cell_range(cell.key(), 5*cell.size());
+}
+
+std::string key_string(uint64_t key) {
+    if (key==0) {
+        return std::string();
+    }
+    // Characters through the last set bit, the 13th holds the last 4 bits and a zero
+    size_t length=(64-size_t(__builtin_ctzll(key))+4)/5;
+    std::string output(length, '0');
+    for (size_t i=0; i<length; i++) {
+        output[i]=base32_codes[i<MAX_GEOHASH_LENGTH ? (key>>(59-5*i)) & 0x1f : (key & 0xf)<<1];
+    }
+    return output;
+}
+
+string_range to_string_range(const key_range &range) {
+    return string_range{key_string(range.begin), key_string(range.end)};
+}
+
+std::vector<string_range> to_string_ranges(const std::vector<key_range> &ranges) {
+    std::vector<string_range> output;
+    output.reserve(ranges.size());
+    for (const key_range &r : ranges) {
+        output.push_back(to_string_range(r));
+    }
+    return output;
+}
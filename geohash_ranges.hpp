@@ -0,0 +1,172 @@
+//
+//  geohash_ranges.hpp
+//
+//  Cells turned into coalesced key ranges, as 64-bit keys or as hash strings, for prefix scans.
+//
+
+#ifndef geohash_ranges_hpp_included
+#define geohash_ranges_hpp_included
+
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "geohash.hpp"
+
+/// Keys of a binary hash cell
+key_range cell_range(const binary_hash &cell);
+/// Keys of a base32 hash cell, throws std::invalid_argument for invalid characters. Characters
+/// past MAX_GEOHASH_LENGTH are beyond the 64-bit key, the range is that of the first ones.
+key_range cell_range(std::string_view hash);
+inline key_range cell_range(const std::string &hash) { return cell_range(std::string_view(hash)); }
+constexpr key_range cell_range(const geohash &hash) { return cell_range(hash.key(), 5*hash.size()); }
+
+/// Half-open range [begin, end) of hash strings in byte order, end empty stands for no bound
+///
+/// Strings hold just enough characters for the bits set in the key, the bits past the last
+/// character zero. Hashes at least as fine as the cells of the range compare with the bounds
+/// like their keys compare with the key range, so they can be scanned in a sorted string store.
+struct string_range {
+    std::string begin;
+    std::string end;
+
+    bool contains(std::string_view hash) const { return hash>=begin && (end.empty() || hash<end); }
+};
+
+inline bool operator==(const string_range &r1, const string_range &r2) {
+    return r1.begin==r2.begin && r1.end==r2.end;
+}
+
+inline bool operator!=(const string_range &r1, const string_range &r2) {
+    return !(r1==r2);
+}
+
+/// Shortest hash string whose bits, padded with zeros, are the key
+std::string key_string(uint64_t key);
+string_range to_string_range(const key_range &range);
+std::vector<string_range> to_string_ranges(const std::vector<key_range> &ranges);
+
+/// Sorted disjoint key ranges of cells in any order, adjacent and overlapping ones merged
+template<typename Iterator>
+std::vector<key_range> cell_ranges(Iterator first, Iterator last) {
+    std::vector<key_range> output;
+    if constexpr (std::is_base_of<std::forward_iterator_tag,
+                                  typename std::iterator_traits<Iterator>::iterator_category>::value) {
+        output.reserve(size_t(std::distance(first, last)));
+    }
+    for (; first!=last; ++first) {
+        output.push_back(cell_range(*first));
+    }
+    coalesce(output);
+    return output;
+}
+
+template<typename Container>
+std::vector<key_range> cell_ranges(const Container &cells) {
+    return cell_ranges(std::begin(cells), std::end(cells));
+}
+
+template<typename Container>
+std::vector<string_range> string_ranges(const Container &cells) {
+    return to_string_ranges(cell_ranges(cells));
+}
+
+/// The coalesced key ranges of cells sorted by key, read one at a time
+///
+/// Cells are read as the ranges are, so a cover of any size streams through in constant
+/// memory. Byte order of lower case hash strings is key order, a cell right before the cells
+/// inside it. A cell starting before the previous one throws std::invalid_argument.
+template<typename Iterator>
+class range_stream {
+public:
+    range_stream(Iterator first, Iterator last)
+    : next_cell(first)
+    , last_cell(last)
+    {}
+
+    /// Write the next range to output, false past the last one
+    bool next(key_range &output) {
+        if (!read_ahead()) {
+            return false;
+        }
+        output=ahead;
+        has_ahead=false;
+        while (read_ahead()) {
+            if (output.end!=0 && ahead.begin>output.end) {
+                break;
+            }
+            has_ahead=false;
+            if (output.end!=0 && (ahead.end==0 || ahead.end>output.end)) {
+                output.end=ahead.end;
+            }
+        }
+        return true;
+    }
+
+    /// Input iterator over the ranges, the iterators of a stream share its position
+    class iterator {
+    public:
+        using iterator_category=std::input_iterator_tag;
+        using value_type=key_range;
+        using difference_type=std::ptrdiff_t;
+        using pointer=const key_range *;
+        using reference=const key_range &;
+
+        iterator()=default;
+        explicit iterator(range_stream *s) : stream(s) { ++*this; }
+
+        const key_range &operator*() const { return current; }
+        const key_range *operator->() const { return &current; }
+        iterator &operator++() {
+            if (!stream->next(current)) {
+                stream=nullptr;
+            }
+            return *this;
+        }
+
+        bool operator==(const iterator &i) const { return stream==i.stream; }
+        bool operator!=(const iterator &i) const { return stream!=i.stream; }
+
+    private:
+        range_stream *stream=nullptr;
+        key_range current;
+    };
+
+    /// Start reading, once per stream
+    iterator begin() { return iterator(this); }
+    iterator end() { return iterator(); }
+
+private:
+    /// Range of the next cell in ahead, unless it holds one already, false past the last cell
+    bool read_ahead() {
+        if (has_ahead) {
+            return true;
+        }
+        if (next_cell==last_cell) {
+            return false;
+        }
+        key_range r=cell_range(*next_cell);
+        ++next_cell;
+        if (r.begin<ahead.begin) {
+            throw std::invalid_argument("cells are not sorted by key");
+        }
+        ahead=r;
+        has_ahead=true;
+        return true;
+    }
+
+    Iterator next_cell;
+    Iterator last_cell;
+    /// Range of the last cell read, not yet merged while has_ahead
+    key_range ahead;
+    bool has_ahead=false;
+};
+
+template<typename Iterator>
+range_stream<Iterator> stream_ranges(Iterator first, Iterator last) {
+    return range_stream<Iterator>(first, last);
+}
+
+#endif
@@ -0,0 +1,111 @@
+//
+//  geohash_set.cpp
+//
+//  Sorted cell ids under a static search tree.
+//
+
+#include <algorithm>
+#include <stdexcept>
+#include "geohash_set.hpp"
+
+/// Ids per node of the search tree, a cache line
+constexpr size_t SET_NODE=8;
+
+geohash_set::geohash_set(std::vector<binary_hash> cells) {
+    ids.reserve(cells.size());
+    for (const binary_hash &cell : cells) {
+        if (cell.size()>=MAX_BINHASH_LENGTH) {
+            throw std::invalid_argument("geohash_set: cells have at most 63 bits");
+        }
+        ids.push_back(cell_id(cell_key(cell), cell.size()));
+    }
+    build();
+}
+
+geohash_set::geohash_set(const std::vector<std::string> &hashes) {
+    ids.reserve(hashes.size());
+    for (const std::string &hash : hashes) {
+        geohash cell=geohash::from_string(hash);
+        ids.push_back(cell_id(cell.key(), 5*cell.size()));
+    }
+    build();
+}
+
+void geohash_set::build() {
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    ids.shrink_to_fit();
+    for (uint64_t id : ids) {
+        precisions|=uint64_t(1)<<id_bits(id);
+    }
+    // Each level above the ids holds the last id of every node of the level below
+    levels.clear();
+    const std::vector<uint64_t> *below=&ids;
+    while (below->size()>SET_NODE) {
+        std::vector<uint64_t> level;
+        level.reserve((below->size()+SET_NODE-1)/SET_NODE);
+        for (size_t i=SET_NODE-1; i<below->size()+SET_NODE-1; i+=SET_NODE) {
+            level.push_back((*below)[std::min(i, below->size()-1)]);
+        }
+        levels.push_back(std::move(level));
+        below=&levels.back();
+    }
+    std::reverse(levels.begin(), levels.end());
+}
+
+/// Ids in a node less than id, the position of id's lower bound in it
+static size_t node_rank(const uint64_t *node, size_t count, uint64_t id) {
+    size_t rank=0;
+    for (size_t i=0; i<count; i++) {
+        rank+=node[i]<id;
+    }
+    return rank;
+}
+
+size_t geohash_set::lower_bound(uint64_t id) const {
+    // Descend one cache line per level, the top levels stay in cache
+    size_t node=0;
+    for (const std::vector<uint64_t> &level : levels) {
+        size_t first=node*SET_NODE;
+        size_t rank=node_rank(level.data()+first, std::min(SET_NODE, level.size()-first), id);
+        if (first+rank==level.size()) {
+            return ids.size();
+        }
+        node=first+rank;
+    }
+    size_t first=node*SET_NODE;
+    return first+node_rank(ids.data()+first, std::min(SET_NODE, ids.size()-first), id);
+}
+
+bool geohash_set::find(uint64_t id) const {
+    size_t i=lower_bound(id);
+    return i<ids.size() && ids[i]==id;
+}
+
+bool geohash_set::contains_prefix(const binary_hash &prefix) const {
+    if (prefix.size()>=MAX_BINHASH_LENGTH) {
+        return false;
+    }
+    key_range range=cell_range(cell_key(prefix), prefix.size());
+    uint64_t last=range.end-1;
+    for (size_t i=lower_bound(range.begin); i<ids.size() && ids[i]<=last; i++) {
+        // Only a coarser member can have its center at the start of the range, and only one
+        if (id_bits(ids[i])>=prefix.size()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::optional<binary_hash> geohash_set::longest_prefix(uint64_t key, size_t bits) const {
+    // Precisions present, up to bits, finest first
+    uint64_t candidates=precisions & (bits>=63 ? ~uint64_t(0) : (uint64_t(2)<<bits)-1);
+    while (candidates) {
+        size_t b=size_t(63-__builtin_clzll(candidates));
+        if (find(cell_id(key, b))) {
+            return binary_hash(b ? key>>(64-b) : 0, b);
+        }
+        candidates&=~(uint64_t(1)<<b);
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,128 @@
+//
+//  geohash_set.hpp
+//
+//  Compact immutable sets of cells of mixed precision.
+//
+
+#ifndef geohash_set_hpp_included
+#define geohash_set_hpp_included
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include "geohash.hpp"
+
+/// Cells of up to 63 bits, about 9 bytes each
+///
+/// A cell is stored as its key with the bit after its last one set, the cell's center in key
+/// space, so every cell has one id, and ids sort like a walk over the cells' centers. A static
+/// search tree of 8 ids per node, the last id of every node one level up, takes an eighth more
+/// and finds an id in one cache line per level, where a binary search touches a line per step.
+/// Lookups by location or prefix probe each precision present in the set, finest first.
+class geohash_set {
+public:
+    geohash_set()=default;
+
+    /// Set of the cells, duplicates are dropped, throws std::invalid_argument for a cell of 64 bits
+    explicit geohash_set(std::vector<binary_hash> cells);
+
+    /// Set of geohash strings, throws std::invalid_argument for an invalid one
+    explicit geohash_set(const std::vector<std::string> &hashes);
+
+    size_t size() const { return ids.size(); }
+    bool empty() const { return ids.empty(); }
+
+    /// Member i in the order of the ids
+    binary_hash at(size_t i) const {
+        size_t bits=id_bits(ids[i]);
+        return binary_hash(bits ? ids[i]>>(64-bits) : 0, bits);
+    }
+
+    /// Whether the cell is a member
+    bool contains(const binary_hash &cell) const {
+        return cell.size()<MAX_BINHASH_LENGTH && find(cell_id(cell_key(cell), cell.size()));
+    }
+
+    bool contains(const geohash &cell) const { return find(cell_id(cell.key(), 5*cell.size())); }
+
+    /// Whether a member contains the location
+    bool contains(geolocation l) const { return longest_prefix(l).has_value(); }
+
+    /// Whether a member lies inside the cell, the cell itself included
+    bool contains_prefix(const binary_hash &prefix) const;
+
+    bool contains_prefix(const geohash &prefix) const { return contains_prefix(to_binary(prefix)); }
+
+    /// Longest member the cell lies inside, the cell itself included
+    std::optional<binary_hash> longest_prefix(const binary_hash &cell) const {
+        return longest_prefix(cell_key(cell), std::min(cell.size(), MAX_BINHASH_LENGTH-1));
+    }
+
+    std::optional<binary_hash> longest_prefix(const geohash &cell) const {
+        return longest_prefix(cell.key(), 5*cell.size());
+    }
+
+    /// Longest member containing the location
+    std::optional<binary_hash> longest_prefix(geolocation l) const {
+        return longest_prefix(encode_key(l), MAX_BINHASH_LENGTH-1);
+    }
+
+    /// Call visitor(cell) for every member inside the range, in the order of the ids
+    template<typename Visitor>
+    void visit(const key_range &range, Visitor &&visitor) const {
+        uint64_t last=range.end-1;
+        for (size_t i=lower_bound(range.begin); i<ids.size() && ids[i]<=last; i++) {
+            // A coarser cell can have its center at the start of the range
+            key_range cell=cell_range(ids[i], id_bits(ids[i]));
+            if (cell.begin>=range.begin && cell.end-1<=last) {
+                visitor(at(i));
+            }
+        }
+    }
+
+    /// Call visitor(cell) for every member inside the prefix, the prefix itself included
+    template<typename Visitor>
+    void visit_prefix(const binary_hash &prefix, Visitor &&visitor) const {
+        visit(cell_range(cell_key(prefix), prefix.size()), visitor);
+    }
+
+    /// Bytes held, the object itself included
+    size_t memory_usage() const {
+        size_t output=sizeof(*this)+ids.capacity()*sizeof(uint64_t);
+        for (const std::vector<uint64_t> &level : levels) {
+            output+=sizeof(level)+level.capacity()*sizeof(uint64_t);
+        }
+        return output;
+    }
+
+private:
+    static uint64_t cell_key(const binary_hash &cell) {
+        return cell.size() ? cell.bits<<(64-cell.size()) : 0;
+    }
+
+    static binary_hash to_binary(const geohash &cell) {
+        return binary_hash(cell.size() ? cell.key()>>(64-5*cell.size()) : 0, 5*cell.size());
+    }
+
+    /// Key of a cell with the bit after its last one set
+    static uint64_t cell_id(uint64_t key, size_t bits) {
+        return (bits ? key & ~(~uint64_t(0)>>bits) : 0) | (uint64_t(1)<<(63-bits));
+    }
+
+    static size_t id_bits(uint64_t id) { return size_t(63-__builtin_ctzll(id)); }
+
+    /// Position of the first id not less than id
+    size_t lower_bound(uint64_t id) const;
+    bool find(uint64_t id) const;
+    std::optional<binary_hash> longest_prefix(uint64_t key, size_t bits) const;
+    void build();
+
+    std::vector<uint64_t> ids;
+    /// Levels of a static search tree over the ids, the root first
+    std::vector<std::vector<uint64_t>> levels;
+    /// Bit n set when a member has n bits
+    uint64_t precisions=0;
+};
+
+#endif
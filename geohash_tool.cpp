@@ -0,0 +1,82 @@
+//
+//  geohash_tool.cpp
+//
+//  Command line front end of the bulk encoding pipeline.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <vector>
+#include "geohash_pipeline.hpp"
+
+static void usage() {
+    std::fprintf(stderr,
+        "usage: geohash_tool [options] input output\n"
+        "  -p precision   characters per hash, default 12\n"
+        "  -i csv|packed  input records, lat,lon lines or pairs of doubles, default csv\n"
+        "  -o text|keys   output records, hash lines or uint64 keys, default text\n"
+        "  -t threads     worker threads, default one per hardware thread\n"
+        "  -c bytes       input bytes per chunk, default 1048576\n"
+        "output - writes to the standard output, statistics go to the standard error\n");
+}
+
+static bool parse_size(const char *s, size_t &value) {
+    char *end=nullptr;
+    unsigned long long v=std::strtoull(s, &end, 10);
+    if (end==s || *end!=0) {
+        return false;
+    }
+    value=size_t(v);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    pipeline_options options;
+    std::vector<std::string> files;
+    for (int i=1; i<argc; i++) {
+        std::string arg=argv[i];
+        if (arg.size()==2 && arg[0]=='-' && i+1<argc) {
+            std::string value=argv[++i];
+            bool ok=true;
+            switch (arg[1]) {
+                case 'p': ok=parse_size(value.c_str(), options.precision); break;
+                case 't': ok=parse_size(value.c_str(), options.threads); break;
+                case 'c': ok=parse_size(value.c_str(), options.chunk_size); break;
+                case 'i':
+                    ok=value=="csv" || value=="packed";
+                    options.input=value=="packed" ? record_format::packed : record_format::csv;
+                    break;
+                case 'o':
+                    ok=value=="text" || value=="keys";
+                    options.output=value=="keys" ? output_format::keys : output_format::text;
+                    break;
+                default: ok=false;
+            }
+            if (!ok) {
+                usage();
+                return 2;
+            }
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.size()!=2) {
+        usage();
+        return 2;
+    }
+    try {
+        auto start=std::chrono::steady_clock::now();
+        pipeline_stats stats=encode_file(files[0], files[1], options);
+        double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        std::fprintf(stderr, "%zu records, %zu bytes in, %zu bytes out, %.3f s, %.3f GB/s\n",
+                     stats.records, stats.input_bytes, stats.output_bytes, seconds,
+                     seconds>0 ? double(stats.input_bytes)/seconds/1e9 : 0.0);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "geohash_tool: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
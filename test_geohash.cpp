@@ -1,7 +1,97 @@
 #include <vector>
+#include <unordered_set>
+#include <type_traits>
+#include <random>
+#include <limits>
+#include <cmath>
+#include <utility>
 #include <assert.h>
 #include "geohash.hpp"
 
+// Reference bisection encoder, the interleaving engine must match it bit by bit
+static binary_hash bisection_binary_encode(geolocation l, size_t precision) {
+	bounding_box bbox{ -90, 90, -180, 180 };
+	bool is_longitude = true;
+	binary_hash output;
+	while(output.size() < precision) {
+		if (is_longitude) {
+			bool bit = l.longitude > bbox.lon_center();
+			output.push_back(bit);
+			(bit ? bbox.min_lon : bbox.max_lon) = bbox.lon_center();
+		} else {
+			bool bit = l.latitude > bbox.lat_center();
+			output.push_back(bit);
+			(bit ? bbox.min_lat : bbox.max_lat) = bbox.lat_center();
+		}
+		is_longitude = !is_longitude;
+	}
+	return output;
+}
+
+static bounding_box bisection_decode(const std::vector<bool> &bits) {
+	bounding_box output{ -90, 90, -180, 180 };
+	bool is_longitude = true;
+	for (bool bit : bits) {
+		if (is_longitude) {
+			(bit ? output.min_lon : output.max_lon) = output.lon_center();
+		} else {
+			(bit ? output.min_lat : output.max_lat) = output.lat_center();
+		}
+		is_longitude = !is_longitude;
+	}
+	return output;
+}
+
+static const char test_base32_codes[] = "0123456789bcdefghjkmnpqrstuvwxyz";
+
+static std::string bisection_encode(geolocation l, size_t precision) {
+	std::vector<bool> bits;
+	binary_hash head = bisection_binary_encode(l, std::min<size_t>(precision*5, 60));
+	for (size_t i=1; i<=head.size(); i++) bits.push_back(head.test(i));
+	// Continue bisecting past 64 bits
+	bounding_box bbox = bisection_decode(bits);
+	bool is_longitude = true;
+	while (bits.size() < precision*5) {
+		if (is_longitude) {
+			bool bit = l.longitude > bbox.lon_center();
+			bits.push_back(bit);
+			(bit ? bbox.min_lon : bbox.max_lon) = bbox.lon_center();
+		} else {
+			bool bit = l.latitude > bbox.lat_center();
+			bits.push_back(bit);
+			(bit ? bbox.min_lat : bbox.max_lat) = bbox.lat_center();
+		}
+		is_longitude = !is_longitude;
+	}
+	std::string output;
+	for (size_t i=0; i<precision; i++) {
+		int index = 0;
+		for (size_t j=0; j<5; j++) index = (index<<1) | (bits[i*5+j] ? 1 : 0);
+		output.push_back(test_base32_codes[index]);
+	}
+	return output;
+}
+
+static void check_bisection_compatibility(geolocation l) {
+	for (size_t p=0; p<=MAX_BINHASH_LENGTH; p++) {
+		binary_hash b = binary_encode(l, p);
+		assert(b == bisection_binary_encode(l, p));
+		std::vector<bool> bits;
+		for (size_t i=1; i<=p; i++) bits.push_back(b.test(i));
+		assert(decode(b) == bisection_decode(bits));
+	}
+	for (size_t p=1; p<=MAX_GEOHASH_LENGTH+2; p++) {
+		std::string hash = encode(l, p);
+		assert(hash == bisection_encode(l, p));
+		std::vector<bool> bits;
+		for (char c : hash) {
+			int index = int(std::find(test_base32_codes, test_base32_codes+32, c)-test_base32_codes);
+			for (int j=4; j>=0; j--) bits.push_back(((index>>j) & 1)!=0);
+		}
+		assert(decode(hash) == bisection_decode(bits));
+	}
+}
+
 void test_geolocation() {
 	geolocation l1{12.5, 26.75};
 	geolocation l2{22.5, 88.75};
@@ -161,6 +251,49 @@ void test_binary_neighbor() {
 	assert(neighbor(b, { 1,  1})==binary_hash("11101101"));
 }
 
+void test_interleave() {
+	assert(spread_bits(0xffffffff)==0x5555555555555555ull);
+	assert(compact_bits(0x5555555555555555ull)==0xffffffff);
+	assert(interleave(1, 0)==2);
+	assert(interleave(0, 1)==1);
+	uint32_t lon, lat;
+	deinterleave(interleave(0x12345678, 0x9abcdef0), lon, lat);
+	assert(lon==0x12345678 && lat==0x9abcdef0);
+	assert(quantize_longitude(-180)==0);
+	assert(quantize_longitude(180)==0xffffffff);
+	assert(quantize_latitude(0)==0x7fffffff);
+	assert(quantize_latitude(std::nextafter(0.0, 1.0))==0x80000000);
+}
+
+void test_bisection_compatibility() {
+	const double inf = std::numeric_limits<double>::infinity();
+	const double specials[] = { 0.0, -0.0, 90, -90, 180, -180, 1e-300, -1e-300, 1e-20, 91, -181, 1e9, inf, -inf };
+	for (double lat : specials) {
+		for (double lon : specials) {
+			check_bisection_compatibility(geolocation{lat, lon});
+		}
+	}
+	check_bisection_compatibility(geolocation{std::nan(""), std::nan("")});
+	std::mt19937_64 rng(42);
+	std::uniform_real_distribution<double> lat_dist(-90, 90), lon_dist(-180, 180);
+	for (int i=0; i<2000; i++) {
+		check_bisection_compatibility(geolocation{lat_dist(rng), lon_dist(rng)});
+	}
+	// Points sitting exactly on cell edges, and one ulp away from them
+	for (int bits=1; bits<=32; bits++) {
+		for (int i=0; i<40; i++) {
+			uint64_t k = rng() & ((1ull<<bits)-1);
+			double lat = -90+double(k)*(180/std::ldexp(1.0, bits));
+			double lon = -180+double(k)*(360/std::ldexp(1.0, bits));
+			for (double plat : {std::nextafter(lat, -inf), lat, std::nextafter(lat, inf)}) {
+				for (double plon : {std::nextafter(lon, -inf), lon, std::nextafter(lon, inf)}) {
+					check_bisection_compatibility(geolocation{plat, plon});
+				}
+			}
+		}
+	}
+}
+
 void test_encode() {
 	geolocation l{31.16373922, 121.62585927};
 	assert(encode(l, 1)=="w");
@@ -193,6 +326,38 @@ void test_decode() {
 	assert(!decode("wtw3r9jjzyjc").contains(geolocation{31.16374922, 121.62585927}));
 }
 
+void test_try_decode() {
+	// Every byte at every position of hashes up to 2 words, against the table
+	for (size_t length=1; length<=17; length++) {
+		for (size_t at=0; at<length; at++) {
+			for (int c=0; c<256; c++) {
+				std::string hash(length, 'w');
+				hash[at]=char(c);
+				bool valid=c>='0' && c<='z' && base32_indexes[c-'0']>=0;
+				assert(find_invalid_char(hash)==(valid ? std::string::npos : at));
+			}
+		}
+	}
+	assert(find_invalid_char("")==std::string::npos);
+	assert(find_invalid_char("wtw3r9jjzyjc0aoz")==13);
+	for (const std::string hash : {"", "w", "WTW3R9", "wtw3r9jjzyjc", "wtw3r9jjzyjcwtw3r9jjz"}) {
+		decode_result r=try_decode(hash);
+		assert(r.ok() && r.box==decode(hash));
+	}
+	std::string_view hashes[3]={"wtw3r9", "wtw\xff", "ezs42"};
+	decode_result output[3];
+	assert(try_decode(hashes, 3, output)==2);
+	assert(output[0] && !output[1] && output[1].error_position==3 && output[2]);
+	assert(output[2].box==decode("ezs42"));
+	// Bytes past the character table used to be read as indexes
+	for (const char *hash : {"wtw\x80", "{", "wt\x7f"}) {
+		bool thrown=false;
+		try { binary_hash::from_geohash(hash); } catch (std::invalid_argument &) { thrown=true; }
+		assert(thrown);
+	}
+	assert(binary_hash::from_geohash("Wt")==binary_encode(decode("wt").center(), 10));
+}
+
 void test_encode_precision_range() {
 	typedef std::vector<std::string> hs;
 	geolocation l{31.16373922, 121.62585927};
@@ -225,6 +390,62 @@ void test_base_hash() {
 	assert(base_hash(l, 0.001)=="wtw3sjjzy");
 }
 
+/// Precision searches by encoding and decoding at every level, finest first
+size_t search_binary_hash_precision(geolocation l, double dist) {
+	for (size_t i = MAX_BINHASH_LENGTH; i >= 1; i--) {
+		if (decode(binary_encode(l, i)).min_span()>=dist*2) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+size_t search_hash_precision(geolocation l, double dist) {
+	for (size_t i = MAX_GEOHASH_LENGTH; i >= 1; i--) {
+		if (decode(encode(l, i)).min_span()>=dist*2) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+void check_precision(geolocation l, double dist) {
+	assert(binary_hash_precision(l, dist)==search_binary_hash_precision(l, dist));
+	assert(hash_precision(l, dist)==search_hash_precision(l, dist));
+	assert(base_hash(l, dist)==encode(l, search_hash_precision(l, dist)));
+}
+
+void test_precision_search() {
+	std::mt19937_64 rng(6);
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180), exponent(-7, 5);
+	for (int i=0; i<20000; i++) {
+		geolocation l{lat(rng), lon(rng)};
+		check_precision(l, std::pow(10, exponent(rng)));
+	}
+	const double specials[]={
+		0, -1, 1e-9, 1e-6, 20000, 40000, 1e9,
+		std::numeric_limits<double>::infinity(),
+		std::numeric_limits<double>::quiet_NaN(),
+	};
+	const geolocation places[]={
+		{0, 0}, {90, 180}, {-90, -180}, {89.9999, 0}, {-89.9999, 179.9999},
+		{45, 0}, {31.23, 121.473}, {std::numeric_limits<double>::quiet_NaN(), 0},
+	};
+	for (const geolocation &l : places) {
+		for (double dist : specials) {
+			check_precision(l, dist);
+		}
+		// Exact cell sides, where the comparison is an equality
+		uint64_t key=encode_key(l);
+		for (size_t bits=1; bits<=MAX_BINHASH_LENGTH; bits++) {
+			double span=decode_key(key, bits).min_span();
+			check_precision(l, span/2);
+			check_precision(l, std::nextafter(span/2, 0.0));
+			check_precision(l, std::nextafter(span/2, 1e9));
+		}
+	}
+}
+
 void test_hash_contains() {
 	assert(hash_contains("w", geolocation{21, 113}));
 	assert(hash_contains("wt", geolocation{30.9, 118}));
@@ -285,6 +506,183 @@ void test_hash_codes() {
 	}
 }
 
+void test_geohash_value() {
+	static_assert(std::is_trivially_copyable<geohash>::value, "geohash must be trivially copyable");
+	geolocation l{31.16373922, 121.62585927};
+	for (size_t n=0; n<=MAX_GEOHASH_LENGTH; n++) {
+		geohash h = geohash::encode(l, n);
+		assert(h.size()==n);
+		assert(h.to_string()==encode(l, n));
+		assert(decode(h)==decode(encode(l, n)));
+		assert(geohash::from_string(encode(l, n))==h);
+	}
+	assert(geohash::encode(l, 20).size()==MAX_GEOHASH_LENGTH);
+	geohash h = geohash::from_string("WTW3R9");
+	std::string_view v = h;
+	std::string s(h);
+	assert(v=="wtw3r9" && s=="wtw3r9");
+	assert(h.key()==binary_hash::from_geohash("wtw3r9").bits<<34);
+	bool thrown = false;
+	try { geohash::from_string("wtw3a"); } catch (std::invalid_argument &) { thrown = true; }
+	assert(thrown);
+	thrown = false;
+	try { geohash::from_string("wtw3r9jjzyjc0"); } catch (std::invalid_argument &) { thrown = true; }
+	assert(thrown);
+	// Same order as the strings
+	assert(geohash::from_string("w")<geohash::from_string("w0"));
+	assert(geohash::from_string("w0")<geohash::from_string("wb"));
+	assert(geohash::from_string("")<geohash::from_string("0"));
+	assert(!(geohash::from_string("wt")<geohash::from_string("wt")));
+	std::unordered_set<geohash> set;
+	for (size_t n=0; n<=MAX_GEOHASH_LENGTH; n++) {
+		set.insert(geohash::encode(l, n));
+		set.insert(geohash::encode(l, n));
+	}
+	assert(set.size()==MAX_GEOHASH_LENGTH+1);
+	assert(set.count(geohash::from_string("wtw3r9j"))==1);
+}
+
+void test_geohash_value_api() {
+	geohash h = geohash::from_string("wtw3sjj");
+	for (int dlat=-1; dlat<=1; dlat++) {
+		for (int dlon=-1; dlon<=1; dlon++) {
+			assert(neighbor(h, {dlat, dlon}).to_string()==neighbor(std::string("wtw3sjj"), {dlat, dlon}));
+		}
+	}
+	assert(hash_contains(h, geolocation{31.23, 121.473}));
+	geolocation l{31.23, 121.473};
+	std::array<geohash, 9> cells = hash_codes(l, 0.01);
+	std::vector<std::string> strings;
+	hash_codes(l, 0.01, strings);
+	std::vector<geohash> values;
+	hash_codes(l, 0.01, values);
+	for (size_t i=0; i<9; i++) {
+		assert(cells[i].to_string()==strings[i]);
+		assert(values[i]==cells[i]);
+	}
+	std::vector<geohash> range;
+	encode_precision_range(l, range, 1, 9);
+	assert(range.size()==9 && range[8].to_string()=="wtw3sjjzy");
+}
+
+/// Neighbor by decoding to a box and re-encoding the offset center
+std::string float_neighbor(const std::string &hash, const std::pair<int, int> &direction) {
+	bounding_box b=decode(hash);
+	geolocation cp=b.center();
+	cp.latitude += direction.first * b.lat_range();
+	cp.longitude += direction.second * b.lon_range();
+	return encode(cp, hash.size());
+}
+
+void test_neighbor_arithmetic() {
+	static const std::pair<int, int> directions[8]={
+		{-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1},
+	};
+	std::mt19937_64 rng(5);
+	std::uniform_real_distribution<double> lat(-80, 80), lon(-170, 170);
+	for (int i=0; i<2000; i++) {
+		geolocation l{lat(rng), lon(rng)};
+		for (size_t precision=1; precision<=MAX_GEOHASH_LENGTH; precision++) {
+			std::string h=encode(l, precision);
+			bounding_box b=decode(h);
+			// Stay away from the poles and the antimeridian, where the float method clamps
+			bool interior=b.min_lat-b.lat_range()>-90 && b.max_lat+b.lat_range()<90
+				&& b.min_lon-b.lon_range()>-180 && b.max_lon+b.lon_range()<180;
+			std::array<std::string, 8> all=neighbors(h);
+			std::array<geohash, 8> values=neighbors(geohash::from_string(h));
+			for (size_t d=0; d<8; d++) {
+				std::string n=neighbor(h, directions[d]);
+				assert(all[d]==n);
+				assert(values[d].to_string()==n);
+				if (interior) {
+					assert(n==float_neighbor(h, directions[d]));
+				}
+			}
+		}
+		for (size_t bits=1; bits<=MAX_BINHASH_LENGTH; bits++) {
+			binary_hash h=binary_encode(l, bits);
+			std::array<binary_hash, 8> all=neighbors(h);
+			for (size_t d=0; d<8; d++) {
+				binary_hash n=neighbor(h, directions[d]);
+				assert(all[d]==n);
+				bounding_box b=decode(h), nb=decode(n);
+				assert(nb.lat_range()==b.lat_range() && nb.lon_range()==b.lon_range());
+				if (b.min_lat>-90 && b.max_lat<90 && b.min_lon>-180 && b.max_lon<180) {
+					assert(nb.min_lat==b.min_lat+directions[d].first*b.lat_range());
+					assert(nb.min_lon==b.min_lon+directions[d].second*b.lon_range());
+				}
+			}
+		}
+	}
+	// Longitude wraps around the antimeridian
+	assert(neighbor("8", {0, -1})=="x");
+	assert(neighbor("x", {0, 1})=="8");
+	assert(neighbor("b", {0, -1})=="z");
+	assert(neighbor("pbpbpbpbpbpb", {0, 1})=="000000000000");
+	assert(neighbor(binary_hash("0"), {0, -1})==binary_hash("1"));
+	// Latitude saturates at the poles
+	assert(neighbor("b", {1, 0})=="b");
+	assert(neighbor("b", {1, 1})=="c");
+	assert(neighbor("0", {-1, 0})=="0");
+	assert(neighbor("0", {-1, -1})=="p");
+	assert(neighbor(binary_hash("1"), {1, 0})==binary_hash("1"));
+	// The empty hash is the whole world
+	assert(neighbor(std::string(), {1, 1}).empty());
+	assert(neighbor(binary_hash(), {1, 1}).empty());
+	// Longer than the key, steps through bisection
+	assert(neighbor("wtw3sjjwtw3sj", {0, 1})==float_neighbor("wtw3sjjwtw3sj", {0, 1}));
+	assert(neighbors("wtw3sjjwtw3sj")[4]==neighbor("wtw3sjjwtw3sj", {0, 1}));
+}
+
+// Built by the compiler, a geofence table needs no startup code
+constexpr geolocation shanghai{31.23, 121.473};
+constexpr std::array<geohash, 3> fence={encode<6>(shanghai), encode<7>(shanghai), encode<9>(shanghai)};
+static_assert(fence[0].view()=="wtw3sj", "");
+static_assert(fence[1].view()=="wtw3sjj", "");
+static_assert(fence[2].view()=="wtw3sjjzy", "");
+static_assert(neighbor(fence[1], {-1, -1}).view()=="wtw3shu", "");
+static_assert(neighbors(fence[1])[7]==neighbor(fence[1], {1, 1}), "");
+static_assert(decode<6>("wtw3sj")==decode(fence[0]), "");
+static_assert(decode<6>("wtw3sj").contains(shanghai), "");
+static_assert(binary_encode<30>(shanghai)==binary_encode(shanghai, 30), "");
+static_assert(binary_encode<0>(shanghai).empty(), "");
+static_assert(geohash::from_string("WTW3SJ")==fence[0], "");
+
+template<size_t N>
+void check_fixed_precision(geolocation l) {
+	geohash h=encode<N>(l);
+	assert(h==geohash::encode(l, N));
+	assert(decode<N>(h)==decode(h));
+	binary_hash b=binary_encode<5*N>(l);
+	assert(b==binary_encode(l, 5*N));
+	assert(decode(b)==decode(h));
+}
+
+template<size_t... N>
+void check_fixed_precisions(geolocation l, std::index_sequence<N...>) {
+	(check_fixed_precision<N>(l), ...);
+}
+
+void test_fixed_precision() {
+	std::mt19937_64 rng(7);
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+	for (int i=0; i<1000; i++) {
+		check_fixed_precisions(geolocation{lat(rng), lon(rng)}, std::make_index_sequence<MAX_GEOHASH_LENGTH+1>());
+	}
+	check_fixed_precisions(geolocation{90, 180}, std::make_index_sequence<MAX_GEOHASH_LENGTH+1>());
+	check_fixed_precisions(geolocation{-90, -180}, std::make_index_sequence<MAX_GEOHASH_LENGTH+1>());
+	assert(binary_encode<64>(shanghai).bits==encode_key(shanghai));
+	for (const char *invalid : {"wtw3s", "wtw3sjj", "wtw3sa"}) {
+		bool thrown=false;
+		try {
+			decode<6>(invalid);
+		} catch (const std::invalid_argument &) {
+			thrown=true;
+		}
+		assert(thrown);
+	}
+}
+
 int main() {
 	test_geolocation();
 	test_bbox1();
@@ -294,13 +692,21 @@ int main() {
 	test_binary_encode();
 	test_binary_decode();
 	test_binary_neighbor();
+	test_interleave();
+	test_bisection_compatibility();
 	test_encode();
 	test_decode();
+	test_try_decode();
 	test_encode_precision_range();
 	test_hash_precision();
 	test_base_hash();
+	test_precision_search();
 	test_hash_contains();
 	test_neighbor();
+	test_neighbor_arithmetic();
 	test_hash_codes();
+	test_geohash_value();
+	test_geohash_value_api();
+	test_fixed_precision();
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include <vector>
+#include <map>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+#include <assert.h>
+#include "geohash_aggregate.hpp"
+
+/// Totals by a plain map, values are whole numbers so sums are exact in any order
+static std::vector<cell_aggregate> expected_cells(const std::vector<geolocation> &locations,
+                                                  const std::vector<double> &values, size_t bit_count) {
+	std::map<uint64_t, cell_aggregate> cells;
+	for (size_t i=0; i<locations.size(); i++) {
+		binary_hash cell=binary_encode(locations[i], bit_count);
+		auto found=cells.find(cell.bits);
+		if (found==cells.end()) {
+			cells[cell.bits]=cell_aggregate{cell, 1, values[i], values[i], values[i]};
+		} else {
+			cell_aggregate &c=found->second;
+			c.count++;
+			c.sum+=values[i];
+			c.min=std::min(c.min, values[i]);
+			c.max=std::max(c.max, values[i]);
+		}
+	}
+	std::vector<cell_aggregate> output;
+	for (const auto &c : cells) {
+		output.push_back(c.second);
+	}
+	return output;
+}
+
+static bool same(const std::vector<cell_aggregate> &a, const std::vector<cell_aggregate> &b) {
+	if (a.size()!=b.size()) {
+		return false;
+	}
+	for (size_t i=0; i<a.size(); i++) {
+		if (a[i].cell!=b[i].cell || a[i].count!=b[i].count || a[i].sum!=b[i].sum ||
+		    a[i].min!=b[i].min || a[i].max!=b[i].max) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void test_aggregate() {
+	std::mt19937_64 rng(19);
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+	std::normal_distribution<double> spread(0, 0.2);
+	std::uniform_int_distribution<int> value(-100, 100);
+	std::vector<geolocation> locations;
+	std::vector<double> values;
+	for (size_t i=0; i<150000; i++) {
+		locations.push_back(i%4 ? geolocation{std::min(90.0, 48.85+spread(rng)), 2.35+spread(rng)}
+		                        : geolocation{lat(rng), lon(rng)});
+		values.push_back(value(rng));
+	}
+	for (size_t bits : {0, 7, 16, 17, 30, 64}) {
+		std::vector<cell_aggregate> expected=expected_cells(locations, values, bits);
+		geohash_aggregator one(bits), first(bits), second(bits);
+		for (size_t i=0; i<locations.size(); i++) {
+			one.add(locations[i], values[i]);
+		}
+		first.add(locations.data(), values.data(), 1000);
+		second.add(locations.data()+1000, values.data()+1000, locations.size()-1000);
+		first.merge(second);
+		geohash_aggregator twice(bits);
+		for (size_t k=0; k<2; k++) {
+			twice.add(locations.data()+1000, values.data()+1000, locations.size()-1000);
+		}
+		second.merge(second);
+		assert(same(second.cells(), twice.cells()));
+		assert(one.size()==expected.size());
+		assert(same(one.cells(), expected));
+		assert(same(first.cells(), expected));
+		assert(same(aggregate(locations, values, bits, 3), expected));
+		assert(same(aggregate(locations, values, bits, 1), expected));
+		for (size_t coarse : {size_t(0), bits/2, bits}) {
+			assert(same(rollup(expected, coarse), expected_cells(locations, values, coarse)));
+		}
+		assert(expected.front().mean()==expected.front().sum/double(expected.front().count));
+	}
+	// A sparse table exactly half full grows on the first add of merging into itself
+	geohash_aggregator half(64), doubled(64);
+	for (size_t i=0; i<512; i++) {
+		half.add(locations[i], values[i]);
+		doubled.add(locations[i], values[i]);
+		doubled.add(locations[i], values[i]);
+	}
+	half.merge(half);
+	assert(half.size()==512 && same(half.cells(), doubled.cells()));
+	assert(aggregate(std::vector<geolocation>(), std::vector<double>(), 20).empty());
+	bool thrown=false;
+	try {
+		geohash_aggregator(20).merge(geohash_aggregator(21));
+	} catch (const std::invalid_argument &) {
+		thrown=true;
+	}
+	assert(thrown);
+	thrown=false;
+	try {
+		rollup(expected_cells(locations, values, 10), 11);
+	} catch (const std::invalid_argument &) {
+		thrown=true;
+	}
+	assert(thrown);
+	// Vectors of different sizes are rejected, not cut to the shorter one
+	std::vector<double> short_values(values.begin(), values.end()-1);
+	geohash_aggregator mismatched(20);
+	thrown=false;
+	try {
+		mismatched.add(locations, short_values);
+	} catch (const std::invalid_argument &) {
+		thrown=true;
+	}
+	assert(thrown && mismatched.size()==0);
+	thrown=false;
+	try {
+		aggregate(locations, short_values, 20);
+	} catch (const std::invalid_argument &) {
+		thrown=true;
+	}
+	assert(thrown);
+}
+
+int main() {
+	test_aggregate();
+	return 0;
+}
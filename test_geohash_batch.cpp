@@ -0,0 +1,180 @@
+#include <vector>
+#include <random>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <assert.h>
+#include "geohash_batch.hpp"
+
+static std::vector<geolocation> test_locations() {
+	std::vector<geolocation> locations;
+	const double inf = std::numeric_limits<double>::infinity();
+	const double specials[] = { 0.0, -0.0, 90, -90, 180, -180, 45, -45, 1e-300, 181, inf, -inf };
+	for (double lat : specials) {
+		for (double lon : specials) {
+			locations.push_back(geolocation{lat, lon});
+		}
+	}
+	locations.push_back(geolocation{std::nan(""), std::nan("")});
+	std::mt19937_64 rng(7);
+	std::uniform_real_distribution<double> lat_dist(-90, 90), lon_dist(-180, 180);
+	for (int i=0; i<1000; i++) {
+		locations.push_back(geolocation{lat_dist(rng), lon_dist(rng)});
+		// Exactly on a cell edge
+		int bits = int(rng()%32)+1;
+		uint64_t k = rng() & ((1ull<<bits)-1);
+		locations.push_back(geolocation{-90+double(k)*(180/std::ldexp(1.0, bits)), -180+double(k)*(360/std::ldexp(1.0, bits))});
+	}
+	return locations;
+}
+
+void test_batch_binary_encode(const std::vector<geolocation> &locations) {
+	std::vector<double> lat, lon;
+	for (auto &l : locations) {
+		lat.push_back(l.latitude);
+		lon.push_back(l.longitude);
+	}
+	// Odd counts exercise the scalar tails of the kernels
+	for (size_t count : {locations.size(), locations.size()-3, size_t(5), size_t(0)}) {
+		for (size_t bits : {0, 1, 5, 25, 33, 60, 64}) {
+			std::vector<uint64_t> soa(count), aos(count);
+			binary_encode(lat.data(), lon.data(), count, bits, soa.data());
+			binary_encode(locations.data(), count, bits, aos.data());
+			for (size_t i=0; i<count; i++) {
+				assert(binary_hash(soa[i], bits)==binary_encode(locations[i], bits));
+				assert(aos[i]==soa[i]);
+			}
+		}
+	}
+}
+
+void test_batch_encode(const std::vector<geolocation> &locations) {
+	std::vector<double> lat, lon;
+	for (auto &l : locations) {
+		lat.push_back(l.latitude);
+		lon.push_back(l.longitude);
+	}
+	for (size_t precision : {1, 6, 9, 12}) {
+		std::vector<char> soa(locations.size()*precision), aos(locations.size()*precision);
+		encode(lat.data(), lon.data(), locations.size(), precision, soa.data());
+		encode(locations.data(), locations.size(), precision, aos.data());
+		for (size_t i=0; i<locations.size(); i++) {
+			std::string expected = encode(locations[i], precision);
+			assert(std::string(&soa[i*precision], precision)==expected);
+			assert(std::string(&aos[i*precision], precision)==expected);
+		}
+	}
+}
+
+// Reference result of one row, through the throwing decode
+static bool reference_decode(const std::string &hash, bounding_box &box) {
+	if (hash.size()>MAX_GEOHASH_LENGTH) {
+		return false;
+	}
+	try {
+		box = decode(hash);
+		return true;
+	} catch (std::invalid_argument &) {
+		return false;
+	}
+}
+
+static std::string random_hash(std::mt19937_64 &rng, size_t length) {
+	static const char codes[] = "0123456789bcdefghjkmnpqrstuvwxyzBCDEFGHJKMNPQRSTUVWXYZ";
+	std::string hash;
+	for (size_t n=0; n<length; n++) {
+		hash.push_back(codes[rng()%(sizeof(codes)-1)]);
+	}
+	// Now and then corrupt one character with any byte value
+	if (length && rng()%8==0) {
+		hash[rng()%length] = char(rng()%256);
+	}
+	return hash;
+}
+
+static void check_decoded_rows(const std::vector<std::string> &hashes, const std::vector<bounding_box> &boxes,
+                               const std::vector<geolocation> &centers, const std::vector<uint64_t> &invalid,
+                               size_t found) {
+	size_t expected_invalid = 0;
+	for (size_t i=0; i<hashes.size(); i++) {
+		bounding_box expected;
+		bool valid = reference_decode(hashes[i], expected);
+		assert(valid==((invalid[i/64]>>(i%64)&1)==0));
+		if (valid) {
+			assert(boxes[i]==expected);
+			assert(centers[i]==expected.center());
+		} else {
+			expected_invalid++;
+			assert(boxes[i]==bounding_box());
+		}
+	}
+	assert(found==expected_invalid);
+}
+
+void test_batch_decode_fixed(std::mt19937_64 &rng) {
+	for (size_t width : {0, 1, 5, 7, 12, 13}) {
+		for (size_t count : {0, 1, 3, 64, 257, 1000}) {
+			std::vector<std::string> hashes;
+			std::string packed;
+			for (size_t i=0; i<count; i++) {
+				hashes.push_back(random_hash(rng, width));
+				packed += hashes.back();
+			}
+			std::vector<bounding_box> boxes(count);
+			std::vector<geolocation> centers(count);
+			std::vector<uint64_t> invalid((count+63)/64, ~0ull), invalid2((count+63)/64, ~0ull);
+			size_t found = decode(packed.data(), count, width, boxes.data(), invalid.data());
+			assert(decode(packed.data(), count, width, centers.data(), invalid2.data())==found);
+			assert(invalid==invalid2);
+			check_decoded_rows(hashes, boxes, centers, invalid, found);
+		}
+	}
+	// Round trip through the batch encoder
+	std::vector<geolocation> locations = test_locations();
+	std::vector<char> packed(locations.size()*9);
+	encode(locations.data(), locations.size(), 9, packed.data());
+	std::vector<geolocation> centers(locations.size());
+	std::vector<uint64_t> invalid((locations.size()+63)/64);
+	assert(decode(packed.data(), locations.size(), 9, centers.data(), invalid.data())==0);
+	for (size_t i=0; i<locations.size(); i++) {
+		assert(centers[i]==decode(encode(locations[i], 9)).center());
+	}
+}
+
+void test_batch_decode_offsets(std::mt19937_64 &rng) {
+	size_t count = 777;
+	std::vector<std::string> hashes;
+	std::string buffer;
+	std::vector<size_t> offsets(1, 0);
+	for (size_t i=0; i<count; i++) {
+		hashes.push_back(random_hash(rng, rng()%15));
+		buffer += hashes.back();
+		offsets.push_back(buffer.size());
+	}
+	std::vector<bounding_box> boxes(count);
+	std::vector<geolocation> centers(count);
+	std::vector<uint64_t> invalid((count+63)/64), invalid2((count+63)/64);
+	size_t found = decode(buffer.data(), offsets.data(), count, boxes.data(), invalid.data());
+	assert(decode(buffer.data(), offsets.data(), count, centers.data(), invalid2.data())==found);
+	assert(invalid==invalid2);
+	check_decoded_rows(hashes, boxes, centers, invalid, found);
+}
+
+int main() {
+	std::vector<geolocation> locations = test_locations();
+	simd_level best = detect_simd_level();
+	assert(active_simd_level()==best);
+	// Every kernel the CPU can run must agree with the scalar encoder
+	for (simd_level level : {simd_level::scalar, simd_level::avx2, simd_level::avx512}) {
+		if (set_simd_level(level)!=level) {
+			continue;
+		}
+		test_batch_binary_encode(locations);
+		test_batch_encode(locations);
+		std::mt19937_64 rng(11);
+		test_batch_decode_fixed(rng);
+		test_batch_decode_offsets(rng);
+	}
+	set_simd_level(best);
+	return 0;
+}
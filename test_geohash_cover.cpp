@@ -0,0 +1,297 @@
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <assert.h>
+#include "geohash_cover.hpp"
+#include "geohash_distance.hpp"
+
+static bool covered(const geohash_cover &c, geolocation l) {
+	uint64_t key=encode_key(l);
+	for (const key_range &r : c.ranges) {
+		if (r.contains(key)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/// Areas on the unit sphere
+static double sphere_area(const bounding_box &b) {
+	return (b.max_lon-b.min_lon)*M_PI/180*(std::sin(b.max_lat*M_PI/180)-std::sin(b.min_lat*M_PI/180));
+}
+
+static double cap_area(double dist) {
+	return 2*M_PI*(1-std::cos(dist/6371.009));
+}
+
+static void check_cells(const geohash_cover &c, const cover_options &options) {
+	assert(c.cells.size()<=options.max_cells);
+	for (size_t i=0; i<c.cells.size(); i++) {
+		assert(c.cells[i].size()<=options.max_bits);
+		if (i>0) {
+			// Key order, and no cell inside the previous one
+			uint64_t previous=c.cells[i-1].empty() ? 0 : c.cells[i-1].bits<<(64-c.cells[i-1].size());
+			uint64_t key=c.cells[i].empty() ? 0 : c.cells[i].bits<<(64-c.cells[i].size());
+			assert(previous<key);
+			assert(!cell_range(previous, c.cells[i-1].size()).contains(key));
+		}
+	}
+	if (!c.cells.empty()) {
+		assert(c.over_coverage>=1-1e-9);
+	}
+}
+
+void test_box_distance() {
+	std::mt19937_64 rng(10);
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180), unit(0, 1);
+	for (int i=0; i<2000; i++) {
+		geolocation l{lat(rng), lon(rng)};
+		bounding_box box(lat(rng), lat(rng), lon(rng), lon(rng));
+		if (i%2) {
+			// Small boxes, where edges matter
+			double a=lat(rng), b=lon(rng);
+			box=bounding_box(a, std::min(90.0, a+unit(rng)), b, std::min(180.0, b+unit(rng)));
+		}
+		double d=distance(l, box);
+		// Sample the edges, no sample may be closer and the closest one is near
+		double closest=std::numeric_limits<double>::infinity();
+		for (int n=0; n<=1000; n++) {
+			double t=n/1000.0;
+			double la=box.min_lat+t*box.lat_range(), lo=box.min_lon+t*box.lon_range();
+			for (geolocation e : {geolocation{la, box.min_lon}, geolocation{la, box.max_lon},
+			                      geolocation{box.min_lat, lo}, geolocation{box.max_lat, lo}}) {
+				closest=std::min(closest, distance(l, e, distance_mode::haversine));
+			}
+		}
+		if (box.contains(l)) {
+			assert(d==0);
+		} else {
+			assert(closest>=d*(1-1e-9)-1e-9);
+			assert(closest<=d+std::max(box.lat_range(), box.lon_range())*111.2/1000*2+1e-9);
+		}
+	}
+}
+
+void test_circle_cover() {
+	std::mt19937_64 rng(11);
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180), unit(0, 1);
+	std::vector<geolocation> centers={{90, 0}, {-90, 0}, {0, 180}, {45, -180}, {89.9, 179.9}, {0, 0}};
+	for (int i=0; i<60; i++) {
+		centers.push_back(geolocation{lat(rng), lon(rng)});
+	}
+	for (geolocation center : centers) {
+		for (double dist : {0.0, 0.05, 1.0, 30.0, 800.0, 12000.0}) {
+			for (size_t level_bits : {1, 5}) {
+				cover_options options;
+				options.level_bits=level_bits;
+				options.max_cells=level_bits==5 ? 40 : 12;
+				geohash_cover c=cover(center, dist, options);
+				check_cells(c, options);
+				assert(!c.cells.empty());
+				assert(covered(c, center));
+				// Every cell touches the circle
+				for (const binary_hash &cell : c.cells) {
+					assert(distance(center, decode(cell))<=dist*(1+1e-6)+1e-9);
+				}
+				// Locations inside the circle are covered
+				double degrees=dist/111.19;
+				for (int n=0; n<200; n++) {
+					double b=2*M_PI*unit(rng), r=degrees*std::sqrt(unit(rng));
+					geolocation l{center.latitude+r*std::cos(b), center.longitude+r*std::sin(b)};
+					l.latitude=std::min(std::max(l.latitude, -90.0), 90.0);
+					l.longitude=std::remainder(l.longitude, 360.0);
+					if (within(center, l, dist)) {
+						assert(covered(c, l));
+					}
+				}
+			}
+		}
+	}
+	assert(cover(geolocation{0, 0}, -1).cells.empty());
+	assert(cover(geolocation{0, 0}, std::nan("")).cells.empty());
+	// The whole sphere is the root cell
+	geohash_cover world=cover(geolocation{0, 0}, 30000);
+	assert(world.cells.size()==1 && world.cells[0].size()==0);
+	assert((world.ranges==std::vector<key_range>{{0, 0}}));
+	// Across the antimeridian, both bounding boxes span too many cells to seed below the root
+	for (double dist : {6000.0, 8000.0}) {
+		cover_options options;
+		geohash_cover wide=cover(geolocation{0, 179.5}, dist, options);
+		check_cells(wide, options);
+		double cells_area=0;
+		for (const binary_hash &cell : wide.cells) {
+			cells_area+=sphere_area(decode(cell));
+		}
+		assert(std::abs(cells_area-wide.over_coverage*cap_area(dist))<=1e-6*cells_area);
+	}
+}
+
+void test_box_cover() {
+	std::mt19937_64 rng(12);
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180), unit(0, 1);
+	std::vector<bounding_box> boxes={
+		bounding_box(),
+		bounding_box(31.2, 31.3, 121.4, 121.5),
+		bounding_box(-90, 90, -0.001, 0.001),
+		bounding_box(10, 10.0001, -180, 180),
+		bounding_box(3, 3, 4, 4),
+	};
+	for (int i=0; i<100; i++) {
+		double a=lat(rng), b=lon(rng), s=std::pow(10, -3+4*unit(rng));
+		boxes.push_back(bounding_box(a, std::min(90.0, a+s*unit(rng)), b, std::min(180.0, b+s*unit(rng))));
+	}
+	for (const bounding_box &box : boxes) {
+		cover_options options;
+		options.max_cells=20;
+		geohash_cover c=cover(box, options);
+		check_cells(c, options);
+		for (const binary_hash &cell : c.cells) {
+			bounding_box b=decode(cell);
+			assert(b.min_lat<=box.max_lat && b.max_lat>=box.min_lat && b.min_lon<=box.max_lon && b.max_lon>=box.min_lon);
+		}
+		for (int n=0; n<200; n++) {
+			geolocation l{box.min_lat+unit(rng)*box.lat_range(), box.min_lon+unit(rng)*box.lon_range()};
+			assert(covered(c, l));
+		}
+		for (geolocation corner : {box.bottom_left(), box.bottom_right(), box.top_left(), box.top_right()}) {
+			assert(covered(c, corner));
+		}
+		// A larger budget never covers more
+		options.max_cells=200;
+		assert(cover(box, options).over_coverage<=c.over_coverage*(1+1e-9));
+	}
+	assert(cover(bounding_box()).cells.size()==1);
+	bounding_box inverted;
+	inverted.min_lon=10;
+	inverted.max_lon=0;
+	assert(cover(inverted).cells.empty());
+}
+
+void test_cover_options() {
+	geolocation l{31.23, 121.473};
+	// hash_codes covers the same circle with 9 cells of one precision
+	cover_options options;
+	options.max_cells=9;
+	geohash_cover c=cover(l, 1, options);
+	double nine=0;
+	for (const geohash &h : hash_codes(l, 1)) {
+		bounding_box b=decode(h);
+		nine+=b.lon_range()*M_PI/180*(std::sin(b.max_lat*M_PI/180)-std::sin(b.min_lat*M_PI/180));
+	}
+	double circle=2*M_PI*(1-std::cos(1/6371.009));
+	assert(c.over_coverage<nine/circle);
+	std::vector<geohash> hashes=c.hashes();
+	assert(hashes.size()==c.cells.size());
+	for (size_t i=0; i<hashes.size(); i++) {
+		assert(hashes[i].size()*5==c.cells[i].size());
+		assert(binary_hash::from_geohash(hashes[i].to_string())==c.cells[i]);
+	}
+	// A loose target stops early
+	options.max_cells=64;
+	options.target_over_coverage=4;
+	geohash_cover loose=cover(l, 1, options);
+	options.target_over_coverage=1;
+	geohash_cover tight=cover(l, 1, options);
+	assert(loose.cells.size()<=tight.cells.size() && tight.over_coverage<=loose.over_coverage);
+	// Binary cells of odd precision are not geohash strings
+	options.level_bits=1;
+	geohash_cover binary=cover(l, 1, options);
+	bool thrown=false;
+	try {
+		binary.hashes();
+	} catch (const std::invalid_argument &) {
+		thrown=true;
+	}
+	assert(thrown || binary.cells.empty());
+	// max_bits bounds the precision
+	options.level_bits=5;
+	options.max_bits=20;
+	for (const binary_hash &cell : cover(l, 0, options).cells) {
+		assert(cell.size()<=20);
+	}
+	// Budgets below the seeds the region meets fall back to coarser seeds
+	bounding_box box(-1, 1, -1, 1);
+	geolocation pole{89.9, 0}, antimeridian{0, 179.9};
+	for (size_t level_bits : {1, 5}) {
+		for (size_t max_cells : {1, 2, 3}) {
+			cover_options small;
+			small.level_bits=level_bits;
+			small.max_cells=max_cells;
+			geohash_cover b=cover(box, small);
+			check_cells(b, small);
+			for (geolocation corner : {geolocation{-1, -1}, geolocation{1, 1}, geolocation{-1, 1}, geolocation{1, -1}}) {
+				assert(covered(b, corner));
+			}
+			geohash_cover p=cover(pole, 50, small);
+			check_cells(p, small);
+			assert(covered(p, pole) && covered(p, geolocation{89.9, 180}) && covered(p, geolocation{89.9, -90}));
+			geohash_cover a=cover(antimeridian, 100, small);
+			check_cells(a, small);
+			assert(covered(a, geolocation{0, 179.95}) && covered(a, geolocation{0, -179.5}));
+		}
+	}
+}
+
+void test_polygon_cover() {
+	std::mt19937_64 rng(15);
+	std::uniform_real_distribution<double> unit(0, 1);
+	for (int i=0; i<40; i++) {
+		// Stars, concave, some of them tiny, up to the poles and the antimeridian
+		double size=std::pow(10, -3+3*unit(rng));
+		double c_lat=-90+size+unit(rng)*(180-2*size), c_lon=-180+size+unit(rng)*(360-2*size);
+		std::vector<geolocation> star;
+		for (int n=0; n<10; n++) {
+			double r=size*(n%2 ? 0.3+0.7*unit(rng) : 1), b=2*M_PI*n/10;
+			star.push_back(geolocation{c_lat+r*std::sin(b), c_lon+r*std::cos(b)});
+		}
+		cover_options options;
+		options.max_cells=30;
+		options.level_bits=i%2 ? 2 : 5;
+		geohash_cover c=cover(star, options);
+		check_cells(c, options);
+		assert(c.interior.size()==c.cells.size());
+		bounding_box bounds=polygon_bounds(star.data(), star.size());
+		for (int n=0; n<300; n++) {
+			geolocation l{bounds.min_lat+unit(rng)*bounds.lat_range(), bounds.min_lon+unit(rng)*bounds.lon_range()};
+			bool inside=polygon_contains(star.data(), star.size(), l);
+			if (inside) {
+				assert(covered(c, l));
+			}
+			// Interior cells hold no location outside
+			for (size_t k=0; k<c.cells.size(); k++) {
+				if (c.interior[k] && decode(c.cells[k]).contains(l)) {
+					assert(inside);
+				}
+			}
+		}
+	}
+	// A box as a polygon has the area of the box
+	std::vector<geolocation> square={{10, 20}, {10, 21}, {11, 21}, {11, 20}};
+	geohash_cover c=cover(square);
+	geohash_cover b=cover(bounding_box(10, 11, 20, 21));
+	assert(std::abs(c.over_coverage-b.over_coverage)<1e-9*b.over_coverage);
+	assert(polygon_contains(square.data(), square.size(), geolocation{10.5, 20.5}));
+	assert(!polygon_contains(square.data(), square.size(), geolocation{11.5, 20.5}));
+	// Cells well inside are interior
+	cover_options options;
+	options.max_cells=64;
+	options.target_over_coverage=0;
+	c=cover(square, options);
+	assert(std::count(c.interior.begin(), c.interior.end(), true)>0);
+	// Degenerate polygons
+	assert(cover(std::vector<geolocation>{{0, 0}, {1, 1}}).cells.empty());
+	assert(cover(std::vector<geolocation>{{0, 0}, {1, 1}, {91, 0}}).cells.empty());
+	assert(cover(std::vector<geolocation>{{0, 0}, {1, 1}, {std::nan(""), 0}}).cells.empty());
+}
+
+int main() {
+	test_box_distance();
+	test_circle_cover();
+	test_box_cover();
+	test_cover_options();
+	test_polygon_cover();
+	return 0;
+}
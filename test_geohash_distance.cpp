@@ -0,0 +1,144 @@
+#include <vector>
+#include <random>
+#include <cmath>
+#include <limits>
+#include <assert.h>
+#include "geohash_distance.hpp"
+
+static const distance_mode modes[]={
+	distance_mode::haversine, distance_mode::equirectangular, distance_mode::fast_local,
+};
+
+static bool close(double a, double b, double relative) {
+	return std::abs(a-b)<=relative*std::max(std::abs(b), 1e-9);
+}
+
+/// Random locations within dist km of origin
+static std::vector<geolocation> around(geolocation origin, double dist, size_t count, std::mt19937_64 &rng) {
+	std::uniform_real_distribution<double> u(0, 1);
+	std::vector<geolocation> output;
+	double degrees=dist/6371.009*180/M_PI;
+	for (size_t i=0; i<count; i++) {
+		double d=degrees*u(rng), b=2*M_PI*u(rng);
+		double lat=std::min(std::max(origin.latitude+d*std::cos(b), -90.0), 90.0);
+		double lon=origin.longitude+d*std::sin(b)/std::cos(origin.latitude*M_PI/180);
+		lon=lon>180 ? lon-360 : (lon<-180 ? lon+360 : lon);
+		output.push_back(geolocation{lat, lon});
+	}
+	return output;
+}
+
+void test_distance_modes() {
+	std::mt19937_64 rng(7);
+	std::uniform_real_distribution<double> lat(-70, 70), lon(-180, 180), any_lat(-90, 90);
+	for (int i=0; i<200; i++) {
+		geolocation o{lat(rng), lon(rng)};
+		for (const geolocation &l : around(o, 10, 20, rng)) {
+			double exact=distance(o, l);
+			assert(close(distance(o, l, distance_mode::haversine), exact, 1e-13));
+			assert(close(distance(o, l, distance_mode::equirectangular), exact, 1e-6));
+			assert(close(distance(o, l, distance_mode::fast_local), exact, 1e-3));
+		}
+		for (const geolocation &l : around(o, 100, 20, rng)) {
+			double exact=distance(o, l);
+			assert(close(distance(o, l, distance_mode::equirectangular), exact, 1e-4));
+			assert(close(distance(o, l, distance_mode::fast_local), exact, 1e-2));
+		}
+		geolocation far{any_lat(rng), lon(rng)};
+		assert(close(distance(o, far, distance_mode::haversine), distance(o, far), 1e-13));
+	}
+	// Across the antimeridian and at the poles
+	geolocation east{10, 179.99}, west{10, -179.99};
+	for (distance_mode mode : modes) {
+		assert(close(distance(east, west, mode), distance(east, west), 1e-6));
+		assert(distance(east, east, mode)==0);
+	}
+	assert(close(distance({90, 0}, {-90, 0}, distance_mode::haversine), distance({90, 0}, {-90, 0}), 1e-13));
+	assert(close(distance({90, 0}, {89, 120}, distance_mode::haversine), distance({90, 0}, {89, 120}), 1e-13));
+	assert(std::isnan(distance({0, 0}, {std::nan(""), 0}, distance_mode::haversine)));
+}
+
+void test_within() {
+	std::mt19937_64 rng(8);
+	geolocation o{31.23, 121.473};
+	for (distance_mode mode : modes) {
+		for (const geolocation &l : around(o, 20, 2000, rng)) {
+			double d=distance(o, l, mode);
+			assert(within(o, l, d*(1+1e-12), mode));
+			assert(!within(o, l, d*(1-1e-12), mode) || d==0);
+		}
+		assert(within(o, o, 0, mode));
+		assert(!within(o, o, -1, mode));
+		assert(!within(o, o, std::nan(""), mode));
+	}
+	assert(within({0, 0}, {0, 180}, 1e9));
+	assert(within({0, 0}, {0, 180}, std::numeric_limits<double>::infinity()));
+}
+
+void test_batch_distance() {
+	std::mt19937_64 rng(9);
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+	std::vector<geolocation> locations;
+	for (int i=0; i<1000; i++) {
+		locations.push_back(geolocation{lat(rng), lon(rng)});
+	}
+	std::vector<geolocation> near=around(locations[0], 50, 700, rng);
+	locations.insert(locations.end(), near.begin(), near.end());
+	locations.push_back(geolocation{90, 180});
+	locations.push_back(geolocation{-90, -180});
+	locations.push_back(geolocation{-locations[0].latitude, locations[0].longitude-180});
+	std::vector<double> lats, lons;
+	for (auto &l : locations) {
+		lats.push_back(l.latitude);
+		lons.push_back(l.longitude);
+	}
+	// Odd counts exercise the padded tails of the kernels
+	for (size_t count : {locations.size(), size_t(301), size_t(3), size_t(0)}) {
+		for (distance_mode mode : modes) {
+			for (geolocation origin : {locations[0], geolocation{89.5, 0}, geolocation{0, 180}}) {
+				std::vector<double> soa(count), aos(count);
+				distance(origin, lats.data(), lons.data(), count, soa.data(), mode);
+				distance(origin, locations.data(), count, aos.data(), mode);
+				std::vector<uint64_t> mask((count+63)/64, ~0ull), aos_mask((count+63)/64);
+				size_t found=within(origin, lats.data(), lons.data(), count, 2000, mask.data(), mode);
+				assert(within(origin, locations.data(), count, 2000, aos_mask.data(), mode)==found);
+				assert(mask==aos_mask);
+				size_t expected=0;
+				for (size_t i=0; i<count; i++) {
+					double d=distance(origin, locations[i], mode);
+					assert(soa[i]==aos[i]);
+					assert(std::abs(soa[i]-d)<=1e-13*std::max(d, 1.0));
+					bool in=(mask[i/64]>>(i%64)) & 1;
+					// Kernels round differently than the scalar path right at the boundary
+					if (std::abs(d-2000)>1e-9) {
+						assert(in==within(origin, locations[i], 2000, mode));
+					}
+					expected+=in;
+				}
+				assert(found==expected);
+			}
+		}
+	}
+	// Many to many is one to many per row
+	std::vector<double> matrix(5*locations.size()), row(locations.size());
+	distance(locations.data(), 5, locations.data(), locations.size(), matrix.data(), distance_mode::haversine);
+	for (size_t r=0; r<5; r++) {
+		distance(locations[r], locations.data(), locations.size(), row.data(), distance_mode::haversine);
+		assert(std::equal(row.begin(), row.end(), matrix.begin()+r*locations.size()));
+	}
+}
+
+int main() {
+	simd_level best=detect_simd_level();
+	test_distance_modes();
+	test_within();
+	// Every kernel the CPU can run must agree with the scalar path
+	for (simd_level level : {simd_level::scalar, simd_level::avx2, simd_level::avx512}) {
+		if (set_simd_level(level)!=level) {
+			continue;
+		}
+		test_batch_distance();
+	}
+	set_simd_level(best);
+	return 0;
+}
@@ -0,0 +1,111 @@
+#include <vector>
+#include <random>
+#include <cmath>
+#include <stdexcept>
+#include <assert.h>
+#include "geohash_geofence.hpp"
+
+/// Concave stars of many sizes, overlapping each other, some on the poles and the antimeridian
+static std::vector<std::vector<geolocation>> test_polygons(std::mt19937_64 &rng, size_t count) {
+	std::uniform_real_distribution<double> unit(0, 1);
+	std::vector<std::vector<geolocation>> polygons;
+	for (size_t i=0; i<count; i++) {
+		double size=std::pow(10, -2+2.5*unit(rng));
+		double c_lat=i%7==0 ? 89 : 20+10*unit(rng), c_lon=i%5==0 ? 179 : 100+10*unit(rng);
+		std::vector<geolocation> star;
+		for (int n=0; n<12; n++) {
+			double r=size*(n%2 ? 0.2+0.8*unit(rng) : 1), b=2*M_PI*n/12;
+			star.push_back(geolocation{std::min(std::max(c_lat+r*std::sin(b), -90.0), 90.0),
+			                           std::min(std::max(c_lon+r*std::cos(b), -180.0), 180.0)});
+		}
+		polygons.push_back(star);
+	}
+	// Polygons sharing a cell, and a large one containing many others
+	polygons.push_back({{25, 105}, {25, 105.001}, {25.001, 105.001}});
+	polygons.push_back({{25, 105}, {25, 105.001}, {25.001, 105}});
+	polygons.push_back({{0, 90}, {0, 130}, {50, 130}, {50, 90}});
+	return polygons;
+}
+
+static std::vector<size_t> brute_force(const std::vector<std::vector<geolocation>> &polygons, geolocation l) {
+	std::vector<size_t> output;
+	for (size_t p=0; p<polygons.size(); p++) {
+		if (polygon_contains(polygons[p].data(), polygons[p].size(), l)) {
+			output.push_back(p);
+		}
+	}
+	return output;
+}
+
+void test_geofence_lookup() {
+	std::mt19937_64 rng(15);
+	std::vector<std::vector<geolocation>> polygons=test_polygons(rng, 300);
+	geofence fence(polygons);
+	assert(fence.size()==polygons.size());
+	assert(fence.cell_count()>=polygons.size() && fence.cell_count()<=polygons.size()*64);
+	std::uniform_real_distribution<double> lat(15, 35), lon(95, 115), unit(0, 1);
+	std::vector<geolocation> locations;
+	for (int i=0; i<20000; i++) {
+		locations.push_back(geolocation{lat(rng), lon(rng)});
+		if (i%4==0) {
+			locations.push_back(geolocation{88+2*unit(rng), 177+3*unit(rng)});
+		}
+	}
+	locations.push_back(geolocation{25.0005, 105.0001});
+	locations.push_back(geolocation{90, 180});
+	size_t matches=0;
+	for (const geolocation &l : locations) {
+		std::vector<size_t> found=fence.find(l);
+		assert(found==brute_force(polygons, l));
+		matches+=found.size();
+	}
+	assert(matches>locations.size());
+	assert(fence.find(geolocation{25.0005, 105.0001}).size()>=3);
+	// Batches give the same, in location order
+	std::vector<geofence_match> batch=fence.find(locations);
+	assert(batch.size()==matches);
+	size_t at=0;
+	for (size_t i=0; i<locations.size(); i++) {
+		for (size_t p : fence.find(locations[i])) {
+			assert(batch[at].location==i && batch[at].polygon==p);
+			at++;
+		}
+	}
+	// Out of range locations are in no polygon
+	assert(fence.find(geolocation{95, 100}).empty());
+	assert(fence.find(geolocation{std::nan(""), 100}).empty());
+	assert(fence.find(std::vector<geolocation>{{95, 100}, {25, -200}}).empty());
+}
+
+void test_geofence_options() {
+	std::mt19937_64 rng(16);
+	std::vector<std::vector<geolocation>> polygons=test_polygons(rng, 50);
+	cover_options options;
+	options.max_cells=4;
+	geofence coarse(polygons, options);
+	geofence fine(polygons);
+	assert(coarse.cell_count()<fine.cell_count());
+	std::uniform_real_distribution<double> lat(15, 35), lon(95, 115);
+	for (int i=0; i<5000; i++) {
+		geolocation l{lat(rng), lon(rng)};
+		assert(coarse.find(l)==fine.find(l));
+	}
+	geofence empty{std::vector<std::vector<geolocation>>()};
+	assert(empty.size()==0 && empty.find(geolocation{0, 0}).empty());
+	for (const std::vector<geolocation> &bad : {std::vector<geolocation>{{0, 0}, {1, 1}},
+	                                            std::vector<geolocation>{{0, 0}, {1, 1}, {0, 181}}}) {
+		bool thrown=false;
+		try {
+			geofence fence({polygons[0], bad});
+		} catch (const std::invalid_argument &) {
+			thrown=true;
+		}
+		assert(thrown);
+	}
+}
+
+int main() {
+	test_geofence_lookup();
+	test_geofence_options();
+	return 0;
+}
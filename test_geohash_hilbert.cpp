@@ -0,0 +1,128 @@
+#include <vector>
+#include <random>
+#include <utility>
+#include <stdexcept>
+#include <assert.h>
+#include "geohash_cover.hpp"
+#include "geohash_distance.hpp"
+#include "geohash_hilbert.hpp"
+
+static_assert(key_from_hilbert(hilbert_from_key(0x123456789abcdef0))==0x123456789abcdef0, "constexpr round trip");
+static_assert(hilbert_from_key(0)==0, "origin starts the curve");
+
+/// The textbook conversion of grid coordinates to a Hilbert index, one level at a time
+static uint64_t reference_hilbert(uint32_t x, uint32_t y) {
+	uint64_t d=0;
+	for (uint64_t s=uint64_t(1)<<31; s>0; s>>=1) {
+		uint64_t rx=(x & s)>0, ry=(y & s)>0;
+		d+=s*s*((3*rx)^ry);
+		if (ry==0) {
+			if (rx==1) {
+				x=~x;
+				y=~y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return d;
+}
+
+void test_hilbert_keys() {
+	std::mt19937_64 rng(20);
+	for (int n=0; n<100000; n++) {
+		uint64_t key=rng();
+		uint32_t lon, lat;
+		deinterleave(key, lon, lat);
+		uint64_t h=hilbert_from_key(key);
+		assert(h==reference_hilbert(lon, lat));
+		assert(key_from_hilbert(h)==key);
+	}
+	// Consecutive cells share an edge, at every even precision
+	for (size_t bits : {2, 4, 10, 16}) {
+		for (uint64_t h=0; h+1<(uint64_t(1)<<bits); h++) {
+			binary_hash a=geohash_from_hilbert(binary_hash(h, bits)), b=geohash_from_hilbert(binary_hash(h+1, bits));
+			uint32_t lon_a, lat_a, lon_b, lat_b;
+			deinterleave(a.bits<<(64-bits), lon_a, lat_a);
+			deinterleave(b.bits<<(64-bits), lon_b, lat_b);
+			uint64_t step=uint64_t(1)<<(32-bits/2);
+			uint64_t dlon=lon_a>lon_b ? lon_a-lon_b : lon_b-lon_a, dlat=lat_a>lat_b ? lat_a-lat_b : lat_b-lat_a;
+			assert((dlon==step && dlat==0) || (dlon==0 && dlat==step));
+		}
+	}
+}
+
+void test_hilbert_cells() {
+	std::mt19937_64 rng(20);
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+	for (int n=0; n<2000; n++) {
+		geolocation l{lat(rng), lon(rng)};
+		for (size_t bits=0; bits<=64; bits++) {
+			binary_hash h=hilbert_encode(l, bits);
+			assert(h.size()==bits);
+			assert(hilbert_decode(h).contains(l));
+			if (bits%2==0) {
+				binary_hash cell=binary_encode(l, bits);
+				assert(hilbert_from_geohash(cell)==h);
+				assert(geohash_from_hilbert(h)==cell);
+				assert(hilbert_decode(h)==decode(cell));
+			}
+		}
+		binary_hash h=hilbert_encode(l, 20);
+		std::array<binary_hash, 8> expected=neighbors(binary_encode(l, 20));
+		std::array<binary_hash, 8> found=hilbert_neighbors(h);
+		for (size_t i=0; i<8; i++) {
+			assert(geohash_from_hilbert(found[i])==expected[i]);
+		}
+		assert(geohash_from_hilbert(hilbert_neighbor(h, std::make_pair(1, -1)))==neighbor(binary_encode(l, 20), std::make_pair(1, -1)));
+	}
+	bool thrown=false;
+	try {
+		hilbert_from_geohash(binary_hash(5, 3));
+	} catch (const std::invalid_argument &) {
+		thrown=true;
+	}
+	assert(thrown);
+}
+
+void test_hilbert_ranges() {
+	std::mt19937_64 rng(20);
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180), offset(-1, 1);
+	for (int n=0; n<200; n++) {
+		geolocation c{lat(rng), lon(rng)};
+		double dist=n%2 ? 30 : 500;
+		cover_options options;
+		options.level_bits=n%3 ? 5 : 1;
+		geohash_cover z=cover(c, dist, options);
+		std::vector<key_range> h=hilbert_ranges(z.cells);
+		assert(h.size()<=2*z.cells.size());
+		std::vector<key_range> hr=hilbert_radius_ranges(c, dist);
+		for (int p=0; p<500; p++) {
+			geolocation l{std::max(-90.0, std::min(90.0, c.latitude+offset(rng)*dist/50)), std::remainder(c.longitude+offset(rng)*dist/50, 360.0)};
+			uint64_t key=encode_key(l);
+			bool in_z=false, in_h=false;
+			for (const key_range &r : z.ranges) {
+				in_z|=r.contains(key);
+			}
+			for (const key_range &r : h) {
+				in_h|=r.contains(hilbert_from_key(key));
+			}
+			assert(in_z==in_h);
+			if (within(c, l, dist)) {
+				bool found=false;
+				for (const key_range &r : hr) {
+					found|=r.contains(hilbert_from_key(key));
+				}
+				assert(found);
+			}
+		}
+	}
+	assert(hilbert_ranges(std::vector<binary_hash>{binary_hash()}).size()==1);
+	assert(hilbert_box_ranges(bounding_box(10, 11, 20, 21)).size()>0);
+}
+
+int main() {
+	test_hilbert_keys();
+	test_hilbert_cells();
+	test_hilbert_ranges();
+	return 0;
+}
@@ -0,0 +1,209 @@
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <stdexcept>
+#include <assert.h>
+#include "geohash_index.hpp"
+
+static std::vector<geolocation> test_points(std::mt19937_64 &rng, size_t count) {
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+	std::normal_distribution<double> spread(0, 0.05);
+	std::vector<geolocation> points;
+	for (size_t i=0; i<count; i++) {
+		if (i%2) {
+			points.push_back(geolocation{lat(rng), lon(rng)});
+		} else {
+			// Clusters, one of them across the antimeridian
+			double lon_center=(i%3) ? 121.47 : 179.98;
+			double l=lon_center+spread(rng);
+			points.push_back(geolocation{31.23+spread(rng), l>180 ? l-360 : l});
+		}
+	}
+	// Duplicates keep their insertion order
+	points.push_back(points[0]);
+	points.push_back(points[0]);
+	return points;
+}
+
+void test_key_ranges() {
+	assert(cell_range(0x123456789abcdef0ull, 0)==(key_range{0, 0}));
+	assert(cell_range(0x123456789abcdef0ull, 4)==(key_range{0x1000000000000000ull, 0x2000000000000000ull}));
+	assert(cell_range(0xffffffffffffffffull, 1)==(key_range{0x8000000000000000ull, 0}));
+	assert(cell_range(42, 64)==(key_range{42, 43}));
+	assert(cell_range(42, 64).contains(42) && !cell_range(42, 64).contains(43));
+	assert((key_range{5, 0}).contains(~0ull));
+	std::vector<key_range> ranges={{10, 20}, {0, 5}, {20, 30}, {25, 28}, {40, 50}, {5, 6}, {45, 0}, {60, 70}};
+	coalesce(ranges);
+	assert((ranges==std::vector<key_range>{{0, 6}, {10, 30}, {40, 0}}));
+	std::vector<key_range> none;
+	coalesce(none);
+	assert(none.empty());
+}
+
+void test_index_queries() {
+	std::mt19937_64 rng(9);
+	std::vector<geolocation> points=test_points(rng, 20000);
+	std::vector<size_t> ids;
+	for (size_t i=0; i<points.size(); i++) {
+		ids.push_back(i);
+	}
+	geohash_index<size_t> index(points, ids);
+	assert(index.size()==points.size());
+	for (size_t i=1; i<index.size(); i++) {
+		assert(index.key(i-1)<=index.key(i));
+		assert(index.key(i)==encode_key(index.location(i)));
+		if (index.key(i-1)==index.key(i) && index.location(i-1)==index.location(i)) {
+			assert(index.value(i-1)<index.value(i));
+		}
+	}
+	std::uniform_real_distribution<double> lat(-80, 80), lon(-180, 180), radius(0.01, 500);
+	std::vector<geolocation> centers={{89.99, 0}, {-89.5, 170}, {31.23, 179.999}, {31.23, -179.999}, {0, 0}};
+	for (int q=0; q<300; q++) {
+		centers.push_back(q%3 ? geolocation{lat(rng), lon(rng)} : points[rng()%points.size()]);
+	}
+	for (size_t q=0; q<centers.size(); q++) {
+		geolocation center=centers[q];
+		double dist=radius(rng);
+		std::vector<size_t> found;
+		for (size_t i : index.radius(center, dist)) {
+			found.push_back(index.value(i));
+		}
+		std::sort(found.begin(), found.end());
+		std::vector<size_t> expected;
+		for (size_t i=0; i<points.size(); i++) {
+			if (within(center, points[i], dist)) {
+				expected.push_back(i);
+			}
+		}
+		assert(found==expected);
+	}
+	assert(radius_ranges(geolocation{0, 0}, -1).empty());
+	assert((radius_ranges(geolocation{0, 0}, 30000)==std::vector<key_range>{{0, 0}}));
+	// Cells of hash_codes scan like any key range
+	size_t in_cells=0;
+	for (const geohash &cell : hash_codes(points[0], 1)) {
+		index.visit(cell, [&](size_t i) { assert(hash_contains(cell, index.location(i))); in_cells++; });
+	}
+	assert(in_cells>0);
+	std::vector<bounding_box> boxes={
+		bounding_box(),
+		bounding_box(31.2, 31.3, 121.4, 121.5),
+		bounding_box(30, 32, 179.9, 180),
+		bounding_box(30, 32, -180, -179.9),
+		bounding_box(-90, 90, -1, 1),
+		bounding_box(10, 10, 20, 20),
+	};
+	bounding_box inverted;
+	inverted.min_lat=1;
+	inverted.max_lat=0;
+	boxes.push_back(inverted);
+	for (int q=0; q<100; q++) {
+		geolocation a{lat(rng), lon(rng)}, b{a.latitude+radius(rng)/100, a.longitude+radius(rng)/100};
+		boxes.push_back(bounding_box(a, b));
+	}
+	for (const bounding_box &box : boxes) {
+		std::vector<size_t> found;
+		for (size_t i : index.box(box)) {
+			found.push_back(index.value(i));
+		}
+		std::sort(found.begin(), found.end());
+		std::vector<size_t> expected;
+		for (size_t i=0; i<points.size(); i++) {
+			if (box.contains(points[i])) {
+				expected.push_back(i);
+			}
+		}
+		assert(found==expected);
+	}
+	assert(box_ranges(inverted).empty());
+	assert(box_ranges(bounding_box()).size()==1);
+	assert(box_ranges(bounding_box(31.2, 31.3, 121.4, 121.5)).size()<=16);
+}
+
+void test_index_insert() {
+	geohash_index<std::string> index;
+	assert(index.empty() && index.radius(geolocation{0, 0}, 1).empty());
+	index.insert(geolocation{31.23, 121.473}, "shanghai");
+	index.insert(geolocation{40.71, -74.01}, "new york");
+	index.insert(geolocation{31.24, 121.474}, "bund");
+	bool thrown=false;
+	try {
+		index.radius(geolocation{31.23, 121.473}, 5);
+	} catch (const std::logic_error &) {
+		thrown=true;
+	}
+	assert(thrown);
+	index.build();
+	std::vector<size_t> found=index.radius(geolocation{31.23, 121.473}, 5);
+	assert(found.size()==2);
+	assert(index.value(found[0])=="shanghai" && index.value(found[1])=="bund");
+	assert(index.box(bounding_box(40, 41, -75, -74)).size()==1);
+	thrown=false;
+	try {
+		geohash_index<int> bad({geolocation{0, 0}}, {});
+	} catch (const std::invalid_argument &) {
+		thrown=true;
+	}
+	assert(thrown);
+}
+
+void test_index_nearest() {
+	std::mt19937_64 rng(14);
+	std::vector<geolocation> points=test_points(rng, 5000);
+	// A pole cluster and an empty ocean
+	std::normal_distribution<double> spread(0, 0.3);
+	for (int i=0; i<200; i++) {
+		points.push_back(geolocation{std::min(90.0, 89.8+std::abs(spread(rng))), std::remainder(spread(rng)*300, 360.0)});
+	}
+	geohash_index<size_t> index(points, std::vector<size_t>(points.size()));
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+	std::vector<geolocation> centers={{90, 0}, {-90, 0}, {89.9, 180}, {31.23, 121.47}, {31.23, 179.9999}, {-40, -120}};
+	for (int q=0; q<100; q++) {
+		centers.push_back(q%2 ? geolocation{lat(rng), lon(rng)} : points[rng()%points.size()]);
+	}
+	std::vector<double> all(index.size());
+	for (geolocation center : centers) {
+		for (size_t i=0; i<index.size(); i++) {
+			all[i]=distance(center, index.location(i), distance_mode::haversine);
+		}
+		std::vector<double> sorted=all;
+		std::sort(sorted.begin(), sorted.end());
+		for (size_t k : {size_t(1), size_t(7), size_t(100), index.size()+3}) {
+			std::vector<index_match> found=index.nearest(center, k);
+			assert(found.size()==std::min(k, index.size()));
+			for (size_t n=0; n<found.size(); n++) {
+				assert(found[n].distance==all[found[n].position]);
+				// The same distances as brute force, closest first
+				assert(found[n].distance==sorted[n]);
+			}
+		}
+	}
+	assert(index.nearest(centers[0], 0).empty());
+	assert(geohash_index<int>().nearest(centers[0], 3).empty());
+	// Rings and their bounds
+	uint64_t key=encode_key(geolocation{31.23, 121.47});
+	assert((ring_ranges(key, 20, 0)==std::vector<key_range>{cell_range(key, 20)}));
+	std::vector<key_range> ring=ring_ranges(key, 20, 1);
+	size_t cells=0;
+	for (const key_range &r : ring) {
+		cells+=size_t((r.end-r.begin)>>44);
+	}
+	assert(cells==8);
+	for (size_t r=0; r<4; r++) {
+		assert(ring_bound(geolocation{31.23, 121.47}, 20, r)<ring_bound(geolocation{31.23, 121.47}, 20, r+1));
+	}
+	assert(ring_bound(geolocation{0, 0}, 0, 0)==HUGE_VAL);
+	assert((subtract_ranges({0, 0}, {{10, 20}, {30, 0}})==std::vector<key_range>{{0, 10}, {20, 30}}));
+	assert((subtract_ranges({15, 35}, {{10, 20}, {30, 0}})==std::vector<key_range>{{20, 30}}));
+	assert((subtract_ranges({5, 0}, {})==std::vector<key_range>{{5, 0}}));
+	assert(subtract_ranges({12, 18}, {{10, 20}}).empty());
+}
+
+int main() {
+	test_key_ranges();
+	test_index_queries();
+	test_index_insert();
+	test_index_nearest();
+	return 0;
+}
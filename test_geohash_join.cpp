@@ -0,0 +1,103 @@
+#include <vector>
+#include <random>
+#include <cmath>
+#include <set>
+#include <utility>
+#include <stdexcept>
+#include <assert.h>
+#include "geohash_join.hpp"
+
+static std::vector<geolocation> test_points(std::mt19937_64 &rng, size_t count) {
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+	std::normal_distribution<double> spread(0, 0.02);
+	std::vector<geolocation> points;
+	for (size_t i=0; i<count; i++) {
+		if (i%4==0) {
+			points.push_back(geolocation{lat(rng), lon(rng)});
+		} else {
+			// Clusters in a city, across the antimeridian and at a pole
+			geolocation c=i%4==1 ? geolocation{31.23, 121.47} : i%4==2 ? geolocation{-17.8, 179.99} : geolocation{89.98, 0};
+			double la=c.latitude+spread(rng), lo=c.longitude+spread(rng);
+			points.push_back(geolocation{std::min(la, 90.0), lo>180 ? lo-360 : lo});
+		}
+	}
+	return points;
+}
+
+static void check_join(const std::vector<geolocation> &left, const std::vector<geolocation> &right,
+                       double dist, const join_options &options)
+{
+	std::set<std::pair<size_t, size_t>> found;
+	size_t batches=0;
+	size_t count=proximity_join(left, right, dist, [&](const join_pair *pairs, size_t n) {
+		assert(n>0 && n<=options.batch_size);
+		batches++;
+		for (size_t i=0; i<n; i++) {
+			const join_pair &p=pairs[i];
+			double d=distance(left[p.left], right[p.right], options.mode);
+			assert(std::abs(p.distance-d)<=1e-9*d+1e-12);
+			assert(p.distance<=dist);
+			// No pair twice
+			assert(found.insert({p.left, p.right}).second);
+		}
+	}, options);
+	assert(count==found.size());
+	// Every pair clearly within the distance is found
+	for (size_t i=0; i<left.size(); i++) {
+		for (size_t j=0; j<right.size(); j++) {
+			if (distance(left[i], right[j], options.mode)<dist*(1-1e-9)) {
+				assert(found.count({i, j}));
+			}
+		}
+	}
+	assert(batches>=(count+options.batch_size-1)/options.batch_size);
+}
+
+void test_proximity_join() {
+	std::mt19937_64 rng(13);
+	std::vector<geolocation> left=test_points(rng, 800), right=test_points(rng, 300);
+	left.push_back(geolocation{90, 180});
+	right.push_back(geolocation{90, -180});
+	right.push_back(left[5]);
+	for (double dist : {0.0, 0.3, 2.0, 50.0, 3000.0}) {
+		for (size_t threads : {1, 3}) {
+			join_options options;
+			options.threads=threads;
+			options.batch_size=dist>1000 ? 4096 : 7;
+			check_join(left, right, dist, options);
+		}
+	}
+	join_options options;
+	options.mode=distance_mode::equirectangular;
+	check_join(left, right, 2.0, options);
+	// Antipodal points are about 20015 km apart
+	options=join_options();
+	check_join(std::vector<geolocation>(left.begin(), left.begin()+100), right, 21000, options);
+	// Nothing to join
+	auto fail=[](const join_pair *, size_t) { assert(false); };
+	assert(proximity_join(left, std::vector<geolocation>(), 10, fail)==0);
+	assert(proximity_join(std::vector<geolocation>(), right, 10, fail)==0);
+	assert(proximity_join(left, right, -1, fail)==0);
+	assert(proximity_join(left, right, std::nan(""), fail)==0);
+}
+
+void test_join_sink_errors() {
+	std::mt19937_64 rng(14);
+	std::vector<geolocation> points=test_points(rng, 500);
+	join_options options;
+	options.threads=2;
+	options.batch_size=1;
+	bool thrown=false;
+	try {
+		proximity_join(points, points, 1, [](const join_pair *, size_t) { throw std::runtime_error("full"); }, options);
+	} catch (const std::runtime_error &) {
+		thrown=true;
+	}
+	assert(thrown);
+}
+
+int main() {
+	test_proximity_join();
+	test_join_sink_errors();
+	return 0;
+}
@@ -0,0 +1,118 @@
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+#include <assert.h>
+#include "geohash_key.hpp"
+
+static_assert(key64::encode(geolocation{31.23, 121.473}, 20).parent(20).empty(), "constexpr parents");
+static_assert(key_range_for_prefix(uint128_t(0), 0)==key_range128{0, 0}, "the whole key space");
+
+void test_binary_hash_edges() {
+	// Shifts by the full width were undefined at precision 0 and 64
+	binary_hash empty;
+	assert(empty.to_string()=="" && !empty.test(0) && !empty.test(1));
+	binary_hash full=binary_encode(geolocation{31.23, 121.473}, 64);
+	std::string bits=full.to_string();
+	assert(bits.size()==64 && binary_hash(bits)==full);
+	assert(!full.test(0) && !full.test(65));
+	for (size_t n=1; n<=64; n++) {
+		assert(full.test(n)==(bits[n-1]=='1'));
+	}
+	bool thrown=false;
+	try { binary_hash(std::string(65, '1')); } catch (const std::invalid_argument &) { thrown=true; }
+	assert(thrown);
+	thrown=false;
+	try { binary_hash::from_geohash("wtw3r9jjzyjc0"); } catch (const std::invalid_argument &) { thrown=true; }
+	assert(thrown);
+	// Appending past 64 bits is rejected, the hash is left as it was
+	binary_hash grown;
+	for (size_t n=1; n<=64; n++) {
+		grown.push_back(full.test(n));
+	}
+	assert(grown==full);
+	thrown=false;
+	try { grown.push_back(true); } catch (const std::invalid_argument &) { thrown=true; }
+	assert(thrown && grown==full);
+}
+
+void test_key64() {
+	std::mt19937_64 rng(24);
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+	for (size_t i=0; i<10000; i++) {
+		geolocation l{lat(rng), lon(rng)};
+		key64 full=key64::encode(l);
+		assert(full.key()==encode_key(l) && full.size()==64);
+		for (size_t bits : {0, 1, 31, 32, 63, 64}) {
+			key64 cell=key64::encode(l, bits);
+			assert(to_binary_hash(cell)==binary_encode(l, bits));
+			assert(to_key64(binary_encode(l, bits))==cell);
+			assert(cell.decode()==decode(binary_encode(l, bits)));
+			assert(cell.contains(full) && cell.range().contains(full.key()));
+			assert(cell==full.prefix(bits) && cell.parent(64)==key64());
+			if (bits<64) {
+				// The two halves split the range at its middle
+				key64 left=cell.child(false), right=cell.child(true);
+				assert(left.parent()==cell && right.parent()==cell);
+				assert(left.range().begin==cell.range().begin && left.range().end==right.range().begin);
+				assert(right.range().end==cell.range().end);
+				assert(cell.contains(left) && !left.contains(cell) && !left.contains(right));
+				assert(cell<left && left<right);
+			}
+		}
+	}
+	key64 full=key64::encode(geolocation{0, 0});
+	bool thrown=false;
+	try { full.child(true); } catch (const std::invalid_argument &) { thrown=true; }
+	assert(thrown);
+	assert(key_range_for_prefix(~uint64_t(0), 64)==(key_range{~uint64_t(0), 0}));
+	// Sorted keys put each cell right before its descendants
+	std::vector<key64> cells;
+	geolocation l{40.71, -74.0};
+	for (size_t bits=0; bits<=64; bits+=8) {
+		cells.push_back(key64::encode(l, bits));
+	}
+	std::vector<key64> sorted=cells;
+	std::reverse(sorted.begin(), sorted.end());
+	std::sort(sorted.begin(), sorted.end());
+	assert(sorted==cells);
+}
+
+void test_key128() {
+	std::mt19937_64 rng(128);
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+	for (size_t i=0; i<10000; i++) {
+		geolocation l{lat(rng), lon(rng)};
+		key128 full=key128::encode(l);
+		assert(uint64_t(full.key()>>64)==encode_key(l));
+		bounding_box outer=decode_key(encode_key(l), 64);
+		for (size_t bits : {0, 1, 64, 65, 66, 90, 127, 128}) {
+			key128 cell=full.prefix(bits);
+			bounding_box box=cell.decode();
+			assert(box.contains(l));
+			assert(bits<64 || (box.min_lat>=outer.min_lat && box.max_lat<=outer.max_lat &&
+			                   box.min_lon>=outer.min_lon && box.max_lon<=outer.max_lon));
+			assert(cell.range().contains(full.key()));
+			if (bits<128) {
+				key128 left=cell.child(false), right=cell.child(true);
+				assert(left.range().end==right.range().begin && right.range().end==cell.range().end);
+				assert(left.test(bits+1)==false && right.test(bits+1)==true);
+				assert(left.contains(full) || right.contains(full));
+			}
+		}
+	}
+	// Locations a tenth of a millimeter apart share a 64-bit cell, not a 128-bit one
+	geolocation a{10.0, 20.0}, b{10.0+1e-9, 20.0+1e-9};
+	assert(encode_key(a)==encode_key(b));
+	assert(key128::encode(a)!=key128::encode(b));
+	assert(key128::encode(a)<key128::encode(b));
+	uint128_t top=~uint128_t(0);
+	assert(key_range_for_prefix(top, 128)==(key_range128{top, 0}));
+}
+
+int main() {
+	test_binary_hash_edges();
+	test_key64();
+	test_key128();
+	return 0;
+}
@@ -0,0 +1,142 @@
+#include <vector>
+#include <string>
+#include <random>
+#include <cstdio>
+#include <stdexcept>
+#include <system_error>
+#include <unistd.h>
+#include <assert.h>
+#include "geohash_mapped.hpp"
+
+static std::string temporary_path() {
+	char path[]="/tmp/geohash_mapped_XXXXXX";
+	int fd=mkstemp(path);
+	assert(fd>=0);
+	close(fd);
+	return path;
+}
+
+static void write_bytes(const std::string &path, const std::string &bytes) {
+	FILE *f=std::fopen(path.c_str(), "wb");
+	assert(std::fwrite(bytes.data(), 1, bytes.size(), f)==bytes.size());
+	std::fclose(f);
+}
+
+static std::string read_bytes(const std::string &path) {
+	FILE *f=std::fopen(path.c_str(), "rb");
+	std::string bytes;
+	char buffer[4096];
+	for (size_t n; (n=std::fread(buffer, 1, sizeof(buffer), f))>0;) {
+		bytes.append(buffer, n);
+	}
+	std::fclose(f);
+	return bytes;
+}
+
+void test_mapped_queries() {
+	std::mt19937_64 rng(17);
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+	std::normal_distribution<double> spread(0, 0.3);
+	std::vector<geolocation> locations;
+	std::vector<std::string> payloads;
+	for (size_t i=0; i<30000; i++) {
+		geolocation l=i%2 ? geolocation{lat(rng), lon(rng)}
+		                  : geolocation{std::min(90.0, 31.23+spread(rng)), 121.47+spread(rng)};
+		locations.push_back(l);
+		payloads.push_back(i%5 ? "point "+std::to_string(i) : "");
+	}
+	// Duplicates keep their order
+	locations.push_back(locations[7]);
+	payloads.push_back("again");
+	geohash_index<std::string> memory(locations, payloads);
+	std::string path=temporary_path();
+	for (size_t directory_bits : {0, 1, 20}) {
+		write_index_file(path, locations, payloads, directory_bits);
+		mapped_index mapped(path);
+		assert(mapped.size()==memory.size());
+		for (size_t i=0; i<memory.size(); i++) {
+			assert(mapped.key(i)==memory.key(i));
+			assert(mapped.location(i).latitude==memory.location(i).latitude);
+			assert(mapped.location(i).longitude==memory.location(i).longitude);
+			assert(mapped.payload(i)==memory.value(i));
+		}
+		for (int n=0; n<300; n++) {
+			geolocation c{std::min(90.0, 31.23+spread(rng)), 121.47+spread(rng)};
+			if (n%3==0) {
+				c=geolocation{lat(rng), lon(rng)};
+			}
+			assert(mapped.lower_bound(encode_key(c))==memory.lower_bound(encode_key(c)));
+			double dist=n%2 ? 5 : 200;
+			assert(mapped.radius(c, dist)==memory.radius(c, dist));
+			bounding_box b(c, geolocation{c.latitude+0.2, c.longitude+0.3});
+			assert(mapped.box(b)==memory.box(b));
+			for (const geohash &cell : hash_codes(c, 1)) {
+				std::vector<size_t> found, expected;
+				mapped.visit(cell, [&](size_t i) { found.push_back(i); });
+				memory.visit(cell, [&](size_t i) { expected.push_back(i); });
+				assert(found==expected);
+			}
+		}
+		assert(mapped.lower_bound(0)==0 && mapped.lower_bound(~uint64_t(0))<=mapped.size());
+		// Moves hand the mapping over
+		mapped_index moved(std::move(mapped));
+		assert(moved.size()==memory.size() && moved.payload(memory.size()-1)==memory.value(memory.size()-1));
+	}
+	// No points
+	write_index_file(path, std::vector<geolocation>(), std::vector<std::string>());
+	mapped_index none(path);
+	assert(none.empty() && none.box(bounding_box(-90, 90, -180, 180)).empty());
+	unlink(path.c_str());
+}
+
+void test_mapped_errors() {
+	std::string path=temporary_path();
+	bool thrown=false;
+	try {
+		write_index_file(path, std::vector<geolocation>(2), std::vector<std::string>(1));
+	} catch (const std::invalid_argument &) {
+		thrown=true;
+	}
+	assert(thrown);
+	thrown=false;
+	try {
+		mapped_index missing("/nonexistent/geohash_mapped");
+	} catch (const std::system_error &) {
+		thrown=true;
+	}
+	assert(thrown);
+	write_index_file(path, std::vector<geolocation>{{1, 2}, {3, 4}, {5, 6}}, std::vector<std::string>{"a", "bb", "ccc"});
+	std::string good=read_bytes(path);
+	assert(mapped_index(path).payload(1)=="bb");
+	std::vector<std::string> damaged={
+		"",
+		good.substr(0, 100),
+		good.substr(0, good.size()-8),
+		good+"x",
+		"X"+good.substr(1),
+	};
+	// Wrong version, count past the end, payloads past the end
+	damaged.push_back(good);
+	damaged.back()[8]=2;
+	damaged.push_back(good);
+	damaged.back()[23]=1;
+	damaged.push_back(good);
+	damaged.back()[63]=1;
+	for (const std::string &bytes : damaged) {
+		write_bytes(path, bytes);
+		thrown=false;
+		try {
+			mapped_index index(path);
+		} catch (const std::invalid_argument &) {
+			thrown=true;
+		}
+		assert(thrown);
+	}
+	unlink(path.c_str());
+}
+
+int main() {
+	test_mapped_queries();
+	test_mapped_errors();
+	return 0;
+}
@@ -0,0 +1,66 @@
+#include <string>
+#include <thread>
+#include <stdexcept>
+#include <assert.h>
+#include "geohash_metrics.hpp"
+
+void test_metrics() {
+	reset_metrics();
+	geolocation l{40.71, -74.0};
+	std::string hash=encode(l, 9);
+	decode(hash);
+	neighbors(hash);
+	base_hash(l, 0.5);
+	base_hash(l, 30000);
+	try {
+		decode("a");
+		assert(false);
+	} catch (const std::invalid_argument &) {
+	}
+	try {
+		binary_hash::from_geohash("a");
+		assert(false);
+	} catch (const std::invalid_argument &) {
+	}
+	// Calls on a thread that exited still count
+	std::thread([] { encode(geolocation{1, 2}, 5); }).join();
+
+	metrics_snapshot s=snapshot_metrics();
+	if (!INSTRUMENTED) {
+		assert(s[metric::encode].calls==0 && s.empty_base_hashes==0);
+		return;
+	}
+	// base_hash encodes too
+	assert(s[metric::encode].calls==4);
+	assert(s[metric::decode].calls==2 && s[metric::decode].errors==1);
+	assert(s[metric::from_geohash].calls==1 && s[metric::from_geohash].errors==1);
+	assert(s[metric::neighbors].calls==1 && s[metric::neighbors].errors==0);
+	assert(s[metric::base_hash].calls==2);
+	assert(s[metric::hash_precision].calls==2);
+	assert(s.hash_precisions[0]==1 && s.empty_base_hashes==1);
+	assert(s.hash_precisions[hash_precision(l, 0.5)]==1);
+	// The first call of each thread is timed, reset_metrics() leaves the sampling as it was
+	uint64_t timed=0, bucketed=0;
+	for (const function_metrics &f : s.functions) {
+		assert(f.timed<=f.calls);
+		timed+=f.timed;
+		for (uint64_t b : f.latency) {
+			bucketed+=b;
+		}
+	}
+	assert(timed>=1 && bucketed==timed);
+
+	std::string text=format_metrics(s);
+	assert(text.find("geohash_calls_total{function=\"encode\"} 4\n")!=std::string::npos);
+	assert(text.find("geohash_errors_total{function=\"decode\"} 1\n")!=std::string::npos);
+	assert(text.find("geohash_call_seconds_count{function=\"encode\"} "+std::to_string(s[metric::encode].timed)+"\n")!=std::string::npos);
+	assert(text.find("geohash_empty_base_hash_total 1\n")!=std::string::npos);
+
+	reset_metrics();
+	assert(snapshot_metrics()[metric::encode].calls==0);
+}
+
+int main() {
+	test_metrics();
+	return 0;
+}
@@ -0,0 +1,175 @@
+#include <vector>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <assert.h>
+#include "geohash_distance.hpp"
+#include "geohash_moving.hpp"
+
+static std::vector<size_t> ids(const std::vector<moving_object> &objects) {
+	std::vector<size_t> output;
+	for (const moving_object &o : objects) {
+		output.push_back(o.id);
+	}
+	std::sort(output.begin(), output.end());
+	return output;
+}
+
+void test_moving_updates() {
+	std::mt19937_64 rng(18);
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+	std::normal_distribution<double> step(0, 0.05);
+	const size_t count=2000;
+	for (size_t bits : {0, 16, 30}) {
+		moving_index index(count, bits);
+		std::vector<geolocation> locations(count);
+		std::vector<bool> present(count);
+		assert(index.size()==0);
+		for (size_t round=0; round<20; round++) {
+			for (size_t id=0; id<count; id++) {
+				if (round>0 && id%7==round%7) {
+					index.erase(id);
+					present[id]=false;
+					continue;
+				}
+				geolocation l=round==0 || id%3==0 ? geolocation{lat(rng), lon(rng)}
+				                                 : geolocation{std::max(-90.0, std::min(90.0, locations[id].latitude+step(rng))),
+				                                               std::remainder(locations[id].longitude+step(rng), 360.0)};
+				index.update(id, l);
+				locations[id]=l;
+				present[id]=true;
+			}
+			assert(index.size()==size_t(std::count(present.begin(), present.end(), true)));
+			for (int n=0; n<20; n++) {
+				geolocation c{lat(rng), lon(rng)};
+				double dist=n%4==0 ? 20000 : n%2 ? 300 : 3000;
+				std::vector<size_t> expected;
+				for (size_t id=0; id<count; id++) {
+					if (present[id] && within(c, locations[id], dist)) {
+						expected.push_back(id);
+					}
+				}
+				std::vector<moving_object> found=index.radius(c, dist);
+				assert(ids(found)==expected);
+				for (const moving_object &o : found) {
+					assert(o.location==locations[o.id]);
+				}
+			}
+			for (size_t id=0; id<count; id++) {
+				geolocation l;
+				assert(index.find(id, l)==present[id]);
+				assert(!present[id] || l==locations[id]);
+			}
+		}
+	}
+	bool thrown=false;
+	try {
+		moving_index(10, 64);
+	} catch (const std::invalid_argument &) {
+		thrown=true;
+	}
+	assert(thrown);
+	thrown=false;
+	try {
+		moving_index(10, 20).update(10, geolocation{0, 0});
+	} catch (const std::invalid_argument &) {
+		thrown=true;
+	}
+	assert(thrown);
+}
+
+/// Objects bouncing between 2 crowded cells leave departed ids behind until compaction
+void test_moving_crowded() {
+	const size_t count=1000;
+	moving_index index(count, 2);
+	const geolocation a{10, 10}, b{10, -10};
+	for (size_t id=0; id<count; id++) {
+		index.update(id, a);
+	}
+	for (size_t round=0; round<50; round++) {
+		// Half of the objects leave and come back, the other half stays
+		for (size_t id=0; id<count; id+=2) {
+			index.update(id, b);
+		}
+		assert(index.radius(a, 1).size()==count/2 && index.radius(b, 1).size()==count/2);
+		for (size_t id=0; id<count; id+=2) {
+			index.update(id, a);
+		}
+		std::vector<size_t> found=ids(index.radius(a, 1));
+		assert(found.size()==count && index.radius(b, 1).empty());
+		for (size_t id=0; id<count; id++) {
+			assert(found[id]==id);
+		}
+	}
+	// A cell most objects left still finds the rest
+	for (size_t id=0; id+10<count; id++) {
+		index.erase(id);
+	}
+	assert(index.size()==10 && index.radius(a, 1).size()==10);
+}
+
+/// Readers run while writers move objects, static objects are always found once and
+/// moving ones are never torn, each keeps longitude = 2 * latitude
+void test_moving_concurrent() {
+	const size_t fixed=1000, moving=4000, writers=3, readers=2;
+	moving_index index(fixed+moving, 24);
+	const geolocation center{10, 20};
+	for (size_t id=0; id<fixed; id++) {
+		// Spread within 50 km of the center
+		index.update(id, geolocation{center.latitude+double(id%40)*0.01, center.longitude+double(id/40)*0.003});
+	}
+	std::atomic<bool> done{false};
+	std::vector<std::thread> threads;
+	for (size_t w=0; w<writers; w++) {
+		threads.emplace_back([&, w] {
+			std::mt19937_64 rng(w);
+			std::uniform_real_distribution<double> lat(9, 11);
+			for (int round=0; round<100; round++) {
+				for (size_t id=fixed+w; id<fixed+moving; id+=writers) {
+					if (rng()%16==0) {
+						index.erase(id);
+					} else {
+						double a=lat(rng);
+						index.update(id, geolocation{a, 2*a});
+					}
+				}
+			}
+		});
+	}
+	std::atomic<size_t> queries{0};
+	for (size_t r=0; r<readers; r++) {
+		threads.emplace_back([&] {
+			while (!done.load()) {
+				std::vector<moving_object> found=index.radius(center, 300);
+				std::vector<size_t> seen=ids(found);
+				assert(std::adjacent_find(seen.begin(), seen.end())==seen.end());
+				assert(std::lower_bound(seen.begin(), seen.end(), fixed)-seen.begin()==ptrdiff_t(fixed));
+				for (const moving_object &o : found) {
+					assert(o.id<fixed || o.location.longitude==2*o.location.latitude);
+				}
+				queries++;
+			}
+		});
+	}
+	for (size_t w=0; w<writers; w++) {
+		threads[w].join();
+	}
+	done=true;
+	for (size_t r=0; r<readers; r++) {
+		threads[writers+r].join();
+	}
+	assert(queries>0);
+	for (size_t id=0; id<fixed+moving; id++) {
+		geolocation l;
+		assert(!index.find(id, l) || id<fixed || l.longitude==2*l.latitude);
+	}
+}
+
+int main() {
+	test_moving_updates();
+	test_moving_crowded();
+	test_moving_concurrent();
+	return 0;
+}
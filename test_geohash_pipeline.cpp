@@ -0,0 +1,189 @@
+#include <vector>
+#include <string>
+#include <random>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <unistd.h>
+#include <assert.h>
+#include "geohash_pipeline.hpp"
+
+static std::vector<geolocation> test_points(size_t count) {
+	std::mt19937_64 rng(12);
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+	std::vector<geolocation> points;
+	for (size_t i=0; i<count; i++) {
+		points.push_back(geolocation{lat(rng), lon(rng)});
+	}
+	points.push_back(geolocation{90, 180});
+	points.push_back(geolocation{-90, -180});
+	return points;
+}
+
+static std::string csv(const std::vector<geolocation> &points) {
+	std::string output="latitude,longitude,name\n";
+	char line[96];
+	for (size_t i=0; i<points.size(); i++) {
+		// Some variety in the layout of the lines
+		const char *format=i%3==0 ? "%.17g,%.17g\n" : i%3==1 ? " %.17g , %.17g,x\r\n" : "%.17g,%.17g\n\n";
+		std::snprintf(line, sizeof(line), format, points[i].latitude, points[i].longitude);
+		output+=line;
+	}
+	return output;
+}
+
+static std::string run(const char *data, size_t size, const pipeline_options &options, pipeline_stats &stats) {
+	std::string output;
+	stats=encode_records(data, size, options, [&](const char *p, size_t n) { output.append(p, n); });
+	return output;
+}
+
+static std::string expected_text(const std::vector<geolocation> &points, size_t precision) {
+	std::string output;
+	for (const geolocation &l : points) {
+		output+=encode(l, precision)+"\n";
+	}
+	return output;
+}
+
+void test_csv_pipeline() {
+	std::vector<geolocation> points=test_points(5000);
+	std::string input=csv(points);
+	for (size_t threads : {1, 2, 3, 8}) {
+		for (size_t chunk_size : {1, 7, 100, 4096, 1<<20}) {
+			pipeline_options options;
+			options.precision=9;
+			options.threads=threads;
+			options.chunk_size=chunk_size;
+			pipeline_stats stats;
+			std::string output=run(input.data(), input.size(), options, stats);
+			assert(output==expected_text(points, 9));
+			assert(stats.records==points.size());
+			assert(stats.input_bytes==input.size() && stats.output_bytes==output.size());
+		}
+	}
+	// Keys output
+	pipeline_options options;
+	options.output=output_format::keys;
+	options.precision=7;
+	options.chunk_size=333;
+	options.threads=4;
+	pipeline_stats stats;
+	std::string output=run(input.data(), input.size(), options, stats);
+	assert(output.size()==points.size()*sizeof(uint64_t));
+	for (size_t i=0; i<points.size(); i++) {
+		uint64_t key;
+		std::memcpy(&key, output.data()+i*sizeof(key), sizeof(key));
+		assert(key==binary_encode(points[i], 35).bits);
+	}
+	// No header, no trailing newline
+	std::string bare="1.5,2.5\n-3,4";
+	assert(run(bare.data(), bare.size(), pipeline_options(), stats)
+	       ==encode(geolocation{1.5, 2.5}, 12)+"\n"+encode(geolocation{-3, 4}, 12)+"\n");
+	assert(run(nullptr, 0, pipeline_options(), stats).empty() && stats.records==0);
+}
+
+void test_packed_pipeline() {
+	std::vector<geolocation> points=test_points(3000);
+	const char *data=reinterpret_cast<const char *>(points.data());
+	size_t size=points.size()*sizeof(geolocation);
+	for (size_t threads : {1, 4}) {
+		for (size_t chunk_size : {1, 160, 1<<20}) {
+			pipeline_options options;
+			options.input=record_format::packed;
+			options.precision=12;
+			options.threads=threads;
+			options.chunk_size=chunk_size;
+			pipeline_stats stats;
+			assert(run(data, size, options, stats)==expected_text(points, 12));
+			assert(stats.records==points.size());
+		}
+	}
+	// Unaligned input is staged
+	std::vector<char> shifted(size+1);
+	std::memcpy(shifted.data()+1, data, size);
+	pipeline_options options;
+	options.input=record_format::packed;
+	options.precision=5;
+	pipeline_stats stats;
+	assert(run(shifted.data()+1, size, options, stats)==expected_text(points, 5));
+}
+
+void test_pipeline_errors() {
+	pipeline_stats stats;
+	for (const char *input : {"1,2\nx,3\n", "1,2\n1\n", "1,2\n1;2\n", "1,2\nnan,2\n", "1,2\n1,2x\n"}) {
+		for (size_t threads : {1, 2}) {
+			pipeline_options options;
+			options.threads=threads;
+			options.chunk_size=2;
+			bool thrown=false;
+			try {
+				run(input, std::strlen(input), options, stats);
+			} catch (const std::invalid_argument &) {
+				thrown=true;
+			}
+			assert(thrown);
+		}
+	}
+	pipeline_options options;
+	options.input=record_format::packed;
+	bool thrown=false;
+	try {
+		run("0123456789abcdef0", 17, options, stats);
+	} catch (const std::invalid_argument &) {
+		thrown=true;
+	}
+	assert(thrown);
+	// Sink failures stop the pipeline
+	std::string input=csv(test_points(2000));
+	options=pipeline_options();
+	options.chunk_size=100;
+	options.threads=3;
+	thrown=false;
+	try {
+		encode_records(input.data(), input.size(), options, [](const char *, size_t) { throw std::runtime_error("full"); });
+	} catch (const std::runtime_error &) {
+		thrown=true;
+	}
+	assert(thrown);
+}
+
+void test_file_pipeline() {
+	std::vector<geolocation> points=test_points(1000);
+	std::string input=csv(points);
+	char in_path[]="/tmp/geohash_pipeline_in_XXXXXX";
+	char out_path[]="/tmp/geohash_pipeline_out_XXXXXX";
+	int in_fd=mkstemp(in_path), out_fd=mkstemp(out_path);
+	assert(in_fd>=0 && out_fd>=0);
+	assert(write(in_fd, input.data(), input.size())==ssize_t(input.size()));
+	close(in_fd);
+	close(out_fd);
+	pipeline_options options;
+	options.precision=8;
+	options.chunk_size=1000;
+	pipeline_stats stats=encode_file(in_path, out_path, options);
+	assert(stats.records==points.size());
+	std::string output(stats.output_bytes, ' ');
+	FILE *f=std::fopen(out_path, "rb");
+	assert(std::fread(&output[0], 1, output.size(), f)==output.size() && std::fgetc(f)==EOF);
+	std::fclose(f);
+	assert(output==expected_text(points, 8));
+	bool thrown=false;
+	try {
+		encode_file("/nonexistent/geohash_pipeline", out_path);
+	} catch (const std::system_error &) {
+		thrown=true;
+	}
+	assert(thrown);
+	unlink(in_path);
+	unlink(out_path);
+}
+
+int main() {
+	test_csv_pipeline();
+	test_packed_pipeline();
+	test_pipeline_errors();
+	test_file_pipeline();
+	return 0;
+}
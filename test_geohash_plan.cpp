@@ -0,0 +1,62 @@
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <assert.h>
+#include "geohash_index.hpp"
+#include "geohash_plan.hpp"
+
+void test_plan() {
+	std::mt19937_64 rng(21);
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+	std::normal_distribution<double> spread(0, 0.05);
+	std::vector<geolocation> points;
+	for (size_t i=0; i<50000; i++) {
+		points.push_back(i%2 ? geolocation{lat(rng), lon(rng)}
+		                     : geolocation{std::min(90.0, 40.71+spread(rng)*4), -74.0+spread(rng)*4});
+	}
+	geohash_index<size_t> index(points, std::vector<size_t>(points.size()));
+	for (size_t count : {0, 1, 70, 600}) {
+		std::vector<radius_query> queries;
+		for (size_t q=0; q<count; q++) {
+			geolocation c=q%5 ? geolocation{40.71+spread(rng), -74.0+spread(rng)} : geolocation{lat(rng), lon(rng)};
+			queries.push_back(radius_query{c, q%3 ? 2.0 : 30.0});
+		}
+		// Poles and the antimeridian, and a query given twice
+		if (count>=70) {
+			queries[1]=radius_query{geolocation{89.9, 10}, 50};
+			queries[2]=radius_query{geolocation{0, 179.99}, 20};
+			queries[3]=queries[4];
+		}
+		query_plan plan(queries);
+		assert(plan.query_count()==count);
+		std::vector<std::vector<size_t>> found(count);
+		plan.run(index, [&](size_t q, size_t i) { found[q].push_back(i); });
+		for (size_t q=0; q<count; q++) {
+			std::sort(found[q].begin(), found[q].end());
+			assert(found[q]==index.radius(queries[q].center, queries[q].dist));
+		}
+		// Ranges are disjoint and in order, and every query's cover is in the ranges naming it
+		for (size_t r=1; r<plan.size(); r++) {
+			assert(plan.range(r-1).end!=0 && plan.range(r-1).end<=plan.range(r).begin);
+		}
+		std::vector<std::vector<key_range>> covered(count);
+		for (size_t r=0; r<plan.size(); r++) {
+			size_t named=0;
+			plan.visit_queries(r, [&](size_t q) {
+				covered[q].push_back(plan.range(r));
+				named++;
+			});
+			assert(named>0);
+		}
+		for (size_t q=0; q<count; q++) {
+			coalesce(covered[q]);
+			assert(covered[q]==radius_ranges(queries[q].center, queries[q].dist));
+		}
+		assert(count==0 || plan.size()<=2*plan.unplanned_size());
+	}
+}
+
+int main() {
+	test_plan();
+	return 0;
+}
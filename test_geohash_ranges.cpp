@@ -0,0 +1,114 @@
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+#include <assert.h>
+#include "geohash_ranges.hpp"
+
+/// Whether any of the cells holds the key, by its bits
+static bool in_cells(const std::vector<binary_hash> &cells, uint64_t key) {
+	for (const binary_hash &c : cells) {
+		if (c.empty() || key>>(64-c.size())==c.bits) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void test_cell_ranges() {
+	// Adjacent cells merge, the ends of the key space have empty bounds
+	std::vector<std::string> cells={"b1", "b0", "zz", "b0k", "0"};
+	std::vector<key_range> ranges=cell_ranges(cells);
+	assert(ranges.size()==3);
+	std::vector<string_range> strings=string_ranges(cells);
+	assert((strings==std::vector<string_range>{{"", "1"}, {"b", "b2"}, {"zz", ""}}));
+	assert(strings[1].contains("b1zzzzzzzzzz") && !strings[1].contains("b2") && strings[2].contains("zzzzzz"));
+	assert(string_ranges(std::vector<std::string>{"z"})[0]==(string_range{"z", ""}));
+	assert(string_ranges(std::vector<std::string>{""})[0]==(string_range{"", ""}));
+	assert(cell_ranges(std::vector<std::string>()).empty());
+	// Ranges of the whole space of keys
+	assert(key_string(0)=="" && key_string(1)=="0000000000002" && key_string(uint64_t(1)<<63)=="h");
+	bool thrown=false;
+	try { cell_ranges(std::vector<std::string>{"wtw", "wta"}); } catch (const std::invalid_argument &) { thrown=true; }
+	assert(thrown);
+
+	// Random binary cells of any length, checked against their bits, as keys and as strings
+	std::mt19937_64 rng(25);
+	for (size_t round=0; round<200; round++) {
+		std::vector<binary_hash> binary;
+		uint64_t center=rng();
+		for (size_t i=0; i<1+rng()%40; i++) {
+			size_t bits=4+rng()%61;
+			uint64_t key=center ^ (rng()>>std::min<size_t>(63, bits-4+rng()%8));
+			binary.push_back(binary_hash(key>>(64-bits), bits));
+		}
+		std::vector<key_range> ranges=cell_ranges(binary);
+		std::vector<string_range> strings=to_string_ranges(ranges);
+		for (size_t r=1; r<ranges.size(); r++) {
+			assert(ranges[r-1].end!=0 && ranges[r-1].end<ranges[r].begin);
+			assert(strings[r-1].end<strings[r].begin);
+		}
+		for (size_t i=0; i<2000; i++) {
+			// Keys near the cells, and 12-character hashes of them
+			uint64_t key=center ^ (rng()>>(rng()%64));
+			bool in_range=false, in_string=false;
+			geohash hash=geohash::from_key(key, MAX_GEOHASH_LENGTH);
+			for (size_t r=0; r<ranges.size(); r++) {
+				in_range|=ranges[r].contains(key);
+				in_string|=strings[r].contains(hash.view());
+			}
+			assert(in_range==in_cells(binary, key));
+			assert(in_string==in_cells(binary, hash.key()));
+		}
+	}
+}
+
+void test_range_stream() {
+	std::mt19937_64 rng(250);
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+	for (size_t round=0; round<50; round++) {
+		std::vector<std::string> cells;
+		geolocation c{lat(rng), lon(rng)};
+		for (size_t i=0; i<rng()%500; i++) {
+			geolocation l{std::max(-90.0, std::min(90.0, c.latitude+lat(rng)/100)), c.longitude+lon(rng)/100};
+			if (l.longitude>180) l.longitude-=360;
+			if (l.longitude<-180) l.longitude+=360;
+			cells.push_back(encode(l, 2+rng()%5));
+		}
+		std::sort(cells.begin(), cells.end());
+		range_stream<std::vector<std::string>::const_iterator> stream(cells.cbegin(), cells.cend());
+		std::vector<key_range> streamed(stream.begin(), stream.end());
+		assert(streamed==cell_ranges(cells));
+		key_range extra;
+		assert(!stream.next(extra));
+	}
+	// Cells inside an earlier one, and one to the end of the keys
+	std::vector<binary_hash> cells={binary_hash("0"), binary_hash("01"), binary_hash("011"), binary_hash("1")};
+	auto stream=stream_ranges(cells.begin(), cells.end());
+	key_range r;
+	assert(stream.next(r) && r==(key_range{0, 0}) && !stream.next(r));
+	std::vector<std::string> unsorted={"b", "c", "bc"};
+	auto bad=stream_ranges(unsorted.begin(), unsorted.end());
+	bool thrown=false;
+	try {
+		while (bad.next(r)) {
+		}
+	} catch (const std::invalid_argument &) {
+		thrown=true;
+	}
+	assert(thrown);
+	// Straight from hash_codes
+	std::array<geohash, 9> codes=hash_codes(geolocation{40.71, -74.0}, 1);
+	std::vector<key_range> ranges=cell_ranges(codes);
+	assert(ranges.size()<9);
+	for (const geohash &h : codes) {
+		assert(std::any_of(ranges.begin(), ranges.end(), [&](const key_range &kr) { return kr.contains(h.key()); }));
+	}
+}
+
+int main() {
+	test_cell_ranges();
+	test_range_stream();
+	return 0;
+}
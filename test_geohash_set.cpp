@@ -0,0 +1,144 @@
+#include <vector>
+#include <string>
+#include <set>
+#include <random>
+#include <stdexcept>
+#include <assert.h>
+#include "geohash_set.hpp"
+
+/// Whether inner lies inside outer, or is outer
+static bool inside(const binary_hash &inner, const binary_hash &outer) {
+	return inner.size()>=outer.size()
+	    && (outer.size()==0 || (inner.bits>>(inner.size()-outer.size()))==outer.bits);
+}
+
+static std::vector<binary_hash> test_cells(std::mt19937_64 &rng, size_t count) {
+	std::uniform_real_distribution<double> lat(30, 32), lon(120, 122);
+	std::vector<binary_hash> cells;
+	for (size_t i=0; i<count; i++) {
+		// Mixed precisions, nested cells and duplicates
+		size_t bits=i%13==0 ? rng()%8 : 10+rng()%30;
+		cells.push_back(binary_encode(geolocation{lat(rng), lon(rng)}, bits));
+		if (i%7==0) {
+			cells.push_back(cells.back());
+		}
+	}
+	cells.push_back(binary_hash(0, 63));
+	cells.push_back(binary_hash(~uint64_t(0)>>1, 63));
+	return cells;
+}
+
+void test_set_membership() {
+	std::mt19937_64 rng(16);
+	std::vector<binary_hash> cells=test_cells(rng, 5000);
+	geohash_set set(cells);
+	std::set<std::pair<size_t, uint64_t>> expected;
+	for (const binary_hash &c : cells) {
+		expected.insert({c.size(), c.bits});
+	}
+	assert(set.size()==expected.size());
+	for (size_t i=0; i<set.size(); i++) {
+		assert(expected.count({set.at(i).size(), set.at(i).bits}));
+	}
+	for (const binary_hash &c : cells) {
+		assert(set.contains(c));
+	}
+	std::uniform_real_distribution<double> lat(29.9, 32.1), lon(119.9, 122.1);
+	for (int n=0; n<3000; n++) {
+		geolocation l{lat(rng), lon(rng)};
+		binary_hash probe=binary_encode(l, rng()%50);
+		// Exact membership
+		assert(set.contains(probe)==(expected.count({probe.size(), probe.bits})>0));
+		// Longest member containing the probe, or the location
+		std::optional<binary_hash> best;
+		bool any_inside=false;
+		for (const binary_hash &c : cells) {
+			if (inside(probe, c) && (!best || c.size()>best->size())) {
+				best=c;
+			}
+			any_inside=any_inside || inside(c, probe);
+		}
+		assert(set.longest_prefix(probe)==best);
+		assert(set.contains_prefix(probe)==any_inside);
+		std::optional<binary_hash> at_location;
+		for (const binary_hash &c : cells) {
+			if (inside(binary_encode(l, 63), c) && (!at_location || c.size()>at_location->size())) {
+				at_location=c;
+			}
+		}
+		assert(set.longest_prefix(l)==at_location);
+		assert(set.contains(l)==at_location.has_value());
+		// Members inside the probe
+		size_t visited=0;
+		set.visit_prefix(probe, [&](const binary_hash &c) {
+			assert(inside(c, probe));
+			visited++;
+		});
+		size_t count=0;
+		for (const std::pair<size_t, uint64_t> &c : expected) {
+			count+=inside(binary_hash(c.second, c.first), probe);
+		}
+		assert(visited==count);
+	}
+	// Cells of 64 bits do not fit
+	bool thrown=false;
+	try {
+		geohash_set(std::vector<binary_hash>{binary_hash(1, 64)});
+	} catch (const std::invalid_argument &) {
+		thrown=true;
+	}
+	assert(thrown);
+	assert(!set.contains(binary_hash(1, 64)) && !set.contains_prefix(binary_hash(1, 64)));
+}
+
+void test_set_strings() {
+	std::vector<std::string> hashes={"wtw3", "wtw3s", "wtw3sjq6", "wtw3sjq6q", "wtw3sjq6q", "u4pruydqqvj", "s"};
+	geohash_set set(hashes);
+	assert(set.size()==6);
+	assert(set.contains(geohash::from_string("wtw3s")));
+	assert(!set.contains(geohash::from_string("wtw3t")));
+	assert(set.contains_prefix(geohash::from_string("wtw")));
+	assert(set.contains_prefix(geohash::from_string("u4pru")));
+	assert(!set.contains_prefix(geohash::from_string("u4prv")));
+	assert(*set.longest_prefix(geohash::from_string("wtw3sjq6qz"))==binary_hash::from_geohash("wtw3sjq6q"));
+	assert(*set.longest_prefix(geohash::from_string("wtw3sx"))==binary_hash::from_geohash("wtw3s"));
+	assert(!set.longest_prefix(geohash::from_string("wtx")));
+	geolocation l=decode(std::string("wtw3sjq6qrst")).center();
+	assert(set.contains(l) && *set.longest_prefix(l)==binary_hash::from_geohash("wtw3sjq6q"));
+	assert(set.contains(geolocation{0.1, 0.1}));
+	assert(!set.contains(geolocation{-45, 100}));
+	bool thrown=false;
+	try {
+		geohash_set(std::vector<std::string>{"wtw3", "wtwa"});
+	} catch (const std::invalid_argument &) {
+		thrown=true;
+	}
+	assert(thrown);
+	geohash_set empty;
+	assert(empty.empty() && !empty.contains(l) && !empty.contains_prefix(binary_hash()));
+	// The whole sphere
+	geohash_set root(std::vector<std::string>{""});
+	assert(root.contains(l) && root.longest_prefix(l)->size()==0);
+}
+
+void test_set_memory() {
+	std::mt19937_64 rng(17);
+	std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+	std::vector<binary_hash> cells;
+	for (int i=0; i<200000; i++) {
+		cells.push_back(binary_encode(geolocation{lat(rng), lon(rng)}, 35));
+	}
+	geohash_set set(cells);
+	// 8 bytes per id and an eighth of that for each level of the tree
+	assert(set.memory_usage()<=set.size()*8*8/7+1024);
+	for (const binary_hash &c : cells) {
+		assert(set.contains(c));
+	}
+}
+
+int main() {
+	test_set_membership();
+	test_set_strings();
+	test_set_memory();
+	return 0;
+}